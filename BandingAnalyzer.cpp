@@ -0,0 +1,124 @@
+﻿// BandingAnalyzer.cpp
+// 渐变色阶分析, 逐行 SSE2
+
+#include "stdafx.h"
+#include <emmintrin.h>
+#include <intrin.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "BandingAnalyzer.h"
+
+using namespace std;
+
+// 非单调的行不能用跳变次数计算灰阶数, 用 65536 位的位图逐个计数
+static unsigned int CountDistinct(const unsigned short *row, unsigned int width)
+{
+	vector<unsigned char> seen(65536 / 8, 0);
+	unsigned int count = 0;
+
+	for (unsigned int x = 0; x < width; x++)
+	{
+		unsigned char bit = (unsigned char)(1 << (row[x] & 7));
+		if (!(seen[row[x] >> 3] & bit))
+		{
+			seen[row[x] >> 3] |= bit;
+			count++;
+		}
+	}
+	return count;
+}
+
+void AnalyzeRow(const unsigned short *row, unsigned int width, RowBanding *result)
+{
+	const __m128i zero = _mm_setzero_si128();
+	unsigned int transitions = 0, last = 0, x;
+	bool decreasing = false;
+
+	result->minStep = width;
+	result->maxStep = 0;
+
+	// 像素 x 与 x-1 比较, 每个跳变结束一个台阶
+	for (x = 1; x < width; )
+	{
+		unsigned int changed, fell, n = 8;
+		if (x + 8 <= width)
+		{
+			__m128i cur = _mm_loadu_si128((const __m128i *)(row + x));
+			__m128i prev = _mm_loadu_si128((const __m128i *)(row + x - 1));
+			// 每个 16 位通道在 movemask 中占两位, 只取低位
+			changed = ~_mm_movemask_epi8(_mm_cmpeq_epi16(cur, prev)) & 0x5555;
+			fell = ~_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_subs_epu16(prev, cur), zero)) & 0x5555;
+		}
+		else
+		{
+			changed = fell = 0;
+			n = width - x;
+			for (unsigned int i = 0; i < n; i++)
+			{
+				if (row[x + i] != row[x + i - 1])
+					changed |= 1 << (2 * i);
+				if (row[x + i] < row[x + i - 1])
+					fell |= 1 << (2 * i);
+			}
+		}
+		if (fell)
+			decreasing = true;
+		while (changed)
+		{
+			unsigned long bit;
+			_BitScanForward(&bit, changed);
+			changed &= changed - 1;
+			unsigned int edge = x + bit / 2;
+			// 第一个台阶从左边缘开始, 可能被截断
+			if (transitions > 0)
+			{
+				unsigned int step = edge - last;
+				if (step < result->minStep)
+					result->minStep = step;
+				if (step > result->maxStep)
+					result->maxStep = step;
+			}
+			last = edge;
+			transitions++;
+		}
+		x += n;
+	}
+
+	result->monotonic = !decreasing;
+	result->levels = decreasing ? CountDistinct(row, width) : transitions + 1;
+	// 少于三个台阶时只有被截断的台阶, 用整行的宽度
+	if (transitions < 2)
+		result->minStep = result->maxStep = width / (transitions + 1);
+}
+
+void AnalyzeRegion(const unsigned short *pixels, unsigned int width, unsigned int rows, unsigned int stride,
+	RegionBanding *result)
+{
+	memset(result, 0, sizeof(RegionBanding));
+	result->rows = rows;
+	result->levels = 65536;
+	result->minStep = width;
+
+	for (unsigned int y = 0; y < rows; y++)
+	{
+		RowBanding row;
+		AnalyzeRow(pixels + (size_t)y * stride, width, &row);
+		if (row.levels < result->levels)
+			result->levels = row.levels;
+		if (row.minStep < result->minStep)
+			result->minStep = row.minStep;
+		if (row.maxStep > result->maxStep)
+			result->maxStep = row.maxStep;
+		if (!row.monotonic)
+			result->nonMonotonicRows++;
+	}
+	if (rows == 0)
+		result->levels = 0;
+	result->meanStep = result->levels ? (double)width / result->levels : 0.0;
+	result->effectiveBits = result->levels ? log((double)result->levels) / log(2.0) : 0.0;
+	// 不四舍五入: n 位要求至少 2^n-1 个灰阶, 2^(n-0.5) 个 (如 725 个) 只算 n-1 位
+	result->bits = 0;
+	while (result->bits < 16 && result->levels >= (2u << result->bits) - 1)
+		result->bits++;
+}
@@ -0,0 +1,34 @@
+﻿// BandingAnalyzer.h
+// 分析读回的灰阶渐变: 每行的不同灰阶数、台阶宽度和单调性, 以及每个区域的有效位数
+// 输入是从左到右递增的渐变, 每个像素一个 16 位值 (读回时 GL_UNSIGNED_SHORT 已把帧缓冲的位数扩展到 16 位)
+
+#pragma once
+
+// 一行的统计
+struct RowBanding
+{
+	unsigned int levels;		// 不同灰阶的个数
+	unsigned int minStep;		// 最窄和最宽的台阶 (相同值的连续像素), 不计两端被截断的台阶
+	unsigned int maxStep;
+	bool monotonic;				// 从左到右没有下降
+};
+
+// 一个区域 (若干行) 的统计
+struct RegionBanding
+{
+	unsigned int rows;
+	unsigned int levels;		// 各行中最少的灰阶数
+	unsigned int minStep;
+	unsigned int maxStep;
+	double meanStep;			// 宽度 / 灰阶数
+	unsigned int nonMonotonicRows;
+	double effectiveBits;		// log2(levels)
+	unsigned int bits;			// 至少 2^n-1 个灰阶时为 n 位, 即 floor(log2(levels + 1))
+};
+
+// 统计一行 width 个像素, 用 SSE2 每次比较 8 个像素
+void AnalyzeRow(const unsigned short *row, unsigned int width, RowBanding *result);
+
+// 统计 rows 行, 行之间相隔 stride 个像素
+void AnalyzeRegion(const unsigned short *pixels, unsigned int width, unsigned int rows, unsigned int stride,
+	RegionBanding *result);
@@ -14,10 +14,32 @@
 #include <stdio.h>
 #include <assert.h>
 #include <limits.h>
+#include <math.h>
 //For EXR file loading
 #include <ImfRgbaFile.h>
 #include <ImfArray.h>
 #include <half.h>
+#include <ImfTestFile.h>
+#include "ExrLoader.h"
+#include "TiledExr.h"
+//For PNG file loading
+#include "PngLoader.h"
+//For streaming the texture uploads
+#include "PboUploader.h"
+//For quantizing 16-bit data to 10 and 8 bits
+#include "ErrorDiffusion.h"
+//For tone mapping the EXR images
+#include "ToneMap.h"
+//For .cube 3D LUTs
+#include "CubeLut.h"
+//For converting to the display gamut
+#include "Gamut.h"
+//For saving the float FBO as EXR files
+#include "FrameCapture.h"
+//For the luminance statistics of the float FBO
+#include "LuminanceStats.h"
+//For the command line tools and the draw benchmark
+#include "Benchmark.h"
 //For FBO
 #include "framebufferObject.h"
 
@@ -27,19 +49,47 @@ PFNWGLGETPIXELFORMATATTRIBFVARBPROC wglGetPixelFormatAttribfv = NULL;
 PFNWGLGETPIXELFORMATATTRIBIVARBPROC wglGetPixelFormatAttribiv = NULL;
 PFNWGLCHOOSEPIXELFORMATARBPROC wglChoosePixelFormat = NULL;
 PFNGLDRAWBUFFERSARBPROC glDrawBuffers = NULL;
+PFNWGLSWAPINTERVALEXTPROC wglSwapInterval = NULL;
 
 HDC ghDC30bit =NULL, ghDC24bit = NULL; //Window DC for the 30 and 24bit windows
 HGLRC ghRC30bit = NULL, ghRC24bit = NULL; //GL context for the 30 and 24 bit window
 HWND ghWnd30bit = NULL, ghWnd24bit = NULL; //handles for the 30bit and 24 bit
 
-//GL Texture Ids for the 3 textures used - 1) RGBA16 Gradient Texture, 2) RGB10A2 Gradient Texture 3) OpenEXR half float texture
-GLuint gTexRGBA16=NULL, gTexRGB10A2=NULL, gTexEXR = NULL ; 
+//GL Texture Ids for the 4 textures used - 1) RGBA16 Gradient Texture, 2) RGB10A2 Gradient Texture 3) OpenEXR half float texture
+//4) 16-bit PNG texture
+GLuint gTexRGBA16=NULL, gTexRGB10A2=NULL, gTexEXR = NULL, gTexPNG = NULL ; 
 unsigned int exrwidth = 0, exrheight = 0; //dimensions of the EXR Image
+unsigned int pngwidth = 0, pngheight = 0; //dimensions of the PNG Image
+const char* gPngFileName = "Gradation-16bit.png"; //can be replaced on the command line
+const char* gExrFileName = "test.exr"; //can be replaced on the command line
+TiledExr gTiledExr; //tiled EXR files are decoded a visible tile at a time, file is NULL otherwise
+ToneMapper gToneMapper; //program is 0 without GLSL, the EXR image is then drawn as is
+ToneMapParams gToneMap; //changed with the T, A, G, H, P, M and +/- keys
+bool gExrGamutGiven = false; //-gamut named the EXR primaries, the file's chromaticities are ignored
+int gPngGamut = GAMUT_BT709; //primaries of the PNG image
+GamutRenderer gGamutRenderer; //program is 0 without GLSL, the PNG image is then drawn as is
+const char* gCubeFileName = NULL; //3D LUT applied to everything drawn, given on the command line
+CubeLut gCubeLut;
+CubeLutRenderer gCubeLutRenderer;
+bool gCubeLutEnabled = false; //toggled with the L key
+FrameCapture gCapture; //the C key captures a burst of the float FBO attachment to EXR files
+unsigned int gCaptureFrames = 8; //frames per burst
+const char* gCapturePrefix = "capture"; //files are capture0000.exr, capture0001.exr..
+bool gCapturePiz = true; //PIZ or ZIP compression
+size_t gCaptureBudget = CAPTURE_BUDGET_BYTES; //readback buffers, frames beyond them are dropped
+bool gCaptureActive = false; //a burst is read or written
+LuminanceReducer gLumStats; //the S key prints luminance statistics of the float FBO attachment
+bool gLumStatsGpu = true; //reduced on the GPU when it can, -stats cpu reads the frames back instead
+int gLumStatsStride = 1; //pixels a side per point of the GPU histogram
+bool gLumStatsEnabled = false; //the 30-bit window keeps drawing and prints them once a second
+DWORD gLumStatsPrinted = 0;
+unsigned int gDrawBenchFrames = 0; //-drawbench times every draw mode for this many frames instead of running the demo
+const char* gDrawBenchReport = "drawbench.csv"; //or a .json file
 unsigned int width = 2048, height = 2048;
 
-//4 different draw modes
-typedef enum DRAWMODE {DRAW_SHADED=0,DRAW_TEXTURE_RGBA16,DRAW_TEXTURE_RGB10A2,DRAW_TEXTURE_EXR};
-char* gDrawModeDesc[4] = {"Shaded Quad", "RGBA16 Texture","RGB10_A2 Texture","OpenEXR File"};
+//5 different draw modes
+typedef enum DRAWMODE {DRAW_SHADED=0,DRAW_TEXTURE_RGBA16,DRAW_TEXTURE_RGB10A2,DRAW_TEXTURE_EXR,DRAW_TEXTURE_PNG,DRAW_MODE_COUNT};
+char* gDrawModeDesc[DRAW_MODE_COUNT] = {"Shaded Quad", "RGBA16 Texture","RGB10_A2 Texture","OpenEXR File","16-bit PNG File"};
 int gDrawMode = DRAW_SHADED; 
 
 //FBO related
@@ -57,6 +107,7 @@ GLfloat x_start = 0.0;		// X starting location within half width window.
 GLfloat x_end = 0.0;		// X ending location wthin half width window.
 GLfloat y_start = 0.0;		// Y starting location within half width window.
 GLfloat y_end = 0.0;		// Y ending location within half width window.
+GLfloat gZoom = 1.0;		// Image size relative to width x height, changed with the mouse wheel
 bool isInitialized = false;
 
 
@@ -84,6 +135,10 @@ void oglInit() {
 	if (isInitialized)
 		return;
 
+	//All textures are allocated empty and filled through a ring of pixel buffer objects
+	PboUploader uploader;
+	initPboUploader(&uploader);
+
 	//Generate a RGBA (ushort component) horizontal gradient
 	unsigned short *pImageData = new unsigned short[width*height*4];
 	for (unsigned int y=0; y < height; y++) {
@@ -106,26 +161,31 @@ void oglInit() {
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16, width, height, 0, GL_RGBA , GL_UNSIGNED_SHORT, pImageData);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16, width, height, 0, GL_RGBA , GL_UNSIGNED_SHORT, NULL);
+	pboTexSubImage2D(&uploader, GL_TEXTURE_2D, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_SHORT,
+		4*sizeof(unsigned short), pImageData, width*4*sizeof(unsigned short));
 	//Make sure we got the right RGBA16 internal format
 	GLint internalFormat;
 	glGetTexLevelParameteriv(GL_TEXTURE_2D,0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
 	assert(internalFormat == GL_RGBA16);
 
-	//Now pack RGBA16 gradient data into RGB10A2 pixel data looking at the packedType and packedFormat specified
+	//Now pack RGBA16 gradient data into RGB10A2 pixel data looking at the packedType and packedFormat specified.
+	//The 16-bit components are error diffused to 10 bits (2 for alpha) so the dropped bits are not lost as banding
 	unsigned int* packedData = new unsigned int[width*height]; //the 4 components will be packed in 1 unsigned int
-	float scale = 1024.0/65536.0; //here we rescale the ushort 16-bit per component data created earlier to 10bits ie 0..1024
+	unsigned short *pLevels = new unsigned short[width*height*4];
+	const unsigned int packedBits[4] = {10, 10, 10, 2};
+	if (!diffuseImage(pImageData, pLevels, width, height, 4, packedBits, DIFFUSE_FLOYD_STEINBERG)) {
+		//out of memory, truncate instead
+		for (unsigned int i=0; i < width*height*4; i++)
+			pLevels[i] = pImageData[i] >> (16 - packedBits[i%4]);
+	}
 	for (unsigned int y=0; y < height; y++) {
 		for (unsigned int x=0; x < width; x++) {
 			int offset = (width*y)+ x;
-			unsigned int alpha = pImageData[offset*4+3]*4.0/65536.0; //since we use 2 bits for alpha, scale to range 0..3
-			alpha &= 0x3; //get 2 lower bits
-			unsigned int blue = pImageData[offset*4+2]*scale;
-			blue &= 0x3FF;	 //get the 10 bits
-			unsigned int green = pImageData[offset*4+1]*scale;
-			green &= 0x3FF;//10 bits
-			unsigned int red = pImageData[offset*4]*scale;
-			red &= 0x3FF; //10bits
+			unsigned int alpha = pLevels[offset*4+3]; //0..3
+			unsigned int blue = pLevels[offset*4+2]; //0..1023
+			unsigned int green = pLevels[offset*4+1];
+			unsigned int red = pLevels[offset*4];
 
 			if (packedType == GL_UNSIGNED_INT_10_10_10_2) {
 				if (packedFormat == GL_RGBA) //R10G10B10A2
@@ -150,30 +210,33 @@ void oglInit() {
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, width, height, 0, packedFormat , packedType, packedData);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, width, height, 0, packedFormat , packedType, NULL);
+	pboTexSubImage2D(&uploader, GL_TEXTURE_2D, 0, 0, width, height, packedFormat, packedType,
+		sizeof(unsigned int), packedData, width*sizeof(unsigned int));
 	glGetTexLevelParameteriv(GL_TEXTURE_2D,0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
 	assert(internalFormat == GL_RGB10_A2); //confirm we have packed pixel internal format
 	free(pImageData);
 	free(packedData);
-
-	//Load EXR file now
-	Imf::Rgba * pixelBuffer;
-	try
-	{
-		Imf::RgbaInputFile in("test.exr");
-		Imath::Box2i win = in.dataWindow();
-		Imath::V2i dim(win.max.x - win.min.x + 1, win.max.y - win.min.y + 1);
-		pixelBuffer = new Imf::Rgba[dim.x * dim.y];
-		int dx = win.min.x;
-		int dy = win.min.y;
-		in.setFrameBuffer(pixelBuffer - dx - dy * dim.x, 1, dim.x);
-		in.readPixels(win.min.y, win.max.y);
-		exrwidth = dim.x; exrheight = dim.y;
+	delete [] pLevels;
+
+	//Load EXR file now. Tiled files are only opened, their tiles are decoded when they come into view.
+	//Scanline files are decoded on all cores in chunks straight into the upload buffers
+	ExrFile exr;
+	bool exrTiled = false, exrOpen = false;
+	if (Imf::isOpenExrFile(gExrFileName, exrTiled) && exrTiled && openTiledExr(&gTiledExr, gExrFileName)) {
+		exrwidth = gTiledExr.width; exrheight = gTiledExr.height;
+	}
+	else if (openExr(&exr, gExrFileName)) {
+		exrOpen = true;
+		exrwidth = exr.width; exrheight = exr.height;
 	}
-	catch(Iex::BaseExc & e)
-	{
-		std::cerr << e.what() << std::endl;
-		 // Handle exception.
+	//the primaries of the EXR image come from its chromaticities unless -gamut named them
+	if (!gExrGamutGiven && (gTiledExr.file ? gTiledExr.hasChromaticities : exrOpen && exr.hasChromaticities)) {
+		int gamut = findGamut(gTiledExr.file ? gTiledExr.chromaticities : exr.chromaticities);
+		if (gamut >= 0)
+			gToneMap.sourceGamut = gamut;
+		else
+			printf("%s: primaries are not BT.709, Display P3 or BT.2020, drawn as BT.709\n", gExrFileName);
 	}
 	//possibly NPOT texture	
 	glGenTextures(1, &gTexEXR);
@@ -184,10 +247,57 @@ void oglInit() {
 	glTexParameteri(GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	glTexImage2D(GL_TEXTURE_RECTANGLE_NV, 0, GL_RGBA16F_ARB, exrwidth, exrheight, 0,GL_RGBA,GL_HALF_FLOAT_ARB, pixelBuffer);
-	glGetTexLevelParameteriv(GL_TEXTURE_RECTANGLE_NV,0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
-	assert(internalFormat == GL_RGBA16F_ARB); //confirm we have RGBA16F internal format
-	delete [] pixelBuffer; //done with exr buffer delete it
+	if (exrOpen) {
+		glTexImage2D(GL_TEXTURE_RECTANGLE_NV, 0, GL_RGBA16F_ARB, exrwidth, exrheight, 0,GL_RGBA,GL_HALF_FLOAT_ARB, NULL);
+		uploadExr(&exr, GL_TEXTURE_RECTANGLE_NV);
+		closeExr(&exr);
+		glGetTexLevelParameteriv(GL_TEXTURE_RECTANGLE_NV,0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+		assert(internalFormat == GL_RGBA16F_ARB); //confirm we have RGBA16F internal format
+	}
+
+	//Load the PNG file, the rows are decoded straight into the upload buffer
+	PngFile png;
+	unsigned short *pngBuffer = NULL;
+	GLenum pngFormat = GL_RGB, pngInternalFormat = GL_RGB16;
+	if (openPng(&png, gPngFileName)) {
+		unsigned int rowSamples = png.width * png.channels;
+		pngBuffer = new unsigned short[rowSamples * png.height];
+		//PNG rows start at the top, GL rows at the bottom
+		while (png.row < png.height) {
+			if (!readPngRow(&png, pngBuffer + (png.height - 1 - png.row) * rowSamples))
+				break;
+		}
+		if (png.row == png.height) {
+			pngwidth = png.width; pngheight = png.height;
+			if (png.channels == 1) {
+				pngFormat = GL_LUMINANCE;
+				pngInternalFormat = GL_LUMINANCE16;
+			}
+		}
+		else
+			printf("ERROR: Unable to decode %s\n", gPngFileName);
+		closePng(&png);
+	}
+	else
+		printf("ERROR: Unable to load %s\n", gPngFileName);
+	glGenTextures(1, &gTexPNG);
+	glBindTexture(GL_TEXTURE_RECTANGLE_NV, gTexPNG);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	if (pngwidth) {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 2); // 16-bit components, rows are not padded
+		glTexImage2D(GL_TEXTURE_RECTANGLE_NV, 0, pngInternalFormat, pngwidth, pngheight, 0, pngFormat, GL_UNSIGNED_SHORT, NULL);
+		pboTexSubImage2D(&uploader, GL_TEXTURE_RECTANGLE_NV, 0, 0, pngwidth, pngheight, pngFormat, GL_UNSIGNED_SHORT,
+			png.channels*sizeof(unsigned short), pngBuffer, pngwidth*png.channels*sizeof(unsigned short));
+	}
+	delete [] pngBuffer;
+	printf("Textures uploaded: %.1f MB at %.0f MB/s, %u buffer transfers, %u stalls, %u direct uploads\n",
+		(double)(__int64)uploader.bytes / (1024.0 * 1024.0), pboUploadRate(&uploader),
+		uploader.transfers, uploader.stalls, uploader.directUploads);
+	deletePboUploader(&uploader);
 
 	//FBO initialization
 	glDrawBuffers = (PFNGLDRAWBUFFERSARBPROC)wglGetProcAddress("glDrawBuffersARB");
@@ -208,13 +318,32 @@ void oglInit() {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);	
 	glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,width, height,0,GL_RGBA,GL_UNSIGNED_BYTE,0);
 
-	//Attach both textures
-	fbo = new FramebufferObject;
-	fbo->Bind();
-	fbo->AttachTexture(GL_TEXTURE_2D,gfboTextures[0],GL_COLOR_ATTACHMENT0_EXT);
-	fbo->AttachTexture(GL_TEXTURE_2D,gfboTextures[1],GL_COLOR_ATTACHMENT1_EXT);
-	fbo->IsValid(); //validate fbo
-	FramebufferObject::Disable();
+	//Attach both textures, software GL has no framebuffer objects and fbo stays NULL
+	if (glDrawBuffers && wglGetProcAddress("glBindFramebufferEXT")) {
+		fbo = new FramebufferObject;
+		fbo->Bind();
+		fbo->AttachTexture(GL_TEXTURE_2D,gfboTextures[0],GL_COLOR_ATTACHMENT0_EXT);
+		fbo->AttachTexture(GL_TEXTURE_2D,gfboTextures[1],GL_COLOR_ATTACHMENT1_EXT);
+		fbo->IsValid(); //validate fbo
+		FramebufferObject::Disable();
+	}
+	else
+		printf("No framebuffer objects, off-screen rendering is not available\n");
+	initFrameCapture(&gCapture, width, height, gCapturePrefix, gCapturePiz, gCaptureBudget);
+	initLuminanceReducer(&gLumStats, width, height, gLumStatsGpu, gLumStatsStride);
+
+	//Tone mapping program and auto exposure meter for the EXR image
+	initToneMapper(&gToneMapper);
+	//Gamut conversion of the PNG image, the EXR image is converted while it is tone mapped
+	initGamutRenderer(&gGamutRenderer);
+
+	//3D LUT pass, the scene is drawn into a texture and goes through the LUT to the window
+	if (gCubeFileName && loadCubeLut(&gCubeLut, gCubeFileName)) {
+		gCubeLutEnabled = initCubeLutRenderer(&gCubeLutRenderer, &gCubeLut);
+		if (gCubeLutEnabled)
+			printf("3D LUT %s (%s): %d points per axis%s\n", gCubeFileName, gCubeLut.title[0] ? gCubeLut.title : "no title",
+				gCubeLut.size, gCubeLut.shaperSize ? ", with a shaper" : "");
+	}
 
 	//Mouse panning parameters
 	x_start = 0;
@@ -256,6 +385,15 @@ void drawRectTexturedQuads(float maxu, float maxv, float x0, float y0, float x1,
 	glDisable(GL_TEXTURE_RECTANGLE_NV);
 }
 
+void drawExr(float x0, float y0, float x1, float y1) {
+	if (gTiledExr.file) {
+		drawTiledExr(&gTiledExr, x0, y0, x1, y1);
+		return;
+	}
+	glBindTexture(GL_TEXTURE_RECTANGLE_NV,gTexEXR);
+	drawRectTexturedQuads(exrwidth,exrheight,x0,y0,x1,y1);
+}
+
 ///Draw function called from WM_PAINT with a valid GL context
 void oglDraw(int winWidth, int winHeight)
 {
@@ -265,6 +403,8 @@ void oglDraw(int winWidth, int winHeight)
 		GLenum buffers[] = {GL_COLOR_ATTACHMENT0_EXT, GL_COLOR_ATTACHMENT1_EXT};
 		glDrawBuffers(2,buffers); 
 	}
+	else if (gCubeLutEnabled)
+		bindCubeLutTarget(&gCubeLutRenderer, winWidth, winHeight);
 
 	glClearColor(0,0,0,0);
     glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
@@ -307,9 +447,56 @@ void oglDraw(int winWidth, int winHeight)
 		//The EXR image
 		case DRAW_TEXTURE_EXR:
 			glColor3f(1.0,1.0,1.0); 
-			glBindTexture(GL_TEXTURE_RECTANGLE_NV,gTexEXR);
-			drawRectTexturedQuads(exrwidth,exrheight,x0,y0,x1,y1);			
+			if (gTiledExr.file) {
+				unsigned int decoded = updateTiledExr(&gTiledExr, x0, y0, x1, y1,
+					gfboEnabled ? width : winWidth, gfboEnabled ? height : winHeight);
+				if (decoded)
+					printf("EXR level %d: %u tiles decoded, %u decoded and %u reused so far, %.1f ms decoding\n", gTiledExr.level,
+						decoded, gTiledExr.tilesDecoded, gTiledExr.tilesReused, gTiledExr.decodeSeconds * 1000.0);
+			}
+			//the meter sees the view as drawn, before the exposure
+			if (gToneMapper.program && gToneMap.autoExposure) {
+				beginToneMapMeter(&gToneMapper, &gToneMap);
+				drawExr(x0,y0,x1,y1);
+				endToneMapMeter(&gToneMapper);
+				if (gfboEnabled) {
+					GLenum buffers[] = {GL_COLOR_ATTACHMENT0_EXT, GL_COLOR_ATTACHMENT1_EXT};
+					fbo->Bind();
+					glDrawBuffers(2,buffers);
+				}
+				else if (gCubeLutEnabled)
+					bindCubeLutTarget(&gCubeLutRenderer, winWidth, winHeight);
+			}
+			if (gToneMapper.program)
+				beginToneMap(&gToneMapper, &gToneMap);
+			drawExr(x0,y0,x1,y1);
+			if (gToneMapper.program)
+				endToneMap(&gToneMapper);
 			break;
+
+		//The PNG image
+		case DRAW_TEXTURE_PNG:
+			glColor3f(1.0,1.0,1.0); 
+			glBindTexture(GL_TEXTURE_RECTANGLE_NV,gTexPNG);
+			if (gGamutRenderer.program && gPngGamut != gToneMap.displayGamut) {
+				GamutConversion gamut;
+				setupGamutConversion(&gamut, gPngGamut, gToneMap.displayGamut, gToneMap.gamutMapping);
+				beginGamut(&gGamutRenderer, &gamut, 2.2f);
+				drawRectTexturedQuads(pngwidth,pngheight,x0,y0,x1,y1);
+				endGamut(&gGamutRenderer);
+			}
+			else
+				drawRectTexturedQuads(pngwidth,pngheight,x0,y0,x1,y1);			
+			break;
+	}
+	//captures read the float attachment before it is blitted, once per frame in the 30-bit window
+	if (wglGetCurrentContext() == ghRC30bit)
+		captureFrame(&gCapture, gfboEnabled);
+	//statistics of the float attachment, the ones printed are of the frame before
+	if (gLumStatsEnabled && gfboEnabled && wglGetCurrentContext() == ghRC30bit) {
+		float weights[3];
+		gamutLuminance(gToneMap.displayGamut, weights);
+		reduceLuminance(&gLumStats, gfboTextures[0], weights);
 	}
 	//2ND pass - blit offscreen textures to screen quads, side by side
 	if (gfboEnabled) {
@@ -327,15 +514,21 @@ void oglDraw(int winWidth, int winHeight)
 			glMatrixMode(GL_MODELVIEW);
 			glLoadIdentity();
 			glEnable(GL_TEXTURE_2D);
+			if (gCubeLutEnabled)
+				beginCubeLut(&gCubeLutRenderer);
 			glBegin(GL_QUADS);
 				glTexCoord2f(0.0,0.0); glVertex2f(x_start,y_start);
 				glTexCoord2f(1.0,0.0); glVertex2f(x_end,y_start);
 				glTexCoord2f(1.0,1.0); glVertex2f(x_end,y_end);
 				glTexCoord2f(0.0,1.0); glVertex2f(x_start,y_end);	
 			glEnd();
+			if (gCubeLutEnabled)
+				endCubeLut(&gCubeLutRenderer);
 			glDisable(GL_TEXTURE_2D);
 		}
 	} //end of if gfboEnabled
+	else if (gCubeLutEnabled)
+		drawCubeLutTarget(&gCubeLutRenderer, winWidth, winHeight);
 
 }
 
@@ -360,8 +553,8 @@ GLvoid PanGLScene(int x, int y)							// Pan Image In The GL Window
 
 		x_start -= deltaX;
 		y_start += deltaY;
-		x_end = x_start + (GLfloat)width;	
-		y_end = y_start + (GLfloat)height;
+		x_end = x_start + (GLfloat)width*gZoom;	
+		y_end = y_start + (GLfloat)height*gZoom;
 	}
 
 	prevX = x;
@@ -370,11 +563,71 @@ GLvoid PanGLScene(int x, int y)							// Pan Image In The GL Window
 	redrawAll();
 
 }
+// Zoom the image in or out around the mouse position
+GLvoid ZoomGLScene(HWND hWnd, int screenX, int screenY, int wheelDelta)
+{
+	POINT pt = {screenX, screenY};
+	RECT rect;
+	GLfloat factor = (wheelDelta > 0) ? 1.25f : 0.8f;
+
+	ScreenToClient(hWnd, &pt);
+	GetClientRect(hWnd, &rect);
+	GLfloat cx = (GLfloat)pt.x;
+	GLfloat cy = (GLfloat)(rect.bottom - pt.y); //GL y goes up
+	x_start = cx - (cx - x_start)*factor;
+	y_start = cy - (cy - y_start)*factor;
+	gZoom *= factor;
+	x_end = x_start + (GLfloat)width*gZoom;
+	y_end = y_start + (GLfloat)height*gZoom;
+	redrawAll();
+}
+
+//print the tone mapping settings after a change
+void toneMapChanged() {
+	printf("Tone mapping: %s, exposure %+.1f stops%s, ", toneMapName(gToneMap.op), gToneMap.exposure,
+		gToneMap.autoExposure ? " over auto exposure" : "");
+	if (gToneMap.output == TONEMAP_OUTPUT_GAMMA)
+		printf("gamma %.1f\n", gToneMap.gamma);
+	else
+		printf("%s for %.0f cd/m2\n", toneMapOutputName(gToneMap.output), gToneMap.peakNits);
+	if (!gToneMapper.program)
+		printf("No tone mapping program, the EXR image is drawn as is\n");
+	redrawAll();
+}
+
+//print the gamut settings after a change
+void gamutChanged() {
+	printf("Display gamut %s, EXR image %s, PNG image %s, out of gamut colors %s\n", gamutName(gToneMap.displayGamut),
+		gamutName(gToneMap.sourceGamut), gamutName(gPngGamut), gamutMappingName(gToneMap.gamutMapping));
+	redrawAll();
+}
+
+//print the capture statistics once a burst is written
+void captureFinished() {
+	printf("Capture: %u frames read, %u dropped, %u written, %u failed, %.2f ms per frame in the draw, %.0f ms per file in the writer\n",
+		gCapture.captured, gCapture.dropped, gCapture.written, gCapture.failed,
+		gCapture.captured ? 1000.0 * gCapture.drawSeconds / gCapture.draws : 0.0,
+		gCapture.written ? 1000.0 * gCapture.writeSeconds / gCapture.written : 0.0);
+	if (gCapture.directReads)
+		printf("Capture: %u frames read without pixel buffer objects, the draws waited for them\n", gCapture.directReads);
+}
+
+//print the latest luminance statistics and the time they take per frame
+void printLuminanceStats() {
+	const LuminanceStats *stats = &gLumStats.stats;
+	if (!gLumStats.valid)
+		return;
+	printf("Frame %u luminance: min %.4g, max %.4g, mean %.4g, log average %.4g, 1%% %.4g, median %.4g, 99%% %.4g, %.3f ms per frame on the %s\n",
+		stats->frame, stats->minimum, stats->maximum, stats->mean, stats->logAverage, luminancePercentile(stats, 0.01f),
+		luminancePercentile(stats, 0.5f), luminancePercentile(stats, 0.99f),
+		1000.0 * gLumStats.seconds / gLumStats.frames, gLumStats.gpu ? "GPU" : "CPU");
+}
+
 //switch to next draw mode
 void switchDrawMode() {
 	char str[256];
 	gDrawMode++;
-	gDrawMode%=4;
+	gDrawMode%=DRAW_MODE_COUNT;
 	//set 30-bit window text to current draw mode
 	sprintf(str,"30 Bit Color Window - ");
 	strcat(str,gDrawModeDesc[gDrawMode]);
@@ -409,6 +662,22 @@ LRESULT WindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 					ReleaseDC(hWnd, ghDC24bit);
 				}
                 ValidateRect(hWnd, NULL);
+                //keep drawing until the burst is read and written
+                if (hWnd == ghWnd30bit && gCaptureActive) {
+                    if (captureBusy(&gCapture))
+                        InvalidateRect(hWnd, NULL, FALSE);
+                    else {
+                        gCaptureActive = false;
+                        captureFinished();
+                    }
+                }
+                if (hWnd == ghWnd30bit && gLumStatsEnabled) {
+                    InvalidateRect(hWnd, NULL, FALSE);
+                    if (GetTickCount() - gLumStatsPrinted >= 1000) {
+                        printLuminanceStats();
+                        gLumStatsPrinted = GetTickCount();
+                    }
+                }
                 return 0;
             }
         break;
@@ -422,8 +691,79 @@ LRESULT WindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 					switchDrawMode();
 					return 0;
 				case 0x46: //key F
-					gfboEnabled = 1-gfboEnabled;
-					redrawAll();
+					//a burst only ends once its frames are read from the FBO
+					if (fbo && gCaptureActive) {
+						printf("Off-screen rendering stays on until the capture is written\n");
+						return 0;
+					}
+					if (fbo) {
+						gfboEnabled = 1-gfboEnabled;
+						redrawAll();
+					}
+					return 0;
+				case 0x54: //key T, next tone mapping operator
+					gToneMap.op = (gToneMap.op + 1) % TONEMAP_COUNT;
+					toneMapChanged();
+					return 0;
+				case 0x41: //key A, automatic exposure on/off
+					gToneMap.autoExposure = !gToneMap.autoExposure;
+					toneMapChanged();
+					return 0;
+				case 0x47: //key G, linear or gamma 2.2 output
+					gToneMap.gamma = (gToneMap.gamma == 1.0f) ? 2.2f : 1.0f;
+					toneMapChanged();
+					return 0;
+				case 0x4C: //key L, 3D LUT on/off
+					if (gCubeLutRenderer.program) {
+						gCubeLutEnabled = !gCubeLutEnabled;
+						printf("3D LUT %s\n", gCubeLutEnabled ? "on" : "off");
+						redrawAll();
+					}
+					return 0;
+				case 0x48: //key H, gamma, PQ or HLG output
+					gToneMap.output = (gToneMap.output + 1) % TONEMAP_OUTPUT_COUNT;
+					toneMapChanged();
+					return 0;
+				case 0x43: //key C, capture a burst of the float FBO attachment
+					if (fbo && gCapture.numBuffers && !gCaptureActive) {
+						if (!gfboEnabled) {
+							gfboEnabled = true;
+							printf("Captures read the off-screen float texture, off-screen rendering is on\n");
+						}
+						printf("Capturing %u frames from %s%04u.exr on\n", gCaptureFrames, gCapture.prefix, gCapture.nextFrame);
+						startCapture(&gCapture, gCaptureFrames);
+						gCaptureActive = true;
+						redrawAll();
+					}
+					return 0;
+				case 0x53: //key S, luminance statistics of the float FBO attachment on/off
+					if (fbo && gLumStats.width) {
+						gLumStatsEnabled = !gLumStatsEnabled;
+						if (gLumStatsEnabled && !gfboEnabled) {
+							gfboEnabled = true;
+							printf("Statistics are of the off-screen float texture, off-screen rendering is on\n");
+						}
+						printf("Luminance statistics %s\n", gLumStatsEnabled ? "on" : "off");
+						redrawAll();
+					}
+					return 0;
+				case 0x50: //key P, BT.709, Display P3 or BT.2020 display
+					gToneMap.displayGamut = (gToneMap.displayGamut + 1) % GAMUT_COUNT;
+					gamutChanged();
+					return 0;
+				case 0x4D: //key M, out of gamut colors kept, clipped or compressed
+					gToneMap.gamutMapping = (gToneMap.gamutMapping + 1) % GAMUT_MAP_COUNT;
+					gamutChanged();
+					return 0;
+				case VK_ADD:
+				case VK_OEM_PLUS: //half a stop brighter
+					gToneMap.exposure += 0.5f;
+					toneMapChanged();
+					return 0;
+				case VK_SUBTRACT:
+				case VK_OEM_MINUS: //half a stop darker
+					gToneMap.exposure -= 0.5f;
+					toneMapChanged();
 					return 0;
             }
         case WM_SIZE:
@@ -435,6 +775,9 @@ LRESULT WindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 			PanGLScene(LOWORD(lParam), HIWORD(lParam));  // LoWord = X, HiWord=Y
 		}
 		return 0;
+	case WM_MOUSEWHEEL:								// Mouse wheel, zoom around the cursor
+		ZoomGLScene(hWnd, (short)LOWORD(lParam), (short)HIWORD(lParam), (short)HIWORD(wParam));
+		return 0;
 	case WM_LBUTTONDOWN:							// Left mouse button down
 		mb[0] = TRUE;		
 		return 0;
@@ -659,10 +1002,59 @@ Cleanup:
     ReleaseDC(dummyWin, dummyDC);
     DestroyWindow(dummyWin);
 
-    wglMakeCurrent(ghDC30bit, ghRC30bit);
-	oglInit();	
+    if (ghRC30bit) {
+        wglMakeCurrent(ghDC30bit, ghRC30bit);
+        oglInit();
+    }
+
+    return ghRC30bit ? ghWnd30bit : NULL;
+}
 
-    return ghWnd30bit;
+//the draw benchmark switches the demo's draw mode and off-screen rendering
+void setDrawBenchMode(int mode, bool fboOn)
+{
+    gDrawMode = mode;
+    gfboEnabled = fboOn;
+}
+
+//Draws every draw mode with off-screen rendering off and on for frames frames each, without vsync, and writes the
+//times to reportFile. Runs in the 10bpc window, or an 8bpc one where there is none, e.g. on a software GL.
+bool benchmarkDrawModes(const char *windowClass, unsigned int frames, const char *reportFile)
+{
+    DrawBenchTarget target;
+
+    target.windowKind = "10bpc";
+    if ((target.hWnd = Create10bpcOpenGLWindow(windowClass, "OpenGL 10bpc Draw Benchmark")) != NULL) {
+        target.hDC = ghDC30bit;
+        target.hRC = ghRC30bit;
+    }
+    else {
+        printf("No 10bpc window, the draws are timed in an 8bpc window\n");
+        if ((target.hWnd = Create8bpcOpenGLWindow(windowClass, "OpenGL 8bpc Draw Benchmark", TRUE, ghDC24bit, ghRC24bit)) == NULL)
+            return false;
+        ghWnd24bit = target.hWnd;
+        target.hDC = ghDC24bit;
+        target.hRC = ghRC24bit;
+        target.windowKind = "8bpc";
+        wglMakeCurrent(target.hDC, target.hRC);
+        oglInit();
+    }
+    ShowWindow(target.hWnd, SW_SHOW);
+    UpdateWindow(target.hWnd);
+    wglMakeCurrent(target.hDC, target.hRC);
+    wglSwapInterval = (PFNWGLSWAPINTERVALEXTPROC)wglGetProcAddress("wglSwapIntervalEXT");
+    if (wglSwapInterval)
+        wglSwapInterval(0);
+    target.modeNames = gDrawModeDesc;
+    target.modeCount = DRAW_MODE_COUNT;
+    target.hasFbo = fbo != NULL;
+    target.fboWidth = width;
+    target.fboHeight = height;
+    target.setMode = setDrawBenchMode;
+    target.draw = oglDraw;
+    bool ok = runDrawBench(&target, frames, reportFile);
+    wglMakeCurrent(target.hDC, NULL);
+    return ok;
 }
 
 int main(int argc, char* argv[])
@@ -674,15 +1066,131 @@ int main(int argc, char* argv[])
 
     printf("10bpc test application (c) NVIDIA Corporation\nBuilt on %s @ %s\n", __DATE__, __TIME__);
 
-    printf("Usage: 10bpctest [bpc]\n"
-        "  bpc: Bits per component of the OpenGL window\n"
+    printf("Usage: 10bpctest [-gamut display [exr] [png] [none|clip|compress]] [-capture frames [prefix] [piz|zip [MB]]]\n"
+        "                 [-stats gpu|cpu [stride]] [-drawbench [frames] [report.csv|report.json]]\n"
+        "                 [bpc] [file.png] [file.exr] [file.cube]\n"
+        "  bpc: Bits per component of the OpenGL window, a number that does not follow an option\n"
         "\t\t8 Show only the 8bpc window\n"
         "\t\t10 Show only the 10bpc window\n"
-        "\t\tBy default, show both 8bpc and 10bpc windows\n");
-
-    if (argc == 2)
+        "\t\tBy default, show both 8bpc and 10bpc windows\n"
+        "  file.png: 8 or 16-bit gray or RGB PNG image, default %s\n"
+        "  file.exr: scanline or tiled OpenEXR image, default %s\n"
+        "  file.cube: 3D LUT applied to everything drawn, L turns it on and off\n"
+        "  -gamut: primaries of the display and of the images, 709 (default), p3 or 2020; the EXR image\n"
+        "  defaults to its chromaticities. Out of gamut colors are compressed by default. Also applies to -tonemap\n"
+        "  -capture: frames C captures from the float FBO to prefixNNNN.exr (default 8, capture, piz), MB of\n"
+        "  readback buffers (default 256) after which frames are dropped\n"
+        "  -stats: where S reduces the float FBO to luminance statistics (default gpu when it can), pixels a side\n"
+        "  per GPU histogram point (default 1)\n"
+        "  -drawbench: instead of the demo, times frames (default 100) of every draw mode with and without the FBO,\n"
+        "  CPU and GPU, and writes the report (default drawbench.csv)\n",
+        gPngFileName, gExrFileName);
+    printBenchUsage();
+
+    defaultToneMapParams(&gToneMap);
+
+    for (int i = 1; i < argc; i++)
     {
-        switch (atoi(argv[1]))
+        int exitCode;
+        if (runBenchTool(argc, argv, i, &gToneMap, !gExrGamutGiven, &exitCode))
+            return exitCode;
+        if (strcmp(argv[i], "-gamut") == 0)
+        {
+            static const char *gamuts[GAMUT_COUNT] = {"709", "p3", "2020"};
+            static const char *mappings[GAMUT_MAP_COUNT] = {"none", "clip", "compress"};
+            int given = 0;
+            //display, EXR and PNG primaries in that order, the mapping anywhere after them
+            while (i + 1 < argc)
+            {
+                int gamut, mapping;
+                for (gamut = 0; gamut < GAMUT_COUNT && _stricmp(argv[i + 1], gamuts[gamut]) != 0; gamut++)
+                    ;
+                for (mapping = 0; mapping < GAMUT_MAP_COUNT && _stricmp(argv[i + 1], mappings[mapping]) != 0; mapping++)
+                    ;
+                if (gamut < GAMUT_COUNT && given < 3)
+                {
+                    if (given == 0)
+                        gToneMap.displayGamut = gamut;
+                    else if (given == 1)
+                        gToneMap.sourceGamut = gamut;
+                    else
+                        gPngGamut = gamut;
+                    gExrGamutGiven = gExrGamutGiven || given == 1;
+                    given++;
+                }
+                else if (mapping < GAMUT_MAP_COUNT)
+                    gToneMap.gamutMapping = mapping;
+                else
+                    break;
+                i++;
+            }
+            if (given == 0)
+            {
+                printf("ERROR: -gamut needs the display primaries, 709, p3 or 2020\n");
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "-capture") == 0)
+        {
+            if (i + 1 >= argc || atoi(argv[i + 1]) <= 0)
+            {
+                printf("ERROR: -capture needs the number of frames\n");
+                return 1;
+            }
+            gCaptureFrames = atoi(argv[++i]);
+            if (i + 1 < argc && argv[i + 1][0] != '-' && !strchr(argv[i + 1], '.') && atoi(argv[i + 1]) == 0)
+                gCapturePrefix = argv[++i];
+            //the budget only after the compression, so that it is not taken for the bits per component
+            if (i + 1 < argc && (_stricmp(argv[i + 1], "piz") == 0 || _stricmp(argv[i + 1], "zip") == 0))
+            {
+                gCapturePiz = _stricmp(argv[++i], "piz") == 0;
+                if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+                    gCaptureBudget = (size_t)atoi(argv[++i]) * 1024 * 1024;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "-stats") == 0)
+        {
+            if (i + 1 >= argc || (_stricmp(argv[i + 1], "gpu") != 0 && _stricmp(argv[i + 1], "cpu") != 0))
+            {
+                printf("ERROR: -stats needs gpu or cpu\n");
+                return 1;
+            }
+            gLumStatsGpu = _stricmp(argv[++i], "gpu") == 0;
+            //any number right after gpu|cpu is the stride, the bits per component are a number after no option
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+                gLumStatsStride = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "-drawbench") == 0)
+        {
+            gDrawBenchFrames = 100;
+            //the benchmark opens its own window, so a number here is the frames and not the bits per component
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+                gDrawBenchFrames = atoi(argv[++i]);
+            const char *reportExt = (i + 1 < argc) ? strrchr(argv[i + 1], '.') : NULL;
+            if (reportExt && (_stricmp(reportExt, ".csv") == 0 || _stricmp(reportExt, ".json") == 0))
+                gDrawBenchReport = argv[++i];
+            continue;
+        }
+        const char *ext = strrchr(argv[i], '.');
+        if (ext && _stricmp(ext, ".png") == 0)
+        {
+            gPngFileName = argv[i];
+            continue;
+        }
+        if (ext && _stricmp(ext, ".exr") == 0)
+        {
+            gExrFileName = argv[i];
+            continue;
+        }
+        if (ext && _stricmp(ext, ".cube") == 0)
+        {
+            gCubeFileName = argv[i];
+            continue;
+        }
+        switch (atoi(argv[i]))
         {
             case 10:
                 bShow8bpc = FALSE;
@@ -695,6 +1203,8 @@ int main(int argc, char* argv[])
         // Couldn't register the window class
         return 0;
     }
+    if (gDrawBenchFrames)
+        return benchmarkDrawModes(szWindowClass, gDrawBenchFrames, gDrawBenchReport) ? 0 : 1;
 
     if ((ghWnd30bit = Create10bpcOpenGLWindow(szWindowClass, "OpenGL 10bpc Demo")) == NULL)    {
         return 0;
@@ -708,9 +1218,23 @@ int main(int argc, char* argv[])
         {
             return 0;
         }
-		wglShareLists(ghRC30bit, ghRC24bit);
-        ShowWindow(ghWnd24bit, SW_SHOW);
-        UpdateWindow(ghWnd24bit);
+        //the 8bpc window draws the 10bpc context's textures with its entry points, which only
+        //holds when both contexts are of the same implementation, and then the sharing works
+        if (!wglShareLists(ghRC30bit, ghRC24bit))
+        {
+            printf("ERROR: Unable to share the 10bpc context with the 8bpc window, showing only the 10bpc window\n");
+            wglDeleteContext(ghRC24bit);
+            ReleaseDC(ghWnd24bit, ghDC24bit);
+            DestroyWindow(ghWnd24bit);
+            ghRC24bit = NULL;
+            ghDC24bit = NULL;
+            ghWnd24bit = NULL;
+        }
+        else
+        {
+            ShowWindow(ghWnd24bit, SW_SHOW);
+            UpdateWindow(ghWnd24bit);
+        }
     }
 	
 
@@ -723,6 +1247,12 @@ int main(int argc, char* argv[])
         }
         TranslateMessage(&msg);
         DispatchMessage(&msg);
+    }
+    //frames still in flight are written before the app quits
+    if (wglMakeCurrent(ghDC30bit, ghRC30bit)) {
+        deleteFrameCapture(&gCapture);
+        deleteLuminanceReducer(&gLumStats);
+        wglMakeCurrent(ghDC30bit, NULL);
     }
 	return 0;
 }
\ No newline at end of file
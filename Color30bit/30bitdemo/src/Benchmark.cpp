@@ -0,0 +1,1013 @@
+//
+// Benchmark.cpp
+//
+// File conversions, CPU benchmarks and the draw benchmark loop
+//
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <gl/gl.h>
+#include <GL/glext.h>
+#include <ImfRgba.h>
+#include "ExrLoader.h"
+#include "PngLoader.h"
+#include "ErrorDiffusion.h"
+#include "HalfConvert.h"
+#include "TransferFunction.h"
+#include "Gamut.h"
+#include "ToneMap.h"
+#include "CubeLut.h"
+#include "LuminanceStats.h"
+#include "GpuTimer.h"
+#include "Benchmark.h"
+
+// Frames drawn and thrown away before each draw mode is timed: first texture
+// uses, tile decodes, program builds
+#define DRAWBENCH_WARMUP        5
+
+typedef struct _BenchTimer {
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER start;
+    double best;                        // ms, the shortest run since the reset
+} BenchTimer;
+
+typedef struct _DrawBenchTimes {
+    double mean;                        // ms
+    double median;
+    double max;
+} DrawBenchTimes;
+
+typedef struct _DrawBenchResult {
+    int mode;
+    bool fbo;
+    unsigned int frames;                // 0 when the combination could not be drawn
+    DrawBenchTimes submit;              // CPU time in the draw
+    DrawBenchTimes finish;              // CPU time glFinish then waited, the GPU work left
+    DrawBenchTimes gpu;                 // timer queries, all 0 without them
+    DrawBenchTimes frame;               // submit, finish and SwapBuffers
+} DrawBenchResult;
+
+// The generator of every test image, the same numbers on every run
+static unsigned int benchRandom(unsigned int *seed)
+{
+    *seed = *seed * 1664525 + 1013904223;
+    return *seed;
+}
+
+// A slow ramp per channel of RGB 16-bit, blue with the top bits of the
+// generator from noiseShift on added, so that every level gets used
+static void fillBenchRamp(unsigned short *rgb, unsigned int width, unsigned int height, int noiseShift)
+{
+    unsigned int seed = 1;
+
+    for (unsigned int y = 0; y < height; y++) {
+        for (unsigned int x = 0; x < width; x++) {
+            unsigned short *p = rgb + ((size_t)y * width + x) * 3;
+            unsigned int noise = benchRandom(&seed) >> noiseShift;
+            p[0] = (unsigned short)(x * 65535 / (width - 1));
+            p[1] = (unsigned short)(y * 65535 / (height - 1));
+            p[2] = (unsigned short)((x + y) * 32767 / (width + height) + noise);
+        }
+    }
+}
+
+// Thread counts go 1, 2, 4.. up to the cores, at most maxThreads
+static unsigned int benchThreads(unsigned int maxThreads)
+{
+    SYSTEM_INFO systemInfo;
+
+    GetSystemInfo(&systemInfo);
+    return systemInfo.dwNumberOfProcessors < maxThreads ? systemInfo.dwNumberOfProcessors : maxThreads;
+}
+
+// The number after argv[i] if there is a positive one, otherwise runs
+static unsigned int benchRuns(int argc, char *argv[], int i, unsigned int runs)
+{
+    return (i + 1 < argc && atoi(argv[i + 1]) > 0) ? atoi(argv[i + 1]) : runs;
+}
+
+static void resetBenchTimer(BenchTimer *timer)
+{
+    timer->best = 1e30;
+}
+
+static void initBenchTimer(BenchTimer *timer)
+{
+    QueryPerformanceFrequency(&timer->frequency);
+    resetBenchTimer(timer);
+}
+
+static double benchMs(const BenchTimer *timer, const LARGE_INTEGER *from, const LARGE_INTEGER *to)
+{
+    return 1000.0*(to->QuadPart - from->QuadPart)/timer->frequency.QuadPart;
+}
+
+static void startBenchRun(BenchTimer *timer)
+{
+    QueryPerformanceCounter(&timer->start);
+}
+
+// Returns the ms since startBenchRun, kept as best if no run was shorter
+static double endBenchRun(BenchTimer *timer)
+{
+    LARGE_INTEGER end;
+
+    QueryPerformanceCounter(&end);
+    double ms = benchMs(timer, &timer->start, &end);
+    if (ms < timer->best)
+        timer->best = ms;
+    return ms;
+}
+
+// The flag printed after a result whose bytes differ from the reference, "" otherwise
+static const char *compareFlag(const void *reference, const void *result, size_t bytes, const char *flag)
+{
+    return memcmp(reference, result, bytes) == 0 ? "" : flag;
+}
+
+// The flag printed after a result whose error is over the bound, "" otherwise
+static const char *boundFlag(double error, double bound, const char *flag)
+{
+    return error > bound ? flag : "";
+}
+
+// Writes GL_UNSIGNED_INT_2_10_10_10_REV pixels as a 10-bit PPM
+static bool writeRgb10A2Ppm(const char *fileName, const unsigned int *packed, unsigned int width, unsigned int height)
+{
+    size_t pixels = (size_t)width * height;
+    unsigned short *levels = (unsigned short *)malloc(pixels * 3 * sizeof(unsigned short));
+
+    if (!levels) {
+        printf("ERROR: Out of memory for %s\n", fileName);
+        return false;
+    }
+    for (size_t i = 0; i < pixels; i++) {
+        levels[i * 3] = (unsigned short)(packed[i] & 0x3ff);
+        levels[i * 3 + 1] = (unsigned short)((packed[i] >> 10) & 0x3ff);
+        levels[i * 3 + 2] = (unsigned short)((packed[i] >> 20) & 0x3ff);
+    }
+    bool ok = writePnm(fileName, levels, width, height, 3, 10);
+    free(levels);
+    return ok;
+}
+
+// Error diffuses a 16-bit PNG to bits per component and writes it as PGM/PPM
+static bool diffusePngFile(const char *inFile, const char *outFile, unsigned int bits, int kernel)
+{
+    PngFile png;
+    BenchTimer timer;
+
+    if (bits < 1 || bits > 15) {
+        printf("ERROR: %u bits per component is not supported, 1 to 15\n", bits);
+        return false;
+    }
+    if (!openPng(&png, inFile))
+        return false;
+    size_t count = (size_t)png.width * png.height * png.channels;
+    unsigned short *samples = (unsigned short *)malloc(count * sizeof(unsigned short));
+    unsigned short *levels = (unsigned short *)malloc(count * sizeof(unsigned short));
+    bool ok = samples && levels;
+    for (unsigned int y = 0; ok && y < png.height; y++)
+        ok = readPngRow(&png, samples + (size_t)y * png.width * png.channels);
+    unsigned int channelBits[4] = {bits, bits, bits, bits};
+    initBenchTimer(&timer);
+    if (ok) {
+        startBenchRun(&timer);
+        ok = diffuseImage(samples, levels, png.width, png.height, png.channels, channelBits, kernel);
+        endBenchRun(&timer);
+    }
+    if (ok) {
+        printf("%s: %ux%u, %u channels diffused to %u bits in %.1f ms\n", inFile, png.width, png.height, png.channels,
+            bits, timer.best);
+        ok = writePnm(outFile, levels, png.width, png.height, png.channels, bits);
+    }
+    else
+        printf("ERROR: Unable to diffuse %s\n", inFile);
+    closePng(&png);
+    free(samples);
+    free(levels);
+    return ok;
+}
+
+// Tone maps an EXR image on the CPU with automatic exposure and writes it as
+// a 10-bit PPM. With fileGamut the primaries of the image come from its
+// chromaticities.
+static bool toneMapExrFile(const char *inFile, const char *outFile, const ToneMapParams *params, bool fileGamut)
+{
+    ExrFile exr;
+    ToneMapParams mapParams = *params;
+    BenchTimer timer;
+    float averageLog2 = 0.0f;
+    double meterMs = 0.0, mapMs = 0.0;
+
+    if (!openExr(&exr, inFile))
+        return false;
+    if (fileGamut && exr.hasChromaticities) {
+        if (findGamut(exr.chromaticities) >= 0)
+            mapParams.sourceGamut = findGamut(exr.chromaticities);
+        else
+            printf("%s: primaries are not BT.709, Display P3 or BT.2020, mapped as BT.709\n", inFile);
+    }
+    params = &mapParams;
+    size_t pixels = (size_t)exr.width * exr.height;
+    Imf::Rgba *rgba = (Imf::Rgba *)malloc(pixels * sizeof(Imf::Rgba));
+    unsigned int *packed = (unsigned int *)malloc(pixels * sizeof(unsigned int));
+    bool ok = rgba && packed;
+    if (!ok)
+        printf("ERROR: Out of memory for %s\n", inFile);
+    ok = ok && readExr(&exr, rgba);
+    initBenchTimer(&timer);
+    if (ok) {
+        startBenchRun(&timer);
+        averageLog2 = averageLogLuminance((const unsigned short *)rgba, pixels, params->sourceGamut);
+        meterMs = endBenchRun(&timer);
+        startBenchRun(&timer);
+        ok = toneMapToRgb10A2((const unsigned short *)rgba, packed, pixels, params, averageLog2);
+        mapMs = endBenchRun(&timer);
+    }
+    if (ok) {
+        printf("%s: average log2 luminance %.2f metered in %.1f ms, %s with exposure scale %.3f, %s to %s %s, to %s in %.1f ms, %.0f Mpixel/s\n",
+            inFile, averageLog2, meterMs, toneMapName(params->op), toneMapScale(params, averageLog2),
+            gamutName(params->sourceGamut), gamutName(params->displayGamut), gamutMappingName(params->gamutMapping),
+            toneMapOutputName(params->output), mapMs, pixels / (mapMs * 1000.0));
+        ok = writeRgb10A2Ppm(outFile, packed, exr.width, exr.height);
+    }
+    closeExr(&exr);
+    free(rgba);
+    free(packed);
+    return ok;
+}
+
+// Maps a 16-bit PNG through a .cube 3D LUT on the CPU and writes it as a 10-bit PPM
+static bool cubeLutPngFile(const char *inFile, const char *cubeFile, const char *outFile)
+{
+    PngFile png;
+    CubeLut lut;
+    BenchTimer timer;
+
+    if (!loadCubeLut(&lut, cubeFile))
+        return false;
+    if (!openPng(&png, inFile)) {
+        freeCubeLut(&lut);
+        return false;
+    }
+    size_t pixels = (size_t)png.width * png.height;
+    unsigned short *samples = (unsigned short *)malloc(pixels * png.channels * sizeof(unsigned short));
+    unsigned int *packed = (unsigned int *)malloc(pixels * sizeof(unsigned int));
+    bool ok = samples && packed;
+    if (!ok)
+        printf("ERROR: Out of memory for %s\n", inFile);
+    for (unsigned int y = 0; ok && y < png.height; y++)
+        ok = readPngRow(&png, samples + (size_t)y * png.width * png.channels);
+    if (ok) {
+        initBenchTimer(&timer);
+        startBenchRun(&timer);
+        cubeLutToRgb10A2(&lut, samples, png.channels, packed, png.width, png.height);
+        double ms = endBenchRun(&timer);
+        printf("%s: %ux%u through %s (%d points per axis%s) in %.1f ms, %.0f Mpixel/s\n", inFile, png.width, png.height,
+            cubeFile, lut.size, lut.shaperSize ? ", shaper" : "", ms, pixels / (ms * 1000.0));
+        ok = writeRgb10A2Ppm(outFile, packed, png.width, png.height);
+    }
+    closePng(&png);
+    freeCubeLut(&lut);
+    free(samples);
+    free(packed);
+    return ok;
+}
+
+// Times the error diffusion of an 8K RGB 16-bit frame with 1, 2, 4..
+// threads, checks the results against the serial one
+static void benchmarkDiffusion(unsigned int runs)
+{
+    const unsigned int benchWidth = 7680, benchHeight = 4320;
+    const unsigned int benchBits[3] = {10, 10, 10};
+    size_t count = (size_t)benchWidth * benchHeight * 3;
+    unsigned short *src = (unsigned short *)malloc(count * sizeof(unsigned short));
+    unsigned short *serial = (unsigned short *)malloc(count * sizeof(unsigned short));
+    unsigned short *levels = (unsigned short *)malloc(count * sizeof(unsigned short));
+    unsigned int maxThreads = benchThreads(DIFFUSE_MAX_THREADS);
+    BenchTimer timer;
+
+    if (!src || !serial || !levels) {
+        printf("ERROR: Out of memory for the diffusion benchmark\n");
+        free(src);
+        free(serial);
+        free(levels);
+        return;
+    }
+    fillBenchRamp(src, benchWidth, benchHeight, 24);
+    initBenchTimer(&timer);
+    printf("Error diffusion of %ux%u RGB 16-bit to 10-bit, best of %u runs\n", benchWidth, benchHeight, runs);
+    for (int kernel = 0; kernel < DIFFUSE_KERNEL_COUNT; kernel++) {
+        double serialMs = 0.0;
+        for (unsigned int threads = 1; threads <= maxThreads; threads *= 2) {
+            resetBenchTimer(&timer);
+            for (unsigned int run = 0; run < runs; run++) {
+                startBenchRun(&timer);
+                diffuseImage(src, threads == 1 ? serial : levels, benchWidth, benchHeight, 3, benchBits, kernel, threads);
+                endBenchRun(&timer);
+            }
+            if (threads == 1)
+                serialMs = timer.best;
+            printf("  %-15s %2u threads: %8.1f ms  %6.1f Mpixel/s  speedup %.2fx%s\n",
+                kernel == DIFFUSE_SIERRA ? "Sierra" : "Floyd-Steinberg", threads, timer.best,
+                benchWidth * benchHeight / (timer.best * 1000.0), serialMs / timer.best,
+                threads == 1 ? "" : compareFlag(serial, levels, count * sizeof(unsigned short), "  DIFFERS FROM SERIAL"));
+        }
+    }
+    free(src);
+    free(serial);
+    free(levels);
+}
+
+// Times the half float conversions of a 4K RGBA frame on every path the CPU
+// has, checks the results against the scalar path
+static void benchmarkHalfConversion(unsigned int runs)
+{
+    const unsigned int benchWidth = 3840, benchHeight = 2160;
+    const char *names[4] = {"half to float", "float to half", "half to unorm16", "half to RGB10_A2"};
+    const size_t bytes[4] = {6, 6, 4, 6};                   // bytes read and written per value
+    size_t count = (size_t)benchWidth * benchHeight * 4;
+    unsigned short *halves = (unsigned short *)malloc(count * sizeof(unsigned short));
+    float *floats = (float *)malloc(count * sizeof(float));
+    void *out = malloc(count * sizeof(float));
+    void *reference[4];
+    size_t outBytes[4] = {count * sizeof(float), count * sizeof(unsigned short), count * sizeof(unsigned short),
+        count / 4 * sizeof(unsigned int)};
+    BenchTimer timer;
+    int bestPath = setHalfConvertPath(HALF_PATH_COUNT);
+    bool ok = halves && floats && out;
+
+    for (int conversion = 0; conversion < 4; conversion++) {
+        reference[conversion] = malloc(outBytes[conversion]);
+        ok = ok && reference[conversion];
+    }
+    // every half bit pattern including NaNs and denormals, floats around the half range with some specials
+    unsigned int seed = 1;
+    for (size_t i = 0; ok && i < count; i++) {
+        unsigned int r = benchRandom(&seed);
+        halves[i] = (unsigned short)(r >> 16);
+        union { unsigned int i; float f; } x;
+        x.i = (i % 64) ? (r & 0x80000000) | ((100 + (r >> 8) % 50) << 23) | ((r * 2654435761u) & 0x7fffff)
+            : r * 2654435761u;
+        floats[i] = x.f;
+    }
+    if (!ok) {
+        printf("ERROR: Out of memory for the half conversion benchmark\n");
+        bestPath = -1;
+    }
+    else
+        printf("Half float conversions of %ux%u RGBA, best of %u runs\n", benchWidth, benchHeight, runs);
+    initBenchTimer(&timer);
+    for (int path = HALF_PATH_SCALAR; path <= bestPath; path++) {
+        setHalfConvertPath(path);
+        for (int conversion = 0; conversion < 4; conversion++) {
+            void *dst = (path == HALF_PATH_SCALAR) ? reference[conversion] : out;
+            resetBenchTimer(&timer);
+            for (unsigned int run = 0; run < runs; run++) {
+                startBenchRun(&timer);
+                switch (conversion) {
+                    case 0:
+                        halfToFloat(halves, (float *)dst, count);
+                        break;
+                    case 1:
+                        floatToHalf(floats, (unsigned short *)dst, count);
+                        break;
+                    case 2:
+                        halfToUnorm16(halves, (unsigned short *)dst, count);
+                        break;
+                    case 3:
+                        halfToRgb10A2(halves, (unsigned int *)dst, count / 4);
+                        break;
+                }
+                endBenchRun(&timer);
+            }
+            printf("  %-6s %-17s %8.1f ms  %6.2f GB/s%s\n", halfConvertPathName(path), names[conversion], timer.best,
+                count * bytes[conversion] / (timer.best * 1e6), path == HALF_PATH_SCALAR ? "" :
+                compareFlag(reference[conversion], out, outBytes[conversion], "  DIFFERS FROM SCALAR"));
+        }
+    }
+    setHalfConvertPath(HALF_PATH_COUNT);
+    for (int conversion = 0; conversion < 4; conversion++)
+        free(reference[conversion]);
+    free(halves);
+    free(floats);
+    free(out);
+}
+
+// Times the transfer functions on 4K RGB float, half and 16-bit inputs
+// against the exact formulas
+static void benchmarkTransfer(unsigned int runs)
+{
+    const unsigned int benchWidth = 3840, benchHeight = 2160;
+    const float maxError = 0.25f / 1023.0f;                 // a quarter of a 10-bit step
+    const char *names[4] = {"exact", "float", "half", "unorm16"};
+    size_t count = (size_t)benchWidth * benchHeight * 3;
+    size_t exactCount = count / 64;                         // the formulas are too slow for the whole frame
+    float *floats = (float *)malloc(count * sizeof(float));
+    unsigned short *halves = (unsigned short *)malloc(count * sizeof(unsigned short));
+    unsigned short *unorms = (unsigned short *)malloc(count * sizeof(unsigned short));
+    float *out = (float *)malloc(count * sizeof(float));
+    BenchTimer timer;
+
+    if (!floats || !halves || !unorms || !out) {
+        printf("ERROR: Out of memory for the transfer function benchmark\n");
+        free(floats);
+        free(halves);
+        free(unorms);
+        free(out);
+        return;
+    }
+    unsigned int seed = 1;
+    for (size_t i = 0; i < count; i++) {
+        unsigned int r = benchRandom(&seed);
+        unorms[i] = (unsigned short)(r >> 16);
+        floats[i] = (r >> 8) / 16777216.0f;
+    }
+    floatToHalf(floats, halves, count);
+    initBenchTimer(&timer);
+    printf("Transfer functions of %ux%u RGB within %.2e, best of %u runs\n", benchWidth, benchHeight, maxError, runs);
+    for (int function = 0; function < TRANSFER_COUNT; function++) {
+        float param = (function == TRANSFER_POWER) ? 1.0f / hlgSystemGamma(1000.0f) : 1.0f;
+        TransferLut lut;
+        startBenchRun(&timer);
+        bool built = buildTransferLut(&lut, function, maxError, param);
+        double buildMs = endBenchRun(&timer);
+        if (!built)
+            continue;
+        printf("  %s%s: %u segments per octave from 2^%d, %u segments, %.1f KB, error %.2e, built in %.1f ms\n",
+            transferName(function), function == TRANSFER_POWER ? " 1/1.2" : "", 1 << lut.bits, lut.minExponent,
+            (unsigned int)lut.count, (lut.count + 1) * 2 * sizeof(float) / 1024.0, lut.maxError, buildMs);
+        for (int input = 0; input < 4; input++) {
+            size_t n = input == 0 ? exactCount : count;
+            resetBenchTimer(&timer);
+            for (unsigned int run = 0; run < runs; run++) {
+                startBenchRun(&timer);
+                switch (input) {
+                    case 0:
+                        for (size_t i = 0; i < n; i++)
+                            out[i] = (float)transferExact(function, floats[i], param);
+                        break;
+                    case 1:
+                        transferFloat(&lut, floats, out, n);
+                        break;
+                    case 2:
+                        transferHalf(&lut, halves, out, n);
+                        break;
+                    case 3:
+                        transferUnorm16(&lut, unorms, out, n);
+                        break;
+                }
+                endBenchRun(&timer);
+            }
+            // every 64th value against the formula
+            double error = 0.0;
+            for (size_t i = 0; input > 0 && i < n; i += 64) {
+                float h = floats[i];
+                if (input == 2)
+                    halfToFloat(halves + i, &h, 1);
+                double x = (input == 3) ? unorms[i] / 65535.0 : h;
+                double e = fabs(out[i] - transferExact(function, x, param));
+                if (e > error)
+                    error = e;
+            }
+            printf("    %-8s %8.2f ms  %6.2f Gvalue/s", names[input], timer.best * count / n, n / (timer.best * 1e6));
+            if (input > 0)
+                printf("  error %.2e%s", error, boundFlag(error, maxError, "  OVER THE BOUND"));
+            printf("\n");
+        }
+        freeTransferLut(&lut);
+    }
+    free(floats);
+    free(halves);
+    free(unorms);
+    free(out);
+}
+
+// Times the fused gamut conversions on a 4K RGBA float frame for every
+// mapping, checks them against the double precision reference
+static void benchmarkGamut(unsigned int runs)
+{
+    const unsigned int benchWidth = 3840, benchHeight = 2160;
+    const int pairs[3][2] = {{GAMUT_BT2020, GAMUT_BT709}, {GAMUT_BT2020, GAMUT_DISPLAY_P3}, {GAMUT_DISPLAY_P3, GAMUT_BT709}};
+    size_t pixels = (size_t)benchWidth * benchHeight;
+    float *src = (float *)malloc(pixels * 4 * sizeof(float));
+    float *out = (float *)malloc(pixels * 4 * sizeof(float));
+    BenchTimer timer;
+
+    if (!src || !out) {
+        printf("ERROR: Out of memory for the gamut benchmark\n");
+        free(src);
+        free(out);
+        return;
+    }
+    // scene linear values up to 4, with some negative ones from earlier conversions
+    unsigned int seed = 1;
+    for (size_t i = 0; i < pixels * 4; i++)
+        src[i] = (benchRandom(&seed) >> 8) / 4194304.0f - 0.1f;
+    initBenchTimer(&timer);
+    printf("Gamut conversion of %ux%u RGBA floats, exposure folded in, best of %u runs\n", benchWidth, benchHeight, runs);
+    for (int pair = 0; pair < 3; pair++) {
+        GamutConversion gamut;
+        setupGamutConversion(&gamut, pairs[pair][0], pairs[pair][1], GAMUT_MAP_NONE, 1.5f);
+        printf("  %s to %s, limits %.3f %.3f %.3f, fused matrix x 1.5:\n", gamutName(gamut.from), gamutName(gamut.to),
+            gamut.limit[0], gamut.limit[1], gamut.limit[2]);
+        for (int row = 0; row < 3; row++)
+            printf("    %9.6f %9.6f %9.6f\n", gamut.matrix[row * 3], gamut.matrix[row * 3 + 1], gamut.matrix[row * 3 + 2]);
+        for (int mapping = 0; mapping < GAMUT_MAP_COUNT; mapping++) {
+            setupGamutConversion(&gamut, pairs[pair][0], pairs[pair][1], mapping, 1.5f);
+            resetBenchTimer(&timer);
+            for (unsigned int run = 0; run < runs; run++) {
+                memcpy(out, src, pixels * 4 * sizeof(float));
+                startBenchRun(&timer);
+                convertGamut(&gamut, out, pixels);
+                endBenchRun(&timer);
+            }
+            // every 16th pixel against the reference, relative to the largest component
+            double error = 0.0;
+            for (size_t i = 0; i < pixels; i += 16) {
+                double rgb[3] = {src[i * 4], src[i * 4 + 1], src[i * 4 + 2]}, ref[3];
+                gamutReference(&gamut, rgb, ref);
+                double scale = 1.0;
+                for (int c = 0; c < 3; c++)
+                    if (fabs(ref[c]) > scale)
+                        scale = fabs(ref[c]);
+                for (int c = 0; c < 3; c++) {
+                    double e = fabs(out[i * 4 + c] - ref[c]) / scale;
+                    if (e > error)
+                        error = e;
+                }
+            }
+            printf("    %-10s %7.2f ms  %6.0f Mpixel/s  error %.2e\n", gamutMappingName(mapping), timer.best,
+                pixels / (timer.best * 1000.0), error);
+        }
+    }
+    free(src);
+    free(out);
+}
+
+// Times a .cube 3D LUT on a 4K RGB 16-bit frame with 1, 2, 4.. threads,
+// checks every pixel against the double precision reference
+static void benchmarkCubeLut(const char *cubeFile, unsigned int runs)
+{
+    const unsigned int benchWidth = 3840, benchHeight = 2160;
+    size_t pixels = (size_t)benchWidth * benchHeight;
+    unsigned short *src = (unsigned short *)malloc(pixels * 3 * sizeof(unsigned short));
+    unsigned int *packed = (unsigned int *)malloc(pixels * sizeof(unsigned int));
+    unsigned int maxThreads = benchThreads(CUBELUT_MAX_THREADS);
+    BenchTimer timer;
+    CubeLut lut;
+
+    if (!loadCubeLut(&lut, cubeFile)) {
+        free(src);
+        free(packed);
+        return;
+    }
+    if (!src || !packed) {
+        printf("ERROR: Out of memory for the 3D LUT benchmark\n");
+        freeCubeLut(&lut);
+        free(src);
+        free(packed);
+        return;
+    }
+    // ramps over the whole cube with noise up to half the range, like a graded frame
+    fillBenchRamp(src, benchWidth, benchHeight, 17);
+    initBenchTimer(&timer);
+    printf("3D LUT %s (%d points per axis%s) on %ux%u RGB 16-bit to RGB10_A2, best of %u runs\n", cubeFile, lut.size,
+        lut.shaperSize ? ", shaper" : "", benchWidth, benchHeight, runs);
+    for (unsigned int threads = 1; threads <= maxThreads; threads *= 2) {
+        resetBenchTimer(&timer);
+        for (unsigned int run = 0; run < runs; run++) {
+            startBenchRun(&timer);
+            cubeLutToRgb10A2(&lut, src, 3, packed, benchWidth, benchHeight, threads);
+            endBenchRun(&timer);
+        }
+        printf("  %2u threads: %8.1f ms  %6.1f Mpixel/s  %6.1f frames/s\n", threads, timer.best,
+            pixels / (timer.best * 1000.0), 1000.0 / timer.best);
+    }
+    // the 10-bit levels against the rounded reference
+    size_t offByOne = 0, worse = 0;
+    for (size_t i = 0; i < pixels; i++) {
+        double in[3], out[3];
+        for (int c = 0; c < 3; c++)
+            in[c] = src[i * 3 + c] / 65535.0;
+        cubeLutReference(&lut, in, out);
+        for (int c = 0; c < 3; c++) {
+            double v = out[c] < 0.0 ? 0.0 : (out[c] > 1.0 ? 1.0 : out[c]);
+            int difference = abs((int)floor(v * 1023.0 + 0.5) - (int)((packed[i] >> (10 * c)) & 0x3ff));
+            if (difference == 1)
+                offByOne++;
+            else if (difference > 1)
+                worse++;
+        }
+    }
+    printf("  against the double precision reference: %u of %u samples 1 level off, %u more%s\n", (unsigned int)offByOne,
+        (unsigned int)(pixels * 3), (unsigned int)worse, boundFlag((double)worse, 0.0, "  OVER 1 LSB"));
+    freeCubeLut(&lut);
+    free(src);
+    free(packed);
+}
+
+// Times the luminance statistics of a 4K RGBA half frame with 1, 2, 4..
+// threads, checks them against a scalar reference
+static void benchmarkLuminanceStats(unsigned int runs)
+{
+    const unsigned int benchWidth = 3840, benchHeight = 2160;
+    const float weights[3] = {0.2126f, 0.7152f, 0.0722f};
+    size_t pixels = (size_t)benchWidth * benchHeight;
+    float *scene = (float *)malloc(pixels * 4 * sizeof(float));
+    unsigned short *src = (unsigned short *)malloc(pixels * 4 * sizeof(unsigned short));
+    unsigned int maxThreads = benchThreads(LUMSTATS_MAX_THREADS);
+    BenchTimer timer;
+    LuminanceStats stats;
+
+    if (!scene || !src) {
+        printf("ERROR: Out of memory for the luminance statistics benchmark\n");
+        free(scene);
+        free(src);
+        return;
+    }
+    // colors from 2^-18 to 2^16 evenly in stops, some black and some negative from a gamut conversion
+    unsigned int seed = 1;
+    for (size_t i = 0; i < pixels * 4; i++) {
+        unsigned int r = benchRandom(&seed);
+        if ((r >> 24) < 4)
+            scene[i] = 0.0f;
+        else if ((r >> 24) < 8)
+            scene[i] = -0.01f * (r >> 24);
+        else
+            scene[i] = (float)ldexp(1.0, (int)((r >> 8) % 34) - 18) * (1.0f + (r & 0xff) / 256.0f);
+    }
+    floatToHalf(scene, src, pixels * 4);
+    halfToFloat(src, scene, pixels * 4);
+    initBenchTimer(&timer);
+    printf("Luminance statistics of %ux%u RGBA half, best of %u runs\n", benchWidth, benchHeight, runs);
+    for (unsigned int threads = 1; threads <= maxThreads; threads *= 2) {
+        resetBenchTimer(&timer);
+        for (unsigned int run = 0; run < runs; run++) {
+            startBenchRun(&timer);
+            computeLuminanceStats(src, pixels, weights, &stats, threads);
+            endBenchRun(&timer);
+        }
+        printf("  %2u threads: %8.2f ms  %6.1f Mpixel/s\n", threads, timer.best, pixels / (timer.best * 1000.0));
+    }
+    // the same luminance in the same order, the bins from the float bits, the sums in double
+    unsigned int *histogram = (unsigned int *)calloc(LUMSTATS_BINS, sizeof(unsigned int));
+    float minimum = 65536.0f * 65536.0f, maximum = 0.0f;
+    double sum = 0.0, logSum = 0.0;
+    for (size_t i = 0; i < pixels && histogram; i++) {
+        const float *p = scene + i * 4;
+        float l = (p[0] > 0.0f ? p[0] : 0.0f) * weights[0] + (p[1] > 0.0f ? p[1] : 0.0f) * weights[1];
+        l += (p[2] > 0.0f ? p[2] : 0.0f) * weights[2];
+        int bin = 0;
+        if (l >= ldexp(1.0, LUMSTATS_LOG2_MAX))
+            bin = LUMSTATS_BINS - 1;
+        else if (l >= ldexp(1.0, LUMSTATS_LOG2_MIN)) {
+            int exponent;
+            double mantissa = frexp(l, &exponent);
+            bin = (exponent - 1 - LUMSTATS_LOG2_MIN) * 8 + (int)((mantissa * 2.0 - 1.0) * 8.0);
+        }
+        histogram[bin]++;
+        minimum = l < minimum ? l : minimum;
+        maximum = l > maximum ? l : maximum;
+        sum += l;
+        logSum += log((double)l + LUMSTATS_LOG_DELTA) / log(2.0);
+    }
+    double mean = sum / pixels, logAverage = pow(2.0, logSum / pixels);
+    unsigned int binsOff = 0;
+    for (int bin = 0; bin < LUMSTATS_BINS && histogram; bin++)
+        binsOff += stats.histogram[bin] != histogram[bin];
+    printf("  min %g (%s), max %g (%s), mean %g (error %.1e), log average %g (error %.1e), %u of %d bins differ%s\n",
+        stats.minimum, stats.minimum == minimum ? "exact" : "DIFFERS", stats.maximum, stats.maximum == maximum ? "exact" : "DIFFERS",
+        stats.mean, fabs(stats.mean - mean) / mean, stats.logAverage, fabs(stats.logAverage - logAverage) / logAverage,
+        binsOff, LUMSTATS_BINS, boundFlag(binsOff, 0.0, "  MISMATCH"));
+    printf("  1%% %g, median %g, 99%% %g\n", luminancePercentile(&stats, 0.01f), luminancePercentile(&stats, 0.5f),
+        luminancePercentile(&stats, 0.99f));
+    free(histogram);
+    free(scene);
+    free(src);
+}
+
+void printBenchUsage()
+{
+    printf("       10bpctest -diffuse in.png out.ppm [bits] [sierra]\n"
+        "  Error diffuses in.png to bits (default 10) per component and writes a PGM/PPM, Floyd-Steinberg by default\n"
+        "       10bpctest -diffusebench [runs]\n"
+        "  Times the error diffusion of an 8K frame on 1, 2, 4.. threads\n"
+        "       10bpctest -halfbench [runs]\n"
+        "  Times the half float conversions of a 4K frame on the scalar, SSE2 and F16C paths\n"
+        "       10bpctest -tonemap in.exr out.ppm [clip|reinhard|hable|aces] [stops] [gamma|pq|hlg]\n"
+        "  Tone maps in.exr on the CPU with automatic exposure (ACES, gamma 2.2 by default) to a 10-bit PPM,\n"
+        "  pq and hlg encode for a 1000 cd/m2 display\n"
+        "       10bpctest -transferbench [runs]\n"
+        "  Times the PQ and HLG tables on float, half and 16-bit inputs against the exact formulas\n"
+        "       10bpctest -gamutbench [runs]\n"
+        "  Times the gamut conversions on a 4K frame and checks them against a double precision reference\n"
+        "       10bpctest -cube in.png lut.cube out.ppm\n"
+        "  Maps in.png through a .cube 3D LUT on the CPU to a 10-bit PPM\n"
+        "       10bpctest -cubebench lut.cube [runs]\n"
+        "  Times the 3D LUT on a 4K frame on 1, 2, 4.. threads and checks it against a double precision reference\n"
+        "       10bpctest -statsbench [runs]\n"
+        "  Times the CPU luminance statistics of a 4K frame on 1, 2, 4.. threads and checks them against a reference\n");
+}
+
+bool runBenchTool(int argc, char *argv[], int i, const ToneMapParams *gamuts, bool fileGamut, int *exitCode)
+{
+    const char *tool = argv[i];
+    bool ok = true;
+
+    if (strcmp(tool, "-diffuse") == 0) {
+        if (i + 2 >= argc) {
+            printf("ERROR: -diffuse needs an input and an output file\n");
+            ok = false;
+        }
+        else {
+            unsigned int bits = (i + 3 < argc) ? atoi(argv[i + 3]) : 10;
+            int kernel = (i + 4 < argc && _stricmp(argv[i + 4], "sierra") == 0) ? DIFFUSE_SIERRA : DIFFUSE_FLOYD_STEINBERG;
+            ok = diffusePngFile(argv[i + 1], argv[i + 2], bits, kernel);
+        }
+    }
+    else if (strcmp(tool, "-tonemap") == 0) {
+        static const char *ops[TONEMAP_COUNT] = {"clip", "reinhard", "hable", "aces"};
+        ToneMapParams params;
+        defaultToneMapParams(&params);
+        params.op = TONEMAP_ACES;
+        params.autoExposure = true;
+        params.gamma = 2.2f;
+        params.sourceGamut = gamuts->sourceGamut;
+        params.displayGamut = gamuts->displayGamut;
+        params.gamutMapping = gamuts->gamutMapping;
+        if (i + 2 >= argc) {
+            printf("ERROR: -tonemap needs an input and an output file\n");
+            ok = false;
+        }
+        if (ok && i + 3 < argc) {
+            for (params.op = 0; params.op < TONEMAP_COUNT && _stricmp(argv[i + 3], ops[params.op]) != 0; params.op++)
+                ;
+            if (params.op == TONEMAP_COUNT) {
+                printf("ERROR: Unknown tone mapping operator %s\n", argv[i + 3]);
+                ok = false;
+            }
+        }
+        if (i + 4 < argc)
+            params.exposure = (float)atof(argv[i + 4]);
+        if (i + 5 < argc && _stricmp(argv[i + 5], "pq") == 0)
+            params.output = TONEMAP_OUTPUT_PQ;
+        else if (i + 5 < argc && _stricmp(argv[i + 5], "hlg") == 0)
+            params.output = TONEMAP_OUTPUT_HLG;
+        else if (i + 5 < argc && atof(argv[i + 5]) > 0.0)
+            params.gamma = (float)atof(argv[i + 5]);
+        ok = ok && toneMapExrFile(argv[i + 1], argv[i + 2], &params, fileGamut);
+    }
+    else if (strcmp(tool, "-cube") == 0) {
+        if (i + 3 >= argc) {
+            printf("ERROR: -cube needs an input, a .cube and an output file\n");
+            ok = false;
+        }
+        else
+            ok = cubeLutPngFile(argv[i + 1], argv[i + 2], argv[i + 3]);
+    }
+    else if (strcmp(tool, "-cubebench") == 0) {
+        if (i + 1 >= argc) {
+            printf("ERROR: -cubebench needs a .cube file\n");
+            ok = false;
+        }
+        else
+            benchmarkCubeLut(argv[i + 1], benchRuns(argc, argv, i + 1, 5));
+    }
+    else if (strcmp(tool, "-diffusebench") == 0)
+        benchmarkDiffusion(benchRuns(argc, argv, i, 3));
+    else if (strcmp(tool, "-halfbench") == 0)
+        benchmarkHalfConversion(benchRuns(argc, argv, i, 5));
+    else if (strcmp(tool, "-transferbench") == 0)
+        benchmarkTransfer(benchRuns(argc, argv, i, 5));
+    else if (strcmp(tool, "-gamutbench") == 0)
+        benchmarkGamut(benchRuns(argc, argv, i, 5));
+    else if (strcmp(tool, "-statsbench") == 0)
+        benchmarkLuminanceStats(benchRuns(argc, argv, i, 5));
+    else
+        return false;
+    *exitCode = ok ? 0 : 1;
+    return true;
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// Sorts the samples
+static void drawBenchTimes(double *ms, unsigned int count, DrawBenchTimes *times)
+{
+    double sum = 0.0;
+
+    qsort(ms, count, sizeof(double), compareDoubles);
+    for (unsigned int i = 0; i < count; i++)
+        sum += ms[i];
+    times->mean = sum / count;
+    times->median = (count % 2) ? ms[count / 2] : (ms[count / 2 - 1] + ms[count / 2]) / 2.0;
+    times->max = ms[count - 1];
+}
+
+// Quoted, quotes doubled
+static void writeCsvString(FILE *file, const char *s)
+{
+    fputc('"', file);
+    for (; s && *s; s++) {
+        if (*s == '"')
+            fputc('"', file);
+        fputc(*s, file);
+    }
+    fputc('"', file);
+}
+
+static void writeJsonString(FILE *file, const char *s)
+{
+    fputc('"', file);
+    for (; s && *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fprintf(file, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20)
+            fprintf(file, "\\u%04x", *s);
+        else
+            fputc(*s, file);
+    }
+    fputc('"', file);
+}
+
+// Every row carries the driver strings, so reports of several drivers can
+// simply be concatenated
+static bool writeDrawBenchReport(const char *reportFile, const DrawBenchTarget *target, const DrawBenchResult *results,
+                                 int count, int winWidth, int winHeight, unsigned int frames, bool timed)
+{
+    const char *vendor = (const char *)glGetString(GL_VENDOR);
+    const char *renderer = (const char *)glGetString(GL_RENDERER);
+    const char *version = (const char *)glGetString(GL_VERSION);
+    const char *ext = strrchr(reportFile, '.');
+    bool json = ext && _stricmp(ext, ".json") == 0;
+    FILE *file = fopen(reportFile, "w");
+
+    if (!file) {
+        printf("ERROR: Unable to create %s\n", reportFile);
+        return false;
+    }
+    if (json) {
+        fprintf(file, "{\n  \"vendor\": ");
+        writeJsonString(file, vendor);
+        fprintf(file, ",\n  \"renderer\": ");
+        writeJsonString(file, renderer);
+        fprintf(file, ",\n  \"version\": ");
+        writeJsonString(file, version);
+        fprintf(file, ",\n  \"window\": \"%s\",\n  \"windowWidth\": %d,\n  \"windowHeight\": %d,\n"
+            "  \"fboWidth\": %u,\n  \"fboHeight\": %u,\n  \"frames\": %u,\n  \"warmup\": %d,\n  \"gpuTimer\": %s,\n"
+            "  \"results\": [\n", target->windowKind, winWidth, winHeight, target->fboWidth, target->fboHeight, frames,
+            DRAWBENCH_WARMUP, timed ? "true" : "false");
+        for (int i = 0; i < count; i++) {
+            const DrawBenchResult *r = &results[i];
+            const DrawBenchTimes *times[4] = {&r->submit, &r->finish, &r->gpu, &r->frame};
+            static const char *names[4] = {"submitMs", "finishMs", "gpuMs", "frameMs"};
+            fprintf(file, "    {\"mode\": ");
+            writeJsonString(file, target->modeNames[r->mode]);
+            fprintf(file, ", \"fbo\": %s, \"frames\": %u", r->fbo ? "true" : "false", r->frames);
+            for (int t = 0; t < 4; t++) {
+                if (r->frames && (t != 2 || timed))
+                    fprintf(file, ", \"%s\": {\"mean\": %.4f, \"median\": %.4f, \"max\": %.4f}", names[t],
+                        times[t]->mean, times[t]->median, times[t]->max);
+                else
+                    fprintf(file, ", \"%s\": null", names[t]);
+            }
+            fprintf(file, "}%s\n", i + 1 < count ? "," : "");
+        }
+        fprintf(file, "  ]\n}\n");
+    }
+    else {
+        fprintf(file, "vendor,renderer,version,window,window_width,window_height,fbo_width,fbo_height,mode,fbo,frames,"
+            "submit_mean_ms,submit_median_ms,submit_max_ms,finish_mean_ms,finish_median_ms,finish_max_ms,"
+            "gpu_mean_ms,gpu_median_ms,gpu_max_ms,frame_mean_ms,frame_median_ms,frame_max_ms\n");
+        for (int i = 0; i < count; i++) {
+            const DrawBenchResult *r = &results[i];
+            const DrawBenchTimes *times[4] = {&r->submit, &r->finish, &r->gpu, &r->frame};
+            writeCsvString(file, vendor);
+            fputc(',', file);
+            writeCsvString(file, renderer);
+            fputc(',', file);
+            writeCsvString(file, version);
+            fprintf(file, ",%s,%d,%d,%u,%u,", target->windowKind, winWidth, winHeight, target->fboWidth, target->fboHeight);
+            writeCsvString(file, target->modeNames[r->mode]);
+            fprintf(file, ",%d,%u", r->fbo ? 1 : 0, r->frames);
+            // empty fields for what was not measured
+            for (int t = 0; t < 4; t++) {
+                if (r->frames && (t != 2 || timed))
+                    fprintf(file, ",%.4f,%.4f,%.4f", times[t]->mean, times[t]->median, times[t]->max);
+                else
+                    fprintf(file, ",,,");
+            }
+            fputc('\n', file);
+        }
+    }
+    bool ok = ferror(file) == 0;
+    if (fclose(file) != 0 || !ok) {
+        printf("ERROR: Unable to write %s\n", reportFile);
+        return false;
+    }
+    printf("Report written to %s\n", reportFile);
+    return true;
+}
+
+bool runDrawBench(const DrawBenchTarget *target, unsigned int frames, const char *reportFile)
+{
+    DrawBenchResult *results = (DrawBenchResult *)calloc(target->modeCount * 2, sizeof(DrawBenchResult));
+    double *samples = (double *)malloc(frames * 4 * sizeof(double));
+    LARGE_INTEGER t0, t1, t2, t3;
+    BenchTimer timer;
+    GpuTimer gpuTimer;
+    RECT rect;
+    MSG msg;
+    bool quit = false;
+    int count = 0;
+
+    if (!results || !samples) {
+        printf("ERROR: Out of memory for the draw benchmark\n");
+        free(results);
+        free(samples);
+        return false;
+    }
+    bool timed = initGpuTimer(&gpuTimer);
+    GetClientRect(target->hWnd, &rect);
+    initBenchTimer(&timer);
+    printf("Draw benchmark on %s, %s, %s window %dx%d, FBO %ux%u, %u frames per mode%s\n",
+        (const char *)glGetString(GL_RENDERER), (const char *)glGetString(GL_VERSION), target->windowKind, rect.right,
+        rect.bottom, target->fboWidth, target->fboHeight, frames, timed ? "" : ", no timer queries");
+    printf("  %-17s %3s %22s %22s %22s %10s\n", "", "FBO", "submit ms mean/median", "finish ms mean/median",
+        "GPU ms mean/median", "frames/s");
+
+    for (int mode = 0; mode < target->modeCount && !quit; mode++) {
+        for (int fboOn = 0; fboOn < 2 && !quit; fboOn++) {
+            DrawBenchResult *result = &results[count++];
+            result->mode = mode;
+            result->fbo = fboOn != 0;
+            if (fboOn && !target->hasFbo) {
+                printf("  %-17s %3s %22s\n", target->modeNames[mode], "on", "skipped, no framebuffer objects");
+                continue;
+            }
+            target->setMode(mode, fboOn != 0);
+            for (unsigned int frame = 0; frame < DRAWBENCH_WARMUP + frames; frame++) {
+                // the window stays responsive; it is validated after every frame, so the demo's WM_PAINT draws nothing
+                while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+                    if (msg.message == WM_QUIT)
+                        quit = true;
+                    TranslateMessage(&msg);
+                    DispatchMessage(&msg);
+                }
+                if (quit)
+                    break;
+                if (wglGetCurrentContext() != target->hRC)
+                    wglMakeCurrent(target->hDC, target->hRC);
+                QueryPerformanceCounter(&t0);
+                beginGpuTimer(&gpuTimer);
+                target->draw(rect.right, rect.bottom);
+                endGpuTimer(&gpuTimer);
+                QueryPerformanceCounter(&t1);
+                glFinish();
+                QueryPerformanceCounter(&t2);
+                SwapBuffers(target->hDC);
+                QueryPerformanceCounter(&t3);
+                ValidateRect(target->hWnd, NULL);
+                finishGpuTimer(&gpuTimer);
+                if (frame >= DRAWBENCH_WARMUP) {
+                    unsigned int i = frame - DRAWBENCH_WARMUP;
+                    samples[i] = benchMs(&timer, &t0, &t1);
+                    samples[frames + i] = benchMs(&timer, &t1, &t2);
+                    samples[frames * 2 + i] = gpuTimer.lastMs;
+                    samples[frames * 3 + i] = benchMs(&timer, &t0, &t3);
+                }
+            }
+            if (quit) {
+                count--;
+                break;
+            }
+            result->frames = frames;
+            drawBenchTimes(samples, frames, &result->submit);
+            drawBenchTimes(samples + frames, frames, &result->finish);
+            drawBenchTimes(samples + frames * 2, frames, &result->gpu);
+            drawBenchTimes(samples + frames * 3, frames, &result->frame);
+            printf("  %-17s %3s %10.3f /%10.3f %10.3f /%10.3f ", target->modeNames[mode], fboOn ? "on" : "off",
+                result->submit.mean, result->submit.median, result->finish.mean, result->finish.median);
+            if (timed)
+                printf("%10.3f /%10.3f ", result->gpu.mean, result->gpu.median);
+            else
+                printf("%22s ", "-");
+            printf("%10.1f\n", 1000.0 / result->frame.mean);
+        }
+    }
+    if (quit)
+        printf("Draw benchmark stopped, the report has the modes finished so far\n");
+    bool ok = writeDrawBenchReport(reportFile, target, results, count, rect.right, rect.bottom, frames, timed);
+    deleteGpuTimer(&gpuTimer);
+    free(results);
+    free(samples);
+    return ok;
+}
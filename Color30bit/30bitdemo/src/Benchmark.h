@@ -0,0 +1,45 @@
+//
+// Benchmark.h
+//
+// The command line tools that run instead of the demo: the file conversions
+// (-diffuse, -tonemap, -cube), the CPU benchmarks of the helper modules and
+// the timing loop and report of the draw benchmark, whose window and draws
+// stay with the demo. The benchmarks share one seeded test image generator,
+// a best of N runs timer and the checks against their references, so their
+// numbers compare across runs and machines.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+typedef struct _ToneMapParams ToneMapParams;
+
+typedef struct _DrawBenchTarget {
+    HWND hWnd;                          // shown, with the context current and vsync off
+    HDC hDC;
+    HGLRC hRC;
+    const char *windowKind;             // "10bpc" or "8bpc", for the report
+    const char * const *modeNames;      // modeCount draw modes
+    int modeCount;
+    bool hasFbo;                        // false skips the off-screen runs
+    unsigned int fboWidth;
+    unsigned int fboHeight;
+    void (*setMode)(int mode, bool fbo);    // the next draws are of mode, off-screen with fbo
+    void (*draw)(int width, int height);    // draws a frame into the client area
+} DrawBenchTarget;
+
+// Prints the usage lines of the tools
+extern void printBenchUsage();
+// Runs the tool named by argv[i] with the arguments after it. Returns false
+// if argv[i] is not a tool, otherwise exitCode is what main returns. The
+// gamuts and mapping of -tonemap come from gamuts, the source one from the
+// chromaticities of the file with fileGamut.
+extern bool runBenchTool(int argc, char *argv[], int i, const ToneMapParams *gamuts, bool fileGamut, int *exitCode);
+// Draws every mode with off-screen rendering off and on for frames frames
+// each, after a few warm-up frames, and writes the times to reportFile
+// (.csv, or .json). Quitting (ESC) stops it early, the modes finished so far
+// are written. Returns false if the report can not be written.
+extern bool runDrawBench(const DrawBenchTarget *target, unsigned int frames, const char *reportFile);
+
+#endif
@@ -0,0 +1,626 @@
+//
+// CubeLut.cpp
+//
+// .cube parser, GLSL 3D texture pass and SSE2 tetrahedral interpolation
+//
+#include <windows.h>
+#include <process.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <emmintrin.h>
+#include <gl/gl.h>
+#include <GL/glext.h>
+#include "framebufferObject.h"
+#include "glShaderUtil.h"
+#include "CubeLut.h"
+
+#define CUBELUT_BLOCK_ROWS      16      // rows a thread takes at a time
+
+static const char *vertexSource =
+    "void main()\n"
+    "{\n"
+    "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+    "    gl_Position = ftransform();\n"
+    "}\n";
+
+//
+// The shaper is filtered linearly, its positions moved to the texel centers
+// so that 0 and 1 hit the first and last entries. The table is read with
+// nearest filtering at the 4 corners of the tetrahedron the position falls
+// in, chosen and weighted as in cubeLut4.
+//
+static const char *lutSource =
+    "uniform sampler2D image;\n"
+    "uniform sampler1D shaper;\n"
+    "uniform sampler3D table;\n"
+    "uniform int useShaper;\n"
+    "uniform vec3 shaperMin;\n"
+    "uniform vec3 shaperScale;\n"
+    "uniform float shaperSize;\n"
+    "uniform vec3 domainMin;\n"
+    "uniform vec3 domainScale;\n"
+    "uniform float size;\n"
+    "vec3 entry(vec3 p)\n"
+    "{\n"
+    "    return texture3D(table, (p + 0.5) / size).rgb;\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "    vec4 c = texture2D(image, gl_TexCoord[0].st);\n"
+    "    vec3 x = c.rgb;\n"
+    "    if (useShaper != 0) {\n"
+    "        x = clamp((x - shaperMin) * shaperScale, 0.0, 1.0);\n"
+    "        x = (x * (shaperSize - 1.0) + 0.5) / shaperSize;\n"
+    "        x = vec3(texture1D(shaper, x.r).r, texture1D(shaper, x.g).g, texture1D(shaper, x.b).b);\n"
+    "    }\n"
+    "    x = clamp((x - domainMin) * domainScale, 0.0, 1.0) * (size - 1.0);\n"
+    "    vec3 i = min(floor(x), vec3(size - 2.0));\n"
+    "    vec3 f = x - i;\n"
+    "    vec3 a, m;\n"
+    "    if (f.r >= f.g && f.r >= f.b)\n"
+    "        a = vec3(1.0, 0.0, 0.0);\n"
+    "    else if (f.g >= f.b)\n"
+    "        a = vec3(0.0, 1.0, 0.0);\n"
+    "    else\n"
+    "        a = vec3(0.0, 0.0, 1.0);\n"
+    "    if (f.r < f.g && f.r < f.b)\n"
+    "        m = vec3(1.0, 0.0, 0.0);\n"
+    "    else if (f.g <= f.b)\n"
+    "        m = vec3(0.0, 1.0, 0.0);\n"
+    "    else\n"
+    "        m = vec3(0.0, 0.0, 1.0);\n"
+    "    float f1 = max(f.r, max(f.g, f.b));\n"
+    "    float f2 = max(min(f.r, f.g), min(max(f.r, f.g), f.b));\n"
+    "    float f3 = min(f.r, min(f.g, f.b));\n"
+    "    vec3 rgb = (1.0 - f1) * entry(i) + (f1 - f2) * entry(i + a) + (f2 - f3) * entry(i + 1.0 - m) + f3 * entry(i + 1.0);\n"
+    "    gl_FragColor = vec4(rgb, c.a);\n"
+    "}\n";
+
+//
+// Parser
+//
+
+static bool parseFloats(const char *s, float *values, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        char *end;
+        values[i] = (float)strtod(s, &end);
+        if (end == s)
+            return false;
+        s = end;
+    }
+    while (isspace((unsigned char)*s))
+        s++;
+    return *s == '\0';
+}
+
+// Input range of a channel to a grid position of 0 .. size - 1
+static double gridPosition(double x, double min, double max, int size)
+{
+    x = (x - min) / (max - min);
+    if (!(x > 0.0))
+        x = 0.0;
+    if (x > 1.0)
+        x = 1.0;
+    return x * (size - 1);
+}
+
+static double shape(const CubeLut *lut, double x, int channel)
+{
+    double p;
+    int i;
+
+    if (!lut->shaperSize)
+        return x;
+    p = gridPosition(x, lut->shaperMin[channel], lut->shaperMax[channel], lut->shaperSize);
+    i = (int)p;
+    if (i > lut->shaperSize - 2)
+        i = lut->shaperSize - 2;
+    p -= i;
+    return lut->shaper[i * 3 + channel] * (1.0 - p) + lut->shaper[(i + 1) * 3 + channel] * p;
+}
+
+static bool buildGrid(CubeLut *lut)
+{
+    const int stride[3] = {3, 3 * lut->size, 3 * lut->size * lut->size};
+    int channel, value;
+
+    lut->grid = (CubeLutGrid *)malloc(3 * 65536 * sizeof(CubeLutGrid));
+    if (!lut->grid)
+        return false;
+    for (channel = 0; channel < 3; channel++) {
+        for (value = 0; value < 65536; value++) {
+            CubeLutGrid *grid = lut->grid + channel * 65536 + value;
+            double p = gridPosition(shape(lut, value / 65535.0, channel), lut->domainMin[channel], lut->domainMax[channel],
+                lut->size);
+            int i = (int)p;
+            if (i > lut->size - 2)
+                i = lut->size - 2;
+            grid->offset = i * stride[channel];
+            grid->fraction = (float)(p - i);
+        }
+    }
+    return true;
+}
+
+//
+// Keywords may come in any order before the data. A shaper comes before the
+// 3D table. DOMAIN_MIN/MAX is the range of the only table of a file, or of
+// the 3D table of a file that has both.
+//
+bool loadCubeLut(CubeLut *lut, const char *fileName)
+{
+    char line[1024], keyword[64];
+    float domain[2][3] = {{0.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 1.0f}};
+    float range[2];
+    size_t shaperRead = 0, tableRead = 0, tableCount = 0;
+    int lineNumber = 0, c;
+    bool ok = true;
+    FILE *file;
+
+    memset(lut, 0, sizeof(CubeLut));
+    for (c = 0; c < 3; c++) {
+        lut->shaperMax[c] = 1.0f;
+        lut->domainMax[c] = 1.0f;
+    }
+    file = fopen(fileName, "r");
+    if (!file) {
+        printf("ERROR: Unable to open %s\n", fileName);
+        return false;
+    }
+    while (ok && fgets(line, sizeof(line), file)) {
+        char *s = line;
+        size_t length = strlen(line);
+        lineNumber++;
+        while (length && isspace((unsigned char)line[length - 1]))
+            line[--length] = '\0';
+        while (isspace((unsigned char)*s))
+            s++;
+        if (*s == '\0' || *s == '#')
+            continue;
+        if (isdigit((unsigned char)*s) || *s == '-' || *s == '+' || *s == '.') {
+            float *entry;
+            if (shaperRead < (size_t)lut->shaperSize)
+                entry = lut->shaper + 3 * shaperRead++;
+            else if (tableRead < tableCount)
+                entry = lut->table + 3 * tableRead++;
+            else {
+                printf("ERROR: %s line %d: more entries than LUT_1D_SIZE and LUT_3D_SIZE give\n", fileName, lineNumber);
+                ok = false;
+                break;
+            }
+            if (!parseFloats(s, entry, 3)) {
+                printf("ERROR: %s line %d: expected 3 numbers\n", fileName, lineNumber);
+                ok = false;
+            }
+            continue;
+        }
+        if (shaperRead || tableRead) {
+            printf("ERROR: %s line %d: keyword after the table entries\n", fileName, lineNumber);
+            ok = false;
+            break;
+        }
+        if (sscanf(s, "%63s", keyword) != 1)
+            continue;
+        s += strlen(keyword);
+        if (strcmp(keyword, "TITLE") == 0) {
+            char *first = strchr(s, '"'), *last = strrchr(s, '"');
+            if (first && last > first) {
+                size_t titleLength = last - first - 1;
+                if (titleLength >= sizeof(lut->title))
+                    titleLength = sizeof(lut->title) - 1;
+                memcpy(lut->title, first + 1, titleLength);
+            }
+        }
+        else if (strcmp(keyword, "LUT_1D_SIZE") == 0) {
+            int size = atoi(s);
+            if (lut->shaper || size < 2 || size > CUBELUT_MAX_SHAPER) {
+                printf("ERROR: %s line %d: LUT_1D_SIZE must be 2 to %d and given once\n", fileName, lineNumber,
+                    CUBELUT_MAX_SHAPER);
+                ok = false;
+            }
+            else {
+                lut->shaperSize = size;
+                lut->shaper = (float *)malloc(3 * size * sizeof(float));
+            }
+        }
+        else if (strcmp(keyword, "LUT_3D_SIZE") == 0) {
+            int size = atoi(s);
+            if (lut->table || size < 2 || size > CUBELUT_MAX_SIZE) {
+                printf("ERROR: %s line %d: LUT_3D_SIZE must be 2 to %d and given once\n", fileName, lineNumber,
+                    CUBELUT_MAX_SIZE);
+                ok = false;
+            }
+            else {
+                lut->size = size;
+                tableCount = (size_t)size * size * size;
+                lut->table = (float *)malloc((3 * tableCount + 1) * sizeof(float));
+            }
+        }
+        else if (strcmp(keyword, "DOMAIN_MIN") == 0 || strcmp(keyword, "DOMAIN_MAX") == 0) {
+            if (!parseFloats(s, domain[keyword[8] == 'A'], 3)) {
+                printf("ERROR: %s line %d: %s needs 3 numbers\n", fileName, lineNumber, keyword);
+                ok = false;
+            }
+        }
+        else if (strcmp(keyword, "LUT_1D_INPUT_RANGE") == 0 || strcmp(keyword, "LUT_3D_INPUT_RANGE") == 0) {
+            if (!parseFloats(s, range, 2)) {
+                printf("ERROR: %s line %d: %s needs 2 numbers\n", fileName, lineNumber, keyword);
+                ok = false;
+            }
+            for (c = 0; ok && c < 3; c++) {
+                (keyword[4] == '1' ? lut->shaperMin : lut->domainMin)[c] = range[0];
+                (keyword[4] == '1' ? lut->shaperMax : lut->domainMax)[c] = range[1];
+            }
+        }
+        // Other keywords, e.g. LUT_IN_VIDEO_RANGE, are ignored
+        if (ok && ((lut->shaperSize && !lut->shaper) || (lut->size && !lut->table))) {
+            printf("ERROR: Out of memory for %s\n", fileName);
+            ok = false;
+        }
+    }
+    fclose(file);
+
+    if (ok && !lut->shaperSize && !lut->size) {
+        printf("ERROR: %s has neither LUT_1D_SIZE nor LUT_3D_SIZE\n", fileName);
+        ok = false;
+    }
+    if (ok && (shaperRead < (size_t)lut->shaperSize || tableRead < tableCount)) {
+        printf("ERROR: %s ends after %u of %u entries\n", fileName, (unsigned int)(shaperRead + tableRead),
+            (unsigned int)(lut->shaperSize + tableCount));
+        ok = false;
+    }
+    for (c = 0; ok && c < 3; c++) {
+        (lut->size ? lut->domainMin : lut->shaperMin)[c] = domain[0][c];
+        (lut->size ? lut->domainMax : lut->shaperMax)[c] = domain[1][c];
+        if (!(lut->shaperMax[c] > lut->shaperMin[c]) || !(lut->domainMax[c] > lut->domainMin[c])) {
+            printf("ERROR: %s has an empty input range\n", fileName);
+            ok = false;
+        }
+    }
+    // A 1D table alone goes through an identity 3D table, which interpolates exactly
+    if (ok && !lut->size) {
+        lut->size = 2;
+        lut->table = (float *)malloc((3 * 8 + 1) * sizeof(float));
+        if (lut->table) {
+            for (c = 0; c < 8; c++) {
+                lut->table[c * 3] = (float)(c & 1);
+                lut->table[c * 3 + 1] = (float)((c >> 1) & 1);
+                lut->table[c * 3 + 2] = (float)(c >> 2);
+            }
+        }
+    }
+    if (ok && lut->table)
+        lut->table[3 * (size_t)lut->size * lut->size * lut->size] = 0.0f;
+    if (ok && (!lut->table || !buildGrid(lut))) {
+        printf("ERROR: Out of memory for %s\n", fileName);
+        ok = false;
+    }
+    if (!ok)
+        freeCubeLut(lut);
+    return ok;
+}
+
+void freeCubeLut(CubeLut *lut)
+{
+    free(lut->shaper);
+    free(lut->table);
+    free(lut->grid);
+    memset(lut, 0, sizeof(CubeLut));
+}
+
+//
+// Tetrahedral interpolation: of the 6 tetrahedra of a cell, the one with the
+// largest fraction's axis first and the smallest's last holds the point. Its
+// corners are the cell origin, one step along the largest axis, one more along
+// the middle axis, and the opposite corner.
+//
+void cubeLutReference(const CubeLut *lut, const double rgb[3], double out[3])
+{
+    const int stride[3] = {3, 3 * lut->size, 3 * lut->size * lut->size};
+    double f[3];
+    int base = 0, order[3], c;
+
+    for (c = 0; c < 3; c++) {
+        double p = gridPosition(shape(lut, rgb[c], c), lut->domainMin[c], lut->domainMax[c], lut->size);
+        int i = (int)p;
+        if (i > lut->size - 2)
+            i = lut->size - 2;
+        f[c] = p - i;
+        base += i * stride[c];
+    }
+    // Ties go the same way as in cubeLut4, either way the weights of the tied corners are 0
+    order[0] = (f[0] >= f[1] && f[0] >= f[2]) ? 0 : (f[1] >= f[2] ? 1 : 2);
+    order[2] = (f[0] < f[1] && f[0] < f[2]) ? 0 : (f[1] <= f[2] ? 1 : 2);
+    order[1] = 3 - order[0] - order[2];
+
+    const float *c0 = lut->table + base;
+    const float *c1 = c0 + stride[order[0]];
+    const float *c2 = c1 + stride[order[1]];
+    const float *c3 = c0 + stride[0] + stride[1] + stride[2];
+    double w0 = 1.0 - f[order[0]], w1 = f[order[0]] - f[order[1]], w2 = f[order[1]] - f[order[2]], w3 = f[order[2]];
+    for (c = 0; c < 3; c++)
+        out[c] = w0 * c0[c] + w1 * c1[c] + w2 * c2[c] + w3 * c3[c];
+}
+
+typedef struct _CubeLutJob {
+    const CubeLut *lut;
+    const unsigned short *src;
+    unsigned int channels;
+    unsigned int *dst;
+    unsigned int width;
+    unsigned int height;
+    volatile LONG nextBlock;            // rows are handed out CUBELUT_BLOCK_ROWS at a time
+} CubeLutJob;
+
+//
+// 4 pixels: the tetrahedron of each is chosen with compares on the fraction
+// vectors, then each pixel sums its 4 corners, RGB in one vector, and the
+// results are transposed to red, green and blue vectors for the packing.
+//
+static __m128i cubeLut4(const CubeLut *lut, const unsigned short *src, unsigned int channels)
+{
+    const CubeLutGrid *grid = lut->grid;
+    const int strideG = 3 * lut->size, strideB = 3 * lut->size * lut->size;
+    const __m128i strideR4 = _mm_set1_epi32(3), strideG4 = _mm_set1_epi32(strideG), strideB4 = _mm_set1_epi32(strideB);
+    const int corner = 3 + strideG + strideB;
+    const unsigned int green = channels >= 3 ? 1 : 0, blue = channels >= 3 ? 2 : 0;
+    const CubeLutGrid *gr[4], *gg[4], *gb[4];
+    float w[4][4];
+    int offsetA[4], offsetB[4];
+    int k;
+
+    for (k = 0; k < 4; k++) {
+        const unsigned short *p = src + k * channels;
+        gr[k] = grid + p[0];
+        gg[k] = grid + 65536 + p[green];
+        gb[k] = grid + 2 * 65536 + p[blue];
+    }
+    // Built from registers, a vector load of 4 separate stores would stall
+    __m128 r = _mm_setr_ps(gr[0]->fraction, gr[1]->fraction, gr[2]->fraction, gr[3]->fraction);
+    __m128 g = _mm_setr_ps(gg[0]->fraction, gg[1]->fraction, gg[2]->fraction, gg[3]->fraction);
+    __m128 b = _mm_setr_ps(gb[0]->fraction, gb[1]->fraction, gb[2]->fraction, gb[3]->fraction);
+    __m128 rMax = _mm_and_ps(_mm_cmpge_ps(r, g), _mm_cmpge_ps(r, b));
+    __m128 gMax = _mm_andnot_ps(rMax, _mm_cmpge_ps(g, b));
+    __m128 bMax = _mm_andnot_ps(_mm_or_ps(rMax, gMax), _mm_castsi128_ps(_mm_set1_epi32(-1)));
+    __m128 rMin = _mm_and_ps(_mm_cmplt_ps(r, g), _mm_cmplt_ps(r, b));
+    __m128 gMin = _mm_andnot_ps(rMin, _mm_cmple_ps(g, b));
+    __m128 bMin = _mm_andnot_ps(_mm_or_ps(rMin, gMin), _mm_castsi128_ps(_mm_set1_epi32(-1)));
+    __m128i a = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_castps_si128(rMax), strideR4),
+        _mm_and_si128(_mm_castps_si128(gMax), strideG4)), _mm_and_si128(_mm_castps_si128(bMax), strideB4));
+    __m128i m = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_castps_si128(rMin), strideR4),
+        _mm_and_si128(_mm_castps_si128(gMin), strideG4)), _mm_and_si128(_mm_castps_si128(bMin), strideB4));
+    _mm_storeu_si128((__m128i *)offsetA, a);
+    _mm_storeu_si128((__m128i *)offsetB, _mm_sub_epi32(_mm_set1_epi32(corner), m));
+    // Largest, middle (exact, no rounding) and smallest fraction
+    __m128 f1 = _mm_max_ps(r, _mm_max_ps(g, b));
+    __m128 f2 = _mm_max_ps(_mm_min_ps(r, g), _mm_min_ps(_mm_max_ps(r, g), b));
+    __m128 f3 = _mm_min_ps(r, _mm_min_ps(g, b));
+    __m128 w0 = _mm_sub_ps(_mm_set1_ps(1.0f), f1), w1 = _mm_sub_ps(f1, f2), w2 = _mm_sub_ps(f2, f3), w3 = f3;
+    _MM_TRANSPOSE4_PS(w0, w1, w2, w3);
+    _mm_storeu_ps(w[0], w0);
+    _mm_storeu_ps(w[1], w1);
+    _mm_storeu_ps(w[2], w2);
+    _mm_storeu_ps(w[3], w3);
+
+    __m128 out[4];
+    for (k = 0; k < 4; k++) {
+        const float *c0 = lut->table + gr[k]->offset + gg[k]->offset + gb[k]->offset;
+        __m128 weights = _mm_loadu_ps(w[k]);
+        __m128 sum = _mm_mul_ps(_mm_loadu_ps(c0), _mm_shuffle_ps(weights, weights, _MM_SHUFFLE(0, 0, 0, 0)));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(c0 + offsetA[k]), _mm_shuffle_ps(weights, weights, _MM_SHUFFLE(1, 1, 1, 1))));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(c0 + offsetB[k]), _mm_shuffle_ps(weights, weights, _MM_SHUFFLE(2, 2, 2, 2))));
+        out[k] = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(c0 + corner), _mm_shuffle_ps(weights, weights, _MM_SHUFFLE(3, 3, 3, 3))));
+    }
+    _MM_TRANSPOSE4_PS(out[0], out[1], out[2], out[3]);
+
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), levels = _mm_set1_ps(1023.0f);
+    __m128i p = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(out[0], zero), one), levels));
+    p = _mm_or_si128(p, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(out[1], zero), one), levels)), 10));
+    p = _mm_or_si128(p, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(out[2], zero), one), levels)), 20));
+    return _mm_or_si128(p, _mm_set1_epi32(3 << 30));
+}
+
+static unsigned __stdcall cubeLutThread(void *arg)
+{
+    CubeLutJob *job = (CubeLutJob *)arg;
+    unsigned short pad[4 * 4];
+    unsigned int packed[4];
+
+    for (;;) {
+        unsigned int first = (unsigned int)InterlockedIncrement(&job->nextBlock) - 1;
+        unsigned int y, end;
+        if (first >= (job->height + CUBELUT_BLOCK_ROWS - 1) / CUBELUT_BLOCK_ROWS)
+            break;
+        first *= CUBELUT_BLOCK_ROWS;
+        end = first + CUBELUT_BLOCK_ROWS < job->height ? first + CUBELUT_BLOCK_ROWS : job->height;
+        for (y = first; y < end; y++) {
+            const unsigned short *src = job->src + (size_t)y * job->width * job->channels;
+            unsigned int *dst = job->dst + (size_t)y * job->width;
+            unsigned int x;
+            for (x = 0; x + 4 <= job->width; x += 4)
+                _mm_storeu_si128((__m128i *)(dst + x), cubeLut4(job->lut, src + x * job->channels, job->channels));
+            // The last pixels of a row are padded with black
+            if (x < job->width) {
+                memset(pad, 0, sizeof(pad));
+                memcpy(pad, src + x * job->channels, (job->width - x) * job->channels * sizeof(unsigned short));
+                _mm_storeu_si128((__m128i *)packed, cubeLut4(job->lut, pad, job->channels));
+                memcpy(dst + x, packed, (job->width - x) * sizeof(unsigned int));
+            }
+        }
+    }
+    return 0;
+}
+
+void cubeLutToRgb10A2(const CubeLut *lut, const unsigned short *src, unsigned int channels, unsigned int *dst,
+                      unsigned int width, unsigned int height, unsigned int numThreads)
+{
+    HANDLE handles[CUBELUT_MAX_THREADS];
+    CubeLutJob job;
+    unsigned int i, started = 0;
+
+    if (numThreads == 0) {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        numThreads = systemInfo.dwNumberOfProcessors;
+    }
+    if (numThreads > CUBELUT_MAX_THREADS)
+        numThreads = CUBELUT_MAX_THREADS;
+    job.lut = lut;
+    job.src = src;
+    job.channels = channels;
+    job.dst = dst;
+    job.width = width;
+    job.height = height;
+    job.nextBlock = 0;
+    // The calling thread works too, a thread that does not start just leaves more blocks for the others
+    for (i = 1; i < numThreads; i++) {
+        handles[started] = (HANDLE)_beginthreadex(NULL, 0, cubeLutThread, &job, 0, NULL);
+        if (handles[started])
+            started++;
+    }
+    cubeLutThread(&job);
+    if (started) {
+        WaitForMultipleObjects(started, handles, TRUE, INFINITE);
+        for (i = 0; i < started; i++)
+            CloseHandle(handles[i]);
+    }
+}
+
+//
+// GPU path
+//
+
+static void setRangeUniforms(GLuint program, const char *minName, const char *scaleName, const float *min,
+                             const float *max)
+{
+    glUniform3f(glGetUniformLocation(program, minName), min[0], min[1], min[2]);
+    glUniform3f(glGetUniformLocation(program, scaleName), 1.0f / (max[0] - min[0]), 1.0f / (max[1] - min[1]),
+        1.0f / (max[2] - min[2]));
+}
+
+bool initCubeLutRenderer(CubeLutRenderer *renderer, const CubeLut *lut)
+{
+    memset(renderer, 0, sizeof(CubeLutRenderer));
+    if (!loadShaderEntryPoints()) {
+        printf("No OpenGL 2.0 shaders or 3D textures, the 3D LUT is not applied\n");
+        return false;
+    }
+    renderer->program = buildProgram(&vertexSource, 1, &lutSource, 1, "3D LUT");
+    if (!renderer->program)
+        return false;
+
+    glGenTextures(1, &renderer->tableTexture);
+    glBindTexture(GL_TEXTURE_3D, renderer->tableTexture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB32F_ARB, lut->size, lut->size, lut->size, 0, GL_RGB, GL_FLOAT, lut->table);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    if (lut->shaperSize) {
+        glGenTextures(1, &renderer->shaperTexture);
+        glBindTexture(GL_TEXTURE_1D, renderer->shaperTexture);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB32F_ARB, lut->shaperSize, 0, GL_RGB, GL_FLOAT, lut->shaper);
+        glBindTexture(GL_TEXTURE_1D, 0);
+    }
+
+    glUseProgram(renderer->program);
+    glUniform1i(glGetUniformLocation(renderer->program, "table"), 1);
+    glUniform1i(glGetUniformLocation(renderer->program, "shaper"), 2);
+    glUniform1i(glGetUniformLocation(renderer->program, "useShaper"), lut->shaperSize != 0);
+    setRangeUniforms(renderer->program, "shaperMin", "shaperScale", lut->shaperMin, lut->shaperMax);
+    glUniform1f(glGetUniformLocation(renderer->program, "shaperSize"), (GLfloat)lut->shaperSize);
+    setRangeUniforms(renderer->program, "domainMin", "domainScale", lut->domainMin, lut->domainMax);
+    glUniform1f(glGetUniformLocation(renderer->program, "size"), (GLfloat)lut->size);
+    glUseProgram(0);
+
+    glGenTextures(1, &renderer->sceneTexture);
+    renderer->fbo = new FramebufferObject;
+    return true;
+}
+
+void bindCubeLutTarget(CubeLutRenderer *renderer, GLsizei width, GLsizei height)
+{
+    // 16 bits keep the 10-bit steps of the scene apart, the window size is reallocated when it changes
+    if (width != renderer->sceneWidth || height != renderer->sceneHeight) {
+        glBindTexture(GL_TEXTURE_2D, renderer->sceneTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16, width, height, 0, GL_RGBA, GL_UNSIGNED_SHORT, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        renderer->fbo->Bind();
+        renderer->fbo->AttachTexture(GL_TEXTURE_2D, renderer->sceneTexture, GL_COLOR_ATTACHMENT0_EXT);
+        renderer->fbo->IsValid();
+        renderer->sceneWidth = width;
+        renderer->sceneHeight = height;
+    }
+    renderer->fbo->Bind();
+    glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
+}
+
+void drawCubeLutTarget(CubeLutRenderer *renderer, GLsizei width, GLsizei height)
+{
+    FramebufferObject::Disable();
+    glDrawBuffer(GL_BACK);
+    glViewport(0, 0, width, height);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(0, 1, 0, 1, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glBindTexture(GL_TEXTURE_2D, renderer->sceneTexture);
+    beginCubeLut(renderer);
+    glBegin(GL_QUADS);
+        glTexCoord2f(0.0f, 0.0f); glVertex2f(0.0f, 0.0f);
+        glTexCoord2f(1.0f, 0.0f); glVertex2f(1.0f, 0.0f);
+        glTexCoord2f(1.0f, 1.0f); glVertex2f(1.0f, 1.0f);
+        glTexCoord2f(0.0f, 1.0f); glVertex2f(0.0f, 1.0f);
+    glEnd();
+    endCubeLut(renderer);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void beginCubeLut(CubeLutRenderer *renderer)
+{
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_3D, renderer->tableTexture);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_1D, renderer->shaperTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glUseProgram(renderer->program);
+}
+
+void endCubeLut(CubeLutRenderer *renderer)
+{
+    glUseProgram(0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_1D, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void deleteCubeLutRenderer(CubeLutRenderer *renderer)
+{
+    if (renderer->program)
+        glDeleteProgram(renderer->program);
+    if (renderer->tableTexture)
+        glDeleteTextures(1, &renderer->tableTexture);
+    if (renderer->shaperTexture)
+        glDeleteTextures(1, &renderer->shaperTexture);
+    if (renderer->sceneTexture)
+        glDeleteTextures(1, &renderer->sceneTexture);
+    delete renderer->fbo;
+    memset(renderer, 0, sizeof(CubeLutRenderer));
+}
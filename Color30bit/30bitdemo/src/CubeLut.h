@@ -0,0 +1,78 @@
+//
+// CubeLut.h
+//
+// 3D color lookup tables from .cube files (Adobe and Resolve flavours: a 3D
+// table, a 1D table, or a 1D shaper followed by a 3D table), applied after
+// everything else is drawn, e.g. a display calibration or a creative look.
+// On the GPU the scene is drawn into a 16-bit texture and shown through a
+// program that samples the shaper as a 1D texture and interpolates the 3D
+// table tetrahedrally from 4 nearest samples. On the CPU 16-bit pixels are
+// interpolated the same way with SSE2, 4 pixels at a time, and packed
+// straight to RGB10_A2, the rows split over every core. The shaper and
+// input domain of each channel are folded into a table of grid positions
+// for every 16-bit value.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef CUBELUT_H
+#define CUBELUT_H
+
+class FramebufferObject;
+
+#define CUBELUT_MAX_SIZE        256     // points per axis of the 3D table
+#define CUBELUT_MAX_SHAPER      65536   // entries of the 1D table
+#define CUBELUT_MAX_THREADS     16
+
+typedef struct _CubeLutGrid {
+    int offset;                         // float offset of the grid cell along one axis
+    float fraction;                     // position inside the cell
+} CubeLutGrid;
+
+typedef struct _CubeLut {
+    char title[256];
+    int shaperSize;                     // 0 without a 1D table
+    float *shaper;                      // RGB, shaperSize entries
+    float shaperMin[3];                 // input range of the shaper
+    float shaperMax[3];
+    int size;                           // points per axis, a 1D only file gets an identity of 2
+    float *table;                       // RGB, red fastest, size^3 entries and a float of padding
+    float domainMin[3];                 // input range of the 3D table
+    float domainMax[3];
+    CubeLutGrid *grid;                  // 3 * 65536: every 16-bit value of each channel
+} CubeLut;
+
+typedef struct _CubeLutRenderer {
+    GLuint program;                     // 0 without GLSL or 3D textures
+    GLuint tableTexture;
+    GLuint shaperTexture;               // 0 without a shaper
+    FramebufferObject *fbo;             // the scene is drawn into sceneTexture
+    GLuint sceneTexture;
+    GLsizei sceneWidth;
+    GLsizei sceneHeight;
+} CubeLutRenderer;
+
+// Returns false if the file can not be read or is not a valid .cube file,
+// the reason and line are printed.
+extern bool loadCubeLut(CubeLut *lut, const char *fileName);
+extern void freeCubeLut(CubeLut *lut);
+// Shaper, domain and tetrahedral interpolation in double precision
+extern void cubeLutReference(const CubeLut *lut, const double rgb[3], double out[3]);
+// Maps width x height pixels of channels (1 gray, 3 RGB or 4 RGBA) 16-bit
+// samples to GL_UNSIGNED_INT_2_10_10_10_REV pixels, alpha opaque. Rows are
+// split over numThreads, 0 uses every core.
+extern void cubeLutToRgb10A2(const CubeLut *lut, const unsigned short *src, unsigned int channels, unsigned int *dst,
+                             unsigned int width, unsigned int height, unsigned int numThreads = 0);
+
+// GL context must be valid. Returns false without GLSL or 3D textures, the
+// reason is printed.
+extern bool initCubeLutRenderer(CubeLutRenderer *renderer, const CubeLut *lut);
+// Binds a framebuffer of width x height for the scene to be drawn into
+extern void bindCubeLutTarget(CubeLutRenderer *renderer, GLsizei width, GLsizei height);
+// Draws the scene through the LUT to the window framebuffer, filling the viewport of width x height
+extern void drawCubeLutTarget(CubeLutRenderer *renderer, GLsizei width, GLsizei height);
+// What is drawn in between, a 2D texture on texture unit 0, goes through the LUT
+extern void beginCubeLut(CubeLutRenderer *renderer);
+extern void endCubeLut(CubeLutRenderer *renderer);
+extern void deleteCubeLutRenderer(CubeLutRenderer *renderer);
+
+#endif
@@ -0,0 +1,268 @@
+//
+// ErrorDiffusion.cpp
+//
+// Wavefront parallel Floyd-Steinberg and Sierra error diffusion
+//
+#include <windows.h>
+#include <process.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+#include "ErrorDiffusion.h"
+
+#define ERROR_PAD   2           // pixels left and right of an error row the kernels reach
+
+// State shared by the row threads
+typedef struct _DiffuseJob {
+    const unsigned short *src;
+    unsigned short *dst;
+    unsigned int width;
+    unsigned int height;
+    unsigned int channels;
+    int kernel;
+    __m128 scale;               // 16-bit sample to level units, per channel
+    __m128 levels;              // highest level, per channel
+    unsigned int numThreads;
+    unsigned int ringRows;      // error rows in the rings, numThreads + 2
+    unsigned int rowFloats;     // floats per error row, including the padding
+    // Errors for the row one and two below, each written by one row only
+    float *nearErrors;
+    float *farErrors;
+    volatile LONG *progress;    // columns done of every row
+} DiffuseJob;
+
+typedef struct _DiffuseThread {
+    DiffuseJob *job;
+    unsigned int firstRow;
+} DiffuseThread;
+
+static __m128 loadPixel(const unsigned short *p, unsigned int channels)
+{
+    if (channels == 4)
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128()));
+    return _mm_setr_ps((float)p[0], channels > 1 ? (float)p[1] : 0.0f, channels > 2 ? (float)p[2] : 0.0f, 0.0f);
+}
+
+static void storePixel(unsigned short *p, __m128i q, unsigned int channels)
+{
+    int values[4];
+    unsigned int c;
+
+    _mm_storeu_si128((__m128i *)values, q);
+    for (c = 0; c < channels; c++)
+        p[c] = (unsigned short)values[c];
+}
+
+// Waits until row y-1 has done columns [0, columns), its errors for them are final then
+static void waitForRow(DiffuseJob *job, unsigned int y, unsigned int columns)
+{
+    int spins = 0;
+
+    if (y == 0)
+        return;
+    if (columns > job->width)
+        columns = job->width;
+    while ((unsigned int)job->progress[y - 1] < columns) {
+        if (++spins < 64)
+            _mm_pause();
+        else
+            SwitchToThread();
+    }
+}
+
+//
+// diffuseRow
+//
+// Floyd-Steinberg:     X 7       Sierra:        X 5 3
+//                    3 5 1 /16              2 4 5 4 2
+//                                             2 3 2   /32
+//
+// The errors of the row come from nearErrors (row above) and farErrors (two
+// rows above), which are cleared again once read for the next use of the ring
+// row. The pixel to the right gets its share through the carry registers.
+//
+static void diffuseRow(DiffuseJob *job, unsigned int y)
+{
+    const unsigned int channels = job->channels;
+    const unsigned int reach = (job->kernel == DIFFUSE_SIERRA) ? 2 : 1;
+    const unsigned short *in = job->src + (size_t)y * job->width * channels;
+    unsigned short *out = job->dst + (size_t)y * job->width * channels;
+    float *nearRow = job->nearErrors + (y % job->ringRows) * job->rowFloats + ERROR_PAD * 4;
+    float *farRow = job->farErrors + (y % job->ringRows) * job->rowFloats + ERROR_PAD * 4;
+    float *nextNear = job->nearErrors + ((y + 1) % job->ringRows) * job->rowFloats + ERROR_PAD * 4;
+    float *nextFar = job->farErrors + ((y + 2) % job->ringRows) * job->rowFloats + ERROR_PAD * 4;
+    const __m128 zero = _mm_setzero_ps();
+    __m128 carry1 = zero, carry2 = zero;
+    unsigned int x;
+
+    for (x = 0; x < job->width; x++) {
+        if (x % DIFFUSE_BLOCK_COLUMNS == 0) {
+            if (x)
+                InterlockedExchange(&job->progress[y], x);
+            // The row above writes the errors of column c up to column c+reach
+            waitForRow(job, y, x + DIFFUSE_BLOCK_COLUMNS + reach);
+        }
+        __m128 value = _mm_add_ps(_mm_mul_ps(loadPixel(in + x * channels, channels), job->scale),
+            _mm_add_ps(_mm_add_ps(_mm_load_ps(nearRow + x * 4), _mm_load_ps(farRow + x * 4)), carry1));
+        _mm_store_ps(nearRow + x * 4, zero);
+        _mm_store_ps(farRow + x * 4, zero);
+        value = _mm_min_ps(_mm_max_ps(value, zero), job->levels);
+        __m128i q = _mm_cvtps_epi32(value);
+        __m128 error = _mm_sub_ps(value, _mm_cvtepi32_ps(q));
+        storePixel(out + x * channels, q, channels);
+
+        float *n = nextNear + x * 4;
+        if (job->kernel == DIFFUSE_SIERRA) {
+            const __m128 e = _mm_mul_ps(error, _mm_set1_ps(1.0f / 32.0f));
+            const __m128 e2 = _mm_add_ps(e, e);
+            const __m128 e3 = _mm_add_ps(e2, e);
+            const __m128 e4 = _mm_add_ps(e2, e2);
+            const __m128 e5 = _mm_add_ps(e4, e);
+            float *f = nextFar + x * 4;
+            carry1 = _mm_add_ps(carry2, e5);
+            carry2 = e3;
+            _mm_store_ps(n - 8, _mm_add_ps(_mm_load_ps(n - 8), e2));
+            _mm_store_ps(n - 4, _mm_add_ps(_mm_load_ps(n - 4), e4));
+            _mm_store_ps(n, _mm_add_ps(_mm_load_ps(n), e5));
+            _mm_store_ps(n + 4, _mm_add_ps(_mm_load_ps(n + 4), e4));
+            _mm_store_ps(n + 8, _mm_add_ps(_mm_load_ps(n + 8), e2));
+            _mm_store_ps(f - 4, _mm_add_ps(_mm_load_ps(f - 4), e2));
+            _mm_store_ps(f, _mm_add_ps(_mm_load_ps(f), e3));
+            _mm_store_ps(f + 4, _mm_add_ps(_mm_load_ps(f + 4), e2));
+        }
+        else {
+            const __m128 e = _mm_mul_ps(error, _mm_set1_ps(1.0f / 16.0f));
+            const __m128 e3 = _mm_add_ps(_mm_add_ps(e, e), e);
+            const __m128 e5 = _mm_add_ps(_mm_add_ps(e3, e), e);
+            carry1 = _mm_add_ps(e5, _mm_add_ps(e, e));
+            _mm_store_ps(n - 4, _mm_add_ps(_mm_load_ps(n - 4), e3));
+            _mm_store_ps(n, _mm_add_ps(_mm_load_ps(n), e5));
+            _mm_store_ps(n + 4, _mm_add_ps(_mm_load_ps(n + 4), e));
+        }
+    }
+    InterlockedExchange(&job->progress[y], job->width);
+}
+
+static unsigned __stdcall diffuseThread(void *arg)
+{
+    DiffuseThread *thread = (DiffuseThread *)arg;
+    DiffuseJob *job = thread->job;
+    unsigned int y;
+
+    for (y = thread->firstRow; y < job->height; y += job->numThreads)
+        diffuseRow(job, y);
+    return 0;
+}
+
+bool diffuseImage(const unsigned short *src, unsigned short *dst, unsigned int width, unsigned int height,
+                  unsigned int channels, const unsigned int *bits, int kernel, unsigned int numThreads)
+{
+    DiffuseJob job;
+    DiffuseThread threads[DIFFUSE_MAX_THREADS];
+    HANDLE handles[DIFFUSE_MAX_THREADS];
+    float levels[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    unsigned int c, i, started = 0;
+
+    if (numThreads == 0) {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        numThreads = systemInfo.dwNumberOfProcessors;
+    }
+    if (numThreads > DIFFUSE_MAX_THREADS)
+        numThreads = DIFFUSE_MAX_THREADS;
+    if (numThreads > height)
+        numThreads = height;
+    if (numThreads < 1)
+        numThreads = 1;
+    for (c = 0; c < channels; c++)
+        levels[c] = (float)((1 << bits[c]) - 1);
+
+    memset(&job, 0, sizeof(job));
+    job.src = src;
+    job.dst = dst;
+    job.width = width;
+    job.height = height;
+    job.channels = channels;
+    job.kernel = kernel;
+    job.levels = _mm_loadu_ps(levels);
+    job.scale = _mm_mul_ps(job.levels, _mm_set1_ps(1.0f / 65535.0f));
+    job.numThreads = numThreads;
+    job.ringRows = numThreads + 2;
+    job.rowFloats = (width + 2 * ERROR_PAD) * 4;
+    job.nearErrors = (float *)_mm_malloc(job.ringRows * job.rowFloats * sizeof(float), 16);
+    job.farErrors = (float *)_mm_malloc(job.ringRows * job.rowFloats * sizeof(float), 16);
+    job.progress = (volatile LONG *)calloc(height, sizeof(LONG));
+    if (!job.nearErrors || !job.farErrors || !job.progress) {
+        _mm_free(job.nearErrors);
+        _mm_free(job.farErrors);
+        free((void *)job.progress);
+        return false;
+    }
+    memset(job.nearErrors, 0, job.ringRows * job.rowFloats * sizeof(float));
+    memset(job.farErrors, 0, job.ringRows * job.rowFloats * sizeof(float));
+
+    // The helpers start suspended, if one can not be created the rows are
+    // spread over the ones that were. The calling thread takes the first row.
+    for (i = 1; i < numThreads; i++) {
+        threads[i].job = &job;
+        threads[i].firstRow = i;
+        handles[started] = (HANDLE)_beginthreadex(NULL, 0, diffuseThread, &threads[i], CREATE_SUSPENDED, NULL);
+        if (!handles[started])
+            break;
+        started++;
+    }
+    job.numThreads = started + 1;
+    for (i = 0; i < started; i++)
+        ResumeThread(handles[i]);
+    threads[0].job = &job;
+    threads[0].firstRow = 0;
+    diffuseThread(&threads[0]);
+    if (started) {
+        WaitForMultipleObjects(started, handles, TRUE, INFINITE);
+        for (i = 0; i < started; i++)
+            CloseHandle(handles[i]);
+    }
+
+    _mm_free(job.nearErrors);
+    _mm_free(job.farErrors);
+    free((void *)job.progress);
+    return true;
+}
+
+bool writePnm(const char *fileName, const unsigned short *levels, unsigned int width, unsigned int height,
+              unsigned int channels, unsigned int bits)
+{
+    unsigned int outChannels = (channels == 1) ? 1 : 3;
+    unsigned int sampleBytes = (bits > 8) ? 2 : 1;
+    unsigned char *row;
+    unsigned int x, y, c;
+    bool ok = true;
+    FILE *file = fopen(fileName, "wb");
+
+    if (!file) {
+        printf("ERROR: Unable to create %s\n", fileName);
+        return false;
+    }
+    fprintf(file, "P%c\n%u %u\n%u\n", outChannels == 1 ? '5' : '6', width, height, (1 << bits) - 1);
+    row = (unsigned char *)malloc(width * outChannels * sampleBytes);
+    for (y = 0; ok && y < height; y++) {
+        const unsigned short *p = levels + (size_t)y * width * channels;
+        unsigned char *q = row;
+        for (x = 0; x < width; x++, p += channels) {
+            for (c = 0; c < outChannels; c++) {
+                // 16-bit samples are big endian
+                if (sampleBytes == 2)
+                    *q++ = (unsigned char)(p[c] >> 8);
+                *q++ = (unsigned char)p[c];
+            }
+        }
+        ok = fwrite(row, sampleBytes * outChannels, width, file) == width;
+    }
+    free(row);
+    if (fclose(file) != 0)
+        ok = false;
+    if (!ok)
+        printf("ERROR: Unable to write %s\n", fileName);
+    return ok;
+}
@@ -0,0 +1,38 @@
+//
+// ErrorDiffusion.h
+//
+// Error diffusion quantization of 16-bit images to fewer bits per sample,
+// e.g. 10-bit for packed RGB10_A2 pixels or 8-bit deliverables. Each pixel
+// depends on the rows above, so rows are split over threads as a wavefront:
+// a row starts a few columns behind the row above it and waits whenever it
+// catches up. The channels of a pixel are diffused together in one SSE
+// vector. Every error sum is formed in the same order whatever the number of
+// threads, so the output is identical to the serial one.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ERRORDIFFUSION_H
+#define ERRORDIFFUSION_H
+
+#define DIFFUSE_MAX_THREADS     16
+#define DIFFUSE_BLOCK_COLUMNS   64      // columns a row does between progress updates
+
+enum {
+    DIFFUSE_FLOYD_STEINBERG = 0,        // 2 rows, 4 neighbours
+    DIFFUSE_SIERRA,                     // 3 rows, 10 neighbours, smoother
+    DIFFUSE_KERNEL_COUNT
+};
+
+// Quantizes width x height pixels of channels (1 to 4) interleaved 16-bit
+// samples to bits[c] (1 to 15) bits per channel c. dst receives the levels
+// 0 .. 2^bits[c]-1 in the same layout. numThreads 0 uses every core, 1 runs
+// serially. Returns false if out of memory.
+extern bool diffuseImage(const unsigned short *src, unsigned short *dst, unsigned int width, unsigned int height,
+                         unsigned int channels, const unsigned int *bits, int kernel, unsigned int numThreads = 0);
+
+// Writes levels from diffuseImage as a binary PGM (1 channel) or PPM (3 or 4
+// channels, alpha dropped) with maxval 2^bits-1. Returns false on errors.
+extern bool writePnm(const char *fileName, const unsigned short *levels, unsigned int width, unsigned int height,
+                     unsigned int channels, unsigned int bits);
+
+#endif
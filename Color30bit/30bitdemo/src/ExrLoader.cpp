@@ -0,0 +1,174 @@
+//
+// ExrLoader.cpp
+//
+// Chunked, multithreaded OpenEXR decode into pixel buffer objects
+//
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <gl/gl.h>
+#include <GL/glext.h>
+#include <ImfRgbaFile.h>
+#include <ImfThreading.h>
+#include <ImfStandardAttributes.h>
+#include "PboUploader.h"
+#include "ExrLoader.h"
+
+// Scan lines the compressor packs into one block, IlmImf decodes a block per task
+static GLuint compressionBlockLines(Imf::Compression compression)
+{
+    switch (compression) {
+        case Imf::ZIP_COMPRESSION:
+        case Imf::PXR24_COMPRESSION:
+            return 16;
+        case Imf::PIZ_COMPRESSION:
+            return 32;
+        default:
+            return 1;
+    }
+}
+
+static const char *compressionName(Imf::Compression compression)
+{
+    static const char *names[] = {"uncompressed", "RLE", "ZIPS", "ZIP", "PIZ", "PXR24"};
+
+    return (compression < Imf::NUM_COMPRESSION_METHODS) ? names[compression] : "unknown";
+}
+
+// The file's chromaticities or, without them, the BT.709 defaults
+static void readChromaticities(const Imf::Header &header, bool *present, float xy[8])
+{
+    Imf::Chromaticities c;
+
+    *present = Imf::hasChromaticities(header);
+    if (*present)
+        c = Imf::chromaticities(header);
+    xy[0] = c.red.x; xy[1] = c.red.y;
+    xy[2] = c.green.x; xy[3] = c.green.y;
+    xy[4] = c.blue.x; xy[5] = c.blue.y;
+    xy[6] = c.white.x; xy[7] = c.white.y;
+}
+
+bool openExr(ExrFile *exr, const char *fileName)
+{
+    memset(exr, 0, sizeof(ExrFile));
+    if (Imf::globalThreadCount() == 0) {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        Imf::setGlobalThreadCount(systemInfo.dwNumberOfProcessors);
+    }
+    try {
+        exr->file = new Imf::RgbaInputFile(fileName, Imf::globalThreadCount());
+        Imath::Box2i window = exr->file->dataWindow();
+        exr->width = window.max.x - window.min.x + 1;
+        exr->height = window.max.y - window.min.y + 1;
+        exr->blockLines = compressionBlockLines(exr->file->compression());
+        exr->numThreads = Imf::globalThreadCount();
+        readChromaticities(exr->file->header(), &exr->hasChromaticities, exr->chromaticities);
+    }
+    catch (Iex::BaseExc &e) {
+        printf("ERROR: Unable to load %s: %s\n", fileName, e.what());
+        delete exr->file;
+        exr->file = NULL;
+        return false;
+    }
+    printf("%s: %ux%u, %s, %u lines per block, %d decode threads\n", fileName, exr->width, exr->height,
+        compressionName(exr->file->compression()), exr->blockLines, exr->numThreads);
+    return true;
+}
+
+//
+// readChunk
+//
+// Points the frame buffer at dst so that scan line y lands in its first row.
+// The base address is outside dst for all but the first line of the data
+// window, IlmImf only ever adds the scan line offset back.
+//
+static void readChunk(ExrFile *exr, Imf::Rgba *dst, GLuint y, GLuint rows)
+{
+    Imath::Box2i window = exr->file->dataWindow();
+    int fileY = window.min.y + (int)y;
+    LARGE_INTEGER start, end, frequency;
+
+    QueryPerformanceCounter(&start);
+    exr->file->setFrameBuffer(dst - window.min.x - (ptrdiff_t)fileY * exr->width, 1, exr->width);
+    exr->file->readPixels(fileY, fileY + (int)rows - 1);
+    QueryPerformanceCounter(&end);
+    QueryPerformanceFrequency(&frequency);
+    exr->decodeSeconds += (double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+}
+
+bool uploadExr(ExrFile *exr, GLenum target)
+{
+    const size_t rowBytes = exr->width * sizeof(Imf::Rgba);
+    PboUploader uploader;
+    Imf::Rgba *chunk = NULL;
+    GLuint chunkRows, y;
+    GLsizei rows = 0;
+    bool mapped = false, ok = true;
+
+    // A block per thread, as far as the chunk limit allows
+    chunkRows = exr->blockLines * (exr->numThreads > 0 ? exr->numThreads : 1);
+    if (chunkRows * rowBytes > EXR_MAX_CHUNK_BYTES)
+        chunkRows = (GLuint)(EXR_MAX_CHUNK_BYTES / rowBytes) / exr->blockLines * exr->blockLines;
+    if (chunkRows == 0)
+        chunkRows = 1;
+    if (chunkRows > exr->height)
+        chunkRows = exr->height;
+
+    initPboUploader(&uploader, chunkRows * rowBytes);
+    try {
+        for (y = 0; y < exr->height; y += rows) {
+            Imf::Rgba *dst;
+            rows = exr->height - y;
+            if (rows > (GLsizei)chunkRows)
+                rows = chunkRows;
+            dst = (Imf::Rgba *)pboMapRows(&uploader, rowBytes, &rows);
+            if (dst) {
+                mapped = true;
+                readChunk(exr, dst, y, rows);
+                mapped = false;
+                pboUnmapRows(&uploader, target, 0, y, exr->width, rows, GL_RGBA, GL_HALF_FLOAT_ARB, sizeof(Imf::Rgba));
+            }
+            else {
+                // No buffer objects, decode into client memory
+                if (!chunk)
+                    chunk = new Imf::Rgba[chunkRows * exr->width];
+                readChunk(exr, chunk, y, rows);
+                pboTexSubImage2D(&uploader, target, 0, y, exr->width, rows, GL_RGBA, GL_HALF_FLOAT_ARB,
+                    sizeof(Imf::Rgba), chunk, rowBytes);
+            }
+        }
+    }
+    catch (Iex::BaseExc &e) {
+        // A mapped buffer is still handed over, so the ring stays consistent
+        printf("ERROR: Unable to decode the image: %s\n", e.what());
+        if (mapped)
+            pboUnmapRows(&uploader, target, 0, y, exr->width, rows, GL_RGBA, GL_HALF_FLOAT_ARB, sizeof(Imf::Rgba));
+        ok = false;
+    }
+    printf("EXR decoded in %.1f ms in %u line chunks, uploaded %.1f MB at %.0f MB/s, %u stalls\n",
+        exr->decodeSeconds * 1000.0, chunkRows, (double)(__int64)uploader.bytes / (1024.0 * 1024.0),
+        pboUploadRate(&uploader), uploader.stalls);
+    deletePboUploader(&uploader);
+    delete [] chunk;
+    return ok;
+}
+
+bool readExr(ExrFile *exr, Imf::Rgba *dst)
+{
+    try {
+        readChunk(exr, dst, 0, exr->height);
+    }
+    catch (Iex::BaseExc &e) {
+        printf("ERROR: Unable to decode the image: %s\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+void closeExr(ExrFile *exr)
+{
+    delete exr->file;
+    memset(exr, 0, sizeof(ExrFile));
+}
@@ -0,0 +1,42 @@
+//
+// ExrLoader.h
+//
+// Scanline OpenEXR images decoded straight into texture upload buffers. The
+// IlmImf thread pool is started with a thread per core, and the image is read
+// in chunks of whole compression blocks (1 to 32 scan lines), enough blocks
+// per chunk to keep every thread busy. Each chunk is decoded into a mapped
+// pixel buffer object and handed to the driver, whose transfer overlaps the
+// decode of the next chunk. No copy of the whole image is ever held.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef EXRLOADER_H
+#define EXRLOADER_H
+
+namespace Imf { class RgbaInputFile; struct Rgba; }
+
+#define EXR_MAX_CHUNK_BYTES     (16*1024*1024)
+
+typedef struct _ExrFile {
+    GLuint width;
+    GLuint height;
+    GLuint blockLines;              // scan lines per compressed block
+    int numThreads;                 // IlmImf worker threads
+    double decodeSeconds;           // time spent in readPixels
+    bool hasChromaticities;         // false: BT.709 is assumed
+    float chromaticities[8];        // red, green, blue and white x, y
+    Imf::RgbaInputFile *file;
+} ExrFile;
+
+// Opens the file and reads its header, starting the IlmImf thread pool on
+// the first call. Returns false if the file can not be read, the reason is
+// printed.
+extern bool openExr(ExrFile *exr, const char *fileName);
+// Decodes the image as RGBA half floats into the texture bound to target,
+// which must be at least width x height. The top scan line goes to row 0.
+extern bool uploadExr(ExrFile *exr, GLenum target);
+// Decodes the whole image into dst, width x height pixels, top scan line first.
+extern bool readExr(ExrFile *exr, Imf::Rgba *dst);
+extern void closeExr(ExrFile *exr);
+
+#endif
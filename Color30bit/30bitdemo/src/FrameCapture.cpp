@@ -0,0 +1,319 @@
+//
+// FrameCapture.cpp
+//
+// Pixel buffer object readback of the FBO and a background OpenEXR writer
+//
+#include <windows.h>
+#include <process.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gl/gl.h>
+#include <GL/glext.h>
+#include <ImfRgbaFile.h>
+#include <ImfHeader.h>
+#include <ImfThreading.h>
+#include "glShaderUtil.h"
+#include "FrameCapture.h"
+
+static int bufferState(FrameCapture *capture, int i)
+{
+    int state;
+
+    EnterCriticalSection(&capture->lock);
+    state = capture->buffers[i].state;
+    LeaveCriticalSection(&capture->lock);
+    return state;
+}
+
+static void setBufferState(FrameCapture *capture, int i, int state)
+{
+    EnterCriticalSection(&capture->lock);
+    capture->buffers[i].state = state;
+    LeaveCriticalSection(&capture->lock);
+}
+
+// The writer counts its failures too
+static void countFailure(FrameCapture *capture)
+{
+    EnterCriticalSection(&capture->lock);
+    capture->failed++;
+    LeaveCriticalSection(&capture->lock);
+}
+
+//
+// writeCapture
+//
+// GL rows go up and EXR scan lines down, so the frame buffer starts at the
+// last row and steps back a row per scan line. IlmImf adds y * yStride to
+// the base, which wraps around to the rows below.
+//
+static bool writeCapture(FrameCapture *capture, const CaptureBuffer *buffer)
+{
+    char fileName[MAX_PATH + 16];
+    const Imf::Rgba *pixels = (const Imf::Rgba *)buffer->pixels;
+
+    _snprintf(fileName, sizeof(fileName), "%s%04u.exr", capture->prefix, buffer->frame);
+    fileName[sizeof(fileName) - 1] = '\0';
+    try {
+        Imf::Header header(capture->width, capture->height, 1.0f, Imath::V2f(0, 0), 1.0f, Imf::INCREASING_Y,
+            (Imf::Compression)capture->compression);
+        Imf::RgbaOutputFile file(fileName, header, Imf::WRITE_RGBA, Imf::globalThreadCount());
+        file.setFrameBuffer(pixels + (size_t)(capture->height - 1) * capture->width, 1, (size_t)0 - capture->width);
+        file.writePixels(capture->height);
+    }
+    catch (Iex::BaseExc &e) {
+        printf("ERROR: Unable to write %s: %s\n", fileName, e.what());
+        return false;
+    }
+    return true;
+}
+
+//
+// The oldest queued frame is written first. The queue is drained before the
+// thread quits, so no frame that was read is lost.
+//
+static unsigned __stdcall writerThread(void *arg)
+{
+    FrameCapture *capture = (FrameCapture *)arg;
+    LARGE_INTEGER frequency, start, end;
+
+    QueryPerformanceFrequency(&frequency);
+    for (;;) {
+        WaitForSingleObject(capture->wake, INFINITE);
+        for (;;) {
+            int i, oldest = -1;
+            EnterCriticalSection(&capture->lock);
+            for (i = 0; i < capture->numBuffers; i++) {
+                if (capture->buffers[i].state == CAPTURE_QUEUED &&
+                    (oldest < 0 || capture->buffers[i].frame < capture->buffers[oldest].frame))
+                    oldest = i;
+            }
+            if (oldest >= 0)
+                capture->buffers[oldest].state = CAPTURE_WRITING;
+            LeaveCriticalSection(&capture->lock);
+            if (oldest < 0)
+                break;
+
+            QueryPerformanceCounter(&start);
+            bool ok = writeCapture(capture, &capture->buffers[oldest]);
+            QueryPerformanceCounter(&end);
+            EnterCriticalSection(&capture->lock);
+            capture->writeSeconds += (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+            if (ok)
+                capture->written++;
+            else
+                capture->failed++;
+            capture->buffers[oldest].state = CAPTURE_WRITTEN;
+            LeaveCriticalSection(&capture->lock);
+        }
+        if (capture->quit)
+            break;
+    }
+    return 0;
+}
+
+bool initFrameCapture(FrameCapture *capture, GLsizei width, GLsizei height, const char *prefix, bool piz,
+                      size_t budgetBytes)
+{
+    size_t frameBytes = (size_t)width * height * sizeof(Imf::Rgba);
+    int i;
+
+    memset(capture, 0, sizeof(FrameCapture));
+    capture->width = width;
+    capture->height = height;
+    strncpy(capture->prefix, prefix, sizeof(capture->prefix) - 1);
+    capture->compression = piz ? Imf::PIZ_COMPRESSION : Imf::ZIP_COMPRESSION;
+    capture->numBuffers = (int)(budgetBytes / frameBytes);
+    if (capture->numBuffers < 2)
+        capture->numBuffers = 2;
+    if (capture->numBuffers > CAPTURE_MAX_BUFFERS)
+        capture->numBuffers = CAPTURE_MAX_BUFFERS;
+    if (Imf::globalThreadCount() == 0) {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        Imf::setGlobalThreadCount(systemInfo.dwNumberOfProcessors);
+    }
+
+    if (hasExtension("GL_ARB_pixel_buffer_object") && loadBufferEntryPoints()) {
+        // The storage is allocated on the first readback into each
+        for (i = 0; i < capture->numBuffers; i++)
+            glGenBuffersARB(1, &capture->buffers[i].pbo);
+        if (loadFenceEntryPoints()) {
+            for (i = 0; i < capture->numBuffers; i++)
+                glGenFencesNV(1, &capture->buffers[i].fence);
+        }
+    }
+    else
+        printf("No pixel buffer objects, captures wait for the frame to be read\n");
+
+    InitializeCriticalSection(&capture->lock);
+    capture->wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+    capture->thread = capture->wake ? (HANDLE)_beginthreadex(NULL, 0, writerThread, capture, 0, NULL) : NULL;
+    if (!capture->thread) {
+        printf("ERROR: Unable to start the capture writer thread\n");
+        deleteFrameCapture(capture);
+        return false;
+    }
+    return true;
+}
+
+void startCapture(FrameCapture *capture, unsigned int frames)
+{
+    capture->remaining = frames;
+}
+
+// Maps a buffer whose transfer is done and queues it for the writer
+static void queueBuffer(FrameCapture *capture, int i)
+{
+    CaptureBuffer *buffer = &capture->buffers[i];
+
+    glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, buffer->pbo);
+    buffer->pixels = glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+    if (!buffer->pixels) {
+        printf("ERROR: Unable to map capture frame %u\n", buffer->frame);
+        countFailure(capture);
+        setBufferState(capture, i, CAPTURE_FREE);
+        return;
+    }
+    setBufferState(capture, i, CAPTURE_QUEUED);
+    SetEvent(capture->wake);
+}
+
+static void readBuffer(FrameCapture *capture, int i)
+{
+    CaptureBuffer *buffer = &capture->buffers[i];
+    size_t frameBytes = (size_t)capture->width * capture->height * sizeof(Imf::Rgba);
+
+    buffer->frame = capture->nextFrame++;
+    buffer->readDraw = capture->draws;
+    glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    if (buffer->pbo) {
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, buffer->pbo);
+        if (!buffer->allocated) {
+            glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, frameBytes, NULL, GL_STREAM_READ_ARB);
+            buffer->allocated = true;
+        }
+        glReadPixels(0, 0, capture->width, capture->height, GL_RGBA, GL_HALF_FLOAT_ARB, 0);
+        if (buffer->fence)
+            glSetFenceNV(buffer->fence, GL_ALL_COMPLETED_NV);
+        setBufferState(capture, i, CAPTURE_READING);
+    }
+    else {
+        if (!buffer->allocated) {
+            buffer->pixels = malloc(frameBytes);
+            buffer->allocated = buffer->pixels != NULL;
+        }
+        if (!buffer->allocated) {
+            printf("ERROR: Out of memory for capture frame %u\n", buffer->frame);
+            countFailure(capture);
+            return;
+        }
+        glReadPixels(0, 0, capture->width, capture->height, GL_RGBA, GL_HALF_FLOAT_ARB, buffer->pixels);
+        capture->directReads++;
+        setBufferState(capture, i, CAPTURE_QUEUED);
+        SetEvent(capture->wake);
+    }
+    capture->captured++;
+}
+
+//
+// Without fences a transfer is taken as done a frame after it was started,
+// mapping then waits for it if it is not.
+//
+void captureFrame(FrameCapture *capture, bool read)
+{
+    LARGE_INTEGER frequency, start, end;
+    int i, freeBuffer = -1;
+
+    if (!capture->numBuffers)
+        return;
+    QueryPerformanceCounter(&start);
+    capture->draws++;
+    for (i = 0; i < capture->numBuffers; i++) {
+        CaptureBuffer *buffer = &capture->buffers[i];
+        int state = bufferState(capture, i);
+        if (state == CAPTURE_WRITTEN) {
+            if (buffer->pbo) {
+                glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, buffer->pbo);
+                glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+                buffer->pixels = NULL;
+            }
+            setBufferState(capture, i, CAPTURE_FREE);
+            state = CAPTURE_FREE;
+        }
+        else if (state == CAPTURE_READING &&
+                 (buffer->fence ? glTestFenceNV(buffer->fence) != GL_FALSE : capture->draws > buffer->readDraw + 1))
+            queueBuffer(capture, i);
+        if (state == CAPTURE_FREE && freeBuffer < 0)
+            freeBuffer = i;
+    }
+    if (read && capture->remaining) {
+        capture->remaining--;
+        if (freeBuffer >= 0)
+            readBuffer(capture, freeBuffer);
+        else
+            capture->dropped++;
+    }
+    if (capture->buffers[0].pbo)
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&end);
+    capture->drawSeconds += (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+}
+
+bool captureBusy(FrameCapture *capture)
+{
+    int i;
+
+    if (capture->remaining)
+        return true;
+    for (i = 0; i < capture->numBuffers; i++) {
+        if (bufferState(capture, i) != CAPTURE_FREE)
+            return true;
+    }
+    return false;
+}
+
+void deleteFrameCapture(FrameCapture *capture)
+{
+    int i;
+
+    if (!capture->numBuffers)
+        return;
+    // Transfers in flight are finished and queued, then the writer drains the queue
+    if (capture->thread) {
+        for (i = 0; i < capture->numBuffers; i++) {
+            if (bufferState(capture, i) == CAPTURE_READING) {
+                if (capture->buffers[i].fence)
+                    glFinishFenceNV(capture->buffers[i].fence);
+                queueBuffer(capture, i);
+            }
+        }
+        capture->quit = true;
+        SetEvent(capture->wake);
+        WaitForSingleObject(capture->thread, INFINITE);
+        CloseHandle(capture->thread);
+    }
+    for (i = 0; i < capture->numBuffers; i++) {
+        CaptureBuffer *buffer = &capture->buffers[i];
+        if (buffer->pbo) {
+            if (buffer->state == CAPTURE_WRITTEN) {
+                glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, buffer->pbo);
+                glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+            }
+            glDeleteBuffersARB(1, &buffer->pbo);
+            if (buffer->fence)
+                glDeleteFencesNV(1, &buffer->fence);
+        }
+        else
+            free(buffer->pixels);
+    }
+    if (capture->buffers[0].pbo)
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+    if (capture->wake)
+        CloseHandle(capture->wake);
+    DeleteCriticalSection(&capture->lock);
+    memset(capture, 0, sizeof(FrameCapture));
+}
@@ -0,0 +1,83 @@
+//
+// FrameCapture.h
+//
+// Captures of the half float FBO attachment as OpenEXR files, a burst of
+// frames at a time, without stalling the draws. Each frame is read into a
+// pixel buffer object; the transfer runs while the next frames are drawn,
+// and once an NV_fence (or, without fences, the next frame) says it is done
+// the buffer is mapped and handed to a writer thread. The writer compresses
+// it with PIZ or ZIP on the IlmImf thread pool straight from the mapped
+// memory, and the buffer is unmapped and reused when the file is written.
+// The buffers are the memory budget: a frame that finds none free is
+// dropped and counted rather than waited for. Without pixel buffer objects
+// (e.g. a software GL) the frames are read into client memory, which waits.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#define CAPTURE_MAX_BUFFERS     16
+#define CAPTURE_BUDGET_BYTES    (256*1024*1024)
+
+enum {
+    CAPTURE_FREE = 0,
+    CAPTURE_READING,                    // read into the buffer, transfer in flight
+    CAPTURE_QUEUED,                     // mapped, waiting for the writer
+    CAPTURE_WRITING,
+    CAPTURE_WRITTEN                     // to be unmapped by the draw thread
+};
+
+typedef struct _CaptureBuffer {
+    GLuint pbo;                         // 0 without pixel buffer objects
+    GLuint fence;                       // NV_fence name, 0 without the extension
+    int state;                          // guarded by the lock
+    unsigned int frame;                 // number in the file name
+    unsigned int readDraw;              // captureFrame call of the readback
+    bool allocated;                     // buffer storage or client memory made
+    void *pixels;                       // RGBA half, bottom row first; mapped while queued or written
+} CaptureBuffer;
+
+typedef struct _FrameCapture {
+    GLsizei width;
+    GLsizei height;
+    int numBuffers;                     // 0 when not initialized
+    CaptureBuffer buffers[CAPTURE_MAX_BUFFERS];
+    char prefix[MAX_PATH];              // files are prefix0000.exr, prefix0001.exr..
+    int compression;                    // Imf::PIZ_COMPRESSION or Imf::ZIP_COMPRESSION
+    unsigned int remaining;             // frames of the burst still to read
+    unsigned int nextFrame;
+    unsigned int draws;                 // captureFrame calls
+    // Writer thread
+    HANDLE thread;
+    HANDLE wake;                        // set when a buffer is queued and on exit
+    CRITICAL_SECTION lock;
+    volatile bool quit;
+    // Statistics
+    unsigned int captured;              // frames read
+    unsigned int dropped;               // frames of a burst that found no free buffer
+    unsigned int written;
+    unsigned int failed;                // guarded by the lock, the writer counts into it too
+    unsigned int directReads;           // reads into client memory, without buffers
+    double drawSeconds;                 // time spent in captureFrame
+    double writeSeconds;                // time the writer spent in IlmImf
+} FrameCapture;
+
+// GL context must be valid. Frames are width x height, budgetBytes bounds
+// the buffers (2 to CAPTURE_MAX_BUFFERS of them). Returns false if the
+// writer thread can not be started, the reason is printed.
+extern bool initFrameCapture(FrameCapture *capture, GLsizei width, GLsizei height, const char *prefix,
+                             bool piz = true, size_t budgetBytes = CAPTURE_BUDGET_BYTES);
+// The next frames read are the burst, numbered on from the last one
+extern void startCapture(FrameCapture *capture, unsigned int frames);
+// Call once per draw with the same context. Finished transfers go to the
+// writer and written buffers are freed; with read, the float attachment of
+// the bound framebuffer is read if a burst is running.
+extern void captureFrame(FrameCapture *capture, bool read);
+// True while a burst runs or a frame is not written and freed yet: keep
+// drawing, or call captureFrame, until it is false.
+extern bool captureBusy(FrameCapture *capture);
+// Waits for the frames in flight to be written, the GL context must be valid
+extern void deleteFrameCapture(FrameCapture *capture);
+
+#endif
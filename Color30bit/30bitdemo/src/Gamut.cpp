@@ -0,0 +1,400 @@
+//
+// Gamut.cpp
+//
+// Fused gamut matrices, SSE2 and GLSL gamut conversion and compression
+//
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <emmintrin.h>
+#include <gl/gl.h>
+#include <GL/glext.h>
+#include "glShaderUtil.h"
+#include "Gamut.h"
+
+#define GAMUT_LIMIT_STEPS       32      // samples per edge of each face of the source cube
+
+// Red, green, blue and white x, y. All three share the D65 white, so going
+// through XYZ needs no chromatic adaptation.
+static const double primaries[GAMUT_COUNT][8] = {
+    {0.640, 0.330, 0.300, 0.600, 0.150, 0.060, 0.3127, 0.3290},
+    {0.680, 0.320, 0.265, 0.690, 0.150, 0.060, 0.3127, 0.3290},
+    {0.708, 0.292, 0.170, 0.797, 0.131, 0.046, 0.3127, 0.3290}
+};
+
+//
+// The matrices
+//
+
+static double max3(double a, double b, double c)
+{
+    return (a > b) ? ((a > c) ? a : c) : ((b > c) ? b : c);
+}
+
+static void invert3(const double m[9], double inv[9])
+{
+    double det = m[0] * (m[4] * m[8] - m[5] * m[7]) - m[1] * (m[3] * m[8] - m[5] * m[6]) +
+        m[2] * (m[3] * m[7] - m[4] * m[6]);
+
+    inv[0] = (m[4] * m[8] - m[5] * m[7]) / det;
+    inv[1] = (m[2] * m[7] - m[1] * m[8]) / det;
+    inv[2] = (m[1] * m[5] - m[2] * m[4]) / det;
+    inv[3] = (m[5] * m[6] - m[3] * m[8]) / det;
+    inv[4] = (m[0] * m[8] - m[2] * m[6]) / det;
+    inv[5] = (m[2] * m[3] - m[0] * m[5]) / det;
+    inv[6] = (m[3] * m[7] - m[4] * m[6]) / det;
+    inv[7] = (m[1] * m[6] - m[0] * m[7]) / det;
+    inv[8] = (m[0] * m[4] - m[1] * m[3]) / det;
+}
+
+static void multiply3(const double a[9], const double b[9], double out[9])
+{
+    int row, col;
+
+    for (row = 0; row < 3; row++)
+        for (col = 0; col < 3; col++)
+            out[row * 3 + col] = a[row * 3] * b[col] + a[row * 3 + 1] * b[3 + col] + a[row * 3 + 2] * b[6 + col];
+}
+
+//
+// The columns are the XYZ of the primaries, scaled so that they add up to
+// the white point at Y = 1.
+//
+static void rgbToXyz(int gamut, double m[9])
+{
+    const double *xy = primaries[gamut];
+    double p[9], inv[9], white[3], s[3];
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        p[i] = xy[i * 2] / xy[i * 2 + 1];
+        p[3 + i] = 1.0;
+        p[6 + i] = (1.0 - xy[i * 2] - xy[i * 2 + 1]) / xy[i * 2 + 1];
+    }
+    white[0] = xy[6] / xy[7];
+    white[1] = 1.0;
+    white[2] = (1.0 - xy[6] - xy[7]) / xy[7];
+    invert3(p, inv);
+    for (i = 0; i < 3; i++)
+        s[i] = inv[i * 3] * white[0] + inv[i * 3 + 1] * white[1] + inv[i * 3 + 2] * white[2];
+    for (i = 0; i < 9; i++)
+        m[i] = p[i] * s[i % 3];
+}
+
+static void gamutMatrix(int from, int to, double m[9])
+{
+    double toXyz[9], destination[9], fromXyz[9];
+    int i;
+
+    // Exact for the same gamut, so that the conversion can always be on
+    if (from == to) {
+        for (i = 0; i < 9; i++)
+            m[i] = (i % 4 == 0) ? 1.0 : 0.0;
+        return;
+    }
+    rgbToXyz(from, toXyz);
+    rgbToXyz(to, destination);
+    invert3(destination, fromXyz);
+    multiply3(fromXyz, toXyz, m);
+}
+
+const char *gamutName(int gamut)
+{
+    static const char *names[GAMUT_COUNT] = {"BT.709", "Display P3", "BT.2020"};
+
+    return (gamut >= 0 && gamut < GAMUT_COUNT) ? names[gamut] : "unknown";
+}
+
+const char *gamutMappingName(int mapping)
+{
+    static const char *names[GAMUT_MAP_COUNT] = {"unmapped", "clipped", "compressed"};
+
+    return (mapping >= 0 && mapping < GAMUT_MAP_COUNT) ? names[mapping] : "unknown";
+}
+
+int findGamut(const float chromaticities[8])
+{
+    int gamut, i;
+
+    for (gamut = 0; gamut < GAMUT_COUNT; gamut++) {
+        for (i = 0; i < 8 && fabs(chromaticities[i] - primaries[gamut][i]) < 0.005; i++)
+            ;
+        if (i == 8)
+            return gamut;
+    }
+    return -1;
+}
+
+void gamutLuminance(int gamut, float weights[3])
+{
+    double m[9];
+
+    rgbToXyz(gamut, m);
+    weights[0] = (float)m[3];
+    weights[1] = (float)m[4];
+    weights[2] = (float)m[5];
+}
+
+//
+// The distance of a component from the neutral axis is 1 - c / max(r, g, b),
+// above 1 for a negative component. The farthest of each is found on the
+// faces of the source cube, where the most saturated colors are; it only
+// depends on the pair, so it is kept once measured.
+//
+static void compressionLimits(int from, int to, double limit[3])
+{
+    static double limits[GAMUT_COUNT][GAMUT_COUNT][3];
+    static bool measured[GAMUT_COUNT][GAMUT_COUNT];
+    double m[9];
+    int face, i, j, c;
+
+    if (!measured[from][to]) {
+        gamutMatrix(from, to, m);
+        limits[from][to][0] = limits[from][to][1] = limits[from][to][2] = 0.0;
+        for (face = 0; face < 6; face++) {
+            for (i = 0; i <= GAMUT_LIMIT_STEPS; i++) {
+                for (j = 0; j <= GAMUT_LIMIT_STEPS; j++) {
+                    double rgb[3], out[3], achromatic;
+                    rgb[face % 3] = face / 3;
+                    rgb[(face + 1) % 3] = (double)i / GAMUT_LIMIT_STEPS;
+                    rgb[(face + 2) % 3] = (double)j / GAMUT_LIMIT_STEPS;
+                    for (c = 0; c < 3; c++)
+                        out[c] = m[c * 3] * rgb[0] + m[c * 3 + 1] * rgb[1] + m[c * 3 + 2] * rgb[2];
+                    achromatic = max3(out[0], out[1], out[2]);
+                    if (achromatic <= 0.0)
+                        continue;
+                    for (c = 0; c < 3; c++)
+                        if (1.0 - out[c] / achromatic > limits[from][to][c])
+                            limits[from][to][c] = 1.0 - out[c] / achromatic;
+                }
+            }
+        }
+        measured[from][to] = true;
+    }
+    for (c = 0; c < 3; c++)
+        limit[c] = limits[from][to][c];
+}
+
+//
+// Past the threshold t the distance d goes through t + (d - t) / (1 + (d - t) / s),
+// which has a slope of 1 at t and takes the limit to 1 for
+// s = (1 - t)(limit - t) / (limit - 1). Nothing is compressed for a source
+// gamut that fits.
+//
+void setupGamutConversion(GamutConversion *conversion, int from, int to, int mapping, float scale)
+{
+    const double t = GAMUT_COMPRESS_THRESHOLD;
+    double m[9], limit[3];
+    int i;
+
+    conversion->from = from;
+    conversion->to = to;
+    conversion->mapping = mapping;
+    gamutMatrix(from, to, m);
+    for (i = 0; i < 9; i++)
+        conversion->matrix[i] = (float)(m[i] * scale);
+    compressionLimits(from, to, limit);
+    for (i = 0; i < 3; i++) {
+        conversion->limit[i] = (float)limit[i];
+        if (limit[i] > 1.0 + 1e-6) {
+            conversion->threshold[i] = (float)t;
+            conversion->rolloff[i] = (float)((1.0 - t) * (limit[i] - t) / (limit[i] - 1.0));
+        }
+        else {
+            conversion->threshold[i] = FLT_MAX;
+            conversion->rolloff[i] = 1.0f;
+        }
+    }
+}
+
+//
+// CPU path
+//
+
+//
+// With e = max(d - t, 0) the compressed component is c + a e^2 / (s + e),
+// a = max(r, g, b): the curve above written as the amount added back.
+//
+void convertGamut4(const GamutConversion *conversion, __m128 *r, __m128 *g, __m128 *b)
+{
+    const float *m = conversion->matrix;
+    __m128 cr = _mm_add_ps(_mm_add_ps(_mm_mul_ps(*r, _mm_set1_ps(m[0])), _mm_mul_ps(*g, _mm_set1_ps(m[1]))),
+        _mm_mul_ps(*b, _mm_set1_ps(m[2])));
+    __m128 cg = _mm_add_ps(_mm_add_ps(_mm_mul_ps(*r, _mm_set1_ps(m[3])), _mm_mul_ps(*g, _mm_set1_ps(m[4]))),
+        _mm_mul_ps(*b, _mm_set1_ps(m[5])));
+    __m128 cb = _mm_add_ps(_mm_add_ps(_mm_mul_ps(*r, _mm_set1_ps(m[6])), _mm_mul_ps(*g, _mm_set1_ps(m[7]))),
+        _mm_mul_ps(*b, _mm_set1_ps(m[8])));
+
+    if (conversion->mapping == GAMUT_MAP_COMPRESS) {
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+        __m128 achromatic = _mm_max_ps(cr, _mm_max_ps(cg, cb));
+        __m128 positive = _mm_cmpgt_ps(achromatic, zero);
+        // Lanes without a positive component get 0 added, the division result is discarded
+        __m128 inv = _mm_div_ps(one, _mm_or_ps(_mm_and_ps(positive, achromatic), _mm_andnot_ps(positive, one)));
+        __m128 e;
+
+        e = _mm_max_ps(_mm_sub_ps(_mm_sub_ps(one, _mm_mul_ps(cr, inv)), _mm_set1_ps(conversion->threshold[0])), zero);
+        cr = _mm_add_ps(cr, _mm_and_ps(positive, _mm_div_ps(_mm_mul_ps(achromatic, _mm_mul_ps(e, e)),
+            _mm_add_ps(_mm_set1_ps(conversion->rolloff[0]), e))));
+        e = _mm_max_ps(_mm_sub_ps(_mm_sub_ps(one, _mm_mul_ps(cg, inv)), _mm_set1_ps(conversion->threshold[1])), zero);
+        cg = _mm_add_ps(cg, _mm_and_ps(positive, _mm_div_ps(_mm_mul_ps(achromatic, _mm_mul_ps(e, e)),
+            _mm_add_ps(_mm_set1_ps(conversion->rolloff[1]), e))));
+        e = _mm_max_ps(_mm_sub_ps(_mm_sub_ps(one, _mm_mul_ps(cb, inv)), _mm_set1_ps(conversion->threshold[2])), zero);
+        cb = _mm_add_ps(cb, _mm_and_ps(positive, _mm_div_ps(_mm_mul_ps(achromatic, _mm_mul_ps(e, e)),
+            _mm_add_ps(_mm_set1_ps(conversion->rolloff[2]), e))));
+    }
+    if (conversion->mapping != GAMUT_MAP_NONE) {
+        const __m128 zero = _mm_setzero_ps();
+        cr = _mm_max_ps(cr, zero);
+        cg = _mm_max_ps(cg, zero);
+        cb = _mm_max_ps(cb, zero);
+    }
+    *r = cr;
+    *g = cg;
+    *b = cb;
+}
+
+// Transposed 4 pixels at a time, the last 1 to 3 go through a padded group
+void convertGamut(const GamutConversion *conversion, float *rgba, size_t pixels)
+{
+    size_t i;
+
+    for (i = 0; i < pixels; i += 4) {
+        float tail[16];
+        float *p = rgba + i * 4;
+        size_t n = (pixels - i < 4) ? pixels - i : 4;
+        if (n < 4) {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, p, n * 4 * sizeof(float));
+            p = tail;
+        }
+        __m128 r = _mm_loadu_ps(p), g = _mm_loadu_ps(p + 4), b = _mm_loadu_ps(p + 8), a = _mm_loadu_ps(p + 12);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        convertGamut4(conversion, &r, &g, &b);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        _mm_storeu_ps(p, r);
+        _mm_storeu_ps(p + 4, g);
+        _mm_storeu_ps(p + 8, b);
+        _mm_storeu_ps(p + 12, a);
+        if (n < 4)
+            memcpy(rgba + i * 4, tail, n * 4 * sizeof(float));
+    }
+}
+
+void gamutReference(const GamutConversion *conversion, const double rgb[3], double out[3])
+{
+    const float *m = conversion->matrix;
+    double achromatic;
+    int c;
+
+    for (c = 0; c < 3; c++)
+        out[c] = m[c * 3] * rgb[0] + m[c * 3 + 1] * rgb[1] + m[c * 3 + 2] * rgb[2];
+    achromatic = max3(out[0], out[1], out[2]);
+    if (conversion->mapping == GAMUT_MAP_COMPRESS && achromatic > 0.0) {
+        for (c = 0; c < 3; c++) {
+            double d = 1.0 - out[c] / achromatic;
+            double t = conversion->threshold[c], s = conversion->rolloff[c];
+            if (d > t)
+                out[c] = achromatic * (1.0 - (t + (d - t) / (1.0 + (d - t) / s)));
+        }
+    }
+    if (conversion->mapping != GAMUT_MAP_NONE) {
+        for (c = 0; c < 3; c++)
+            if (out[c] < 0.0)
+                out[c] = 0.0;
+    }
+}
+
+//
+// GLSL
+//
+
+// The same conversion and compression as convertGamut4
+const char *gamutGlslSource =
+    "uniform mat3 gamutMatrix;\n"
+    "uniform int gamutMapping;\n"
+    "uniform vec3 gamutThreshold;\n"
+    "uniform vec3 gamutRolloff;\n"
+    "vec3 convertGamut(vec3 rgb)\n"
+    "{\n"
+    "    vec3 c = gamutMatrix * rgb;\n"
+    "    float a = max(c.r, max(c.g, c.b));\n"
+    "    if (gamutMapping == 2 && a > 0.0) {\n"
+    "        vec3 e = max(1.0 - c / a - gamutThreshold, 0.0);\n"
+    "        c += a * e * e / (gamutRolloff + e);\n"
+    "    }\n"
+    "    if (gamutMapping != 0)\n"
+    "        c = max(c, 0.0);\n"
+    "    return c;\n"
+    "}\n";
+
+static const char *vertexSource =
+    "void main()\n"
+    "{\n"
+    "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+    "    gl_Position = ftransform();\n"
+    "}\n";
+
+// gamutGlslSource goes in between
+static const char *gamutHeader =
+    "#extension GL_ARB_texture_rectangle : enable\n";
+static const char *gamutSource =
+    "uniform sampler2DRect image;\n"
+    "uniform float gamma;\n"
+    "void main()\n"
+    "{\n"
+    "    vec4 c = texture2DRect(image, gl_TexCoord[0].st);\n"
+    "    vec3 rgb = clamp(convertGamut(pow(c.rgb, vec3(gamma))), 0.0, 1.0);\n"
+    "    gl_FragColor = vec4(pow(rgb, vec3(1.0 / gamma)), c.a);\n"
+    "}\n";
+
+bool initGamutRenderer(GamutRenderer *renderer)
+{
+    const char *fragmentSources[3] = {gamutHeader, gamutGlslSource, gamutSource};
+
+    memset(renderer, 0, sizeof(GamutRenderer));
+    if (!loadShaderEntryPoints()) {
+        printf("No OpenGL 2.0 shaders, the PNG image is not converted to the display gamut\n");
+        return false;
+    }
+    renderer->program = buildProgram(&vertexSource, 1, fragmentSources, 3, "gamut");
+    if (!renderer->program)
+        return false;
+    renderer->gammaLocation = glGetUniformLocation(renderer->program, "gamma");
+    return true;
+}
+
+// The matrix goes in column major, transposing on upload is optional in older drivers
+void setGamutUniforms(GLuint program, const GamutConversion *conversion)
+{
+    const float *m = conversion->matrix;
+    const GLfloat columns[9] = {m[0], m[3], m[6], m[1], m[4], m[7], m[2], m[5], m[8]};
+
+    if (!loadShaderEntryPoints())
+        return;
+    glUniformMatrix3fv(glGetUniformLocation(program, "gamutMatrix"), 1, GL_FALSE, columns);
+    glUniform1i(glGetUniformLocation(program, "gamutMapping"), conversion->mapping);
+    glUniform3fv(glGetUniformLocation(program, "gamutThreshold"), 1, conversion->threshold);
+    glUniform3fv(glGetUniformLocation(program, "gamutRolloff"), 1, conversion->rolloff);
+}
+
+void beginGamut(GamutRenderer *renderer, const GamutConversion *conversion, float gamma)
+{
+    glUseProgram(renderer->program);
+    glUniform1f(renderer->gammaLocation, gamma);
+    setGamutUniforms(renderer->program, conversion);
+}
+
+void endGamut(GamutRenderer *renderer)
+{
+    glUseProgram(0);
+}
+
+void deleteGamutRenderer(GamutRenderer *renderer)
+{
+    if (renderer->program)
+        glDeleteProgram(renderer->program);
+    memset(renderer, 0, sizeof(GamutRenderer));
+}
@@ -0,0 +1,90 @@
+//
+// Gamut.h
+//
+// Conversions between the linear RGB of BT.709 (sRGB), Display P3 and
+// BT.2020. Every RGB to XYZ matrix is derived from the chromaticities of the
+// primaries and the white point, and a conversion fuses the source to XYZ,
+// XYZ to destination and any scale (e.g. the exposure) into one 3x3 matrix,
+// so a pixel costs a single matrix multiply. Colors the destination can not
+// show come out with negative components; they are clipped or, keeping
+// the hue, compressed towards the neutral axis: the distance from it of
+// each component past a threshold is rolled off so the farthest color of
+// the source gamut lands on the destination boundary. The CPU path converts
+// 4 pixels at a time with SSE2, the GLSL one is source to put in front of a
+// shader, and a small program shows display-referred rectangle textures
+// converted.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GAMUT_H
+#define GAMUT_H
+
+#include <stddef.h>
+#include <emmintrin.h>
+
+enum {
+    GAMUT_BT709 = 0,                    // sRGB primaries
+    GAMUT_DISPLAY_P3,                   // DCI-P3 primaries with a D65 white
+    GAMUT_BT2020,
+    GAMUT_COUNT
+};
+
+enum {
+    GAMUT_MAP_NONE = 0,                 // out of gamut colors keep their negative components
+    GAMUT_MAP_CLIP,                     // negative components clipped to 0
+    GAMUT_MAP_COMPRESS,                 // distances from the neutral axis rolled off, then clipped
+    GAMUT_MAP_COUNT
+};
+
+#define GAMUT_COMPRESS_THRESHOLD    0.8f    // distance from the neutral axis compression starts at
+
+typedef struct _GamutConversion {
+    int from;
+    int to;
+    int mapping;
+    float matrix[9];                    // row major, destination RGB = matrix * source RGB
+    float threshold[3];                 // per destination component, FLT_MAX when nothing needs compressing
+    float limit[3];                     // farthest distance of the source gamut, maps to 1.0
+    float rolloff[3];                   // the curve parameter that takes limit to 1.0
+} GamutConversion;
+
+typedef struct _GamutRenderer {
+    GLuint program;                     // 0 without GLSL
+    GLint gammaLocation;
+} GamutRenderer;
+
+extern const char *gamutName(int gamut);
+extern const char *gamutMappingName(int mapping);
+// Index of the gamut with these red, green, blue and white x, y, within
+// 0.005, or -1 if none matches
+extern int findGamut(const float chromaticities[8]);
+// The Y row of the RGB to XYZ matrix, the luminance weights
+extern void gamutLuminance(int gamut, float weights[3]);
+// Builds the fused matrix of from to to, multiplied by scale, and the
+// compression curve of every component
+extern void setupGamutConversion(GamutConversion *conversion, int from, int to, int mapping, float scale = 1.0f);
+
+// Converts and maps 4 pixels, planar
+extern void convertGamut4(const GamutConversion *conversion, __m128 *r, __m128 *g, __m128 *b);
+// RGBA float pixels in place, alpha is left as is
+extern void convertGamut(const GamutConversion *conversion, float *rgba, size_t pixels);
+// The same conversion and mapping in double precision
+extern void gamutReference(const GamutConversion *conversion, const double rgb[3], double out[3]);
+
+// GLSL function vec3 convertGamut(vec3 rgb) and the uniforms it reads,
+// set with setGamutUniforms while the program is in use
+extern const char *gamutGlslSource;
+
+// GL context must be valid. Returns false without GLSL or if the program
+// does not build, the reason is printed.
+extern bool initGamutRenderer(GamutRenderer *renderer);
+// Sets the uniforms of gamutGlslSource in program, which must be in use.
+// Needs OpenGL 2.0 but not initGamutRenderer.
+extern void setGamutUniforms(GLuint program, const GamutConversion *conversion);
+// What is drawn in between, a rectangle texture on texture unit 0 encoded
+// with gamma, is decoded, converted and encoded again
+extern void beginGamut(GamutRenderer *renderer, const GamutConversion *conversion, float gamma);
+extern void endGamut(GamutRenderer *renderer);
+extern void deleteGamutRenderer(GamutRenderer *renderer);
+
+#endif
@@ -0,0 +1,91 @@
+//
+// GpuTimer.cpp
+//
+// A ring of GL_TIME_ELAPSED queries
+//
+#include <windows.h>
+#include <string.h>
+#include <gl/gl.h>
+#include <GL/glext.h>
+#include "glShaderUtil.h"
+#include "GpuTimer.h"
+
+static PFNGLGENQUERIESARBPROC gtGenQueries = NULL;
+static PFNGLDELETEQUERIESARBPROC gtDeleteQueries = NULL;
+static PFNGLBEGINQUERYARBPROC gtBeginQuery = NULL;
+static PFNGLENDQUERYARBPROC gtEndQuery = NULL;
+static PFNGLGETQUERYOBJECTUI64VEXTPROC gtGetQueryObjectui64v = NULL;
+
+// The core name of an entry point, or the one with the suffix on older drivers
+static PROC getProc(const char *name, const char *suffixed)
+{
+    PROC proc = wglGetProcAddress(name);
+    return proc ? proc : wglGetProcAddress(suffixed);
+}
+
+bool initGpuTimer(GpuTimer *timer)
+{
+    memset(timer, 0, sizeof(GpuTimer));
+    if (!hasExtension("GL_EXT_timer_query") && !hasExtension("GL_ARB_timer_query"))
+        return false;
+    gtGenQueries = (PFNGLGENQUERIESARBPROC)getProc("glGenQueries", "glGenQueriesARB");
+    gtDeleteQueries = (PFNGLDELETEQUERIESARBPROC)getProc("glDeleteQueries", "glDeleteQueriesARB");
+    gtBeginQuery = (PFNGLBEGINQUERYARBPROC)getProc("glBeginQuery", "glBeginQueryARB");
+    gtEndQuery = (PFNGLENDQUERYARBPROC)getProc("glEndQuery", "glEndQueryARB");
+    gtGetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VEXTPROC)getProc("glGetQueryObjectui64v", "glGetQueryObjectui64vEXT");
+    if (!gtGenQueries || !gtDeleteQueries || !gtBeginQuery || !gtEndQuery || !gtGetQueryObjectui64v)
+        return false;
+    gtGenQueries(GPUTIMER_QUERIES, timer->queries);
+    return true;
+}
+
+static void readQuery(GpuTimer *timer, unsigned int slot)
+{
+    GLuint64EXT nanoseconds = 0;
+
+    gtGetQueryObjectui64v(timer->queries[slot], GL_QUERY_RESULT_ARB, &nanoseconds);
+    timer->pending[slot] = false;
+    timer->lastMs = (double)(__int64)nanoseconds / 1000000.0;
+    timer->totalMs += timer->lastMs;
+    timer->timings++;
+}
+
+void beginGpuTimer(GpuTimer *timer)
+{
+    if (!timer->queries[0])
+        return;
+    if (timer->pending[timer->next])
+        readQuery(timer, timer->next);
+    gtBeginQuery(GL_TIME_ELAPSED_EXT, timer->queries[timer->next]);
+}
+
+void endGpuTimer(GpuTimer *timer)
+{
+    if (!timer->queries[0])
+        return;
+    gtEndQuery(GL_TIME_ELAPSED_EXT);
+    timer->pending[timer->next] = true;
+    timer->next = (timer->next + 1) % GPUTIMER_QUERIES;
+}
+
+// Oldest first, so lastMs ends up as the latest timing
+unsigned int finishGpuTimer(GpuTimer *timer)
+{
+    unsigned int i, before = timer->timings;
+
+    if (!timer->queries[0])
+        return 0;
+    for (i = 0; i < GPUTIMER_QUERIES; i++) {
+        unsigned int slot = (timer->next + i) % GPUTIMER_QUERIES;
+        if (timer->pending[slot])
+            readQuery(timer, slot);
+    }
+    return timer->timings - before;
+}
+
+void deleteGpuTimer(GpuTimer *timer)
+{
+    if (timer->queries[0])
+        gtDeleteQueries(GPUTIMER_QUERIES, timer->queries);
+    memset(timer, 0, sizeof(GpuTimer));
+}
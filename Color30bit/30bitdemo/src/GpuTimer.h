@@ -0,0 +1,38 @@
+//
+// GpuTimer.h
+//
+// GPU time of the commands between a begin and an end, from timer queries
+// (GL_EXT_timer_query, or GL_ARB_timer_query on OpenGL 3.3 drivers). The
+// queries form a ring so that a result is only read when its slot comes up
+// again, by then the GPU is usually done with it; timings of different
+// timers must not be nested. Without the extension, e.g. on a software GL,
+// the timer says so and reports nothing.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#define GPUTIMER_QUERIES        8       // timings in flight before begin waits for the oldest
+
+typedef struct _GpuTimer {
+    GLuint queries[GPUTIMER_QUERIES];   // 0 without timer queries
+    bool pending[GPUTIMER_QUERIES];     // begun, result not read yet
+    unsigned int next;
+    unsigned int timings;               // results read
+    double lastMs;                      // the latest result read
+    double totalMs;
+} GpuTimer;
+
+// GL context must be valid. Returns false without timer queries, the timer
+// can still be used and does nothing.
+extern bool initGpuTimer(GpuTimer *timer);
+// Reads the result of the slot if it is still pending, then starts it
+extern void beginGpuTimer(GpuTimer *timer);
+extern void endGpuTimer(GpuTimer *timer);
+// Waits for every pending result. Returns the number read since the last
+// call; their times are added to totalMs and the latest is lastMs.
+extern unsigned int finishGpuTimer(GpuTimer *timer);
+extern void deleteGpuTimer(GpuTimer *timer);
+
+#endif
@@ -0,0 +1,375 @@
+//
+// HalfConvert.cpp
+//
+// F16C, SSE2 and scalar half float conversions
+//
+#include <windows.h>
+#include <intrin.h>
+#include <emmintrin.h>
+#if (defined(_MSC_VER) && _MSC_VER >= 1700) || defined(__F16C__)
+#include <immintrin.h>
+#define HALF_HAVE_F16C                  // the compiler knows the F16C intrinsics
+#endif
+#include "HalfConvert.h"
+
+#define HALF_BLOCK      256             // values staged as floats by the compound conversions, multiple of 8
+
+static int gHalfPath = -1;
+
+union FloatBits {
+    float f;
+    unsigned int i;
+};
+
+//
+// Half to float is exact: normal numbers get the exponent rebiased, Inf and
+// NaN twice so it becomes 255, denormals are their mantissa times 2^-24.
+//
+static float halfBitsToFloat(unsigned short h)
+{
+    unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+    unsigned int em = h & 0x7fff;
+    FloatBits x;
+
+    if (em < 0x400) {
+        x.f = (float)em * (1.0f / 16777216.0f);
+        x.i |= sign;
+        return x.f;
+    }
+    x.i = (em << 13) + (112 << 23);
+    if (em >= 0x7c00) {
+        x.i += 112 << 23;
+        if (em > 0x7c00)
+            x.i |= 0x400000;
+    }
+    x.i |= sign;
+    return x.f;
+}
+
+//
+// Float to half rounds to nearest even. Normal halves: rebias, add 0xfff plus
+// the lowest kept mantissa bit and drop 13 bits; a carry out of the mantissa
+// bumps the exponent, up to Inf. Denormal halves: adding 0.5 lines the half's
+// lowest bit up with the float's, so the SSE add does the rounding.
+//
+static unsigned short floatToHalfBits(float f)
+{
+    FloatBits x;
+    unsigned int sign, a;
+
+    x.f = f;
+    sign = (x.i >> 16) & 0x8000;
+    a = x.i & 0x7fffffff;
+    if (a >= (143 << 23))
+        return (unsigned short)(sign | (a > 0x7f800000 ? 0x7e00 | ((a >> 13) & 0x3ff) : 0x7c00));
+    if (a < (113 << 23)) {
+        x.i = a;
+        x.f = _mm_cvtss_f32(_mm_add_ss(_mm_set_ss(x.f), _mm_set_ss(0.5f)));
+        return (unsigned short)(sign | (x.i - 0x3f000000));
+    }
+    a += ((15 - 127) << 23) + 0xfff + ((a >> 13) & 1);
+    return (unsigned short)(sign | (a >> 13));
+}
+
+// The same as halfBitsToFloat on 4 halves, zero extended to 32 bits
+static __m128 halfToFloat4(__m128i h)
+{
+    const __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+    const __m128i em = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+    const __m128i infNan = _mm_cmpgt_epi32(em, _mm_set1_epi32(0x7bff));
+    const __m128i nan = _mm_cmpgt_epi32(em, _mm_set1_epi32(0x7c00));
+    const __m128i denormal = _mm_cmplt_epi32(em, _mm_set1_epi32(0x400));
+    __m128i normal = _mm_add_epi32(_mm_slli_epi32(em, 13), _mm_set1_epi32(112 << 23));
+    normal = _mm_add_epi32(normal, _mm_and_si128(infNan, _mm_set1_epi32(112 << 23)));
+    normal = _mm_or_si128(normal, _mm_and_si128(nan, _mm_set1_epi32(0x400000)));
+    __m128i small = _mm_castps_si128(_mm_mul_ps(_mm_cvtepi32_ps(em), _mm_set1_ps(1.0f / 16777216.0f)));
+    __m128i bits = _mm_or_si128(_mm_and_si128(denormal, small), _mm_andnot_si128(denormal, normal));
+    return _mm_castsi128_ps(_mm_or_si128(bits, sign));
+}
+
+// The same as floatToHalfBits on 4 floats, the halves sign extended to 32 bits for _mm_packs_epi32
+static __m128i floatToHalf4(__m128 f)
+{
+    const __m128i x = _mm_castps_si128(f);
+    const __m128i sign = _mm_and_si128(_mm_srli_epi32(x, 16), _mm_set1_epi32(0x8000));
+    const __m128i a = _mm_and_si128(x, _mm_set1_epi32(0x7fffffff));
+    const __m128i big = _mm_cmpgt_epi32(a, _mm_set1_epi32((143 << 23) - 1));
+    const __m128i nan = _mm_cmpgt_epi32(a, _mm_set1_epi32(0x7f800000));
+    const __m128i small = _mm_cmplt_epi32(a, _mm_set1_epi32(113 << 23));
+    const __m128i payload = _mm_or_si128(_mm_set1_epi32(0x200), _mm_and_si128(_mm_srli_epi32(a, 13), _mm_set1_epi32(0x3ff)));
+    const __m128i special = _mm_or_si128(_mm_set1_epi32(0x7c00), _mm_and_si128(nan, payload));
+    const __m128i denormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(a), _mm_set1_ps(0.5f))),
+        _mm_set1_epi32(0x3f000000));
+    __m128i normal = _mm_add_epi32(a, _mm_set1_epi32(((15 - 127) << 23) + 0xfff));
+    normal = _mm_srli_epi32(_mm_add_epi32(normal, _mm_and_si128(_mm_srli_epi32(a, 13), _mm_set1_epi32(1))), 13);
+    __m128i h = _mm_or_si128(_mm_and_si128(small, denormal), _mm_andnot_si128(small, normal));
+    h = _mm_or_si128(_mm_and_si128(big, special), _mm_andnot_si128(big, h));
+    h = _mm_or_si128(h, sign);
+    return _mm_srai_epi32(_mm_slli_epi32(h, 16), 16);
+}
+
+static void halfToFloatScalar(const unsigned short *src, float *dst, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        dst[i] = halfBitsToFloat(src[i]);
+}
+
+static void floatToHalfScalar(const float *src, unsigned short *dst, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        dst[i] = floatToHalfBits(src[i]);
+}
+
+static void halfToFloatSse2(const unsigned short *src, float *dst, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m128i h = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_ps(dst + i, halfToFloat4(_mm_unpacklo_epi16(h, zero)));
+        _mm_storeu_ps(dst + i + 4, halfToFloat4(_mm_unpackhi_epi16(h, zero)));
+    }
+    halfToFloatScalar(src + i, dst + i, count - i);
+}
+
+static void floatToHalfSse2(const float *src, unsigned short *dst, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m128i lo = floatToHalf4(_mm_loadu_ps(src + i));
+        __m128i hi = floatToHalf4(_mm_loadu_ps(src + i + 4));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(lo, hi));
+    }
+    floatToHalfScalar(src + i, dst + i, count - i);
+}
+
+#ifdef HALF_HAVE_F16C
+static void halfToFloatF16c(const unsigned short *src, float *dst, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(src + i))));
+    _mm256_zeroupper();
+    halfToFloatScalar(src + i, dst + i, count - i);
+}
+
+static void floatToHalfF16c(const float *src, unsigned short *dst, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i + 8 <= count; i += 8)
+        _mm_storeu_si128((__m128i *)(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), 0));
+    _mm256_zeroupper();
+    floatToHalfScalar(src + i, dst + i, count - i);
+}
+#endif
+
+static int bestHalfPath()
+{
+    int info[4];
+
+    __cpuid(info, 1);
+#ifdef HALF_HAVE_F16C
+    // F16C uses the AVX registers, which the OS has to save (OSXSAVE, XCR0 bits 1 and 2)
+    if ((info[2] & (1 << 29)) && (info[2] & (1 << 28)) && (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6)
+        return HALF_PATH_F16C;
+#endif
+    if (info[3] & (1 << 26))
+        return HALF_PATH_SSE2;
+    return HALF_PATH_SCALAR;
+}
+
+int halfConvertPath()
+{
+    if (gHalfPath < 0)
+        gHalfPath = bestHalfPath();
+    return gHalfPath;
+}
+
+int setHalfConvertPath(int path)
+{
+    int best = bestHalfPath();
+
+    gHalfPath = (path < 0 || path > best) ? best : path;
+    return gHalfPath;
+}
+
+const char *halfConvertPathName(int path)
+{
+    switch (path) {
+        case HALF_PATH_SCALAR:
+            return "scalar";
+        case HALF_PATH_SSE2:
+            return "SSE2";
+        case HALF_PATH_F16C:
+            return "F16C";
+    }
+    return "unknown";
+}
+
+void halfToFloat(const unsigned short *src, float *dst, size_t count)
+{
+    switch (halfConvertPath()) {
+#ifdef HALF_HAVE_F16C
+        case HALF_PATH_F16C:
+            halfToFloatF16c(src, dst, count);
+            break;
+#endif
+        case HALF_PATH_SSE2:
+            halfToFloatSse2(src, dst, count);
+            break;
+        default:
+            halfToFloatScalar(src, dst, count);
+            break;
+    }
+}
+
+void floatToHalf(const float *src, unsigned short *dst, size_t count)
+{
+    switch (halfConvertPath()) {
+#ifdef HALF_HAVE_F16C
+        case HALF_PATH_F16C:
+            floatToHalfF16c(src, dst, count);
+            break;
+#endif
+        case HALF_PATH_SSE2:
+            floatToHalfSse2(src, dst, count);
+            break;
+        default:
+            floatToHalfScalar(src, dst, count);
+            break;
+    }
+}
+
+//
+// The compound conversions stage HALF_BLOCK values as floats in a buffer that
+// stays in L1, so they run on whichever half path is selected. The float math
+// is the same SSE code on every path, the tails use its scalar forms.
+//
+static __m128i clampRound4(__m128 v, __m128 scale)
+{
+    return _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f)), scale));
+}
+
+void halfToUnorm16(const unsigned short *src, unsigned short *dst, size_t count)
+{
+    __m128 block[HALF_BLOCK / 4];
+    const float *values = (const float *)block;
+    const __m128 scale = _mm_set1_ps(65535.0f);
+
+    while (count) {
+        size_t n = (count < HALF_BLOCK) ? count : HALF_BLOCK;
+        size_t i;
+
+        halfToFloat(src, (float *)block, n);
+        for (i = 0; i + 8 <= n; i += 8) {
+            // 0..65535 biased to the signed range for the saturating pack
+            __m128i lo = _mm_sub_epi32(clampRound4(block[i / 4], scale), _mm_set1_epi32(0x8000));
+            __m128i hi = _mm_sub_epi32(clampRound4(block[i / 4 + 1], scale), _mm_set1_epi32(0x8000));
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(_mm_packs_epi32(lo, hi), _mm_set1_epi16((short)0x8000)));
+        }
+        for (; i < n; i++)
+            dst[i] = (unsigned short)_mm_cvtsi128_si32(clampRound4(_mm_set_ss(values[i]), scale));
+        src += n;
+        dst += n;
+        count -= n;
+    }
+}
+
+void unorm16ToHalf(const unsigned short *src, unsigned short *dst, size_t count)
+{
+    __m128 block[HALF_BLOCK / 4];
+    float *values = (float *)block;
+    const __m128 scale = _mm_set1_ps(1.0f / 65535.0f);
+    const __m128i zero = _mm_setzero_si128();
+
+    while (count) {
+        size_t n = (count < HALF_BLOCK) ? count : HALF_BLOCK;
+        size_t i;
+
+        for (i = 0; i + 8 <= n; i += 8) {
+            __m128i u = _mm_loadu_si128((const __m128i *)(src + i));
+            block[i / 4] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(u, zero)), scale);
+            block[i / 4 + 1] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(u, zero)), scale);
+        }
+        for (; i < n; i++)
+            values[i] = _mm_cvtss_f32(_mm_mul_ss(_mm_cvtsi32_ss(_mm_setzero_ps(), src[i]), scale));
+        floatToHalf(values, dst, n);
+        src += n;
+        dst += n;
+        count -= n;
+    }
+}
+
+void halfToRgb10A2(const unsigned short *src, unsigned int *dst, size_t pixels)
+{
+    __m128 block[HALF_BLOCK / 4];
+    const __m128 scale10 = _mm_set1_ps(1023.0f);
+    const __m128 scale2 = _mm_set1_ps(3.0f);
+    const __m128 pixelScale = _mm_setr_ps(1023.0f, 1023.0f, 1023.0f, 3.0f);
+
+    while (pixels) {
+        size_t n = (pixels < HALF_BLOCK / 4) ? pixels : HALF_BLOCK / 4;
+        size_t i;
+
+        halfToFloat(src, (float *)block, n * 4);
+        for (i = 0; i + 4 <= n; i += 4) {
+            __m128 r = block[i], g = block[i + 1], b = block[i + 2], a = block[i + 3];
+            _MM_TRANSPOSE4_PS(r, g, b, a);
+            __m128i p = _mm_or_si128(clampRound4(r, scale10), _mm_slli_epi32(clampRound4(g, scale10), 10));
+            p = _mm_or_si128(p, _mm_slli_epi32(clampRound4(b, scale10), 20));
+            p = _mm_or_si128(p, _mm_slli_epi32(clampRound4(a, scale2), 30));
+            _mm_storeu_si128((__m128i *)(dst + i), p);
+        }
+        for (; i < n; i++) {
+            int c[4];
+            _mm_storeu_si128((__m128i *)c, clampRound4(block[i], pixelScale));
+            dst[i] = (unsigned int)c[0] | ((unsigned int)c[1] << 10) | ((unsigned int)c[2] << 20) | ((unsigned int)c[3] << 30);
+        }
+        src += n * 4;
+        dst += n;
+        pixels -= n;
+    }
+}
+
+void rgb10A2ToHalf(const unsigned int *src, unsigned short *dst, size_t pixels)
+{
+    __m128 block[HALF_BLOCK / 4];
+    const __m128i mask10 = _mm_set1_epi32(0x3ff);
+    const __m128 scale10 = _mm_set1_ps(1.0f / 1023.0f);
+    const __m128 scale2 = _mm_set1_ps(1.0f / 3.0f);
+    const __m128 pixelScale = _mm_setr_ps(1.0f / 1023.0f, 1.0f / 1023.0f, 1.0f / 1023.0f, 1.0f / 3.0f);
+
+    while (pixels) {
+        size_t n = (pixels < HALF_BLOCK / 4) ? pixels : HALF_BLOCK / 4;
+        size_t i;
+
+        for (i = 0; i + 4 <= n; i += 4) {
+            __m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128 r = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(p, mask10)), scale10);
+            __m128 g = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 10), mask10)), scale10);
+            __m128 b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 20), mask10)), scale10);
+            __m128 a = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(p, 30)), scale2);
+            _MM_TRANSPOSE4_PS(r, g, b, a);
+            block[i] = r;
+            block[i + 1] = g;
+            block[i + 2] = b;
+            block[i + 3] = a;
+        }
+        for (; i < n; i++) {
+            __m128i c = _mm_setr_epi32(src[i] & 0x3ff, (src[i] >> 10) & 0x3ff, (src[i] >> 20) & 0x3ff, src[i] >> 30);
+            block[i] = _mm_mul_ps(_mm_cvtepi32_ps(c), pixelScale);
+        }
+        floatToHalf((const float *)block, dst, n * 4);
+        src += n;
+        dst += n * 4;
+        pixels -= n;
+    }
+}
@@ -0,0 +1,44 @@
+//
+// HalfConvert.h
+//
+// Bulk conversions between half floats and float, normalized 16-bit and
+// packed RGB10_A2 pixels. The half class of OpenEXR converts one value at a
+// time through tables and rounds ties up; these work on whole rows with F16C
+// (VCVTPH2PS/VCVTPS2PH, 8 values per instruction) when the CPU and compiler
+// have it, otherwise with SSE2 integer code, and round to nearest even like
+// the GPU does. All paths give the same bits, NaNs are returned quiet.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HALFCONVERT_H
+#define HALFCONVERT_H
+
+#include <stddef.h>
+
+enum {
+    HALF_PATH_SCALAR = 0,
+    HALF_PATH_SSE2,
+    HALF_PATH_F16C,
+    HALF_PATH_COUNT
+};
+
+// The path the conversions use, the best one the CPU supports unless
+// setHalfConvertPath picked another
+extern int halfConvertPath();
+// Selects path, or the best supported one below it. Returns the path selected.
+extern int setHalfConvertPath(int path);
+extern const char *halfConvertPathName(int path);
+
+extern void halfToFloat(const unsigned short *src, float *dst, size_t count);
+extern void floatToHalf(const float *src, unsigned short *dst, size_t count);
+
+// [0, 1] to 0..65535, rounded; values outside and NaNs are clamped (NaN to 0)
+extern void halfToUnorm16(const unsigned short *src, unsigned short *dst, size_t count);
+extern void unorm16ToHalf(const unsigned short *src, unsigned short *dst, size_t count);
+
+// RGBA half pixels to GL_UNSIGNED_INT_2_10_10_10_REV (red in the low bits),
+// clamped and rounded like halfToUnorm16
+extern void halfToRgb10A2(const unsigned short *src, unsigned int *dst, size_t pixels);
+extern void rgb10A2ToHalf(const unsigned int *src, unsigned short *dst, size_t pixels);
+
+#endif
@@ -0,0 +1,687 @@
+//
+// LuminanceStats.cpp
+//
+// GLSL block reduction and point histogram, SSE2 CPU reduction of a readback
+//
+#include <windows.h>
+#include <process.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <emmintrin.h>
+#include <gl/gl.h>
+#include <GL/glext.h>
+#include "framebufferObject.h"
+#include "HalfConvert.h"
+#include "glShaderUtil.h"
+#include "LuminanceStats.h"
+
+#define LUMSTATS_BLOCK_PIXELS   64      // pixels staged as floats at a time, multiple of 4
+#define LUMSTATS_GPU_BYTES      ((4 + LUMSTATS_BINS) * sizeof(GLfloat)) // 1x1 level and the histogram
+
+// A quad from -1 to 1 covers the viewport without any matrices
+static const char *reduceVertexSource =
+    "void main()\n"
+    "{\n"
+    "    gl_Position = gl_Vertex;\n"
+    "}\n";
+
+static const char *firstHeader = "#define FIRST\n";
+static const char *levelHeader = "\n";
+
+//
+// Each fragment reduces a 4x4 block of the input, the texels past its
+// edges left out. The first pass turns the pixels into luminance and its
+// log2, later ones combine the blocks of the level before. Sums rather than
+// means keep partial blocks exact; the CPU divides by the pixel count.
+//
+static const char *reduceSource =
+    "uniform sampler2D image;\n"
+    "uniform vec2 size;\n"
+    "uniform vec3 weights;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 base = floor(gl_FragCoord.xy) * 4.0;\n"
+    "    vec4 r = vec4(65536.0 * 65536.0, -1.0, 0.0, 0.0);\n"
+    "    for (int y = 0; y < 4; y++) {\n"
+    "        for (int x = 0; x < 4; x++) {\n"
+    "            vec2 p = base + vec2(float(x), float(y));\n"
+    "            if (p.x < size.x && p.y < size.y) {\n"
+    "                vec4 t = texture2D(image, (p + 0.5) / size);\n"
+    "#ifdef FIRST\n"
+    "                float l = dot(max(t.rgb, 0.0), weights);\n"
+    "                t = vec4(l, l, l, log2(l + 0.0001));\n"
+    "#endif\n"
+    "                r = vec4(min(r.x, t.x), max(r.y, t.y), r.zw + t.zw);\n"
+    "            }\n"
+    "        }\n"
+    "    }\n"
+    "    gl_FragColor = r;\n"
+    "}\n";
+
+//
+// A point per pixel, moved to the column of its bin in a LUMSTATS_BINS x 1
+// viewport. The bin is the float exponent and top 3 mantissa bits, as the
+// CPU takes them from the bits; log2 may be off by one next to a power of
+// two, the comparisons put it right. Points of pixels past the edges of the
+// image go left of the viewport and are clipped.
+//
+static const char *histogramVertexSource =
+    "uniform sampler2D image;\n"
+    "uniform vec2 size;\n"
+    "uniform vec2 origin;\n"
+    "uniform float stride;\n"
+    "uniform vec3 weights;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 p = origin + gl_Vertex.xy * stride;\n"
+    "    float bin = -1.0;\n"
+    "    if (p.x < size.x && p.y < size.y) {\n"
+    "        float l = dot(max(texture2DLod(image, (p + 0.5) / size, 0.0).rgb, 0.0), weights);\n"
+    "        l = clamp(l, exp2(-16.0), 65535.996);\n"
+    "        float e = floor(log2(l));\n"
+    "        if (exp2(e) > l)\n"
+    "            e -= 1.0;\n"
+    "        else if (exp2(e + 1.0) <= l)\n"
+    "            e += 1.0;\n"
+    "        bin = (e + 16.0) * 8.0 + floor((l / exp2(e) - 1.0) * 8.0);\n"
+    "    }\n"
+    "    gl_Position = vec4((bin + 0.5) / 128.0 - 1.0, 0.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char *histogramFragmentSource =
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = vec4(1.0, 0.0, 0.0, 0.0);\n"
+    "}\n";
+
+static GLuint createFloatTexture(GLsizei width, GLsizei height)
+{
+    GLuint texture;
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F_ARB, width, height, 0, GL_RGBA, GL_FLOAT, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+static FramebufferObject *createFbo(GLuint texture)
+{
+    FramebufferObject *fbo = new FramebufferObject;
+
+    fbo->Bind();
+    fbo->AttachTexture(GL_TEXTURE_2D, texture, GL_COLOR_ATTACHMENT0_EXT);
+    fbo->IsValid();
+    return fbo;
+}
+
+// IsValid only checks in debug builds, this one is for the bound FBO in all
+static bool isFboComplete()
+{
+    return glCheckFramebufferStatusEXT &&
+           glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT) == GL_FRAMEBUFFER_COMPLETE_EXT;
+}
+
+//
+// canBlendFloat
+//
+// The histogram counts by adding 1.0 per point with blending into the bound
+// RGBA32F target. Cards with fp16 blending only either drop the blend or set
+// an error, so 1.0 is drawn twice into one pixel and has to read back as 2.0.
+//
+static bool canBlendFloat()
+{
+    GLfloat red = 0.0f;
+
+    glGetError();
+    glPushAttrib(GL_VIEWPORT_BIT | GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_CURRENT_BIT | GL_PIXEL_MODE_BIT);
+    glViewport(0, 0, 1, 1);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_TEXTURE_2D);
+    glDisable(GL_TEXTURE_RECTANGLE_ARB);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glColor4f(1.0f, 0.0f, 0.0f, 0.0f);
+    glRecti(-1, -1, 1, 1);
+    glRecti(-1, -1, 1, 1);
+    glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+    glReadPixels(0, 0, 1, 1, GL_RED, GL_FLOAT, &red);
+    glPopAttrib();
+    return glGetError() == GL_NO_ERROR && red == 2.0f;
+}
+
+// The programs, the level chain and the histogram target
+static bool initGpuReduction(LuminanceReducer *reducer)
+{
+    const char *firstSources[2] = {firstHeader, reduceSource};
+    const char *levelSources[2] = {levelHeader, reduceSource};
+    GLint vertexTextureUnits = 0;
+    GLsizei w = reducer->width, h = reducer->height;
+    GLfloat *points;
+    int i;
+
+    if (!hasExtension("GL_ARB_texture_float")) {
+        printf("No float textures, luminance statistics are reduced on the CPU\n");
+        return false;
+    }
+    glGetIntegerv(GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS_ARB, &vertexTextureUnits);
+    if (vertexTextureUnits < 1) {
+        printf("No vertex texture fetch for the histogram, luminance statistics are reduced on the CPU\n");
+        return false;
+    }
+    if (!loadShaderEntryPoints() || !loadBufferEntryPoints()) {
+        printf("No OpenGL 2.0 shaders or vertex buffer objects, luminance statistics are reduced on the CPU\n");
+        return false;
+    }
+
+    reducer->reduceProgram[0] = buildProgram(&reduceVertexSource, 1, firstSources, 2, "luminance reduction");
+    reducer->reduceProgram[1] = buildProgram(&reduceVertexSource, 1, levelSources, 2, "luminance reduction");
+    reducer->histogramProgram = buildProgram(&histogramVertexSource, 1, &histogramFragmentSource, 1,
+        "luminance histogram");
+    if (!reducer->reduceProgram[0] || !reducer->reduceProgram[1] || !reducer->histogramProgram)
+        return false;
+    for (i = 0; i < 2; i++)
+        reducer->sizeLocation[i] = glGetUniformLocation(reducer->reduceProgram[i], "size");
+    reducer->weightsLocation = glGetUniformLocation(reducer->reduceProgram[0], "weights");
+    reducer->histogramSizeLocation = glGetUniformLocation(reducer->histogramProgram, "size");
+    reducer->originLocation = glGetUniformLocation(reducer->histogramProgram, "origin");
+    reducer->strideLocation = glGetUniformLocation(reducer->histogramProgram, "stride");
+    reducer->histogramWeightsLocation = glGetUniformLocation(reducer->histogramProgram, "weights");
+
+    // A level a quarter of the one before a side, rounded up, down to 1x1
+    do {
+        if (reducer->numLevels == LUMSTATS_MAX_LEVELS) {
+            printf("ERROR: %d x %d is too large for the luminance reduction\n", reducer->width, reducer->height);
+            return false;
+        }
+        w = (w + 3) / 4;
+        h = (h + 3) / 4;
+        reducer->levelWidth[reducer->numLevels] = w;
+        reducer->levelHeight[reducer->numLevels] = h;
+        reducer->levelTextures[reducer->numLevels] = createFloatTexture(w, h);
+        reducer->levelFbos[reducer->numLevels] = createFbo(reducer->levelTextures[reducer->numLevels]);
+        reducer->numLevels++;
+        if (!isFboComplete()) {
+            FramebufferObject::Disable();
+            printf("No float framebuffer for the reduction, luminance statistics are reduced on the CPU\n");
+            return false;
+        }
+    } while (w > 1 || h > 1);
+    reducer->histogramTexture = createFloatTexture(LUMSTATS_BINS, 1);
+    reducer->histogramFbo = createFbo(reducer->histogramTexture);
+    if (!isFboComplete() || !canBlendFloat()) {
+        FramebufferObject::Disable();
+        printf("No float blending for the histogram, luminance statistics are reduced on the CPU\n");
+        return false;
+    }
+    FramebufferObject::Disable();
+
+    points = (GLfloat *)malloc(LUMSTATS_TILE * LUMSTATS_TILE * 2 * sizeof(GLfloat));
+    if (!points) {
+        printf("ERROR: Out of memory for the luminance histogram points\n");
+        return false;
+    }
+    for (i = 0; i < LUMSTATS_TILE * LUMSTATS_TILE; i++) {
+        points[i * 2] = (GLfloat)(i % LUMSTATS_TILE);
+        points[i * 2 + 1] = (GLfloat)(i / LUMSTATS_TILE);
+    }
+    glGenBuffersARB(1, &reducer->pointBuffer);
+    glBindBufferARB(GL_ARRAY_BUFFER_ARB, reducer->pointBuffer);
+    glBufferDataARB(GL_ARRAY_BUFFER_ARB, LUMSTATS_TILE * LUMSTATS_TILE * 2 * sizeof(GLfloat), points, GL_STATIC_DRAW_ARB);
+    glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+    free(points);
+    return true;
+}
+
+bool initLuminanceReducer(LuminanceReducer *reducer, GLsizei width, GLsizei height, bool gpu, int histogramStride)
+{
+    size_t readBytes;
+    int i;
+
+    memset(reducer, 0, sizeof(LuminanceReducer));
+    reducer->width = width;
+    reducer->height = height;
+    reducer->histogramStride = histogramStride > 1 ? histogramStride : 1;
+    if (gpu) {
+        reducer->gpu = initGpuReduction(reducer);
+        if (!reducer->gpu) {
+            // Whatever was made is freed, the CPU path starts over
+            deleteLuminanceReducer(reducer);
+            reducer->width = width;
+            reducer->height = height;
+            reducer->histogramStride = histogramStride > 1 ? histogramStride : 1;
+        }
+    }
+    readBytes = reducer->gpu ? LUMSTATS_GPU_BYTES : (size_t)width * height * 4 * sizeof(unsigned short);
+    if (hasExtension("GL_ARB_pixel_buffer_object") && loadBufferEntryPoints()) {
+        for (i = 0; i < 2; i++) {
+            glGenBuffersARB(1, &reducer->pbo[i]);
+            glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, reducer->pbo[i]);
+            glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, readBytes, NULL, GL_STREAM_READ_ARB);
+        }
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+    }
+    else if (!reducer->gpu) {
+        printf("No pixel buffer objects, luminance statistics wait for the frame to be read\n");
+        reducer->pixels = (unsigned short *)malloc(readBytes);
+        if (!reducer->pixels) {
+            printf("ERROR: Out of memory for the luminance statistics readback\n");
+            return false;
+        }
+    }
+    printf("Luminance statistics of %d x %d frames reduced on the %s\n", width, height, reducer->gpu ? "GPU" : "CPU");
+    return true;
+}
+
+// The 1x1 level and the histogram, as the GPU path reads them back
+static void gpuStats(const GLfloat *results, unsigned int frame, LuminanceReducer *reducer)
+{
+    LuminanceStats *stats = &reducer->stats;
+    double pixels = (double)reducer->width * reducer->height;
+    int i;
+
+    stats->minimum = results[0];
+    stats->maximum = results[1];
+    stats->mean = (float)(results[2] / pixels);
+    stats->logAverage = (float)pow(2.0, results[3] / pixels);
+    stats->samples = 0;
+    for (i = 0; i < LUMSTATS_BINS; i++) {
+        stats->histogram[i] = (unsigned int)(results[4 + i] + 0.5f);
+        stats->samples += stats->histogram[i];
+    }
+    stats->frame = frame;
+    reducer->valid = true;
+}
+
+//
+// The passes draw with their own viewport and blending, and the source
+// texture is sampled at texel centers with nearest filtering; all of it is
+// put back as it was.
+//
+static void runGpuReduction(LuminanceReducer *reducer, GLuint texture, const float weights[3])
+{
+    GLsizei w = reducer->width, h = reducer->height;
+    GLint minFilter, magFilter;
+    int i, tilesX, tilesY, x, y, span = LUMSTATS_TILE * reducer->histogramStride;
+
+    glPushAttrib(GL_VIEWPORT_BIT | GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT | GL_POINT_BIT);
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glDisable(GL_BLEND);
+    glDisable(GL_DEPTH_TEST);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &minFilter);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, &magFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // Level by level, each read by the next pass
+    for (i = 0; i < reducer->numLevels; i++) {
+        int program = i ? 1 : 0;
+        reducer->levelFbos[i]->Bind();
+        glViewport(0, 0, reducer->levelWidth[i], reducer->levelHeight[i]);
+        glUseProgram(reducer->reduceProgram[program]);
+        glUniform2f(reducer->sizeLocation[program], (GLfloat)w, (GLfloat)h);
+        if (!i)
+            glUniform3fv(reducer->weightsLocation, 1, weights);
+        glRecti(-1, -1, 1, 1);
+        glBindTexture(GL_TEXTURE_2D, reducer->levelTextures[i]);
+        w = reducer->levelWidth[i];
+        h = reducer->levelHeight[i];
+    }
+
+    // The histogram counts add up in red
+    reducer->histogramFbo->Bind();
+    glViewport(0, 0, LUMSTATS_BINS, 1);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glPointSize(1.0f);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glUseProgram(reducer->histogramProgram);
+    glUniform2f(reducer->histogramSizeLocation, (GLfloat)reducer->width, (GLfloat)reducer->height);
+    glUniform1f(reducer->strideLocation, (GLfloat)reducer->histogramStride);
+    glUniform3fv(reducer->histogramWeightsLocation, 1, weights);
+    glBindBufferARB(GL_ARRAY_BUFFER_ARB, reducer->pointBuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, 0);
+    tilesX = (reducer->width + span - 1) / span;
+    tilesY = (reducer->height + span - 1) / span;
+    for (y = 0; y < tilesY; y++) {
+        for (x = 0; x < tilesX; x++) {
+            glUniform2f(reducer->originLocation, (GLfloat)(x * span), (GLfloat)(y * span));
+            glDrawArrays(GL_POINTS, 0, LUMSTATS_TILE * LUMSTATS_TILE);
+        }
+    }
+    glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+    glUseProgram(0);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+    glPopClientAttrib();
+    glPopAttrib();
+}
+
+// Reads the results of the passes into pbo, or straight away without one
+static void readGpuResults(LuminanceReducer *reducer, GLuint pbo)
+{
+    GLfloat results[4 + LUMSTATS_BINS];
+    char *base = pbo ? (char *)0 : (char *)results;
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    if (pbo)
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, pbo);
+    reducer->levelFbos[reducer->numLevels - 1]->Bind();
+    glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+    glReadPixels(0, 0, 1, 1, GL_RGBA, GL_FLOAT, base);
+    reducer->histogramFbo->Bind();
+    glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+    glReadPixels(0, 0, LUMSTATS_BINS, 1, GL_RED, GL_FLOAT, base + 4 * sizeof(GLfloat));
+    if (pbo)
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+    else
+        gpuStats(results, reducer->frames, reducer);
+}
+
+//
+// With buffers, the frame read into one is reduced on the next call while
+// the other takes the new frame; mapping then seldom waits, the transfer
+// had a whole frame to finish.
+//
+void reduceLuminance(LuminanceReducer *reducer, GLuint texture, const float weights[3])
+{
+    LARGE_INTEGER frequency, start, end;
+    unsigned int current = reducer->next, previous = 1 - reducer->next;
+
+    if (!reducer->width)
+        return;
+    QueryPerformanceCounter(&start);
+    reducer->frames++;
+    if (reducer->pbo[0] && reducer->pending[previous]) {
+        void *mapped;
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, reducer->pbo[previous]);
+        mapped = glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+        if (mapped) {
+            if (reducer->gpu)
+                gpuStats((const GLfloat *)mapped, reducer->pendingFrame[previous], reducer);
+            else {
+                computeLuminanceStats((const unsigned short *)mapped, (size_t)reducer->width * reducer->height,
+                    weights, &reducer->stats);
+                reducer->stats.frame = reducer->pendingFrame[previous];
+                reducer->valid = true;
+            }
+            glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+        }
+        else
+            printf("ERROR: Unable to map the luminance statistics of frame %u\n", reducer->pendingFrame[previous]);
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+        reducer->pending[previous] = false;
+    }
+
+    if (reducer->gpu) {
+        runGpuReduction(reducer, texture, weights);
+        readGpuResults(reducer, reducer->pbo[current]);
+    }
+    else {
+        glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        if (reducer->pbo[0]) {
+            glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, reducer->pbo[current]);
+            glReadPixels(0, 0, reducer->width, reducer->height, GL_RGBA, GL_HALF_FLOAT_ARB, 0);
+            glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+        }
+        else {
+            glReadPixels(0, 0, reducer->width, reducer->height, GL_RGBA, GL_HALF_FLOAT_ARB, reducer->pixels);
+            computeLuminanceStats(reducer->pixels, (size_t)reducer->width * reducer->height, weights, &reducer->stats);
+            reducer->stats.frame = reducer->frames;
+            reducer->valid = true;
+        }
+    }
+    if (reducer->pbo[0]) {
+        reducer->pending[current] = true;
+        reducer->pendingFrame[current] = reducer->frames;
+        reducer->next = previous;
+    }
+    FramebufferObject::Disable();
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&end);
+    reducer->seconds += (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+}
+
+void deleteLuminanceReducer(LuminanceReducer *reducer)
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if (reducer->reduceProgram[i])
+            glDeleteProgram(reducer->reduceProgram[i]);
+        if (reducer->pbo[i])
+            glDeleteBuffersARB(1, &reducer->pbo[i]);
+    }
+    if (reducer->histogramProgram)
+        glDeleteProgram(reducer->histogramProgram);
+    for (i = 0; i < reducer->numLevels; i++) {
+        if (reducer->levelTextures[i])
+            glDeleteTextures(1, &reducer->levelTextures[i]);
+        delete reducer->levelFbos[i];
+    }
+    if (reducer->histogramTexture)
+        glDeleteTextures(1, &reducer->histogramTexture);
+    delete reducer->histogramFbo;
+    if (reducer->pointBuffer)
+        glDeleteBuffersARB(1, &reducer->pointBuffer);
+    free(reducer->pixels);
+    memset(reducer, 0, sizeof(LuminanceReducer));
+}
+
+//
+// CPU path
+//
+
+typedef struct _LuminanceThread {
+    const unsigned short *rgba;
+    const float *weights;
+    size_t first;
+    size_t pixels;
+    float minimum;
+    float maximum;
+    double sum;
+    double logSum;
+    unsigned int histogram[4][LUMSTATS_BINS];   // a histogram per lane, no lane waits on another's count
+} LuminanceThread;
+
+// Cephes style polynomial, about 1e-6 relative error
+static __m128 poly5(__m128 x, float c0, float c1, float c2, float c3, float c4, float c5)
+{
+    __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(c5), x), _mm_set1_ps(c4));
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(c3));
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(c2));
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(c1));
+    return _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(c0));
+}
+
+// x > 0
+static __m128 log2Ps(__m128 x)
+{
+    __m128i i = _mm_castps_si128(x);
+    __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(i, 23), _mm_set1_epi32(127)));
+    __m128 m = _mm_or_ps(_mm_castsi128_ps(_mm_and_si128(i, _mm_set1_epi32(0x007fffff))), _mm_set1_ps(1.0f));
+    __m128 p = poly5(m, 3.1157899f, -3.3241990f, 2.5988452f, -1.2315303f, 3.1821337e-1f, -3.4436006e-2f);
+    return _mm_add_ps(_mm_mul_ps(p, _mm_sub_ps(m, _mm_set1_ps(1.0f))), e);
+}
+
+//
+// Bits 20 and up of a positive float are its biased exponent times 8 plus
+// the top 3 mantissa bits, so clamped to the histogram range a shift and a
+// subtraction give the bin.
+//
+static __m128i histogramBin4(__m128 l)
+{
+    const __m128 lowest = _mm_castsi128_ps(_mm_set1_epi32((127 + LUMSTATS_LOG2_MIN) << 23));
+    const __m128 highest = _mm_castsi128_ps(_mm_set1_epi32(((127 + LUMSTATS_LOG2_MAX) << 23) - 1));
+    __m128i bits = _mm_castps_si128(_mm_min_ps(_mm_max_ps(l, lowest), highest));
+
+    return _mm_sub_epi32(_mm_srli_epi32(bits, 20), _mm_set1_epi32((127 + LUMSTATS_LOG2_MIN) * 8));
+}
+
+//
+// Every block of pixels is converted to floats, a pixel per vector, and
+// transposed 4 pixels at a time into red, green and blue vectors. The last
+// group of a short block is padded with its last pixel, which leaves the
+// minimum and maximum as they are, and masked out of the sums and counts.
+//
+static unsigned __stdcall luminanceThread(void *arg)
+{
+    LuminanceThread *thread = (LuminanceThread *)arg;
+    __m128 block[LUMSTATS_BLOCK_PIXELS];
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 delta = _mm_set1_ps(LUMSTATS_LOG_DELTA);
+    const __m128 wr = _mm_set1_ps(thread->weights[0]);
+    const __m128 wg = _mm_set1_ps(thread->weights[1]);
+    const __m128 wb = _mm_set1_ps(thread->weights[2]);
+    __m128 minimum = _mm_set1_ps(65536.0f * 65536.0f), maximum = _mm_setzero_ps();
+    float lanes[4];
+    size_t done;
+    int i;
+
+    thread->sum = 0.0;
+    thread->logSum = 0.0;
+    memset(thread->histogram, 0, sizeof(thread->histogram));
+    for (done = 0; done < thread->pixels; ) {
+        size_t n = thread->pixels - done, j;
+        __m128 sum = _mm_setzero_ps(), logSum = _mm_setzero_ps();
+        float sums[4], logSums[4];
+
+        if (n > LUMSTATS_BLOCK_PIXELS)
+            n = LUMSTATS_BLOCK_PIXELS;
+        halfToFloat(thread->rgba + (thread->first + done) * 4, (float *)block, n * 4);
+        for (j = n; j % 4; j++)
+            block[j] = block[n - 1];
+        for (j = 0; j < n; j += 4) {
+            __m128 r = block[j], g = block[j + 1], b = block[j + 2], a = block[j + 3];
+            int bins[4];
+            _MM_TRANSPOSE4_PS(r, g, b, a);
+            // max(x, 0) takes NaNs to 0
+            __m128 l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_max_ps(r, zero), wr), _mm_mul_ps(_mm_max_ps(g, zero), wg)),
+                _mm_mul_ps(_mm_max_ps(b, zero), wb));
+            __m128 logL = log2Ps(_mm_add_ps(l, delta));
+            size_t valid = n - j < 4 ? n - j : 4;
+            minimum = _mm_min_ps(minimum, l);
+            maximum = _mm_max_ps(maximum, l);
+            _mm_storeu_si128((__m128i *)bins, histogramBin4(l));
+            if (valid < 4) {
+                static const int masks[8] = {-1, -1, -1, -1, 0, 0, 0, 0};
+                __m128 mask = _mm_loadu_ps((const float *)masks + 4 - valid);
+                l = _mm_and_ps(l, mask);
+                logL = _mm_and_ps(logL, mask);
+            }
+            sum = _mm_add_ps(sum, l);
+            logSum = _mm_add_ps(logSum, logL);
+            for (i = 0; i < (int)valid; i++)
+                thread->histogram[i][bins[i]]++;
+        }
+        _mm_storeu_ps(sums, sum);
+        _mm_storeu_ps(logSums, logSum);
+        thread->sum += (double)sums[0] + sums[1] + sums[2] + sums[3];
+        thread->logSum += (double)logSums[0] + logSums[1] + logSums[2] + logSums[3];
+        done += n;
+    }
+    _mm_storeu_ps(lanes, minimum);
+    thread->minimum = lanes[0];
+    for (i = 1; i < 4; i++)
+        thread->minimum = lanes[i] < thread->minimum ? lanes[i] : thread->minimum;
+    _mm_storeu_ps(lanes, maximum);
+    thread->maximum = lanes[0];
+    for (i = 1; i < 4; i++)
+        thread->maximum = lanes[i] > thread->maximum ? lanes[i] : thread->maximum;
+    return 0;
+}
+
+//
+// The pixels are split over the threads, the calling thread takes the
+// first part. The sums are added in thread order, the same result for the
+// same number of threads.
+//
+void computeLuminanceStats(const unsigned short *rgba, size_t pixels, const float weights[3],
+                           LuminanceStats *stats, unsigned int numThreads)
+{
+    LuminanceThread threads[LUMSTATS_MAX_THREADS];
+    HANDLE handles[LUMSTATS_MAX_THREADS];
+    unsigned int i, started = 0;
+    double sum = 0.0, logSum = 0.0;
+    int bin;
+
+    memset(stats, 0, sizeof(LuminanceStats));
+    if (pixels == 0)
+        return;
+    if (numThreads == 0) {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        numThreads = systemInfo.dwNumberOfProcessors;
+    }
+    if (numThreads > LUMSTATS_MAX_THREADS)
+        numThreads = LUMSTATS_MAX_THREADS;
+    if (numThreads > pixels / LUMSTATS_BLOCK_PIXELS)
+        numThreads = (unsigned int)(pixels / LUMSTATS_BLOCK_PIXELS);
+    if (numThreads < 1)
+        numThreads = 1;
+    for (i = 0; i < numThreads; i++) {
+        threads[i].rgba = rgba;
+        threads[i].weights = weights;
+        threads[i].first = pixels * i / numThreads;
+        threads[i].pixels = pixels * (i + 1) / numThreads - threads[i].first;
+    }
+    // If a thread can not be started, the calling thread does its part too
+    for (i = 1; i < numThreads; i++) {
+        handles[started] = (HANDLE)_beginthreadex(NULL, 0, luminanceThread, &threads[i], 0, NULL);
+        if (handles[started])
+            started++;
+        else
+            luminanceThread(&threads[i]);
+    }
+    luminanceThread(&threads[0]);
+    if (started) {
+        WaitForMultipleObjects(started, handles, TRUE, INFINITE);
+        for (i = 0; i < started; i++)
+            CloseHandle(handles[i]);
+    }
+
+    stats->minimum = threads[0].minimum;
+    stats->maximum = threads[0].maximum;
+    for (i = 0; i < numThreads; i++) {
+        if (threads[i].minimum < stats->minimum)
+            stats->minimum = threads[i].minimum;
+        if (threads[i].maximum > stats->maximum)
+            stats->maximum = threads[i].maximum;
+        sum += threads[i].sum;
+        logSum += threads[i].logSum;
+        for (bin = 0; bin < LUMSTATS_BINS; bin++)
+            stats->histogram[bin] += threads[i].histogram[0][bin] + threads[i].histogram[1][bin] +
+                threads[i].histogram[2][bin] + threads[i].histogram[3][bin];
+    }
+    stats->mean = (float)(sum / pixels);
+    stats->logAverage = (float)pow(2.0, logSum / pixels);
+    stats->samples = (unsigned int)pixels;
+}
+
+float luminancePercentile(const LuminanceStats *stats, float fraction)
+{
+    double target = (double)fraction * stats->samples, count = 0.0;
+    int bin;
+
+    for (bin = 0; bin < LUMSTATS_BINS - 1; bin++) {
+        count += stats->histogram[bin];
+        if (count > target)
+            break;
+    }
+    // The lower edge: exponent bin / 8, the mantissa an eighth of the octave per bin
+    return (float)ldexp(1.0 + (bin % 8) / 8.0, LUMSTATS_LOG2_MIN + bin / 8);
+}
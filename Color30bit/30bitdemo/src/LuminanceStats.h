@@ -0,0 +1,103 @@
+//
+// LuminanceStats.h
+//
+// Luminance statistics of the half float FBO attachment, every frame: the
+// minimum, maximum, mean and log average and a histogram of log2 luminance.
+// On the GPU a chain of float textures reduces 4x4 blocks per pass, each
+// texel holding the minimum, maximum, sum and log2 sum of its block, down to
+// 1x1, and the histogram is counted by drawing a point per pixel whose
+// vertex shader reads the pixel and moves it to its bin, with additive
+// blending. Without float render targets, blending on them or vertex
+// texture fetch the attachment is read back and reduced on the CPU, 4
+// pixels at a time with SSE2 on every core, each lane counting into its own
+// histogram. Either way the results are read through a pixel buffer object
+// the next frame, so the draws do not wait for them.
+//
+// The bins are the exponent and the top 3 mantissa bits of the luminance as
+// a float: 8 per octave from 2^LUMSTATS_LOG2_MIN to 2^LUMSTATS_LOG2_MAX,
+// each an eighth of its octave in value. Darker pixels count in the first
+// bin and brighter ones in the last.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef LUMINANCESTATS_H
+#define LUMINANCESTATS_H
+
+#include <stddef.h>
+
+class FramebufferObject;
+
+#define LUMSTATS_BINS           256
+#define LUMSTATS_LOG2_MIN       (-16)
+#define LUMSTATS_LOG2_MAX       16
+#define LUMSTATS_LOG_DELTA      0.0001f // keeps black pixels from dominating the log average
+#define LUMSTATS_MAX_LEVELS     12      // 4x4 reductions, enough for 4^12 pixels a side
+#define LUMSTATS_TILE           256     // points drawn at a time for the GPU histogram, a side
+#define LUMSTATS_MAX_THREADS    16
+
+typedef struct _LuminanceStats {
+    float minimum;
+    float maximum;
+    float mean;
+    float logAverage;                   // 2 ^ mean of log2(luminance + LUMSTATS_LOG_DELTA)
+    unsigned int histogram[LUMSTATS_BINS];
+    unsigned int samples;               // pixels counted in the histogram
+    unsigned int frame;                 // reduceLuminance call the frame was read in
+} LuminanceStats;
+
+typedef struct _LuminanceReducer {
+    GLsizei width;
+    GLsizei height;
+    bool gpu;                           // false: read back and reduced on the CPU
+    // GPU path
+    GLuint reduceProgram[2];            // from the image, from a level
+    GLint sizeLocation[2];
+    GLint weightsLocation;
+    GLuint histogramProgram;
+    GLint histogramSizeLocation;
+    GLint originLocation;
+    GLint strideLocation;
+    GLint histogramWeightsLocation;
+    int numLevels;
+    GLsizei levelWidth[LUMSTATS_MAX_LEVELS];
+    GLsizei levelHeight[LUMSTATS_MAX_LEVELS];
+    GLuint levelTextures[LUMSTATS_MAX_LEVELS];    // RGBA32F minimum, maximum, sum, log2 sum
+    FramebufferObject *levelFbos[LUMSTATS_MAX_LEVELS];
+    GLuint histogramTexture;            // LUMSTATS_BINS x 1 RGBA32F, counts in red
+    FramebufferObject *histogramFbo;
+    GLuint pointBuffer;                 // LUMSTATS_TILE^2 points, a vertex buffer object
+    int histogramStride;                // every stride-th pixel of every stride-th row is counted
+    // Readback, the last two frames
+    GLuint pbo[2];                      // 0 without pixel buffer objects
+    bool pending[2];
+    unsigned int pendingFrame[2];
+    unsigned short *pixels;             // CPU path without pixel buffer objects
+    unsigned int next;
+    unsigned int frames;                // reduceLuminance calls
+    // Results
+    LuminanceStats stats;               // the latest frame reduced
+    bool valid;                         // stats holds a frame
+    double seconds;                     // time spent in reduceLuminance
+} LuminanceReducer;
+
+// GL context must be valid. Frames are width x height; gpu false, or no
+// GPU support, reduces them on the CPU. histogramStride thins the points of
+// the GPU histogram, 1 counts every pixel. Returns false if neither path
+// can be set up, the reason is printed.
+extern bool initLuminanceReducer(LuminanceReducer *reducer, GLsizei width, GLsizei height, bool gpu = true,
+                                 int histogramStride = 1);
+// Call once per frame with the framebuffer whose first color attachment is
+// texture, a GL_TEXTURE_2D of width x height, bound. Starts the reduction of
+// this frame with the luminance weights and collects the one of the frame
+// before into stats. Leaves the window framebuffer bound.
+extern void reduceLuminance(LuminanceReducer *reducer, GLuint texture, const float weights[3]);
+extern void deleteLuminanceReducer(LuminanceReducer *reducer);
+
+// CPU path on half RGBA pixels. numThreads 0 uses every core.
+extern void computeLuminanceStats(const unsigned short *rgba, size_t pixels, const float weights[3],
+                                  LuminanceStats *stats, unsigned int numThreads = 0);
+// Luminance at the 0..1 fraction of the pixels counted, from the histogram:
+// the lower edge of the bin it falls in
+extern float luminancePercentile(const LuminanceStats *stats, float fraction);
+
+#endif
@@ -0,0 +1,17 @@
+//
+// PboEntryPoints.h
+//
+// The OpenGL headers and entry points the shared PboUploader is built
+// against. hasExtension, loadBufferEntryPoints and loadFenceEntryPoints are
+// those of glShaderUtil, which loads the ARB and NV named pointers.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PBOENTRYPOINTS_H
+#define PBOENTRYPOINTS_H
+
+#include <gl/gl.h>
+#include <GL/glext.h>
+#include "glShaderUtil.h"
+
+#endif
@@ -0,0 +1,336 @@
+//
+// TiledExr.cpp
+//
+// Lazy tile decode with an LRU tile atlas
+//
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <map>
+#include <vector>
+#include <gl/gl.h>
+#include <GL/glext.h>
+#include <ImfTiledRgbaFile.h>
+#include <ImfThreading.h>
+#include <ImfStandardAttributes.h>
+#include "TiledExr.h"
+
+#define TILE_GUTTER             1           // texels of the tile's edges repeated around its slot
+
+typedef struct _TileSlot {
+    int level;                              // -1 if empty
+    int dx, dy;
+    unsigned int lastUsed;                  // frame the tile was last drawn
+} TileSlot;
+
+typedef struct _VisibleTile {
+    int dx, dy;
+    GLuint slot;
+} VisibleTile;
+
+struct _TiledExrIndex {
+    std::vector<TileSlot> slots;
+    std::map<unsigned __int64, GLuint> lookup;      // tileKey -> slot
+    std::vector<VisibleTile> visible;
+    std::vector<Imf::Rgba> staging;                 // decoded run of tiles
+    std::vector<Imf::Rgba> padded;                  // a tile with its gutter
+};
+
+static unsigned __int64 tileKey(int level, int dx, int dy)
+{
+    return ((unsigned __int64)level << 48) | ((unsigned __int64)(unsigned int)dy << 24) | (unsigned int)dx;
+}
+
+// The file's chromaticities or, without them, the BT.709 defaults
+static void readChromaticities(const Imf::Header &header, bool *present, float xy[8])
+{
+    Imf::Chromaticities c;
+
+    *present = Imf::hasChromaticities(header);
+    if (*present)
+        c = Imf::chromaticities(header);
+    xy[0] = c.red.x; xy[1] = c.red.y;
+    xy[2] = c.green.x; xy[3] = c.green.y;
+    xy[4] = c.blue.x; xy[5] = c.blue.y;
+    xy[6] = c.white.x; xy[7] = c.white.y;
+}
+
+// Atlas texel of the top left texel of a slot, inside its gutter
+static GLuint slotX(const TiledExr *exr, GLuint slot)
+{
+    return (slot % exr->slotsX) * (exr->tileWidth + 2 * TILE_GUTTER) + TILE_GUTTER;
+}
+
+static GLuint slotY(const TiledExr *exr, GLuint slot)
+{
+    return (slot / exr->slotsX) * (exr->tileHeight + 2 * TILE_GUTTER) + TILE_GUTTER;
+}
+
+// The width x height tile at src surrounded by copies of its edge texels,
+// so that linear filtering at the border of the slot reads the tile's own
+// texels and never those of the neighbouring slot
+static void padTile(const Imf::Rgba *src, int rowLength, int width, int height, Imf::Rgba *dst)
+{
+    int y;
+
+    for (y = -TILE_GUTTER; y < height + TILE_GUTTER; y++) {
+        const Imf::Rgba *row = src + (ptrdiff_t)(y < 0 ? 0 : y >= height ? height - 1 : y) * rowLength;
+        Imf::Rgba *out = dst + (ptrdiff_t)(y + TILE_GUTTER) * (width + 2 * TILE_GUTTER);
+        int x;
+        for (x = 0; x < TILE_GUTTER; x++) {
+            out[x] = row[0];
+            out[TILE_GUTTER + width + x] = row[width - 1];
+        }
+        memcpy(out + TILE_GUTTER, row, width * sizeof(Imf::Rgba));
+    }
+}
+
+bool openTiledExr(TiledExr *exr, const char *fileName)
+{
+    GLint maxSize = 0;
+    GLuint i;
+
+    memset(exr, 0, sizeof(TiledExr));
+    if (Imf::globalThreadCount() == 0) {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        Imf::setGlobalThreadCount(systemInfo.dwNumberOfProcessors);
+    }
+    try {
+        exr->file = new Imf::TiledRgbaInputFile(fileName, Imf::globalThreadCount());
+    }
+    catch (Iex::BaseExc &e) {
+        printf("ERROR: Unable to load %s: %s\n", fileName, e.what());
+        return false;
+    }
+    readChromaticities(exr->file->header(), &exr->hasChromaticities, exr->chromaticities);
+    exr->width = exr->file->levelWidth(0);
+    exr->height = exr->file->levelHeight(0);
+    exr->tileWidth = exr->file->tileXSize();
+    exr->tileHeight = exr->file->tileYSize();
+    // Levels are used with the same number along x and y, which covers rip maps too
+    exr->numLevels = exr->file->numXLevels() < exr->file->numYLevels() ? exr->file->numXLevels() : exr->file->numYLevels();
+
+    glGetIntegerv(GL_MAX_RECTANGLE_TEXTURE_SIZE_NV, &maxSize);
+    if (maxSize <= 0 || maxSize > TILED_EXR_ATLAS_SIZE)
+        maxSize = TILED_EXR_ATLAS_SIZE;
+    exr->slotsX = maxSize / (exr->tileWidth + 2 * TILE_GUTTER);
+    exr->numSlots = exr->slotsX * (maxSize / (exr->tileHeight + 2 * TILE_GUTTER));
+    if (exr->numSlots == 0) {
+        printf("ERROR: %s has %ux%u tiles, larger than the %d texel atlas\n", fileName, exr->tileWidth, exr->tileHeight, maxSize);
+        closeTiledExr(exr);
+        return false;
+    }
+    glGenTextures(1, &exr->atlasTexture);
+    glBindTexture(GL_TEXTURE_RECTANGLE_NV, exr->atlasTexture);
+    glTexParameteri(GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_RECTANGLE_NV, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_RECTANGLE_NV, 0, GL_RGBA16F_ARB, exr->slotsX * (exr->tileWidth + 2 * TILE_GUTTER),
+        (exr->numSlots / exr->slotsX) * (exr->tileHeight + 2 * TILE_GUTTER), 0, GL_RGBA, GL_HALF_FLOAT_ARB, NULL);
+
+    exr->index = new TiledExrIndex;
+    exr->index->slots.resize(exr->numSlots);
+    for (i = 0; i < exr->numSlots; i++) {
+        exr->index->slots[i].level = -1;
+        exr->index->slots[i].lastUsed = 0;
+    }
+    printf("%s: %ux%u tiled %ux%u, %d levels, %u cached tiles\n", fileName, exr->width, exr->height,
+        exr->tileWidth, exr->tileHeight, exr->numLevels, exr->numSlots);
+    return true;
+}
+
+// The least recently drawn slot not drawn in this frame, numSlots if there is none
+static GLuint evictSlot(TiledExr *exr)
+{
+    TiledExrIndex *index = exr->index;
+    GLuint i, best = exr->numSlots;
+    unsigned int oldest = exr->frame;
+
+    for (i = 0; i < exr->numSlots; i++) {
+        if (index->slots[i].level < 0)
+            return i;
+        if (index->slots[i].lastUsed < oldest) {
+            oldest = index->slots[i].lastUsed;
+            best = i;
+        }
+    }
+    if (best < exr->numSlots)
+        index->lookup.erase(tileKey(index->slots[best].level, index->slots[best].dx, index->slots[best].dy));
+    return best;
+}
+
+//
+// decodeRun
+//
+// Decodes tiles dxMin..dxMax of tile row dy in one readTiles call, which
+// spreads them over the thread pool, and copies each into its slot.
+//
+static void decodeRun(TiledExr *exr, int level, int dxMin, int dxMax, int dy)
+{
+    TiledExrIndex *index = exr->index;
+    Imath::Box2i first = exr->file->dataWindowForTile(dxMin, dy, level, level);
+    Imath::Box2i last = exr->file->dataWindowForTile(dxMax, dy, level, level);
+    int runWidth = last.max.x - first.min.x + 1;
+    int runHeight = first.max.y - first.min.y + 1;
+    LARGE_INTEGER start, end, frequency;
+    int dx;
+
+    if (index->staging.size() < (size_t)runWidth * runHeight)
+        index->staging.resize((size_t)runWidth * runHeight);
+    index->padded.resize((size_t)(exr->tileWidth + 2 * TILE_GUTTER) * (runHeight + 2 * TILE_GUTTER));
+    QueryPerformanceCounter(&start);
+    try {
+        exr->file->setFrameBuffer(&index->staging[0] - first.min.x - (ptrdiff_t)first.min.y * runWidth, 1, runWidth);
+        exr->file->readTiles(dxMin, dxMax, dy, dy, level, level);
+    }
+    catch (Iex::BaseExc &e) {
+        printf("ERROR: Unable to decode tiles %d..%d,%d of level %d: %s\n", dxMin, dxMax, dy, level, e.what());
+        return;
+    }
+    QueryPerformanceCounter(&end);
+    QueryPerformanceFrequency(&frequency);
+    exr->decodeSeconds += (double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+
+    glBindTexture(GL_TEXTURE_RECTANGLE_NV, exr->atlasTexture);
+    glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    for (dx = dxMin; dx <= dxMax; dx++) {
+        Imath::Box2i box = exr->file->dataWindowForTile(dx, dy, level, level);
+        int tileWidth = box.max.x - box.min.x + 1;
+        GLuint slot = evictSlot(exr);
+        if (slot == exr->numSlots)
+            break;
+        TileSlot &s = index->slots[slot];
+        s.level = level;
+        s.dx = dx;
+        s.dy = dy;
+        s.lastUsed = exr->frame;
+        index->lookup[tileKey(level, dx, dy)] = slot;
+        padTile(&index->staging[box.min.x - first.min.x], runWidth, tileWidth, runHeight, &index->padded[0]);
+        glTexSubImage2D(GL_TEXTURE_RECTANGLE_NV, 0, slotX(exr, slot) - TILE_GUTTER, slotY(exr, slot) - TILE_GUTTER,
+            tileWidth + 2 * TILE_GUTTER, runHeight + 2 * TILE_GUTTER, GL_RGBA, GL_HALF_FLOAT_ARB, &index->padded[0]);
+        exr->tilesDecoded++;
+    }
+    glPopClientAttrib();
+}
+
+unsigned int updateTiledExr(TiledExr *exr, float x0, float y0, float x1, float y1, int viewWidth, int viewHeight)
+{
+    TiledExrIndex *index = exr->index;
+    unsigned int decoded = exr->tilesDecoded;
+    int level, dxMin, dxMax, dyMin, dyMax, dx, dy;
+
+    if (!exr->file || x1 <= x0 || y1 <= y0)
+        return 0;
+    exr->frame++;
+    exr->index->visible.clear();
+    if (x1 <= 0.0f || x0 >= viewWidth || y1 <= 0.0f || y0 >= viewHeight)
+        return 0;
+
+    // The finest level with no more than one of its pixels per screen pixel
+    level = (int)floor(log((double)exr->width / (x1 - x0)) / log(2.0));
+    if (level < 0)
+        level = 0;
+    for (;;) {
+        if (level >= exr->numLevels)
+            level = exr->numLevels - 1;
+        int levelWidth = exr->file->levelWidth(level);
+        int levelHeight = exr->file->levelHeight(level);
+        float scaleX = (x1 - x0) / levelWidth;
+        float scaleY = (y1 - y0) / levelHeight;
+        // Level pixels under the viewport, the top row is at y1
+        dxMin = (int)floor((0.0f - x0) / scaleX) / (int)exr->tileWidth;
+        dxMax = (int)floor((viewWidth - x0) / scaleX) / (int)exr->tileWidth;
+        dyMin = (int)floor((y1 - viewHeight) / scaleY) / (int)exr->tileHeight;
+        dyMax = (int)floor((y1 - 0.0f) / scaleY) / (int)exr->tileHeight;
+        if (dxMin < 0) dxMin = 0;
+        if (dyMin < 0) dyMin = 0;
+        if (dxMax >= exr->file->numXTiles(level)) dxMax = exr->file->numXTiles(level) - 1;
+        if (dyMax >= exr->file->numYTiles(level)) dyMax = exr->file->numYTiles(level) - 1;
+        // A coarser level if the visible tiles do not fit the cache
+        if ((dxMax - dxMin + 1) * (dyMax - dyMin + 1) <= (int)exr->numSlots || level == exr->numLevels - 1)
+            break;
+        level++;
+    }
+    exr->level = level;
+
+    // Cached tiles are marked first, so the decodes below can not evict them
+    for (dy = dyMin; dy <= dyMax; dy++) {
+        for (dx = dxMin; dx <= dxMax; dx++) {
+            std::map<unsigned __int64, GLuint>::iterator it = index->lookup.find(tileKey(level, dx, dy));
+            if (it != index->lookup.end()) {
+                index->slots[it->second].lastUsed = exr->frame;
+                exr->tilesReused++;
+            }
+        }
+    }
+    for (dy = dyMin; dy <= dyMax; dy++) {
+        for (dx = dxMin; dx <= dxMax; ) {
+            int runEnd = dx;
+            while (runEnd <= dxMax && index->lookup.find(tileKey(level, runEnd, dy)) == index->lookup.end())
+                runEnd++;
+            if (runEnd > dx)
+                decodeRun(exr, level, dx, runEnd - 1, dy);
+            dx = runEnd + 1;
+        }
+        for (dx = dxMin; dx <= dxMax; dx++) {
+            std::map<unsigned __int64, GLuint>::iterator it = index->lookup.find(tileKey(level, dx, dy));
+            if (it != index->lookup.end()) {
+                VisibleTile tile = {dx, dy, it->second};
+                index->visible.push_back(tile);
+            }
+        }
+    }
+    return exr->tilesDecoded - decoded;
+}
+
+void drawTiledExr(TiledExr *exr, float x0, float y0, float x1, float y1)
+{
+    TiledExrIndex *index = exr->index;
+    size_t i;
+
+    if (!exr->file || index->visible.empty())
+        return;
+    int levelWidth = exr->file->levelWidth(exr->level);
+    int levelHeight = exr->file->levelHeight(exr->level);
+    float scaleX = (x1 - x0) / levelWidth;
+    float scaleY = (y1 - y0) / levelHeight;
+    Imath::Box2i window = exr->file->dataWindowForLevel(exr->level, exr->level);
+
+    glEnable(GL_TEXTURE_RECTANGLE_NV);
+    glBindTexture(GL_TEXTURE_RECTANGLE_NV, exr->atlasTexture);
+    glBegin(GL_QUADS);
+    for (i = 0; i < index->visible.size(); i++) {
+        const VisibleTile &tile = index->visible[i];
+        Imath::Box2i box = exr->file->dataWindowForTile(tile.dx, tile.dy, exr->level, exr->level);
+        float left = x0 + (box.min.x - window.min.x) * scaleX;
+        float right = x0 + (box.max.x - window.min.x + 1) * scaleX;
+        float top = y1 - (box.min.y - window.min.y) * scaleY;
+        float bottom = y1 - (box.max.y - window.min.y + 1) * scaleY;
+        // The whole texels of the tile, w texels on w pixels; the filter
+        // reaches half a texel into the gutter at the edges, never further
+        float u0 = (float)slotX(exr, tile.slot);
+        float v0 = (float)slotY(exr, tile.slot);
+        float u1 = u0 + (box.max.x - box.min.x + 1);
+        float v1 = v0 + (box.max.y - box.min.y + 1);
+        glTexCoord2f(u0, v1); glVertex2f(left, bottom);
+        glTexCoord2f(u1, v1); glVertex2f(right, bottom);
+        glTexCoord2f(u1, v0); glVertex2f(right, top);
+        glTexCoord2f(u0, v0); glVertex2f(left, top);
+    }
+    glEnd();
+    glDisable(GL_TEXTURE_RECTANGLE_NV);
+}
+
+void closeTiledExr(TiledExr *exr)
+{
+    if (exr->atlasTexture)
+        glDeleteTextures(1, &exr->atlasTexture);
+    delete exr->index;
+    delete exr->file;
+    memset(exr, 0, sizeof(TiledExr));
+}
@@ -0,0 +1,59 @@
+//
+// TiledExr.h
+//
+// Tiled (optionally mip or rip mapped) OpenEXR images of any size shown by
+// decoding only the tiles under the window. Opening reads just the header
+// and the tile offsets. Every draw picks the level whose pixels are closest
+// to screen pixels for the current pan and zoom, and decodes the visible
+// tiles that are not cached yet, contiguous runs of them in one readTiles
+// call on the IlmImf thread pool. Tiles live in the slots of one half float
+// rectangle texture, each with a one texel gutter repeating its edges so
+// that linear filtering stays inside the slot, the least recently drawn
+// slot is reused.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TILEDEXR_H
+#define TILEDEXR_H
+
+namespace Imf { class TiledRgbaInputFile; }
+
+#define TILED_EXR_ATLAS_SIZE    4096        // texels, lowered to the largest rectangle texture
+
+typedef struct _TiledExrIndex TiledExrIndex;
+
+typedef struct _TiledExr {
+    GLuint width;                           // level 0
+    GLuint height;
+    GLuint tileWidth;
+    GLuint tileHeight;
+    int numLevels;                          // levels along both axes
+    int level;                              // level of the last update
+    // Tile cache
+    GLuint atlasTexture;                    // GL_TEXTURE_RECTANGLE_NV, RGBA16F
+    GLuint slotsX;                          // slots per atlas row
+    GLuint numSlots;
+    unsigned int frame;                     // update counter, the LRU clock
+    TiledExrIndex *index;                   // slots, tile lookup and the visible list
+    Imf::TiledRgbaInputFile *file;
+    bool hasChromaticities;                 // false: BT.709 is assumed
+    float chromaticities[8];                // red, green, blue and white x, y
+    // Statistics
+    unsigned int tilesDecoded;
+    unsigned int tilesReused;
+    double decodeSeconds;
+} TiledExr;
+
+// Opens the file and creates the tile atlas, no pixels are decoded. Returns
+// false if the file is not a tiled OpenEXR image, the reason is printed.
+extern bool openTiledExr(TiledExr *exr, const char *fileName);
+// The image covers x0..x1, y0..y1 (top row at y1) of a viewWidth x
+// viewHeight viewport. Selects the level and makes the tiles in the
+// viewport resident. Returns the number of tiles decoded.
+extern unsigned int updateTiledExr(TiledExr *exr, float x0, float y0, float x1, float y1,
+                                   int viewWidth, int viewHeight);
+// Draws the tiles of the last update as textured quads.
+extern void drawTiledExr(TiledExr *exr, float x0, float y0, float x1, float y1);
+extern void closeTiledExr(TiledExr *exr);
+
+#endif
@@ -0,0 +1,568 @@
+//
+// ToneMap.cpp
+//
+// GLSL and SSE2 tone mapping operators, HDR output, auto exposure metering
+//
+#include <windows.h>
+#include <process.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <emmintrin.h>
+#include <gl/gl.h>
+#include <GL/glext.h>
+#include "framebufferObject.h"
+#include "HalfConvert.h"
+#include "TransferFunction.h"
+#include "Gamut.h"
+#include "glShaderUtil.h"
+#include "ToneMap.h"
+
+#define TONEMAP_BLOCK_PIXELS    64      // pixels staged as floats at a time, multiple of 4
+#define HABLE_WHITE             11.2f   // linear value the filmic curve maps to 1.0
+#define HABLE_EXPOSURE_BIAS     2.0f
+#define TONEMAP_LUT_ERROR       (0.25f / 1023.0f)   // a quarter of a 10-bit step
+#define TONEMAP_OOTF_ERROR      (TONEMAP_LUT_ERROR / 64.0f) // the OOTF gain is divided by small luminances
+
+static const char *vertexSource =
+    "void main()\n"
+    "{\n"
+    "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+    "    gl_Position = ftransform();\n"
+    "}\n";
+
+// The operators are the same as the SSE2 ones below, transferGlslSource and
+// gamutGlslSource go in between. The exposure is in the gamut matrix.
+static const char *toneMapHeader =
+    "#extension GL_ARB_texture_rectangle : enable\n";
+static const char *toneMapSource =
+    "uniform sampler2DRect image;\n"
+    "uniform int op;\n"
+    "uniform float whitePoint;\n"
+    "uniform vec3 luminance;\n"
+    "uniform float invGamma;\n"
+    "uniform int encoding;\n"
+    "uniform float peak;\n"
+    "uniform float invSystemGamma;\n"
+    "vec3 hable(vec3 x)\n"
+    "{\n"
+    "    return (x * (0.15 * x + 0.05) + 0.004) / (x * (0.15 * x + 0.5) + 0.06) - 0.02 / 0.3;\n"
+    "}\n"
+    "vec3 aces(vec3 c)\n"
+    "{\n"
+    "    vec3 v = vec3(dot(c, vec3(0.59719, 0.35458, 0.04823)), dot(c, vec3(0.07600, 0.90834, 0.01566)),\n"
+    "        dot(c, vec3(0.02840, 0.13383, 0.83777)));\n"
+    "    v = (v * (v + 0.0245786) - 0.000090537) / (v * (0.983729 * v + 0.4329510) + 0.238081);\n"
+    "    return vec3(dot(v, vec3(1.60475, -0.53108, -0.07367)), dot(v, vec3(-0.10208, 1.10813, -0.00605)),\n"
+    "        dot(v, vec3(-0.00327, -0.07276, 1.07602)));\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "    vec3 c = max(convertGamut(texture2DRect(image, gl_TexCoord[0].st).rgb), 0.0);\n"
+    "    if (op == 1) {\n"
+    "        float l = dot(c, luminance);\n"
+    "        c *= (1.0 + l / (whitePoint * whitePoint)) / (1.0 + l);\n"
+    "    }\n"
+    "    else if (op == 2)\n"
+    "        c = hable(2.0 * c) / hable(vec3(11.2));\n"
+    "    else if (op == 3)\n"
+    "        c = aces(c);\n"
+    "    c = clamp(c, 0.0, 1.0);\n"
+    "    if (encoding == 1)\n"
+    "        c = pqEncode(c * peak);\n"
+    "    else if (encoding == 2)\n"
+    "        c = hlgEncode(hlgOotf(c, invSystemGamma));\n"
+    "    else\n"
+    "        c = pow(c, vec3(invGamma));\n"
+    "    gl_FragColor = vec4(c, 1.0);\n"
+    "}\n";
+
+// log2 of the luminance and coverage, the mipmaps average both. The weights
+// are the ones of the source gamut, the meter sees the image before it is
+// converted.
+static const char *meterSource =
+    "#extension GL_ARB_texture_rectangle : enable\n"
+    "uniform sampler2DRect image;\n"
+    "uniform vec3 weights;\n"
+    "void main()\n"
+    "{\n"
+    "    float l = dot(max(texture2DRect(image, gl_TexCoord[0].st).rgb, 0.0), weights);\n"
+    "    gl_FragColor = vec4(log2(l + 0.0001), 0.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const float logDelta = 0.0001f;  // keeps black pixels from dominating the average
+
+const char *toneMapName(int op)
+{
+    static const char *names[TONEMAP_COUNT] = {"Clip", "Reinhard", "Hable filmic", "ACES"};
+
+    return (op >= 0 && op < TONEMAP_COUNT) ? names[op] : "unknown";
+}
+
+const char *toneMapOutputName(int output)
+{
+    static const char *names[TONEMAP_OUTPUT_COUNT] = {"gamma", "PQ", "HLG"};
+
+    return (output >= 0 && output < TONEMAP_OUTPUT_COUNT) ? names[output] : "unknown";
+}
+
+void defaultToneMapParams(ToneMapParams *params)
+{
+    params->op = TONEMAP_CLIP;
+    params->exposure = 0.0f;
+    params->autoExposure = false;
+    params->whitePoint = 4.0f;
+    params->gamma = 1.0f;
+    params->output = TONEMAP_OUTPUT_GAMMA;
+    params->peakNits = 1000.0f;
+    params->sourceGamut = GAMUT_BT709;
+    params->displayGamut = GAMUT_BT709;
+    params->gamutMapping = GAMUT_MAP_COMPRESS;
+}
+
+float toneMapScale(const ToneMapParams *params, float averageLog2)
+{
+    float stops = params->exposure;
+
+    if (params->autoExposure)
+        stops += logf(TONEMAP_KEY) / logf(2.0f) - averageLog2;
+    return powf(2.0f, stops);
+}
+
+bool initToneMapper(ToneMapper *mapper)
+{
+    const char *toneMapSources[4] = {toneMapHeader, transferGlslSource, gamutGlslSource, toneMapSource};
+    GLint size;
+    int i;
+
+    memset(mapper, 0, sizeof(ToneMapper));
+    if (!loadShaderEntryPoints() || !glGenerateMipmapEXT) {
+        printf("No OpenGL 2.0 shaders or mipmap generation, the EXR image is not tone mapped\n");
+        return false;
+    }
+
+    mapper->program = buildProgram(&vertexSource, 1, toneMapSources, 4, "tone mapping");
+    mapper->meterProgram = buildProgram(&vertexSource, 1, &meterSource, 1, "exposure meter");
+    if (!mapper->program || !mapper->meterProgram) {
+        deleteToneMapper(mapper);
+        return false;
+    }
+    mapper->opLocation = glGetUniformLocation(mapper->program, "op");
+    mapper->whitePointLocation = glGetUniformLocation(mapper->program, "whitePoint");
+    mapper->luminanceLocation = glGetUniformLocation(mapper->program, "luminance");
+    mapper->invGammaLocation = glGetUniformLocation(mapper->program, "invGamma");
+    mapper->encodingLocation = glGetUniformLocation(mapper->program, "encoding");
+    mapper->peakLocation = glGetUniformLocation(mapper->program, "peak");
+    mapper->invSystemGammaLocation = glGetUniformLocation(mapper->program, "invSystemGamma");
+    mapper->meterWeightsLocation = glGetUniformLocation(mapper->meterProgram, "weights");
+
+    glGenTextures(1, &mapper->meterTexture);
+    glBindTexture(GL_TEXTURE_2D, mapper->meterTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F_ARB, TONEMAP_METER_SIZE, TONEMAP_METER_SIZE, 0, GL_RGBA, GL_HALF_FLOAT_ARB, 0);
+    glGenerateMipmapEXT(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    for (size = TONEMAP_METER_SIZE; size > 1; size /= 2)
+        mapper->meterLevel++;
+    mapper->meterFbo = new FramebufferObject;
+    mapper->meterFbo->Bind();
+    mapper->meterFbo->AttachTexture(GL_TEXTURE_2D, mapper->meterTexture, GL_COLOR_ATTACHMENT0_EXT);
+    mapper->meterFbo->IsValid();
+    FramebufferObject::Disable();
+    if (hasExtension("GL_ARB_pixel_buffer_object") && loadBufferEntryPoints()) {
+        glGenBuffersARB(2, mapper->meterPbo);
+        for (i = 0; i < 2; i++) {
+            glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, mapper->meterPbo[i]);
+            glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, 4 * sizeof(GLfloat), NULL, GL_STREAM_READ_ARB);
+        }
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+    }
+    else
+        printf("No pixel buffer objects, the exposure meter waits for the frame\n");
+    return true;
+}
+
+void beginToneMapMeter(ToneMapper *mapper, const ToneMapParams *params)
+{
+    float weights[3];
+
+    gamutLuminance(params->sourceGamut, weights);
+    glGetIntegerv(GL_VIEWPORT, mapper->savedViewport);
+    mapper->meterFbo->Bind();
+    glViewport(0, 0, TONEMAP_METER_SIZE, TONEMAP_METER_SIZE);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glUseProgram(mapper->meterProgram);
+    glUniform3fv(mapper->meterWeightsLocation, 1, weights);
+}
+
+//
+// Alpha is the part of the meter the image covered, so the average over the
+// drawn pixels is red / alpha. The 1x1 level goes into one pixel buffer
+// object while the one of the frame before is read from the other, by then
+// the GPU is done with it. Without them glGetTexImage waits for the meter.
+//
+float endToneMapMeter(ToneMapper *mapper)
+{
+    GLfloat texel[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+    glUseProgram(0);
+    FramebufferObject::Disable();
+    glViewport(mapper->savedViewport[0], mapper->savedViewport[1], mapper->savedViewport[2], mapper->savedViewport[3]);
+    glBindTexture(GL_TEXTURE_2D, mapper->meterTexture);
+    glGenerateMipmapEXT(GL_TEXTURE_2D);
+    if (mapper->meterPbo[0]) {
+        unsigned int previous = mapper->meterNext ^ 1;
+        const GLfloat *mapped;
+        if (mapper->meterPending[previous]) {
+            glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, mapper->meterPbo[previous]);
+            mapped = (const GLfloat *)glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+            if (mapped) {
+                memcpy(texel, mapped, sizeof(texel));
+                glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+            }
+            mapper->meterPending[previous] = false;
+        }
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, mapper->meterPbo[mapper->meterNext]);
+        glGetTexImage(GL_TEXTURE_2D, mapper->meterLevel, GL_RGBA, GL_FLOAT, 0);
+        glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+        mapper->meterPending[mapper->meterNext] = true;
+        mapper->meterNext = previous;
+    }
+    else
+        glGetTexImage(GL_TEXTURE_2D, mapper->meterLevel, GL_RGBA, GL_FLOAT, texel);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if (texel[3] > 0.0f)
+        mapper->averageLog2 = texel[0] / texel[3];
+    return mapper->averageLog2;
+}
+
+void beginToneMap(ToneMapper *mapper, const ToneMapParams *params)
+{
+    GamutConversion gamut;
+    float luminance[3];
+
+    setupGamutConversion(&gamut, params->sourceGamut, params->displayGamut, params->gamutMapping,
+        toneMapScale(params, mapper->averageLog2));
+    gamutLuminance(params->displayGamut, luminance);
+    glUseProgram(mapper->program);
+    setGamutUniforms(mapper->program, &gamut);
+    glUniform1i(mapper->opLocation, params->op);
+    glUniform1f(mapper->whitePointLocation, params->whitePoint);
+    glUniform3fv(mapper->luminanceLocation, 1, luminance);
+    glUniform1f(mapper->invGammaLocation, 1.0f / params->gamma);
+    glUniform1i(mapper->encodingLocation, params->output);
+    glUniform1f(mapper->peakLocation, params->peakNits / TRANSFER_PQ_PEAK_NITS);
+    glUniform1f(mapper->invSystemGammaLocation, 1.0f / hlgSystemGamma(params->peakNits));
+}
+
+void endToneMap(ToneMapper *mapper)
+{
+    glUseProgram(0);
+}
+
+void deleteToneMapper(ToneMapper *mapper)
+{
+    if (mapper->program)
+        glDeleteProgram(mapper->program);
+    if (mapper->meterProgram)
+        glDeleteProgram(mapper->meterProgram);
+    if (mapper->meterTexture)
+        glDeleteTextures(1, &mapper->meterTexture);
+    delete mapper->meterFbo;
+    if (mapper->meterPbo[0])
+        glDeleteBuffersARB(2, mapper->meterPbo);
+    memset(mapper, 0, sizeof(ToneMapper));
+}
+
+//
+// CPU path
+//
+
+// Cephes style polynomials, about 1e-6 relative error, far below a 10-bit step
+static __m128 poly5(__m128 x, float c0, float c1, float c2, float c3, float c4, float c5)
+{
+    __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(c5), x), _mm_set1_ps(c4));
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(c3));
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(c2));
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(c1));
+    return _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(c0));
+}
+
+// x >= 0, 0 gives -127
+static __m128 log2Ps(__m128 x)
+{
+    __m128i i = _mm_castps_si128(x);
+    __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(i, 23), _mm_set1_epi32(127)));
+    __m128 m = _mm_or_ps(_mm_castsi128_ps(_mm_and_si128(i, _mm_set1_epi32(0x007fffff))), _mm_set1_ps(1.0f));
+    __m128 p = poly5(m, 3.1157899f, -3.3241990f, 2.5988452f, -1.2315303f, 3.1821337e-1f, -3.4436006e-2f);
+    return _mm_add_ps(_mm_mul_ps(p, _mm_sub_ps(m, _mm_set1_ps(1.0f))), e);
+}
+
+static __m128 exp2Ps(__m128 x)
+{
+    x = _mm_max_ps(_mm_min_ps(x, _mm_set1_ps(127.0f)), _mm_set1_ps(-126.0f));
+    // floor, the round to even of x - 0.5 is off only for integer x, where the fraction becomes 1
+    __m128i ipart = _mm_cvtps_epi32(_mm_sub_ps(x, _mm_set1_ps(0.5f)));
+    __m128 fpart = _mm_sub_ps(x, _mm_cvtepi32_ps(ipart));
+    __m128 expipart = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(ipart, _mm_set1_epi32(127)), 23));
+    __m128 expfpart = poly5(fpart, 9.9999994e-1f, 6.9315308e-1f, 2.4015361e-1f, 5.5826318e-2f, 8.9893397e-3f, 1.8775767e-3f);
+    return _mm_mul_ps(expipart, expfpart);
+}
+
+static __m128 luminance4(__m128 r, __m128 g, __m128 b, const float weights[3])
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(weights[0])), _mm_mul_ps(g, _mm_set1_ps(weights[1]))),
+        _mm_mul_ps(b, _mm_set1_ps(weights[2])));
+}
+
+static __m128 hable4(__m128 x)
+{
+    __m128 n = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(0.15f)), _mm_set1_ps(0.05f))), _mm_set1_ps(0.004f));
+    __m128 d = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(0.15f)), _mm_set1_ps(0.5f))), _mm_set1_ps(0.06f));
+    return _mm_sub_ps(_mm_div_ps(n, d), _mm_set1_ps(0.02f / 0.3f));
+}
+
+static __m128 dot4(__m128 r, __m128 g, __m128 b, float cr, float cg, float cb)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(cr)), _mm_mul_ps(g, _mm_set1_ps(cg))), _mm_mul_ps(b, _mm_set1_ps(cb)));
+}
+
+static __m128 acesFit4(__m128 v)
+{
+    __m128 n = _mm_sub_ps(_mm_mul_ps(v, _mm_add_ps(v, _mm_set1_ps(0.0245786f))), _mm_set1_ps(0.000090537f));
+    __m128 d = _mm_add_ps(_mm_mul_ps(v, _mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(0.983729f)), _mm_set1_ps(0.4329510f))),
+        _mm_set1_ps(0.238081f));
+    return _mm_div_ps(n, d);
+}
+
+typedef struct _ToneMapJob {
+    const unsigned short *rgba;
+    unsigned int *dst;                  // NULL when metering
+    const ToneMapParams *params;
+    GamutConversion gamut;              // with the exposure scale
+    float luminance[3];                 // of the display gamut, of the source one when metering
+    LookupConstants encode;             // PQ or HLG output
+    LookupConstants ootf;               // HLG: luminance to the power of 1 / system gamma
+} ToneMapJob;
+
+typedef struct _ToneMapThread {
+    const ToneMapJob *job;
+    size_t first;
+    size_t pixels;
+    double logSum;
+} ToneMapThread;
+
+// Tone maps 4 pixels, planar, to packed RGB10_A2
+static __m128i toneMap4(__m128 r, __m128 g, __m128 b, const ToneMapJob *job)
+{
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+
+    convertGamut4(&job->gamut, &r, &g, &b);
+    r = _mm_max_ps(r, zero);
+    g = _mm_max_ps(g, zero);
+    b = _mm_max_ps(b, zero);
+    switch (job->params->op) {
+        case TONEMAP_REINHARD: {
+            __m128 l = dot4(r, g, b, job->luminance[0], job->luminance[1], job->luminance[2]);
+            __m128 f = _mm_div_ps(_mm_add_ps(one, _mm_mul_ps(l, _mm_set1_ps(1.0f / (job->params->whitePoint * job->params->whitePoint)))),
+                _mm_add_ps(one, l));
+            r = _mm_mul_ps(r, f);
+            g = _mm_mul_ps(g, f);
+            b = _mm_mul_ps(b, f);
+            break;
+        }
+        case TONEMAP_HABLE: {
+            const __m128 bias = _mm_set1_ps(HABLE_EXPOSURE_BIAS);
+            const __m128 white = hable4(_mm_set1_ps(HABLE_WHITE));
+            r = _mm_div_ps(hable4(_mm_mul_ps(r, bias)), white);
+            g = _mm_div_ps(hable4(_mm_mul_ps(g, bias)), white);
+            b = _mm_div_ps(hable4(_mm_mul_ps(b, bias)), white);
+            break;
+        }
+        case TONEMAP_ACES: {
+            __m128 vr = acesFit4(dot4(r, g, b, 0.59719f, 0.35458f, 0.04823f));
+            __m128 vg = acesFit4(dot4(r, g, b, 0.07600f, 0.90834f, 0.01566f));
+            __m128 vb = acesFit4(dot4(r, g, b, 0.02840f, 0.13383f, 0.83777f));
+            r = dot4(vr, vg, vb, 1.60475f, -0.53108f, -0.07367f);
+            g = dot4(vr, vg, vb, -0.10208f, 1.10813f, -0.00605f);
+            b = dot4(vr, vg, vb, -0.00327f, -0.07276f, 1.07602f);
+            break;
+        }
+    }
+    r = _mm_min_ps(_mm_max_ps(r, zero), one);
+    g = _mm_min_ps(_mm_max_ps(g, zero), one);
+    b = _mm_min_ps(_mm_max_ps(b, zero), one);
+    if (job->params->output == TONEMAP_OUTPUT_PQ) {
+        const __m128 peak = _mm_set1_ps(job->params->peakNits / TRANSFER_PQ_PEAK_NITS);
+        r = transferLookup4(&job->encode, _mm_mul_ps(r, peak));
+        g = transferLookup4(&job->encode, _mm_mul_ps(g, peak));
+        b = transferLookup4(&job->encode, _mm_mul_ps(b, peak));
+    }
+    else if (job->params->output == TONEMAP_OUTPUT_HLG) {
+        // Inverse OOTF, display to scene light: RGB * Y^(1 / gamma - 1) as RGB * Y^(1 / gamma) / Y
+        __m128 y = dot4(r, g, b, 0.2627f, 0.6780f, 0.0593f);
+        __m128 gain = _mm_and_ps(_mm_cmpgt_ps(y, zero), _mm_div_ps(transferLookup4(&job->ootf, y), y));
+        r = transferLookup4(&job->encode, _mm_mul_ps(r, gain));
+        g = transferLookup4(&job->encode, _mm_mul_ps(g, gain));
+        b = transferLookup4(&job->encode, _mm_mul_ps(b, gain));
+    }
+    else if (job->params->gamma != 1.0f) {
+        const __m128 invGamma = _mm_set1_ps(1.0f / job->params->gamma);
+        r = exp2Ps(_mm_mul_ps(log2Ps(r), invGamma));
+        g = exp2Ps(_mm_mul_ps(log2Ps(g), invGamma));
+        b = exp2Ps(_mm_mul_ps(log2Ps(b), invGamma));
+    }
+    const __m128 levels = _mm_set1_ps(1023.0f);
+    __m128i p = _mm_cvtps_epi32(_mm_mul_ps(r, levels));
+    p = _mm_or_si128(p, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(g, levels)), 10));
+    p = _mm_or_si128(p, _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(b, levels)), 20));
+    return _mm_or_si128(p, _mm_set1_epi32(3 << 30));
+}
+
+//
+// Every block of pixels is converted to floats, a pixel per vector, and
+// transposed 4 pixels at a time into red, green and blue vectors. The last
+// group of a short block is padded with black and masked.
+//
+static unsigned __stdcall toneMapThread(void *arg)
+{
+    ToneMapThread *thread = (ToneMapThread *)arg;
+    const ToneMapJob *job = thread->job;
+    __m128 block[TONEMAP_BLOCK_PIXELS];
+    const __m128 delta = _mm_set1_ps(logDelta);
+    size_t done;
+
+    thread->logSum = 0.0;
+    for (done = 0; done < thread->pixels; ) {
+        size_t n = thread->pixels - done, i;
+        __m128 logSum = _mm_setzero_ps();
+        float sums[4];
+
+        if (n > TONEMAP_BLOCK_PIXELS)
+            n = TONEMAP_BLOCK_PIXELS;
+        halfToFloat(job->rgba + (thread->first + done) * 4, (float *)block, n * 4);
+        for (i = n; i % 4; i++)
+            block[i] = _mm_setzero_ps();
+        for (i = 0; i < n; i += 4) {
+            __m128 r = block[i], g = block[i + 1], b = block[i + 2], a = block[i + 3];
+            _MM_TRANSPOSE4_PS(r, g, b, a);
+            if (job->dst) {
+                __m128i p = toneMap4(r, g, b, job);
+                unsigned int *dst = job->dst + thread->first + done + i;
+                if (i + 4 <= n)
+                    _mm_storeu_si128((__m128i *)dst, p);
+                else {
+                    unsigned int packed[4];
+                    _mm_storeu_si128((__m128i *)packed, p);
+                    memcpy(dst, packed, (n - i) * sizeof(unsigned int));
+                }
+            }
+            else {
+                const __m128 zero = _mm_setzero_ps();
+                __m128 l = luminance4(_mm_max_ps(r, zero), _mm_max_ps(g, zero), _mm_max_ps(b, zero), job->luminance);
+                __m128 logL = log2Ps(_mm_add_ps(l, delta));
+                if (i + 4 > n) {
+                    static const int lanes[8] = {-1, -1, -1, -1, 0, 0, 0, 0};
+                    logL = _mm_and_ps(logL, _mm_loadu_ps((const float *)lanes + 4 - (n - i)));
+                }
+                logSum = _mm_add_ps(logSum, logL);
+            }
+        }
+        _mm_storeu_ps(sums, logSum);
+        thread->logSum += (double)sums[0] + sums[1] + sums[2] + sums[3];
+        done += n;
+    }
+    return 0;
+}
+
+// Splits the pixels over the threads, the calling thread takes the first part
+static double runToneMapJob(const ToneMapJob *job, size_t pixels, unsigned int numThreads)
+{
+    ToneMapThread threads[TONEMAP_MAX_THREADS];
+    HANDLE handles[TONEMAP_MAX_THREADS];
+    unsigned int i, started = 0;
+    double logSum = 0.0;
+
+    if (numThreads == 0) {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        numThreads = systemInfo.dwNumberOfProcessors;
+    }
+    if (numThreads > TONEMAP_MAX_THREADS)
+        numThreads = TONEMAP_MAX_THREADS;
+    if (numThreads > pixels / TONEMAP_BLOCK_PIXELS)
+        numThreads = (unsigned int)(pixels / TONEMAP_BLOCK_PIXELS);
+    if (numThreads < 1)
+        numThreads = 1;
+    for (i = 0; i < numThreads; i++) {
+        threads[i].job = job;
+        threads[i].first = pixels * i / numThreads;
+        threads[i].pixels = pixels * (i + 1) / numThreads - threads[i].first;
+        threads[i].logSum = 0.0;
+    }
+    // If a thread can not be started, the calling thread does its part too
+    for (i = 1; i < numThreads; i++) {
+        handles[started] = (HANDLE)_beginthreadex(NULL, 0, toneMapThread, &threads[i], 0, NULL);
+        if (handles[started])
+            started++;
+        else
+            toneMapThread(&threads[i]);
+    }
+    toneMapThread(&threads[0]);
+    if (started) {
+        WaitForMultipleObjects(started, handles, TRUE, INFINITE);
+        for (i = 0; i < started; i++)
+            CloseHandle(handles[i]);
+    }
+    // Summed in a fixed order, the same result for the same number of threads
+    for (i = 0; i < numThreads; i++)
+        logSum += threads[i].logSum;
+    return logSum;
+}
+
+float averageLogLuminance(const unsigned short *rgba, size_t pixels, int gamut, unsigned int numThreads)
+{
+    ToneMapJob job;
+
+    if (pixels == 0)
+        return 0.0f;
+    job.rgba = rgba;
+    job.dst = NULL;
+    job.params = NULL;
+    gamutLuminance(gamut, job.luminance);
+    return (float)(runToneMapJob(&job, pixels, numThreads) / (double)pixels);
+}
+
+bool toneMapToRgb10A2(const unsigned short *rgba, unsigned int *dst, size_t pixels,
+                      const ToneMapParams *params, float averageLog2, unsigned int numThreads)
+{
+    ToneMapJob job;
+    TransferLut encodeLut, ootfLut;
+    bool ok = true;
+
+    memset(&encodeLut, 0, sizeof(TransferLut));
+    memset(&ootfLut, 0, sizeof(TransferLut));
+    if (params->output == TONEMAP_OUTPUT_PQ)
+        ok = buildTransferLut(&encodeLut, TRANSFER_PQ_ENCODE, TONEMAP_LUT_ERROR);
+    else if (params->output == TONEMAP_OUTPUT_HLG)
+        ok = buildTransferLut(&encodeLut, TRANSFER_HLG_ENCODE, TONEMAP_LUT_ERROR) &&
+            buildTransferLut(&ootfLut, TRANSFER_POWER, TONEMAP_OOTF_ERROR, 1.0f / hlgSystemGamma(params->peakNits));
+    if (ok) {
+        job.rgba = rgba;
+        job.dst = dst;
+        job.params = params;
+        setupGamutConversion(&job.gamut, params->sourceGamut, params->displayGamut, params->gamutMapping,
+            toneMapScale(params, averageLog2));
+        gamutLuminance(params->displayGamut, job.luminance);
+        if (params->output != TONEMAP_OUTPUT_GAMMA)
+            setupTransferLookup(&encodeLut, &job.encode);
+        if (params->output == TONEMAP_OUTPUT_HLG)
+            setupTransferLookup(&ootfLut, &job.ootf);
+        runToneMapJob(&job, pixels, numThreads);
+    }
+    freeTransferLut(&encodeLut);
+    freeTransferLut(&ootfLut);
+    return ok;
+}
@@ -0,0 +1,112 @@
+//
+// ToneMap.h
+//
+// Tone mapping of the HDR images to the 0..1 range the windows show:
+// exposure and the conversion from the gamut of the image to the one of the
+// display (one fused matrix), one of the operators below, then display gamma
+// or an HDR signal (PQ or HLG, for a display of peakNits). The GLSL program
+// maps the half float texture while it is drawn. The SSE2 CPU path maps half
+// RGBA pixels to packed RGB10_A2 on every core, for stills to compare with.
+// Automatic exposure brings the average log luminance to middle gray. On the
+// GPU the log luminance of the view is drawn into a small texture whose
+// mipmaps average it, read back a frame later through a pixel buffer
+// object; on the CPU each thread sums a part of the image.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TONEMAP_H
+#define TONEMAP_H
+
+#include <stddef.h>
+
+class FramebufferObject;
+
+enum {
+    TONEMAP_CLIP = 0,                   // exposure and gamma only, clips above 1.0
+    TONEMAP_REINHARD,                   // extended Reinhard on luminance
+    TONEMAP_HABLE,                      // Hable's filmic curve per channel
+    TONEMAP_ACES,                       // Hill's fit of the ACES RRT and sRGB ODT
+    TONEMAP_COUNT
+};
+
+enum {
+    TONEMAP_OUTPUT_GAMMA = 0,           // pow(1 / gamma)
+    TONEMAP_OUTPUT_PQ,                  // 1.0 is peakNits, PQ encoded
+    TONEMAP_OUTPUT_HLG,                 // 1.0 is peakNits, inverse HLG OOTF and HLG OETF
+    TONEMAP_OUTPUT_COUNT
+};
+
+#define TONEMAP_KEY             0.18f   // middle gray the average luminance is exposed to
+#define TONEMAP_METER_SIZE      256     // auto exposure meter texture, power of two
+#define TONEMAP_MAX_THREADS     16
+
+typedef struct _ToneMapParams {
+    int op;
+    float exposure;                     // stops, on top of the automatic exposure
+    bool autoExposure;
+    float whitePoint;                   // Reinhard: exposed luminance that maps to 1.0
+    float gamma;                        // display gamma, 1.0 leaves the output linear
+    int output;
+    float peakNits;                     // PQ and HLG: luminance of the display white
+    int sourceGamut;                    // primaries of the image
+    int displayGamut;                   // primaries of the display, also the Reinhard luminance weights
+    int gamutMapping;                   // for colors outside the display gamut
+} ToneMapParams;
+
+typedef struct _ToneMapper {
+    GLuint program;                     // 0 without GLSL
+    GLint opLocation;
+    GLint whitePointLocation;
+    GLint luminanceLocation;
+    GLint invGammaLocation;
+    GLint encodingLocation;
+    GLint peakLocation;
+    GLint invSystemGammaLocation;
+    GLuint meterProgram;
+    GLint meterWeightsLocation;
+    GLuint meterTexture;                // log2 luminance in red, coverage in alpha
+    GLint meterLevel;                   // its 1x1 mipmap level
+    FramebufferObject *meterFbo;
+    GLuint meterPbo[2];                 // 1x1 level readback, 0 without pixel buffer objects
+    bool meterPending[2];
+    unsigned int meterNext;
+    GLint savedViewport[4];
+    float averageLog2;                  // last meter reading, of the frame before
+} ToneMapper;
+
+extern const char *toneMapName(int op);
+extern const char *toneMapOutputName(int output);
+// Clip, no exposure, linear output: the image as it was drawn without tone
+// mapping. PQ and HLG are for a 1000 cd/m2 display. BT.709 image and display,
+// out of gamut colors compressed.
+extern void defaultToneMapParams(ToneMapParams *params);
+// Factor for the linear pixels: the exposure and, with autoExposure, the one
+// that takes averageLog2 to TONEMAP_KEY
+extern float toneMapScale(const ToneMapParams *params, float averageLog2);
+
+// GL context must be valid. Returns false without GLSL or if a program does
+// not build, the reason is printed.
+extern bool initToneMapper(ToneMapper *mapper);
+// What is drawn in between, the image on texture unit 0 as a rectangle
+// texture in window coordinates, is metered instead of shown, with the
+// luminance weights of the source gamut of params. The end leaves the window
+// framebuffer bound and returns the average log2 luminance, which is also
+// kept in averageLog2. With pixel buffer objects it is the reading of the
+// frame before, the meter of this frame is not waited for.
+extern void beginToneMapMeter(ToneMapper *mapper, const ToneMapParams *params);
+extern float endToneMapMeter(ToneMapper *mapper);
+// What is drawn in between, the image on texture unit 0 as a rectangle
+// texture, is tone mapped with params.
+extern void beginToneMap(ToneMapper *mapper, const ToneMapParams *params);
+extern void endToneMap(ToneMapper *mapper);
+extern void deleteToneMapper(ToneMapper *mapper);
+
+// CPU path on half RGBA pixels of the gamut, its primaries weight the
+// luminance. numThreads 0 uses every core.
+extern float averageLogLuminance(const unsigned short *rgba, size_t pixels, int gamut, unsigned int numThreads = 0);
+// Output alpha is opaque. PQ and HLG go through tables within a quarter of
+// a 10-bit step, false if they can not be built.
+extern bool toneMapToRgb10A2(const unsigned short *rgba, unsigned int *dst, size_t pixels,
+                             const ToneMapParams *params, float averageLog2, unsigned int numThreads = 0);
+
+#endif
@@ -0,0 +1,348 @@
+//
+// TransferFunction.cpp
+//
+// PQ and HLG transfer functions, interpolated and direct lookup tables
+//
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <emmintrin.h>
+#include "HalfConvert.h"
+#include "TransferFunction.h"
+
+#define ERROR_SAMPLES       8           // points per segment the error is measured at, 7 inside
+
+// SMPTE ST 2084
+static const double pqM1 = 2610.0 / 16384.0;
+static const double pqM2 = 2523.0 / 4096.0 * 128.0;
+static const double pqC1 = 3424.0 / 4096.0;
+static const double pqC2 = 2413.0 / 4096.0 * 32.0;
+static const double pqC3 = 2392.0 / 4096.0 * 32.0;
+// BT.2100 HLG
+static const double hlgA = 0.17883277;
+static const double hlgB = 0.28466892;
+static const double hlgC = 0.55991073;
+
+const char *transferGlslSource =
+    "const float pqM1 = 0.1593017578125;\n"
+    "const float pqM2 = 78.84375;\n"
+    "const float pqC1 = 0.8359375;\n"
+    "const float pqC2 = 18.8515625;\n"
+    "const float pqC3 = 18.6875;\n"
+    "const float hlgA = 0.17883277;\n"
+    "const float hlgB = 0.28466892;\n"
+    "const float hlgC = 0.55991073;\n"
+    "vec3 pqEncode(vec3 y)\n"
+    "{\n"
+    "    vec3 p = pow(clamp(y, 0.0, 1.0), vec3(pqM1));\n"
+    "    return pow((pqC1 + pqC2 * p) / (1.0 + pqC3 * p), vec3(pqM2));\n"
+    "}\n"
+    "vec3 pqDecode(vec3 n)\n"
+    "{\n"
+    "    vec3 p = pow(clamp(n, 0.0, 1.0), vec3(1.0 / pqM2));\n"
+    "    return pow(max(p - pqC1, 0.0) / (pqC2 - pqC3 * p), vec3(1.0 / pqM1));\n"
+    "}\n"
+    "vec3 hlgEncode(vec3 e)\n"
+    "{\n"
+    "    e = clamp(e, 0.0, 1.0);\n"
+    "    return mix(sqrt(3.0 * e), hlgA * log(max(12.0 * e - hlgB, 1e-6)) + hlgC, step(1.0 / 12.0, e));\n"
+    "}\n"
+    "vec3 hlgDecode(vec3 s)\n"
+    "{\n"
+    "    s = clamp(s, 0.0, 1.0);\n"
+    "    return mix(s * s / 3.0, (exp((s - hlgC) / hlgA) + hlgB) / 12.0, step(0.5, s));\n"
+    "}\n"
+    "vec3 hlgOotf(vec3 rgb, float gamma)\n"
+    "{\n"
+    "    float y = dot(rgb, vec3(0.2627, 0.6780, 0.0593));\n"
+    "    if (y <= 0.0)\n"
+    "        return vec3(0.0);\n"
+    "    return rgb * pow(y, gamma - 1.0);\n"
+    "}\n";
+
+const char *transferName(int function)
+{
+    static const char *names[TRANSFER_COUNT] = {"PQ encode", "PQ decode", "HLG encode", "HLG decode", "power"};
+
+    return (function >= 0 && function < TRANSFER_COUNT) ? names[function] : "unknown";
+}
+
+double transferExact(int function, double x, double param)
+{
+    double p;
+
+    if (!(x > 0.0))
+        x = 0.0;
+    if (x > 1.0)
+        x = 1.0;
+    switch (function) {
+        case TRANSFER_PQ_ENCODE:
+            p = pow(x, pqM1);
+            return pow((pqC1 + pqC2 * p) / (1.0 + pqC3 * p), pqM2);
+        case TRANSFER_PQ_DECODE:
+            p = pow(x, 1.0 / pqM2);
+            return pow((p > pqC1 ? p - pqC1 : 0.0) / (pqC2 - pqC3 * p), 1.0 / pqM1);
+        case TRANSFER_HLG_ENCODE:
+            return (x <= 1.0 / 12.0) ? sqrt(3.0 * x) : hlgA * log(12.0 * x - hlgB) + hlgC;
+        case TRANSFER_HLG_DECODE:
+            return (x <= 0.5) ? x * x / 3.0 : (exp((x - hlgC) / hlgA) + hlgB) / 12.0;
+        case TRANSFER_POWER:
+            return pow(x, param);
+    }
+    return x;
+}
+
+// Start of segment i: 2^bits uniform segments below 2^minExponent, then 2^bits per octave
+static double segmentStart(const TransferLut *lut, size_t i)
+{
+    size_t perOctave = (size_t)1 << lut->bits;
+
+    if (i < perOctave)
+        return ldexp((double)i / perOctave, lut->minExponent);
+    return ldexp(1.0 + (double)(i & (perOctave - 1)) / perOctave, lut->minExponent + (int)(i >> lut->bits) - 1);
+}
+
+static void fillSegments(TransferLut *lut, size_t first, size_t end)
+{
+    size_t i;
+
+    for (i = first; i < end; i++) {
+        double value = transferExact(lut->function, segmentStart(lut, i), lut->param);
+        lut->segments[2 * i] = (float)value;
+        lut->segments[2 * i + 1] = (float)(transferExact(lut->function, segmentStart(lut, i + 1), lut->param) - value);
+    }
+}
+
+//
+// A value of the lowest octave or above gives its segment by its exponent
+// and top mantissa bits, the rest of the mantissa is the interpolation
+// fraction. A value below gets 2^minExponent added first, which lines it up
+// with the lowest octave, and goes to the uniform segments in front of it.
+//
+void setupTransferLookup(const TransferLut *lut, LookupConstants *c)
+{
+    const int shift = 23 - lut->bits;
+
+    c->low = _mm_castsi128_ps(_mm_set1_epi32((127 + lut->minExponent) << 23));
+    c->shift = _mm_cvtsi32_si128(shift);
+    c->offset = _mm_set1_epi32((126 + lut->minExponent) << lut->bits);
+    c->belowOffset = _mm_set1_epi32(1 << lut->bits);
+    c->fracMask = _mm_set1_epi32((1 << shift) - 1);
+    c->fracScale = _mm_set1_ps(1.0f / (float)(1 << shift));
+    c->segments = lut->segments;
+}
+
+static inline __m128 lookup4(const LookupConstants *c, __m128 x)
+{
+    x = _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    __m128 below = _mm_cmplt_ps(x, c->low);
+    __m128i bits = _mm_castps_si128(_mm_add_ps(x, _mm_and_ps(below, c->low)));
+    __m128i index = _mm_sub_epi32(_mm_srl_epi32(bits, c->shift),
+        _mm_add_epi32(c->offset, _mm_and_si128(_mm_castps_si128(below), c->belowOffset)));
+    __m128 frac = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(bits, c->fracMask)), c->fracScale);
+
+    // Value and slope of a segment are next to each other, a 64-bit load per lane
+    const float *s = c->segments;
+    index = _mm_add_epi32(index, index);
+    __m128 lo = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)(s + _mm_cvtsi128_si32(index)));
+    lo = _mm_loadh_pi(lo, (const __m64 *)(s + _mm_cvtsi128_si32(_mm_srli_si128(index, 4))));
+    __m128 hi = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)(s + _mm_cvtsi128_si32(_mm_srli_si128(index, 8))));
+    hi = _mm_loadh_pi(hi, (const __m64 *)(s + _mm_cvtsi128_si32(_mm_srli_si128(index, 12))));
+    __m128 value = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 slope = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm_add_ps(value, _mm_mul_ps(frac, slope));
+}
+
+__m128 transferLookup4(const LookupConstants *c, __m128 x)
+{
+    return lookup4(c, x);
+}
+
+// Largest error at the points inside segments [first, end)
+static float segmentError(const TransferLut *lut, size_t first, size_t end)
+{
+    LookupConstants c;
+    float x[4], y[4];
+    double exact[4];
+    float maxError = 0.0f;
+    int n = 0, k;
+    size_t i;
+
+    setupTransferLookup(lut, &c);
+    for (i = first; i < end; i++) {
+        double x0 = segmentStart(lut, i), x1 = segmentStart(lut, i + 1);
+        int t;
+        for (t = 1; t < ERROR_SAMPLES; t++) {
+            x[n] = (float)(x0 + (x1 - x0) * t / ERROR_SAMPLES);
+            exact[n] = transferExact(lut->function, x[n], lut->param);
+            if (++n < 4 && !(i + 1 == end && t + 1 == ERROR_SAMPLES))
+                continue;
+            _mm_storeu_ps(y, lookup4(&c, _mm_loadu_ps(x)));
+            for (k = 0; k < n; k++) {
+                float error = (float)fabs(y[k] - exact[k]);
+                if (error > maxError)
+                    maxError = error;
+            }
+            n = 0;
+        }
+    }
+    return maxError;
+}
+
+//
+// For each number of segments per octave, the lowest octave is lowered
+// until the uniform segments below it meet the bound, then the whole table
+// is measured. The first that meets the bound is the smallest table.
+//
+bool buildTransferLut(TransferLut *lut, int function, float maxError, float param)
+{
+    float *values;
+    size_t i;
+
+    memset(lut, 0, sizeof(TransferLut));
+    lut->function = function;
+    lut->param = param;
+    for (lut->bits = 2; lut->bits <= TRANSFER_MAX_BITS; lut->bits++) {
+        size_t perOctave = (size_t)1 << lut->bits;
+        lut->segments = (float *)_mm_malloc(2 * (perOctave + 1) * sizeof(float), 16);
+        if (!lut->segments)
+            break;
+        for (lut->minExponent = -1; lut->minExponent > -126; lut->minExponent--) {
+            fillSegments(lut, 0, perOctave + 1);
+            if (segmentError(lut, 0, perOctave) <= maxError)
+                break;
+        }
+        _mm_free(lut->segments);
+        lut->count = (size_t)(1 - lut->minExponent) << lut->bits;
+        lut->segments = (float *)_mm_malloc(2 * (lut->count + 1) * sizeof(float), 16);
+        if (!lut->segments)
+            break;
+        fillSegments(lut, 0, lut->count);
+        // x = 1.0 lands on the entry after the last segment with a fraction of 0
+        lut->segments[2 * lut->count] = (float)transferExact(function, 1.0, param);
+        lut->segments[2 * lut->count + 1] = 0.0f;
+        lut->maxError = segmentError(lut, 0, lut->count);
+        if (lut->maxError <= maxError)
+            break;
+        _mm_free(lut->segments);
+        lut->segments = NULL;
+    }
+    if (!lut->segments) {
+        if (lut->bits > TRANSFER_MAX_BITS)
+            printf("ERROR: %s does not meet an error of %g with %d segments per octave\n", transferName(function),
+                maxError, 1 << TRANSFER_MAX_BITS);
+        else
+            printf("ERROR: Out of memory for the %s table\n", transferName(function));
+        return false;
+    }
+
+    lut->halfTable = (float *)malloc(65536 * sizeof(float));
+    lut->unorm16Table = (float *)malloc(65536 * sizeof(float));
+    values = (float *)malloc(65536 * sizeof(float));
+    if (!lut->halfTable || !lut->unorm16Table || !values) {
+        printf("ERROR: Out of memory for the %s table\n", transferName(function));
+        free(values);
+        freeTransferLut(lut);
+        return false;
+    }
+    for (i = 0; i < 65536; i++)
+        ((unsigned short *)lut->unorm16Table)[i] = (unsigned short)i;
+    halfToFloat((const unsigned short *)lut->unorm16Table, values, 65536);
+    for (i = 0; i < 65536; i++) {
+        lut->halfTable[i] = (float)transferExact(function, values[i], param);
+        lut->unorm16Table[i] = (float)transferExact(function, i / 65535.0, param);
+    }
+    free(values);
+    return true;
+}
+
+void freeTransferLut(TransferLut *lut)
+{
+    _mm_free(lut->segments);
+    free(lut->halfTable);
+    free(lut->unorm16Table);
+    memset(lut, 0, sizeof(TransferLut));
+}
+
+void transferFloat(const TransferLut *lut, const float *src, float *dst, size_t count)
+{
+    LookupConstants c;
+    size_t i;
+
+    setupTransferLookup(lut, &c);
+    // Two vectors at a time, so the loads of one overlap the index math of the other
+    for (i = 0; i + 8 <= count; i += 8) {
+        __m128 a = lookup4(&c, _mm_loadu_ps(src + i));
+        __m128 b = lookup4(&c, _mm_loadu_ps(src + i + 4));
+        _mm_storeu_ps(dst + i, a);
+        _mm_storeu_ps(dst + i + 4, b);
+    }
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(dst + i, lookup4(&c, _mm_loadu_ps(src + i)));
+    for (; i < count; i++)
+        dst[i] = _mm_cvtss_f32(lookup4(&c, _mm_set_ss(src[i])));
+}
+
+void transferHalf(const TransferLut *lut, const unsigned short *src, float *dst, size_t count)
+{
+    const float *table = lut->halfTable;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        dst[i] = table[src[i]];
+}
+
+void transferUnorm16(const TransferLut *lut, const unsigned short *src, float *dst, size_t count)
+{
+    const float *table = lut->unorm16Table;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        dst[i] = table[src[i]];
+}
+
+float hlgSystemGamma(float peakNits)
+{
+    return 1.2f + 0.42f * log10f(peakNits / 1000.0f);
+}
+
+// Y^(gamma-1) as Y^gamma / Y, black stays black
+static void ootf4(const LookupConstants *power, __m128 *pixels)
+{
+    __m128 r = pixels[0], g = pixels[1], b = pixels[2], a = pixels[3];
+
+    _MM_TRANSPOSE4_PS(r, g, b, a);
+    __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.2627f)), _mm_mul_ps(g, _mm_set1_ps(0.6780f))),
+        _mm_mul_ps(b, _mm_set1_ps(0.0593f)));
+    __m128 gain = _mm_and_ps(_mm_cmpgt_ps(y, _mm_setzero_ps()), _mm_div_ps(lookup4(power, y), y));
+    r = _mm_mul_ps(r, gain);
+    g = _mm_mul_ps(g, gain);
+    b = _mm_mul_ps(b, gain);
+    _MM_TRANSPOSE4_PS(r, g, b, a);
+    pixels[0] = r;
+    pixels[1] = g;
+    pixels[2] = b;
+    pixels[3] = a;
+}
+
+void hlgOotf(const TransferLut *powerLut, float *rgba, size_t pixels)
+{
+    LookupConstants c;
+    __m128 group[4];
+    size_t i;
+
+    setupTransferLookup(powerLut, &c);
+    for (i = 0; i + 4 <= pixels; i += 4) {
+        memcpy(group, rgba + i * 4, sizeof(group));
+        ootf4(&c, group);
+        memcpy(rgba + i * 4, group, sizeof(group));
+    }
+    if (i < pixels) {
+        memset(group, 0, sizeof(group));
+        memcpy(group, rgba + i * 4, (pixels - i) * 4 * sizeof(float));
+        ootf4(&c, group);
+        memcpy(rgba + i * 4, group, (pixels - i) * 4 * sizeof(float));
+    }
+}
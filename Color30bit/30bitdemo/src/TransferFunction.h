@@ -0,0 +1,84 @@
+//
+// TransferFunction.h
+//
+// BT.2100 transfer functions for HDR signals: PQ (SMPTE ST 2084) and HLG,
+// encode and decode, and the HLG OOTF. The exact formulas are slow (pow,
+// exp and log per sample), so they are tabulated. Float inputs interpolate
+// linearly in a table indexed by the exponent and the top mantissa bits, the
+// segments per octave and the lowest octave chosen so that the measured
+// error stays within a bound. Half and 16-bit inputs have only 65536 values
+// each, so they get a table entry per value and no interpolation. The same
+// functions are available as GLSL source to put in front of a shader.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TRANSFERFUNCTION_H
+#define TRANSFERFUNCTION_H
+
+#include <stddef.h>
+#include <emmintrin.h>
+
+enum {
+    TRANSFER_PQ_ENCODE = 0,             // display linear, 1.0 = 10000 cd/m2, to PQ signal
+    TRANSFER_PQ_DECODE,
+    TRANSFER_HLG_ENCODE,                // scene linear to HLG signal (OETF)
+    TRANSFER_HLG_DECODE,                // inverse OETF
+    TRANSFER_POWER,                     // x^param, e.g. the luminance of the HLG OOTF
+    TRANSFER_COUNT
+};
+
+#define TRANSFER_PQ_PEAK_NITS   10000.0f
+#define TRANSFER_MAX_BITS       12      // segments per octave up to 2^12
+
+typedef struct _TransferLut {
+    int function;
+    float param;
+    int bits;                           // 2^bits segments per octave
+    int minExponent;                    // the octaves start at 2^minExponent, below it 2^bits segments run to 0
+    size_t count;                       // segments
+    float *segments;                    // value and slope of every segment, 2 * (count + 1) floats
+    float maxError;                     // largest error measured, output units
+    float *halfTable;                   // output for every half bit pattern
+    float *unorm16Table;                // output for every 16-bit normalized value
+} TransferLut;
+
+extern const char *transferName(int function);
+// The formula in double precision, x is clamped to [0, 1]
+extern double transferExact(int function, double x, double param = 1.0);
+// Builds the tables for function with at most maxError (output units, e.g.
+// 0.25 / 1023 for a quarter 10-bit step). Returns false if out of memory or
+// if the bound can not be met, the reason is printed.
+extern bool buildTransferLut(TransferLut *lut, int function, float maxError, float param = 1.0f);
+extern void freeTransferLut(TransferLut *lut);
+
+// The table address and the index math of a TransferLut in vectors, set up
+// once for a run of lookups
+typedef struct _LookupConstants {
+    __m128 low;                         // 2^minExponent
+    __m128i shift;
+    __m128i offset;                     // segment of the lowest octave minus 2^bits
+    __m128i belowOffset;                // 2^bits
+    __m128i fracMask;
+    __m128 fracScale;
+    const float *segments;
+} LookupConstants;
+
+extern void setupTransferLookup(const TransferLut *lut, LookupConstants *c);
+// Inputs are clamped to [0, 1], NaNs count as 0.
+extern __m128 transferLookup4(const LookupConstants *c, __m128 x);
+extern void transferFloat(const TransferLut *lut, const float *src, float *dst, size_t count);
+extern void transferHalf(const TransferLut *lut, const unsigned short *src, float *dst, size_t count);
+extern void transferUnorm16(const TransferLut *lut, const unsigned short *src, float *dst, size_t count);
+
+// HLG system gamma for a display of peakNits (1.2 at 1000 cd/m2)
+extern float hlgSystemGamma(float peakNits);
+// Scales the RGB of each RGBA pixel by Y^(gamma-1), Y the BT.2100 luminance:
+// the HLG OOTF (display light relative to the peak) with a TRANSFER_POWER
+// table of the system gamma, its inverse with one of 1 / system gamma.
+extern void hlgOotf(const TransferLut *powerLut, float *rgba, size_t pixels);
+
+// GLSL functions pqEncode, pqDecode, hlgEncode, hlgDecode (vec3 -> vec3) and
+// hlgOotf(vec3 rgb, float gamma), the same formulas as transferExact
+extern const char *transferGlslSource;
+
+#endif
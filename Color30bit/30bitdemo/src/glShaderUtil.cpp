@@ -0,0 +1,237 @@
+//
+// glShaderUtil.cpp
+//
+// Shared OpenGL entry points, extension check and GLSL program helpers
+//
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <gl/gl.h>
+#include <GL/glext.h>
+#include "glShaderUtil.h"
+
+PFNGLACTIVETEXTUREPROC glActiveTexture = NULL;
+PFNGLTEXIMAGE3DPROC glTexImage3D = NULL;
+PFNGLCREATESHADERPROC glCreateShader = NULL;
+PFNGLSHADERSOURCEPROC glShaderSource = NULL;
+PFNGLCOMPILESHADERPROC glCompileShader = NULL;
+PFNGLGETSHADERIVPROC glGetShaderiv = NULL;
+PFNGLGETSHADERINFOLOGPROC glGetShaderInfoLog = NULL;
+PFNGLDELETESHADERPROC glDeleteShader = NULL;
+PFNGLCREATEPROGRAMPROC glCreateProgram = NULL;
+PFNGLATTACHSHADERPROC glAttachShader = NULL;
+PFNGLLINKPROGRAMPROC glLinkProgram = NULL;
+PFNGLGETPROGRAMIVPROC glGetProgramiv = NULL;
+PFNGLGETPROGRAMINFOLOGPROC glGetProgramInfoLog = NULL;
+PFNGLDELETEPROGRAMPROC glDeleteProgram = NULL;
+PFNGLUSEPROGRAMPROC glUseProgram = NULL;
+PFNGLGETUNIFORMLOCATIONPROC glGetUniformLocation = NULL;
+PFNGLUNIFORM1IPROC glUniform1i = NULL;
+PFNGLUNIFORM1FPROC glUniform1f = NULL;
+PFNGLUNIFORM2FPROC glUniform2f = NULL;
+PFNGLUNIFORM3FPROC glUniform3f = NULL;
+PFNGLUNIFORM3FVPROC glUniform3fv = NULL;
+PFNGLUNIFORMMATRIX3FVPROC glUniformMatrix3fv = NULL;
+PFNGLGENERATEMIPMAPEXTPROC glGenerateMipmapEXT = NULL;
+PFNGLCHECKFRAMEBUFFERSTATUSEXTPROC glCheckFramebufferStatusEXT = NULL;
+
+PFNGLGENBUFFERSARBPROC glGenBuffersARB = NULL;
+PFNGLDELETEBUFFERSARBPROC glDeleteBuffersARB = NULL;
+PFNGLBINDBUFFERARBPROC glBindBufferARB = NULL;
+PFNGLBUFFERDATAARBPROC glBufferDataARB = NULL;
+PFNGLMAPBUFFERARBPROC glMapBufferARB = NULL;
+PFNGLUNMAPBUFFERARBPROC glUnmapBufferARB = NULL;
+
+PFNGLGENFENCESNVPROC glGenFencesNV = NULL;
+PFNGLDELETEFENCESNVPROC glDeleteFencesNV = NULL;
+PFNGLSETFENCENVPROC glSetFenceNV = NULL;
+PFNGLTESTFENCENVPROC glTestFenceNV = NULL;
+PFNGLFINISHFENCENVPROC glFinishFenceNV = NULL;
+
+// 0 not tried yet, 1 loaded, -1 missing
+static int shaderState = 0;
+static int bufferState = 0;
+static int fenceState = 0;
+
+bool hasExtension(const char *name)
+{
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+    size_t length = strlen(name);
+    const char *p;
+
+    if (!extensions)
+        return false;
+    // Match whole names only, one may be the prefix of another
+    for (p = strstr(extensions, name); p; p = strstr(p + length, name)) {
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+            return true;
+    }
+    return false;
+}
+
+bool loadShaderEntryPoints()
+{
+    if (shaderState)
+        return shaderState > 0;
+    glActiveTexture = (PFNGLACTIVETEXTUREPROC)wglGetProcAddress("glActiveTexture");
+    glTexImage3D = (PFNGLTEXIMAGE3DPROC)wglGetProcAddress("glTexImage3D");
+    glCreateShader = (PFNGLCREATESHADERPROC)wglGetProcAddress("glCreateShader");
+    glShaderSource = (PFNGLSHADERSOURCEPROC)wglGetProcAddress("glShaderSource");
+    glCompileShader = (PFNGLCOMPILESHADERPROC)wglGetProcAddress("glCompileShader");
+    glGetShaderiv = (PFNGLGETSHADERIVPROC)wglGetProcAddress("glGetShaderiv");
+    glGetShaderInfoLog = (PFNGLGETSHADERINFOLOGPROC)wglGetProcAddress("glGetShaderInfoLog");
+    glDeleteShader = (PFNGLDELETESHADERPROC)wglGetProcAddress("glDeleteShader");
+    glCreateProgram = (PFNGLCREATEPROGRAMPROC)wglGetProcAddress("glCreateProgram");
+    glAttachShader = (PFNGLATTACHSHADERPROC)wglGetProcAddress("glAttachShader");
+    glLinkProgram = (PFNGLLINKPROGRAMPROC)wglGetProcAddress("glLinkProgram");
+    glGetProgramiv = (PFNGLGETPROGRAMIVPROC)wglGetProcAddress("glGetProgramiv");
+    glGetProgramInfoLog = (PFNGLGETPROGRAMINFOLOGPROC)wglGetProcAddress("glGetProgramInfoLog");
+    glDeleteProgram = (PFNGLDELETEPROGRAMPROC)wglGetProcAddress("glDeleteProgram");
+    glUseProgram = (PFNGLUSEPROGRAMPROC)wglGetProcAddress("glUseProgram");
+    glGetUniformLocation = (PFNGLGETUNIFORMLOCATIONPROC)wglGetProcAddress("glGetUniformLocation");
+    glUniform1i = (PFNGLUNIFORM1IPROC)wglGetProcAddress("glUniform1i");
+    glUniform1f = (PFNGLUNIFORM1FPROC)wglGetProcAddress("glUniform1f");
+    glUniform2f = (PFNGLUNIFORM2FPROC)wglGetProcAddress("glUniform2f");
+    glUniform3f = (PFNGLUNIFORM3FPROC)wglGetProcAddress("glUniform3f");
+    glUniform3fv = (PFNGLUNIFORM3FVPROC)wglGetProcAddress("glUniform3fv");
+    glUniformMatrix3fv = (PFNGLUNIFORMMATRIX3FVPROC)wglGetProcAddress("glUniformMatrix3fv");
+    // Optional, the modules that need mipmaps check it
+    glGenerateMipmapEXT = (PFNGLGENERATEMIPMAPEXTPROC)wglGetProcAddress("glGenerateMipmapEXT");
+    glCheckFramebufferStatusEXT = (PFNGLCHECKFRAMEBUFFERSTATUSEXTPROC)wglGetProcAddress("glCheckFramebufferStatusEXT");
+    if (!glActiveTexture || !glTexImage3D || !glCreateShader || !glShaderSource || !glCompileShader ||
+        !glGetShaderiv || !glGetShaderInfoLog || !glDeleteShader || !glCreateProgram || !glAttachShader ||
+        !glLinkProgram || !glGetProgramiv || !glGetProgramInfoLog || !glDeleteProgram || !glUseProgram ||
+        !glGetUniformLocation || !glUniform1i || !glUniform1f || !glUniform2f || !glUniform3f || !glUniform3fv ||
+        !glUniformMatrix3fv) {
+        glActiveTexture = NULL;
+        glTexImage3D = NULL;
+        glCreateShader = NULL;
+        glShaderSource = NULL;
+        glCompileShader = NULL;
+        glGetShaderiv = NULL;
+        glGetShaderInfoLog = NULL;
+        glDeleteShader = NULL;
+        glCreateProgram = NULL;
+        glAttachShader = NULL;
+        glLinkProgram = NULL;
+        glGetProgramiv = NULL;
+        glGetProgramInfoLog = NULL;
+        glDeleteProgram = NULL;
+        glUseProgram = NULL;
+        glGetUniformLocation = NULL;
+        glUniform1i = NULL;
+        glUniform1f = NULL;
+        glUniform2f = NULL;
+        glUniform3f = NULL;
+        glUniform3fv = NULL;
+        glUniformMatrix3fv = NULL;
+        shaderState = -1;
+        return false;
+    }
+    shaderState = 1;
+    return true;
+}
+
+bool loadBufferEntryPoints()
+{
+    if (bufferState)
+        return bufferState > 0;
+    if (hasExtension("GL_ARB_vertex_buffer_object") || hasExtension("GL_ARB_pixel_buffer_object")) {
+        glGenBuffersARB = (PFNGLGENBUFFERSARBPROC)wglGetProcAddress("glGenBuffersARB");
+        glDeleteBuffersARB = (PFNGLDELETEBUFFERSARBPROC)wglGetProcAddress("glDeleteBuffersARB");
+        glBindBufferARB = (PFNGLBINDBUFFERARBPROC)wglGetProcAddress("glBindBufferARB");
+        glBufferDataARB = (PFNGLBUFFERDATAARBPROC)wglGetProcAddress("glBufferDataARB");
+        glMapBufferARB = (PFNGLMAPBUFFERARBPROC)wglGetProcAddress("glMapBufferARB");
+        glUnmapBufferARB = (PFNGLUNMAPBUFFERARBPROC)wglGetProcAddress("glUnmapBufferARB");
+    }
+    if (!glGenBuffersARB || !glDeleteBuffersARB || !glBindBufferARB || !glBufferDataARB || !glMapBufferARB ||
+        !glUnmapBufferARB) {
+        glGenBuffersARB = NULL;
+        glDeleteBuffersARB = NULL;
+        glBindBufferARB = NULL;
+        glBufferDataARB = NULL;
+        glMapBufferARB = NULL;
+        glUnmapBufferARB = NULL;
+        bufferState = -1;
+        return false;
+    }
+    bufferState = 1;
+    return true;
+}
+
+bool loadFenceEntryPoints()
+{
+    if (fenceState)
+        return fenceState > 0;
+    if (hasExtension("GL_NV_fence")) {
+        glGenFencesNV = (PFNGLGENFENCESNVPROC)wglGetProcAddress("glGenFencesNV");
+        glDeleteFencesNV = (PFNGLDELETEFENCESNVPROC)wglGetProcAddress("glDeleteFencesNV");
+        glSetFenceNV = (PFNGLSETFENCENVPROC)wglGetProcAddress("glSetFenceNV");
+        glTestFenceNV = (PFNGLTESTFENCENVPROC)wglGetProcAddress("glTestFenceNV");
+        glFinishFenceNV = (PFNGLFINISHFENCENVPROC)wglGetProcAddress("glFinishFenceNV");
+    }
+    if (!glGenFencesNV || !glDeleteFencesNV || !glSetFenceNV || !glTestFenceNV || !glFinishFenceNV) {
+        glGenFencesNV = NULL;
+        glDeleteFencesNV = NULL;
+        glSetFenceNV = NULL;
+        glTestFenceNV = NULL;
+        glFinishFenceNV = NULL;
+        fenceState = -1;
+        return false;
+    }
+    fenceState = 1;
+    return true;
+}
+
+GLuint compileShader(GLenum type, const char **sources, GLsizei count, const char *name)
+{
+    GLuint shader = glCreateShader(type);
+    GLint compiled = 0;
+
+    glShaderSource(shader, count, sources, NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+        char log[2048];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        printf("ERROR: Unable to compile the %s shader:\n%s\n", name, log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint buildProgram(const char **vertexSources, GLsizei vertexCount, const char **fragmentSources,
+                    GLsizei fragmentCount, const char *name)
+{
+    GLuint vertex = compileShader(GL_VERTEX_SHADER, vertexSources, vertexCount, name);
+    GLuint fragment = compileShader(GL_FRAGMENT_SHADER, fragmentSources, fragmentCount, name);
+    GLuint program = 0;
+    GLint linked = 0;
+
+    if (vertex && fragment) {
+        program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        glLinkProgram(program);
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            char log[2048];
+            glGetProgramInfoLog(program, sizeof(log), NULL, log);
+            printf("ERROR: Unable to link the %s program:\n%s\n", name, log);
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    // The program keeps them until it is deleted
+    if (vertex)
+        glDeleteShader(vertex);
+    if (fragment)
+        glDeleteShader(fragment);
+    if (program) {
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "image"), 0);
+        glUseProgram(0);
+    }
+    return program;
+}
@@ -0,0 +1,76 @@
+//
+// glShaderUtil.h
+//
+// The OpenGL entry points past 1.1 that the helper modules share, and the
+// GLSL program helpers. Windows exports OpenGL 1.1 only, the rest comes from
+// wglGetProcAddress once a context is current. Each group is loaded on its
+// first use and then kept for both windows: the 10bpc and the 8bpc context
+// come from the same ICD, which hands out the same addresses for all of its
+// pixel formats, and the demo only shows the 8bpc window when wglShareLists,
+// which fails between implementations, joined the two. The pointers are
+// named like the functions they point to.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef GLSHADERUTIL_H
+#define GLSHADERUTIL_H
+
+// OpenGL 2.0 shaders, with glActiveTexture and glTexImage3D of 1.3 and 1.2
+extern PFNGLACTIVETEXTUREPROC glActiveTexture;
+extern PFNGLTEXIMAGE3DPROC glTexImage3D;
+extern PFNGLCREATESHADERPROC glCreateShader;
+extern PFNGLSHADERSOURCEPROC glShaderSource;
+extern PFNGLCOMPILESHADERPROC glCompileShader;
+extern PFNGLGETSHADERIVPROC glGetShaderiv;
+extern PFNGLGETSHADERINFOLOGPROC glGetShaderInfoLog;
+extern PFNGLDELETESHADERPROC glDeleteShader;
+extern PFNGLCREATEPROGRAMPROC glCreateProgram;
+extern PFNGLATTACHSHADERPROC glAttachShader;
+extern PFNGLLINKPROGRAMPROC glLinkProgram;
+extern PFNGLGETPROGRAMIVPROC glGetProgramiv;
+extern PFNGLGETPROGRAMINFOLOGPROC glGetProgramInfoLog;
+extern PFNGLDELETEPROGRAMPROC glDeleteProgram;
+extern PFNGLUSEPROGRAMPROC glUseProgram;
+extern PFNGLGETUNIFORMLOCATIONPROC glGetUniformLocation;
+extern PFNGLUNIFORM1IPROC glUniform1i;
+extern PFNGLUNIFORM1FPROC glUniform1f;
+extern PFNGLUNIFORM2FPROC glUniform2f;
+extern PFNGLUNIFORM3FPROC glUniform3f;
+extern PFNGLUNIFORM3FVPROC glUniform3fv;
+extern PFNGLUNIFORMMATRIX3FVPROC glUniformMatrix3fv;
+// GL_EXT_framebuffer_object, NULL without it
+extern PFNGLGENERATEMIPMAPEXTPROC glGenerateMipmapEXT;
+extern PFNGLCHECKFRAMEBUFFERSTATUSEXTPROC glCheckFramebufferStatusEXT;
+
+// GL_ARB_vertex_buffer_object, which GL_ARB_pixel_buffer_object uses too
+extern PFNGLGENBUFFERSARBPROC glGenBuffersARB;
+extern PFNGLDELETEBUFFERSARBPROC glDeleteBuffersARB;
+extern PFNGLBINDBUFFERARBPROC glBindBufferARB;
+extern PFNGLBUFFERDATAARBPROC glBufferDataARB;
+extern PFNGLMAPBUFFERARBPROC glMapBufferARB;
+extern PFNGLUNMAPBUFFERARBPROC glUnmapBufferARB;
+
+// GL_NV_fence
+extern PFNGLGENFENCESNVPROC glGenFencesNV;
+extern PFNGLDELETEFENCESNVPROC glDeleteFencesNV;
+extern PFNGLSETFENCENVPROC glSetFenceNV;
+extern PFNGLTESTFENCENVPROC glTestFenceNV;
+extern PFNGLFINISHFENCENVPROC glFinishFenceNV;
+
+// True if the current context lists the extension by its whole name
+extern bool hasExtension(const char *name);
+// Each returns false if an entry point of its group is missing, the
+// pointers of the group are all NULL then.
+extern bool loadShaderEntryPoints();
+extern bool loadBufferEntryPoints();
+extern bool loadFenceEntryPoints();
+
+// Compiles the sources one after the other into one shader. Returns 0 on
+// failure, the log is printed with the name of the shader.
+extern GLuint compileShader(GLenum type, const char **sources, GLsizei count, const char *name);
+// Links the vertex and fragment shaders of the sources. The sampler "image",
+// if the program has one, is set to unit 0. Returns 0 on failure.
+extern GLuint buildProgram(const char **vertexSources, GLsizei vertexCount, const char **fragmentSources,
+                           GLsizei fragmentCount, const char *name);
+
+#endif
@@ -0,0 +1,168 @@
+//
+// PboUploader.cpp
+//
+// Ring of pixel buffer objects with fences for streaming texture uploads
+//
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include "PboEntryPoints.h"
+#include "PboUploader.h"
+
+void initPboUploader(PboUploader *uploader, GLsizeiptrARB bufferBytes)
+{
+    GLuint i;
+
+    memset(uploader, 0, sizeof(PboUploader));
+    if (!hasExtension("GL_ARB_pixel_buffer_object") || !loadBufferEntryPoints()) {
+        printf("No pixel buffer objects, textures are uploaded from client memory\n");
+        return;
+    }
+    uploader->numBuffers = PBO_RING_SIZE;
+    uploader->bufferBytes = bufferBytes;
+    glGenBuffersARB(PBO_RING_SIZE, uploader->buffers);
+    for (i = 0; i < PBO_RING_SIZE; i++) {
+        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, uploader->buffers[i]);
+        glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, bufferBytes, NULL, GL_STREAM_DRAW_ARB);
+    }
+    glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+    if (loadFenceEntryPoints())
+        glGenFencesNV(PBO_RING_SIZE, uploader->fences);
+}
+
+//
+// acquireBuffer
+//
+// Binds the next buffer of the ring once the driver is done reading it and
+// maps it for writing. Without fences the storage is orphaned instead, so the
+// driver can hand out new memory rather than wait.
+//
+static void *acquireBuffer(PboUploader *uploader)
+{
+    GLuint i = uploader->next;
+
+    glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, uploader->buffers[i]);
+    if (uploader->fences[i]) {
+        if (uploader->fenceSet[i] && !glTestFenceNV(uploader->fences[i])) {
+            uploader->stalls++;
+            glFinishFenceNV(uploader->fences[i]);
+        }
+        uploader->fenceSet[i] = false;
+    }
+    else {
+        glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, uploader->bufferBytes, NULL, GL_STREAM_DRAW_ARB);
+    }
+    return glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+}
+
+void pboTexSubImage2D(PboUploader *uploader, GLenum target, GLint x, GLint y, GLsizei width, GLsizei height,
+                      GLenum format, GLenum type, GLuint bytesPerPixel, const void *pixels, size_t srcRowBytes)
+{
+    LARGE_INTEGER start, end, frequency;
+    const unsigned char *src = (const unsigned char *)pixels;
+    size_t rowBytes = (size_t)width * bytesPerPixel;
+    GLsizei rowsPerBuffer;
+    GLsizei row, rows, r;
+
+    if (width <= 0 || height <= 0)
+        return;
+    QueryPerformanceCounter(&start);
+    rowsPerBuffer = uploader->numBuffers ? (GLsizei)(uploader->bufferBytes / rowBytes) : 0;
+
+    // The buffers hold tightly packed rows
+    glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (row = 0; row < height; row += rows) {
+        unsigned char *dst = NULL;
+
+        rows = height - row;
+        if (rowsPerBuffer > 0) {
+            if (rows > rowsPerBuffer)
+                rows = rowsPerBuffer;
+            dst = (unsigned char *)acquireBuffer(uploader);
+        }
+        if (!dst) {
+            // No buffer, or the row does not fit: let the driver copy from client memory
+            if (uploader->numBuffers)
+                glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(srcRowBytes / bytesPerPixel));
+            glTexSubImage2D(target, 0, x, y + row, width, rows, format, type, src + row * srcRowBytes);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            uploader->directUploads++;
+            continue;
+        }
+        for (r = 0; r < rows; r++)
+            memcpy(dst + r * rowBytes, src + (row + r) * srcRowBytes, rowBytes);
+        glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+        // Sourced from offset 0 of the bound buffer, the call returns at once
+        glTexSubImage2D(target, 0, x, y + row, width, rows, format, type, NULL);
+        if (uploader->fences[uploader->next]) {
+            glSetFenceNV(uploader->fences[uploader->next], GL_ALL_COMPLETED_NV);
+            uploader->fenceSet[uploader->next] = true;
+        }
+        uploader->next = (uploader->next + 1) % uploader->numBuffers;
+        uploader->transfers++;
+    }
+    if (uploader->numBuffers)
+        glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+    glPopClientAttrib();
+
+    QueryPerformanceCounter(&end);
+    QueryPerformanceFrequency(&frequency);
+    uploader->seconds += (double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+    uploader->bytes += (unsigned __int64)rowBytes * height;
+}
+
+void *pboMapRows(PboUploader *uploader, size_t rowBytes, GLsizei *rows)
+{
+    GLsizei fit = uploader->numBuffers ? (GLsizei)(uploader->bufferBytes / rowBytes) : 0;
+
+    if (fit <= 0)
+        return NULL;
+    if (*rows > fit)
+        *rows = fit;
+    return acquireBuffer(uploader);
+}
+
+void pboUnmapRows(PboUploader *uploader, GLenum target, GLint x, GLint y, GLsizei width, GLsizei rows,
+                  GLenum format, GLenum type, GLuint bytesPerPixel)
+{
+    LARGE_INTEGER start, end, frequency;
+
+    QueryPerformanceCounter(&start);
+    glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+    glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(target, 0, x, y, width, rows, format, type, NULL);
+    glPopClientAttrib();
+    if (uploader->fences[uploader->next]) {
+        glSetFenceNV(uploader->fences[uploader->next], GL_ALL_COMPLETED_NV);
+        uploader->fenceSet[uploader->next] = true;
+    }
+    uploader->next = (uploader->next + 1) % uploader->numBuffers;
+    uploader->transfers++;
+    glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+    QueryPerformanceCounter(&end);
+    QueryPerformanceFrequency(&frequency);
+    uploader->seconds += (double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+    uploader->bytes += (unsigned __int64)width * bytesPerPixel * rows;
+}
+
+double pboUploadRate(const PboUploader *uploader)
+{
+    if (uploader->seconds <= 0.0)
+        return 0.0;
+    return (double)(__int64)uploader->bytes / (1024.0 * 1024.0) / uploader->seconds;
+}
+
+void deletePboUploader(PboUploader *uploader)
+{
+    if (uploader->numBuffers) {
+        glDeleteBuffersARB(uploader->numBuffers, uploader->buffers);
+        if (uploader->fences[0])
+            glDeleteFencesNV(uploader->numBuffers, uploader->fences);
+    }
+    memset(uploader, 0, sizeof(PboUploader));
+}
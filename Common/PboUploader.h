@@ -0,0 +1,52 @@
+//
+// PboUploader.h
+//
+// Texture uploads streamed through a ring of pixel buffer objects. Rows are
+// packed into one buffer while the driver still copies the previous ones to
+// the GPU, so glTexSubImage2D returns without copying client memory. An
+// NV_fence per buffer tells whether its last transfer is done; waiting for
+// one is counted as a stall. Without pixel buffer objects (e.g. a software
+// GL) the uploads go straight from client memory.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PBOUPLOADER_H
+#define PBOUPLOADER_H
+
+#define PBO_RING_SIZE       4
+#define PBO_BUFFER_BYTES    (4*1024*1024)
+
+typedef struct _PboUploader {
+    GLuint numBuffers;                  // 0 if uploads go straight from client memory
+    GLuint buffers[PBO_RING_SIZE];
+    GLuint fences[PBO_RING_SIZE];       // NV_fence names, 0 without the extension
+    bool fenceSet[PBO_RING_SIZE];
+    GLuint next;                        // buffer filled next
+    GLsizeiptrARB bufferBytes;
+    // Statistics
+    unsigned __int64 bytes;             // bytes uploaded
+    double seconds;                     // time spent in pboTexSubImage2D
+    unsigned int transfers;             // buffers handed to the driver
+    unsigned int stalls;                // waits for a buffer still in transfer
+    unsigned int directUploads;         // uploads without a buffer
+} PboUploader;
+
+// Creates the buffers if GL_ARB_pixel_buffer_object is supported.
+extern void initPboUploader(PboUploader *uploader, GLsizeiptrARB bufferBytes = PBO_BUFFER_BYTES);
+// glTexSubImage2D of the texture bound to target. pixels points at the first
+// texel of the region, rows are srcRowBytes apart.
+extern void pboTexSubImage2D(PboUploader *uploader, GLenum target, GLint x, GLint y, GLsizei width, GLsizei height,
+                             GLenum format, GLenum type, GLuint bytesPerPixel, const void *pixels, size_t srcRowBytes);
+// For producers that write the rows themselves, e.g. a decoder: maps the next
+// buffer of the ring and returns it, *rows is lowered to the rows of rowBytes
+// that fit. Returns NULL without buffers or if not even one row fits.
+extern void *pboMapRows(PboUploader *uploader, size_t rowBytes, GLsizei *rows);
+// Unmaps the buffer from pboMapRows and uploads its rows, tightly packed, to
+// the texture bound to target. The transfer runs while the next rows are made.
+extern void pboUnmapRows(PboUploader *uploader, GLenum target, GLint x, GLint y, GLsizei width, GLsizei rows,
+                         GLenum format, GLenum type, GLuint bytesPerPixel);
+// Upload rate in MB/s of the time spent in pboTexSubImage2D and pboUnmapRows.
+extern double pboUploadRate(const PboUploader *uploader);
+extern void deletePboUploader(PboUploader *uploader);
+
+#endif
@@ -0,0 +1,722 @@
+//
+// PngLoader.cpp
+//
+// PNG decode: inflate, SSE2 unfilter and 16-bit sample conversion
+//
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+#include <GL/gl.h>
+#include "PngLoader.h"
+
+//
+// Inflate
+//
+// A small resumable inflater (RFC 1951). The PNG rows are pulled out of it a
+// row at a time: when the output is full in the middle of a match the rest of
+// the match is kept for the next call. The last 32 KB of output are kept in a
+// ring buffer for the back references.
+//
+#define INFLATE_WINDOW_SIZE     32768
+#define HUFFMAN_FAST_BITS       9
+
+enum {
+    INFLATE_BLOCK = 0,              // next is a block header
+    INFLATE_STORED,                 // inside a stored block
+    INFLATE_CODES,                  // inside a fixed or dynamic huffman block
+    INFLATE_DONE
+};
+
+typedef struct _Huffman {
+    unsigned short fast[1 << HUFFMAN_FAST_BITS];  // (length << 9) | symbol for short codes
+    unsigned short firstCode[16];
+    int maxCode[17];
+    unsigned short firstSymbol[16];
+    unsigned char size[288];
+    unsigned short value[288];
+} Huffman;
+
+struct _PngInflate {
+    const unsigned char *in;
+    const unsigned char *inEnd;
+    unsigned int bits;              // bit buffer, LSB first
+    int numBits;
+    int overrun;                    // zero bytes fed past the end of the input
+    int state;
+    bool finalBlock;
+    bool error;
+    unsigned int storedLeft;
+    unsigned int matchLength;       // pending part of a match
+    unsigned int matchDistance;
+    unsigned __int64 total;         // bytes produced so far
+    unsigned int windowPos;
+    Huffman lengths;
+    Huffman distances;
+    unsigned char window[INFLATE_WINDOW_SIZE];
+};
+
+static const unsigned short lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short distanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char distanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const unsigned char codeLengthOrder[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+static int reverseBits(int code, int numBits)
+{
+    int reversed = 0;
+    while (numBits--) {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+    return reversed;
+}
+
+// Builds the canonical code for num symbols with the given code lengths
+static bool buildHuffman(Huffman *h, const unsigned char *sizes, int num)
+{
+    int count[17], nextCode[16];
+    int i, code = 0, symbols = 0;
+
+    memset(count, 0, sizeof(count));
+    memset(h->fast, 0, sizeof(h->fast));
+    for (i = 0; i < num; i++)
+        count[sizes[i]]++;
+    count[0] = 0;
+    for (i = 1; i < 16; i++) {
+        nextCode[i] = code;
+        h->firstCode[i] = (unsigned short)code;
+        h->firstSymbol[i] = (unsigned short)symbols;
+        code += count[i];
+        if (count[i] && code - 1 >= (1 << i))
+            return false;                           // over subscribed
+        h->maxCode[i] = code << (16 - i);
+        code <<= 1;
+        symbols += count[i];
+    }
+    h->maxCode[16] = 0x10000;
+    for (i = 0; i < num; i++) {
+        int s = sizes[i];
+        if (s) {
+            int c = nextCode[s] - h->firstCode[s] + h->firstSymbol[s];
+            h->size[c] = (unsigned char)s;
+            h->value[c] = (unsigned short)i;
+            if (s <= HUFFMAN_FAST_BITS) {
+                int j = reverseBits(nextCode[s], s);
+                while (j < (1 << HUFFMAN_FAST_BITS)) {
+                    h->fast[j] = (unsigned short)((s << 9) | i);
+                    j += 1 << s;
+                }
+            }
+            nextCode[s]++;
+        }
+    }
+    return true;
+}
+
+static void fillBits(PngInflate *z)
+{
+    while (z->numBits <= 24) {
+        unsigned int byte = 0;
+        if (z->in < z->inEnd)
+            byte = *z->in++;
+        else
+            z->overrun++;
+        z->bits |= byte << z->numBits;
+        z->numBits += 8;
+    }
+}
+
+static unsigned int getBits(PngInflate *z, int n)
+{
+    unsigned int v;
+    if (z->numBits < n)
+        fillBits(z);
+    v = z->bits & ((1u << n) - 1);
+    z->bits >>= n;
+    z->numBits -= n;
+    return v;
+}
+
+static int decodeSymbol(PngInflate *z, const Huffman *h)
+{
+    int b, s, k;
+
+    if (z->numBits < 16)
+        fillBits(z);
+    b = h->fast[z->bits & ((1 << HUFFMAN_FAST_BITS) - 1)];
+    if (b) {
+        s = b >> 9;
+        z->bits >>= s;
+        z->numBits -= s;
+        return b & 511;
+    }
+    // Longer codes, compare the bit reversed code against the canonical limits
+    k = reverseBits(z->bits & 0xFFFF, 16);
+    for (s = HUFFMAN_FAST_BITS + 1; k >= h->maxCode[s]; s++)
+        ;
+    if (s >= 16)
+        return -1;
+    b = (k >> (16 - s)) - h->firstCode[s] + h->firstSymbol[s];
+    if (b >= 288 || h->size[b] != s)
+        return -1;
+    z->bits >>= s;
+    z->numBits -= s;
+    return h->value[b];
+}
+
+static bool readDynamicTables(PngInflate *z)
+{
+    unsigned char sizes[286 + 32];
+    unsigned char codeLengthSizes[19];
+    Huffman codeLengths;
+    int numLengths = getBits(z, 5) + 257;
+    int numDistances = getBits(z, 5) + 1;
+    int numCodeLengths = getBits(z, 4) + 4;
+    int i, n = 0;
+
+    memset(codeLengthSizes, 0, sizeof(codeLengthSizes));
+    for (i = 0; i < numCodeLengths; i++)
+        codeLengthSizes[codeLengthOrder[i]] = (unsigned char)getBits(z, 3);
+    if (!buildHuffman(&codeLengths, codeLengthSizes, 19))
+        return false;
+
+    while (n < numLengths + numDistances) {
+        int c = decodeSymbol(z, &codeLengths);
+        int repeat;
+        unsigned char fill = 0;
+        if (c < 0 || c > 18)
+            return false;
+        if (c < 16) {
+            sizes[n++] = (unsigned char)c;
+            continue;
+        }
+        if (c == 16) {
+            if (n == 0)
+                return false;
+            repeat = getBits(z, 2) + 3;
+            fill = sizes[n - 1];
+        } else if (c == 17) {
+            repeat = getBits(z, 3) + 3;
+        } else {
+            repeat = getBits(z, 7) + 11;
+        }
+        if (n + repeat > numLengths + numDistances)
+            return false;
+        memset(sizes + n, fill, repeat);
+        n += repeat;
+    }
+    if (sizes[256] == 0)
+        return false;                               // no end of block code
+    return buildHuffman(&z->lengths, sizes, numLengths) &&
+           buildHuffman(&z->distances, sizes + numLengths, numDistances);
+}
+
+static bool readFixedTables(PngInflate *z)
+{
+    unsigned char sizes[288];
+    int i;
+
+    for (i = 0; i < 144; i++) sizes[i] = 8;
+    for (; i < 256; i++) sizes[i] = 9;
+    for (; i < 280; i++) sizes[i] = 7;
+    for (; i < 288; i++) sizes[i] = 8;
+    if (!buildHuffman(&z->lengths, sizes, 288))
+        return false;
+    for (i = 0; i < 30; i++) sizes[i] = 5;
+    return buildHuffman(&z->distances, sizes, 30);
+}
+
+static bool startInflate(PngInflate *z, const unsigned char *data, size_t size)
+{
+    memset(z, 0, sizeof(PngInflate));
+    // zlib header: deflate method, no preset dictionary
+    if (size < 2 || (data[0] & 15) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 32))
+        return false;
+    z->in = data + 2;
+    z->inEnd = data + size;
+    z->state = INFLATE_BLOCK;
+    return true;
+}
+
+//
+// inflateRead
+//
+// Produces up to size bytes of output, fewer only at the end of the stream or
+// on corrupt data (z->error).
+//
+static size_t inflateRead(PngInflate *z, unsigned char *dst, size_t size)
+{
+    const unsigned int windowMask = INFLATE_WINDOW_SIZE - 1;
+    size_t n = 0;
+
+    while (n < size && !z->error) {
+        // Finish a match which did not fit into the previous output
+        if (z->matchLength) {
+            unsigned int from = z->windowPos - z->matchDistance;
+            while (z->matchLength && n < size) {
+                unsigned char c = z->window[from++ & windowMask];
+                z->window[z->windowPos++ & windowMask] = c;
+                dst[n++] = c;
+                z->matchLength--;
+            }
+            continue;
+        }
+
+        switch (z->state) {
+        case INFLATE_BLOCK:
+            if (z->finalBlock) {
+                z->state = INFLATE_DONE;
+                break;
+            }
+            z->finalBlock = getBits(z, 1) != 0;
+            switch (getBits(z, 2)) {
+            case 0:
+                // stored block starts at the next byte boundary
+                getBits(z, z->numBits & 7);
+                z->storedLeft = getBits(z, 16);
+                if ((getBits(z, 16) ^ 0xFFFF) != z->storedLeft)
+                    z->error = true;
+                z->state = INFLATE_STORED;
+                break;
+            case 1:
+                z->error = !readFixedTables(z);
+                z->state = INFLATE_CODES;
+                break;
+            case 2:
+                z->error = !readDynamicTables(z);
+                z->state = INFLATE_CODES;
+                break;
+            default:
+                z->error = true;
+                break;
+            }
+            break;
+
+        case INFLATE_STORED:
+            while (z->storedLeft && n < size) {
+                unsigned char c = (unsigned char)getBits(z, 8);
+                z->window[z->windowPos++ & windowMask] = c;
+                dst[n++] = c;
+                z->storedLeft--;
+            }
+            if (!z->storedLeft)
+                z->state = INFLATE_BLOCK;
+            break;
+
+        case INFLATE_CODES:
+            while (n < size) {
+                int symbol = decodeSymbol(z, &z->lengths);
+                if (symbol < 256) {
+                    if (symbol < 0) {
+                        z->error = true;
+                        break;
+                    }
+                    z->window[z->windowPos++ & windowMask] = (unsigned char)symbol;
+                    dst[n++] = (unsigned char)symbol;
+                } else if (symbol == 256) {
+                    z->state = INFLATE_BLOCK;
+                    break;
+                } else {
+                    int distanceSymbol;
+                    symbol -= 257;
+                    if (symbol >= 29) {
+                        z->error = true;
+                        break;
+                    }
+                    z->matchLength = lengthBase[symbol] + getBits(z, lengthExtra[symbol]);
+                    distanceSymbol = decodeSymbol(z, &z->distances);
+                    if (distanceSymbol < 0 || distanceSymbol >= 30) {
+                        z->error = true;
+                        break;
+                    }
+                    z->matchDistance = distanceBase[distanceSymbol] + getBits(z, distanceExtra[distanceSymbol]);
+                    if (z->matchDistance > z->total + n) {
+                        z->error = true;                // reaches before the stream start
+                        break;
+                    }
+                    break;                              // the match is copied at the loop top
+                }
+            }
+            break;
+
+        case INFLATE_DONE:
+            z->total += n;
+            return n;
+        }
+        // The input may only be over read by the bits still in the buffer
+        if (z->overrun * 8 > z->numBits)
+            z->error = true;
+    }
+    if (z->error)
+        z->matchLength = 0;
+    z->total += n;
+    return n;
+}
+
+//
+// Unfilter
+//
+// The rows have 16 zero bytes in front of them, so the left neighbours of the
+// first pixel read as zero, and 16 bytes of slack behind them for the SIMD
+// loads. Sub, Average and Paeth depend on the pixel to the left; Sub is done
+// as a prefix sum inside a register, Average and Paeth one pixel per iteration
+// with all of its bytes (up to 8 for 16-bit RGBA) side by side. That pays from
+// 2 byte pixels (16-bit gray) up, 8-bit gray stays scalar for those two.
+//
+#define PNG_ROW_PADDING 16
+
+enum { FILTER_NONE = 0, FILTER_SUB, FILTER_UP, FILTER_AVERAGE, FILTER_PAETH };
+
+// _mm_slli_si128/_mm_srli_si128 need immediate counts
+static __m128i shiftLeftBytes(__m128i x, int n)
+{
+    switch (n) {
+    case 1: return _mm_slli_si128(x, 1);
+    case 2: return _mm_slli_si128(x, 2);
+    case 3: return _mm_slli_si128(x, 3);
+    case 4: return _mm_slli_si128(x, 4);
+    case 6: return _mm_slli_si128(x, 6);
+    case 8: return _mm_slli_si128(x, 8);
+    }
+    return x;
+}
+
+static __m128i shiftRightBytes(__m128i x, int n)
+{
+    switch (n) {
+    case 6: return _mm_srli_si128(x, 6);
+    case 8: return _mm_srli_si128(x, 8);
+    case 9: return _mm_srli_si128(x, 9);
+    case 12: return _mm_srli_si128(x, 12);
+    case 14: return _mm_srli_si128(x, 14);
+    case 15: return _mm_srli_si128(x, 15);
+    }
+    return x;
+}
+
+static void unfilterSub(unsigned char *cur, size_t rowBytes, int bpp)
+{
+    static const unsigned char lowBytes[32] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    size_t i = 0;
+
+    if (bpp == 1 || bpp == 2 || bpp == 3 || bpp == 4 || bpp == 6 || bpp == 8) {
+        // 3 and 6 byte pixels are done 12 bytes at a time so no pixel straddles two loads
+        const int chunk = (bpp == 3 || bpp == 6) ? 12 : 16;
+        const __m128i pixelMask = _mm_loadu_si128((const __m128i *)(lowBytes + 16 - bpp));
+        __m128i left = _mm_setzero_si128();
+        int s;
+        for (; i + 16 <= rowBytes; i += chunk) {
+            __m128i x = _mm_add_epi8(_mm_loadu_si128((const __m128i *)(cur + i)), left);
+            for (s = bpp; s < chunk; s *= 2)
+                x = _mm_add_epi8(x, shiftLeftBytes(x, s));
+            if (chunk == 16) {
+                _mm_storeu_si128((__m128i *)(cur + i), x);
+            } else {
+                int high = _mm_cvtsi128_si32(_mm_srli_si128(x, 8));
+                _mm_storel_epi64((__m128i *)(cur + i), x);
+                memcpy(cur + i + 8, &high, sizeof(high));
+            }
+            left = _mm_and_si128(shiftRightBytes(x, chunk - bpp), pixelMask);
+        }
+    }
+    for (; i < rowBytes; i++)
+        cur[i] = (unsigned char)(cur[i] + cur[i - bpp]);
+}
+
+static void unfilterUp(unsigned char *cur, const unsigned char *prev, size_t rowBytes)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= rowBytes; i += 16) {
+        __m128i x = _mm_add_epi8(_mm_loadu_si128((const __m128i *)(cur + i)),
+                                 _mm_loadu_si128((const __m128i *)(prev + i)));
+        _mm_storeu_si128((__m128i *)(cur + i), x);
+    }
+    for (; i < rowBytes; i++)
+        cur[i] = (unsigned char)(cur[i] + prev[i]);
+}
+
+static void unfilterAverage(unsigned char *cur, const unsigned char *prev, size_t rowBytes, int bpp)
+{
+    size_t i = 0;
+
+    if (bpp >= 2) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i a = zero;                           // left, already unfiltered
+        for (; i < rowBytes; i += bpp) {
+            unsigned char bytes[8];
+            __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(prev + i)), zero);
+            __m128i x = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(cur + i)), zero);
+            x = _mm_and_si128(_mm_add_epi16(x, _mm_srli_epi16(_mm_add_epi16(a, b), 1)), _mm_set1_epi16(0xFF));
+            _mm_storel_epi64((__m128i *)bytes, _mm_packus_epi16(x, x));
+            memcpy(cur + i, bytes, bpp);
+            a = x;
+        }
+        return;
+    }
+    for (; i < rowBytes; i++)
+        cur[i] = (unsigned char)(cur[i] + ((cur[i - bpp] + prev[i]) >> 1));
+}
+
+static void unfilterPaeth(unsigned char *cur, const unsigned char *prev, size_t rowBytes, int bpp)
+{
+    size_t i = 0;
+
+    if (bpp >= 2) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i a = zero;                           // left, already unfiltered
+        __m128i c = zero;                           // upper left
+        for (; i < rowBytes; i += bpp) {
+            unsigned char bytes[8];
+            __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(prev + i)), zero);
+            __m128i x = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(cur + i)), zero);
+            __m128i bc = _mm_sub_epi16(b, c);
+            __m128i ac = _mm_sub_epi16(a, c);
+            __m128i abc = _mm_add_epi16(bc, ac);
+            __m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));     // |p - a|
+            __m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));     // |p - b|
+            __m128i pc = _mm_max_epi16(abc, _mm_sub_epi16(zero, abc));   // |p - c|
+            // b if pb <= pc else c, then a if pa is the smallest
+            __m128i useC = _mm_cmpgt_epi16(pb, pc);
+            __m128i useA = _mm_andnot_si128(_mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc)),
+                                            _mm_set1_epi16(-1));
+            __m128i pred = _mm_or_si128(_mm_and_si128(useC, c), _mm_andnot_si128(useC, b));
+            pred = _mm_or_si128(_mm_and_si128(useA, a), _mm_andnot_si128(useA, pred));
+            x = _mm_and_si128(_mm_add_epi16(x, pred), _mm_set1_epi16(0xFF));
+            // Only this pixel may be stored, the next one is still filtered
+            _mm_storel_epi64((__m128i *)bytes, _mm_packus_epi16(x, x));
+            memcpy(cur + i, bytes, bpp);
+            a = x;
+            c = b;
+        }
+        return;
+    }
+    for (; i < rowBytes; i++) {
+        int left = cur[i - bpp], up = prev[i], upLeft = prev[i - bpp];
+        int p = left + up - upLeft;
+        int pa = abs(p - left), pb = abs(p - up), pc = abs(p - upLeft);
+        int pred = (pa <= pb && pa <= pc) ? left : (pb <= pc ? up : upLeft);
+        cur[i] = (unsigned char)(cur[i] + pred);
+    }
+}
+
+// Big endian 16-bit or 8-bit samples to host order 16-bit samples
+static void convertSamples(const unsigned char *src, unsigned short *dst, size_t count, GLuint bitDepth)
+{
+    size_t i = 0;
+
+    if (bitDepth == 16) {
+        for (; i + 8 <= count; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(src + i * 2));
+            v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+            _mm_storeu_si128((__m128i *)(dst + i), v);
+        }
+        for (; i < count; i++)
+            dst[i] = (unsigned short)((src[i * 2] << 8) | src[i * 2 + 1]);
+    } else {
+        // x * 257 maps 255 to 65535
+        for (; i + 16 <= count; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi8(v, v));
+            _mm_storeu_si128((__m128i *)(dst + i + 8), _mm_unpackhi_epi8(v, v));
+        }
+        for (; i < count; i++)
+            dst[i] = (unsigned short)(src[i] * 257);
+    }
+}
+
+static unsigned int readBigEndian32(const unsigned char *p)
+{
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+bool isPngFile(const char *fileName)
+{
+    static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    unsigned char header[8];
+    bool isPng = false;
+    FILE *file = fopen(fileName, "rb");
+
+    if (file) {
+        isPng = fread(header, 1, 8, file) == 8 && memcmp(header, signature, 8) == 0;
+        fclose(file);
+    }
+    return isPng;
+}
+
+//
+// openPng
+//
+// Collects the IDAT chunks, ancillary chunks are skipped. The CRCs are not
+// checked, the zlib stream has its own consistency checks.
+//
+bool openPng(PngFile *png, const char *fileName)
+{
+    bool ok = false;
+    bool haveHeader = false;
+    size_t capacity = 0;
+    unsigned char chunk[8], header[13];
+    unsigned int colorType = 0;
+    FILE *file = NULL;
+
+    memset(png, 0, sizeof(PngFile));
+    if (!isPngFile(fileName)) {
+        fprintf(stderr, "Not a PNG file\n");
+        goto Exit;
+    }
+    if ((file = fopen(fileName, "rb")) == NULL) {
+        fprintf(stderr, "Could not open incoming image\n");
+        goto Exit;
+    }
+    fseek(file, 8, SEEK_SET);
+
+    for (;;) {
+        unsigned int length;
+        if (fread(chunk, 1, 8, file) != 8) {
+            fprintf(stderr, "PNG file is truncated\n");
+            goto Exit;
+        }
+        length = readBigEndian32(chunk);
+        if (length > 0x7FFFFFFF) {
+            fprintf(stderr, "Invalid PNG chunk length\n");
+            goto Exit;
+        }
+        if (memcmp(chunk + 4, "IHDR", 4) == 0) {
+            if (length != 13 || fread(header, 1, 13, file) != 13) {
+                fprintf(stderr, "Invalid PNG header\n");
+                goto Exit;
+            }
+            png->width = readBigEndian32(header);
+            png->height = readBigEndian32(header + 4);
+            png->bitDepth = header[8];
+            colorType = header[9];
+            if (header[10] != 0 || header[11] != 0 || header[12] != 0) {
+                fprintf(stderr, "Interlaced PNG files are not supported\n");
+                goto Exit;
+            }
+            haveHeader = true;
+        } else if (memcmp(chunk + 4, "IDAT", 4) == 0) {
+            if (length > (size_t)-1 - png->dataSize) {
+                fprintf(stderr, "PNG image data is too large\n");
+                goto Exit;
+            }
+            if (png->dataSize + length > capacity) {
+                unsigned char *data;
+                size_t needed = png->dataSize + length;
+                // Doubled so the data is copied a few times only, unless that overflows
+                capacity = (needed <= (size_t)-1 / 2) ? needed * 2 : needed;
+                if ((data = (unsigned char *)realloc(png->data, capacity)) == NULL) {
+                    fprintf(stderr, "Could not allocate the image data\n");
+                    goto Exit;
+                }
+                png->data = data;
+            }
+            if (fread(png->data + png->dataSize, 1, length, file) != length) {
+                fprintf(stderr, "PNG file is truncated\n");
+                goto Exit;
+            }
+            png->dataSize += length;
+        } else if (memcmp(chunk + 4, "IEND", 4) == 0) {
+            break;
+        } else {
+            fseek(file, length, SEEK_CUR);
+        }
+        fseek(file, 4, SEEK_CUR);                   // CRC
+    }
+
+    if (!haveHeader || png->width == 0 || png->height == 0) {
+        fprintf(stderr, "Invalid PNG header\n");
+        goto Exit;
+    }
+    if ((colorType != 0 && colorType != 2) || (png->bitDepth != 8 && png->bitDepth != 16)) {
+        fprintf(stderr, "Only 8 and 16-bit gray or RGB PNG files are supported (color type %u, %u bits)\n",
+            colorType, png->bitDepth);
+        goto Exit;
+    }
+    png->channels = (colorType == 2) ? 3 : 1;
+    png->pixelBytes = png->channels * png->bitDepth / 8;
+    png->rowBytes = (size_t)png->width * png->pixelBytes;
+
+    png->inflate = (PngInflate *)malloc(sizeof(PngInflate));
+    png->rowBuffer = (unsigned char *)calloc(2, png->rowBytes + 2 * PNG_ROW_PADDING);
+    if (!png->inflate || !png->rowBuffer) {
+        fprintf(stderr, "Could not allocate the PNG decoder\n");
+        goto Exit;
+    }
+    png->curRow = png->rowBuffer + PNG_ROW_PADDING;
+    png->prevRow = png->curRow + png->rowBytes + 2 * PNG_ROW_PADDING;
+    if (!startInflate(png->inflate, png->data, png->dataSize)) {
+        fprintf(stderr, "Invalid PNG image data\n");
+        goto Exit;
+    }
+    ok = true;
+
+Exit:;
+    if (file)
+        fclose(file);
+    if (!ok)
+        closePng(png);
+    return ok;
+}
+
+bool readPngRow(PngFile *png, unsigned short *samples)
+{
+    unsigned char filter;
+    unsigned char *row;
+
+    if (png->row >= png->height)
+        return false;
+
+    // The previous row is the reference of the filters
+    row = png->prevRow;
+    png->prevRow = png->curRow;
+    png->curRow = row;
+
+    if (inflateRead(png->inflate, &filter, 1) != 1 ||
+        inflateRead(png->inflate, row, png->rowBytes) != png->rowBytes) {
+        fprintf(stderr, "PNG image data is corrupt or truncated at row %u\n", png->row);
+        return false;
+    }
+    switch (filter) {
+    case FILTER_NONE:
+        break;
+    case FILTER_SUB:
+        unfilterSub(row, png->rowBytes, png->pixelBytes);
+        break;
+    case FILTER_UP:
+        unfilterUp(row, png->prevRow, png->rowBytes);
+        break;
+    case FILTER_AVERAGE:
+        unfilterAverage(row, png->prevRow, png->rowBytes, png->pixelBytes);
+        break;
+    case FILTER_PAETH:
+        unfilterPaeth(row, png->prevRow, png->rowBytes, png->pixelBytes);
+        break;
+    default:
+        fprintf(stderr, "Unknown PNG filter %u at row %u\n", filter, png->row);
+        return false;
+    }
+    convertSamples(row, samples, (size_t)png->width * png->channels, png->bitDepth);
+    png->row++;
+    return true;
+}
+
+void closePng(PngFile *png)
+{
+    free(png->data);
+    free(png->inflate);
+    free(png->rowBuffer);
+    memset(png, 0, sizeof(PngFile));
+}
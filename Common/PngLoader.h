@@ -0,0 +1,43 @@
+//
+// PngLoader.h
+//
+// Streaming reader for non-interlaced 8 and 16-bit gray and RGB PNG files.
+// The image data is inflated one row at a time, unfiltered with SSE2 and
+// returned as host order 16-bit samples, so the raw image never has to be
+// held in memory as a whole.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PNGLOADER_H
+#define PNGLOADER_H
+
+typedef struct _PngInflate PngInflate;
+
+typedef struct _PngFile {
+    GLuint width;
+    GLuint height;
+    GLuint channels;                // 1 gray, 3 RGB
+    GLuint bitDepth;                // bits per sample in the file, 8 or 16
+    GLuint row;                     // next row readPngRow returns
+    // decoder state
+    unsigned char *data;            // concatenated IDAT chunks (zlib stream)
+    size_t dataSize;
+    PngInflate *inflate;
+    unsigned char *rowBuffer;       // the current and the previous raw row
+    unsigned char *curRow;
+    unsigned char *prevRow;
+    size_t rowBytes;                // raw bytes per row without the filter byte
+    GLuint pixelBytes;              // raw bytes per pixel, the filter distance
+} PngFile;
+
+// Checks the signature of the file.
+extern bool isPngFile(const char *fileName);
+// Reads the header and the compressed data. Returns false if the file is not
+// a supported PNG, the reason is printed.
+extern bool openPng(PngFile *png, const char *fileName);
+// Decodes the next row, top to bottom, into width*channels 16-bit samples.
+// 8-bit samples are scaled to 16 bits (x*257).
+extern bool readPngRow(PngFile *png, unsigned short *samples);
+extern void closePng(PngFile *png);
+
+#endif
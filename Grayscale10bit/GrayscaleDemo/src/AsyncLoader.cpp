@@ -0,0 +1,220 @@
+//
+// AsyncLoader.cpp
+//
+// Background tiff and PNG loading with a progressive proxy image
+//
+#include <windows.h>
+#include <process.h>
+#include <stdio.h>
+#include <string.h>
+#include <GL/gl.h>
+#include "ImageBuffer.h"
+#include "TiffLoader.h"
+#include "PngLoader.h"
+#include "PngImage.h"
+#include "ImagePyramid.h"
+#include "AsyncLoader.h"
+
+//
+// decimateRow
+//
+// Averages the factor x factor blocks of image pixels covering one proxy row.
+// Blocks at the right and bottom border may be smaller.
+//
+static void decimateRow(const unsigned short *pixels, GLuint width, GLuint height, GLuint factor,
+    GLuint proxyWidth, GLuint row, unsigned short *dst)
+{
+    GLuint y0 = row * factor;
+    GLuint y1 = (y0 + factor < height) ? y0 + factor : height;
+    GLuint px, x, y;
+
+    for (px = 0; px < proxyWidth; px++) {
+        GLuint x0 = px * factor;
+        GLuint x1 = (x0 + factor < width) ? x0 + factor : width;
+        unsigned __int64 sum = 0;
+        for (y = y0; y < y1; y++) {
+            const unsigned short *src = pixels + (size_t)y * width;
+            for (x = x0; x < x1; x++)
+                sum += src[x];
+        }
+        dst[px] = (unsigned short)(sum / ((unsigned __int64)(y1 - y0) * (x1 - x0)));
+    }
+}
+
+// Strip progress from readTiff or readPngImage, runs on the loader thread
+static bool loadProgress(void *userData, const unsigned short *pixels, GLuint width, GLuint height, GLuint rowsDone)
+{
+    AsyncLoad *load = (AsyncLoad *)userData;
+    AsyncLoadStatus *status = &load->status;
+    GLuint proxyRows;
+
+    if (!pixels) {
+        // The load failed, the main thread must not touch the buffer anymore
+        EnterCriticalSection(&load->lock);
+        status->pixels = NULL;
+        status->rowsDone = 0;
+        LeaveCriticalSection(&load->lock);
+        SetEvent(load->progressEvent);
+        return false;
+    }
+
+    if (rowsDone == 0 && !load->proxy) {
+        // First call, pick the smallest power of two decimation that fits
+        GLuint factor = 1;
+        GLuint longSide = width > height ? width : height;
+        while (longSide / factor > ASYNCLOAD_PROXY_SIZE)
+            factor *= 2;
+        GLuint proxyWidth = (width + factor - 1) / factor;
+        GLuint proxyHeight = (height + factor - 1) / factor;
+        load->proxy = (unsigned short *)malloc((size_t)proxyWidth * proxyHeight * sizeof(unsigned short));
+
+        EnterCriticalSection(&load->lock);
+        status->width = width;
+        status->height = height;
+        if (load->proxy) {
+            status->proxy = load->proxy;
+            status->proxyWidth = proxyWidth;
+            status->proxyHeight = proxyHeight;
+            status->proxyFactor = factor;
+        }
+        LeaveCriticalSection(&load->lock);
+    }
+
+    // Decimate every proxy row whose source rows are complete
+    proxyRows = status->proxyRowsDone;
+    if (load->proxy) {
+        while (proxyRows < status->proxyHeight) {
+            GLuint lastSourceRow = (proxyRows + 1) * status->proxyFactor;
+            if (lastSourceRow > height)
+                lastSourceRow = height;
+            if (lastSourceRow > rowsDone)
+                break;
+            decimateRow(pixels, width, height, status->proxyFactor, status->proxyWidth, proxyRows,
+                load->proxy + (size_t)proxyRows * status->proxyWidth);
+            proxyRows++;
+        }
+    }
+
+    EnterCriticalSection(&load->lock);
+    status->pixels = pixels;
+    status->rowsDone = rowsDone;
+    status->proxyRowsDone = proxyRows;
+    LeaveCriticalSection(&load->lock);
+    SetEvent(load->progressEvent);
+
+    return load->cancel == 0;
+}
+
+static unsigned __stdcall loadThread(void *arg)
+{
+    AsyncLoad *load = (AsyncLoad *)arg;
+    GLuint width, height, bitDepth, minValue, maxValue, numValues;
+    char *pixels = NULL;
+    int ok;
+
+    if (isPngFile(load->fileName))
+        ok = readPngImage(load->fileName, &width, &height, &bitDepth, &minValue, &maxValue, &numValues, &pixels,
+            loadProgress, load);
+    else
+        ok = readTiff(load->fileName, &width, &height, &bitDepth, &minValue, &maxValue, &numValues, &pixels,
+            loadProgress, load);
+
+    // The main thread may upload the pixels meanwhile, both only read them
+    if (ok && !buildImagePyramid(&load->pyramid, (const unsigned short *)pixels, width, height))
+        fprintf(stderr, "Not enough memory for the image pyramid\n");
+
+    EnterCriticalSection(&load->lock);
+    if (ok) {
+        load->status.state = ASYNCLOAD_DONE;
+        load->status.pixels = (const unsigned short *)pixels;
+        load->status.rowsDone = height;
+        load->status.bitDepth = bitDepth;
+        load->status.minValue = minValue;
+        load->status.maxValue = maxValue;
+        load->status.numValues = numValues;
+    } else {
+        load->status.state = ASYNCLOAD_FAILED;
+    }
+    LeaveCriticalSection(&load->lock);
+    SetEvent(load->progressEvent);
+    return 0;
+}
+
+bool startAsyncLoad(AsyncLoad *load, const char *fileName)
+{
+    memset(load, 0, sizeof(AsyncLoad));
+    strncpy(load->fileName, fileName, MAX_PATH - 1);
+    InitializeCriticalSection(&load->lock);
+    load->progressEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    load->status.state = ASYNCLOAD_RUNNING;
+    QueryPerformanceCounter(&load->startTime);
+
+    load->thread = (HANDLE)_beginthreadex(NULL, 0, loadThread, load, 0, NULL);
+    if (!load->thread) {
+        fprintf(stderr, "Could not start the image loader thread\n");
+        CloseHandle(load->progressEvent);
+        DeleteCriticalSection(&load->lock);
+        return false;
+    }
+    return true;
+}
+
+void getAsyncLoadStatus(AsyncLoad *load, AsyncLoadStatus *status)
+{
+    EnterCriticalSection(&load->lock);
+    *status = load->status;
+    LeaveCriticalSection(&load->lock);
+}
+
+void lockAsyncLoad(AsyncLoad *load)
+{
+    EnterCriticalSection(&load->lock);
+}
+
+void unlockAsyncLoad(AsyncLoad *load)
+{
+    LeaveCriticalSection(&load->lock);
+}
+
+double asyncLoadSeconds(const AsyncLoad *load)
+{
+    LARGE_INTEGER now, frequency;
+
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)(now.QuadPart - load->startTime.QuadPart) / (double)frequency.QuadPart;
+}
+
+bool detachAsyncLoadImage(AsyncLoad *load, unsigned short **pixels, ImagePyramid *pyramid)
+{
+    bool done;
+
+    EnterCriticalSection(&load->lock);
+    done = load->status.state == ASYNCLOAD_DONE;
+    if (done) {
+        *pixels = (unsigned short *)load->status.pixels;
+        *pyramid = load->pyramid;
+        load->status.pixels = NULL;
+        memset(&load->pyramid, 0, sizeof(ImagePyramid));
+    }
+    LeaveCriticalSection(&load->lock);
+    return done;
+}
+
+void finishAsyncLoad(AsyncLoad *load)
+{
+    if (!load->thread)
+        return;
+
+    InterlockedExchange(&load->cancel, 1);
+    WaitForSingleObject(load->thread, INFINITE);
+    CloseHandle(load->thread);
+    CloseHandle(load->progressEvent);
+    DeleteCriticalSection(&load->lock);
+
+    // A failed or cancelled load has already released its pixels
+    freeImagePixels((void *)load->status.pixels);
+    free(load->proxy);
+    freeImagePyramid(&load->pyramid);
+    memset(load, 0, sizeof(AsyncLoad));
+}
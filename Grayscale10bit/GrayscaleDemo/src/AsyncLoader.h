@@ -0,0 +1,71 @@
+//
+// AsyncLoader.h
+//
+// Loads a tiff or PNG file on a worker thread so the window keeps running.
+// While the strips are decoded a box filtered proxy (long side at most
+// ASYNCLOAD_PROXY_SIZE) is built, which can be shown long before the full
+// resolution rows are available. Once decoded, the image pyramid is built on
+// the same thread.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef ASYNCLOADER_H
+#define ASYNCLOADER_H
+
+#define ASYNCLOAD_PROXY_SIZE    1024
+
+enum {
+    ASYNCLOAD_RUNNING = 0,
+    ASYNCLOAD_DONE,
+    ASYNCLOAD_FAILED
+};
+
+// State shared with the loader thread, guarded by AsyncLoad::lock
+typedef struct _AsyncLoadStatus {
+    int state;
+    GLuint width;                   // image size, 0 until known
+    GLuint height;
+    GLuint bitDepth;                // valid once done
+    const unsigned short *pixels;   // full resolution image, rows [0, rowsDone) are final
+    GLuint rowsDone;
+    const unsigned short *proxy;    // decimated image, rows [0, proxyRowsDone) are final
+    GLuint proxyWidth;
+    GLuint proxyHeight;
+    GLuint proxyFactor;             // image pixels per proxy pixel along each axis
+    GLuint proxyRowsDone;
+    GLuint minValue;                // image statistics, valid once done
+    GLuint maxValue;
+    GLuint numValues;
+} AsyncLoadStatus;
+
+typedef struct _AsyncLoad {
+    char fileName[MAX_PATH];
+    HANDLE thread;                  // NULL if no load was started
+    HANDLE progressEvent;           // auto reset, set whenever the status changes
+    CRITICAL_SECTION lock;
+    volatile LONG cancel;
+    LARGE_INTEGER startTime;
+    unsigned short *proxy;          // owned by the loader thread
+    ImagePyramid pyramid;           // valid once the state is ASYNCLOAD_DONE
+    AsyncLoadStatus status;
+} AsyncLoad;
+
+// Starts loading fileName on a new thread.
+extern bool startAsyncLoad(AsyncLoad *load, const char *fileName);
+// Copies the current state of the load. Wait on load->progressEvent to
+// sleep until it changes.
+extern void getAsyncLoadStatus(AsyncLoad *load, AsyncLoadStatus *status);
+// While locked status.pixels stays valid (it is cleared before a failed load
+// releases it), so rows up to status.rowsDone can be read.
+extern void lockAsyncLoad(AsyncLoad *load);
+extern void unlockAsyncLoad(AsyncLoad *load);
+// Seconds since the load was started.
+extern double asyncLoadSeconds(const AsyncLoad *load);
+// Hands the pixels and the pyramid of a finished load over to the caller,
+// finishAsyncLoad no longer releases them. Returns false if not done yet.
+extern bool detachAsyncLoadImage(AsyncLoad *load, unsigned short **pixels, ImagePyramid *pyramid);
+// Cancels the load if it is still running, waits for the thread and releases
+// the pixels, the proxy and the pyramid.
+extern void finishAsyncLoad(AsyncLoad *load);
+
+#endif
@@ -0,0 +1,381 @@
+//
+// CinePlayer.cpp
+//
+// Frame sequence playback: decode threads, upload and present stages
+//
+#include <windows.h>
+#include <process.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GL\glew.h>
+#include <GL\gl.h>
+#include "ImageBuffer.h"
+#include "TiffLoader.h"
+#include "PngLoader.h"
+#include "PngImage.h"
+#include "ShaderVariants.h"
+#include "DisplayProgram.h"
+#include "PboUploader.h"
+#include "TiledImage.h"
+#include "CinePlayer.h"
+
+static double cineSeconds()
+{
+    LARGE_INTEGER now, frequency;
+
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+static void addLatency(LatencyHistogram *histogram, double seconds)
+{
+    double ms = seconds * 1000.0;
+    unsigned int bin = 0;
+
+    // bin i > 0 holds [2^(i-1), 2^i) ms, the last one everything above
+    while (bin < CINE_HISTOGRAM_BINS - 1 && ms >= (double)(1 << bin))
+        bin++;
+    histogram->counts[bin]++;
+    histogram->samples++;
+    histogram->total += seconds;
+    if (seconds > histogram->max)
+        histogram->max = seconds;
+}
+
+static int compareFileNames(const void *a, const void *b)
+{
+    return _stricmp((const char *)a, (const char *)b);
+}
+
+static bool cineProgress(void *userData, const unsigned short *pixels, GLuint width, GLuint height, GLuint rowsDone)
+{
+    // Stopping the player aborts the frames being decoded
+    return ((CinePlayer *)userData)->stop == 0;
+}
+
+// Decodes a file of the sequence, NULL on failure
+static unsigned short *decodeFrame(CinePlayer *player, unsigned int file, GLuint *pWidth, GLuint *pHeight)
+{
+    char *fileName = player->fileNames[file];
+    GLuint bitDepth, minValue, maxValue, numValues;
+    char *pixels = NULL;
+    int ok;
+
+    if (isPngFile(fileName))
+        ok = readPngImage(fileName, pWidth, pHeight, &bitDepth, &minValue, &maxValue, &numValues, &pixels,
+            cineProgress, player);
+    else
+        ok = readTiff(fileName, pWidth, pHeight, &bitDepth, &minValue, &maxValue, &numValues, &pixels,
+            cineProgress, player);
+    return ok ? (unsigned short *)pixels : NULL;
+}
+
+//
+// decodeThread
+//
+// Claims the next frame, waits until the queue slot of the frame is free and
+// decodes into it. A slot is reserved for frames index, index+CINE_QUEUE_FRAMES,
+// ... in turn, so the frames reach the upload stage in order. With at most
+// CINE_QUEUE_FRAMES decoders only one of them can wait for a slot.
+//
+static unsigned __stdcall decodeThread(void *arg)
+{
+    CinePlayer *player = (CinePlayer *)arg;
+
+    for (;;) {
+        unsigned int frame = (unsigned int)InterlockedIncrement(&player->nextDecode) - 1;
+        unsigned int index = frame % CINE_QUEUE_FRAMES;
+        CineSlot *slot = &player->slots[index];
+        bool claimed = false;
+
+        while (!claimed) {
+            if (player->stop)
+                return 0;
+            EnterCriticalSection(&player->lock);
+            if (slot->state == CINE_SLOT_FREE && slot->frame == frame) {
+                slot->state = CINE_SLOT_DECODING;
+                claimed = true;
+            }
+            LeaveCriticalSection(&player->lock);
+            if (!claimed)
+                WaitForSingleObject(player->slotFreed[index], INFINITE);
+        }
+
+        double start = cineSeconds();
+        GLuint width = 0, height = 0;
+        unsigned short *pixels = decodeFrame(player, frame % player->numFiles, &width, &height);
+        if (pixels && (width != player->width || height != player->height)) {
+            fprintf(stderr, "%s is %ux%u, not %ux%u like the first frame\n", player->fileNames[frame % player->numFiles],
+                width, height, player->width, player->height);
+            freeImagePixels(pixels);
+            pixels = NULL;
+        }
+        EnterCriticalSection(&player->lock);
+        slot->pixels = pixels;
+        slot->decodeSeconds = cineSeconds() - start;
+        slot->state = CINE_SLOT_READY;
+        LeaveCriticalSection(&player->lock);
+        SetEvent(player->frameReady);
+    }
+}
+
+bool startCinePlayer(CinePlayer *player, const char *pattern, double fps)
+{
+    WIN32_FIND_DATA found;
+    HANDLE find;
+    SYSTEM_INFO systemInfo;
+    const char *slash = strrchr(pattern, '\\');
+    int dirLength;
+    unsigned int capacity = 0, i;
+    double start;
+
+    memset(player, 0, sizeof(CinePlayer));
+    if (!slash || strrchr(pattern, '/') > slash)
+        slash = strrchr(pattern, '/');
+    dirLength = slash ? (int)(slash - pattern) + 1 : 0;
+
+    // The frames are the files matching the pattern in name order
+    find = FindFirstFile(pattern, &found);
+    if (find == INVALID_HANDLE_VALUE) {
+        printf("No frames match %s\n", pattern);
+        return false;
+    }
+    do {
+        if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            continue;
+        if (player->numFiles == capacity) {
+            char (*fileNames)[MAX_PATH];
+            capacity = capacity ? capacity * 2 : 256;
+            fileNames = (char (*)[MAX_PATH])realloc(player->fileNames, capacity * MAX_PATH);
+            if (!fileNames)
+                break;
+            player->fileNames = fileNames;
+        }
+        _snprintf(player->fileNames[player->numFiles], MAX_PATH - 1, "%.*s%s", dirLength, pattern, found.cFileName);
+        player->fileNames[player->numFiles][MAX_PATH - 1] = '\0';
+        player->numFiles++;
+    } while (FindNextFile(find, &found));
+    FindClose(find);
+    if (!player->numFiles) {
+        printf("No frames match %s\n", pattern);
+        free(player->fileNames);
+        player->fileNames = NULL;
+        return false;
+    }
+    qsort(player->fileNames, player->numFiles, MAX_PATH, compareFileNames);
+
+    // The first frame gives the size of the sequence and is the first in the queue
+    start = cineSeconds();
+    player->slots[0].pixels = decodeFrame(player, 0, &player->width, &player->height);
+    if (!player->slots[0].pixels) {
+        printf("Unable to load the first frame %s\n", player->fileNames[0]);
+        free(player->fileNames);
+        memset(player, 0, sizeof(CinePlayer));
+        return false;
+    }
+    player->slots[0].decodeSeconds = cineSeconds() - start;
+    player->slots[0].state = CINE_SLOT_READY;
+    for (i = 1; i < CINE_QUEUE_FRAMES; i++)
+        player->slots[i].frame = i;
+    if (!createTiledImage(&player->textures[0], player->width, player->height) ||
+        !createTiledImage(&player->textures[1], player->width, player->height)) {
+        printf("Unable to create the frame textures\n");
+        deleteTiledImage(&player->textures[0]);
+        freeImagePixels(player->slots[0].pixels);
+        free(player->fileNames);
+        memset(player, 0, sizeof(CinePlayer));
+        return false;
+    }
+    player->fps = fps;
+
+    InitializeCriticalSection(&player->lock);
+    player->frameReady = CreateEvent(NULL, FALSE, FALSE, NULL);
+    for (i = 0; i < CINE_QUEUE_FRAMES; i++)
+        player->slotFreed[i] = CreateEvent(NULL, FALSE, FALSE, NULL);
+    player->nextDecode = 1;
+
+    // One core is left for the upload and present stages
+    GetSystemInfo(&systemInfo);
+    unsigned int numDecoders = systemInfo.dwNumberOfProcessors > 1 ? systemInfo.dwNumberOfProcessors - 1 : 1;
+    if (numDecoders > CINE_MAX_DECODERS)
+        numDecoders = CINE_MAX_DECODERS;
+    for (i = 0; i < numDecoders; i++) {
+        player->decoders[i] = (HANDLE)_beginthreadex(NULL, 0, decodeThread, player, 0, NULL);
+        if (!player->decoders[i])
+            break;
+        player->numDecoders++;
+    }
+    if (!player->numDecoders) {
+        fprintf(stderr, "Could not start the frame decoder threads\n");
+        stopCinePlayer(player);
+        return false;
+    }
+    printf("Playing %u frames of %ux%u at %.1f fps with %u decoder threads\n", player->numFiles,
+        player->width, player->height, fps, player->numDecoders);
+    return true;
+}
+
+//
+// uploadNextFrame - Upload stage. Fills the back textures with the next
+// decoded frame, frames already late whose successor is decoded are dropped.
+//
+static void uploadNextFrame(CinePlayer *player, PboUploader *uploader, unsigned int due)
+{
+    while (!player->backValid) {
+        unsigned int index = player->nextUpload % CINE_QUEUE_FRAMES;
+        CineSlot *slot = &player->slots[index];
+        CineSlot *next = &player->slots[(player->nextUpload + 1) % CINE_QUEUE_FRAMES];
+        bool ready, nextReady;
+
+        EnterCriticalSection(&player->lock);
+        ready = slot->state == CINE_SLOT_READY && slot->frame == player->nextUpload;
+        nextReady = next->state == CINE_SLOT_READY && next->frame == player->nextUpload + 1;
+        LeaveCriticalSection(&player->lock);
+        if (!ready)
+            return;
+
+        // Decoders do not touch a ready slot, no lock needed until it is freed
+        addLatency(&player->decodeLatency, slot->decodeSeconds);
+        if (!slot->pixels) {
+            player->decodeErrors++;
+        }
+        else if (player->nextUpload < due && nextReady) {
+            player->framesDropped++;
+        }
+        else {
+            double start = cineSeconds();
+            uploadTiledImage(&player->textures[1 - player->front], uploader, slot->pixels, 0, player->height);
+            addLatency(&player->uploadLatency, cineSeconds() - start);
+            player->backFrame = player->nextUpload;
+            player->backValid = true;
+        }
+        freeImagePixels(slot->pixels);
+
+        EnterCriticalSection(&player->lock);
+        slot->pixels = NULL;
+        slot->frame += CINE_QUEUE_FRAMES;       // the slot takes the frame one queue length later
+        slot->state = CINE_SLOT_FREE;
+        LeaveCriticalSection(&player->lock);
+        SetEvent(player->slotFreed[index]);
+        player->nextUpload++;
+    }
+}
+
+bool updateCinePlayer(CinePlayer *player, PboUploader *uploader, double now)
+{
+    unsigned int due;
+    bool changed = false;
+
+    if (!player->numFiles)
+        return false;
+    if (player->startTime == 0.0)
+        player->startTime = now;
+    due = (unsigned int)((now - player->startTime) * player->fps);
+
+    uploadNextFrame(player, uploader, due);
+    // Present stage, the previous frame must have been drawn first
+    if (player->backValid && player->backFrame <= due && !player->presentPending) {
+        player->front = 1 - player->front;
+        player->frontFrame = player->backFrame;
+        player->backValid = false;
+        player->presentPending = true;
+        player->framesShown++;
+        changed = true;
+        // The next frame is uploaded while this one is shown
+        uploadNextFrame(player, uploader, due);
+    }
+    return changed;
+}
+
+void cineFramePresented(CinePlayer *player, double now)
+{
+    double late;
+
+    if (!player->presentPending)
+        return;
+    late = now - (player->startTime + player->frontFrame / player->fps);
+    addLatency(&player->presentLatency, late > 0.0 ? late : 0.0);
+    player->presentPending = false;
+    player->lastPresent = now;
+}
+
+double cineWaitTime(const CinePlayer *player, double now)
+{
+    double due;
+
+    if (player->startTime == 0.0)
+        return 0.0;
+    // Waiting for the draw of the current frame or for a decoder
+    if (player->presentPending || !player->backValid)
+        return CINE_WAIT_FOR_FRAME;
+    due = player->startTime + player->backFrame / player->fps;
+    return (now >= due) ? 0.0 : due - now;
+}
+
+const TiledImage *cineFrontImage(const CinePlayer *player)
+{
+    return &player->textures[player->front];
+}
+
+static void printHistogram(const char *name, const LatencyHistogram *histogram)
+{
+    unsigned int i;
+
+    if (!histogram->samples)
+        return;
+    printf("  %-8s avg %7.2f ms, max %7.2f ms:", name, histogram->total * 1000.0 / histogram->samples,
+        histogram->max * 1000.0);
+    for (i = 0; i < CINE_HISTOGRAM_BINS; i++) {
+        if (!histogram->counts[i])
+            continue;
+        if (i == 0)
+            printf(" <1:%u", histogram->counts[i]);
+        else if (i == CINE_HISTOGRAM_BINS - 1)
+            printf(" >=%u:%u", 1 << (i - 1), histogram->counts[i]);
+        else
+            printf(" %u-%u:%u", 1 << (i - 1), 1 << i, histogram->counts[i]);
+    }
+    printf("\n");
+}
+
+void printCineStats(const CinePlayer *player)
+{
+    double seconds = player->lastPresent - player->startTime;
+
+    if (!player->numFiles)
+        return;
+    printf("Cine: %u frames shown, %u dropped, %u decode errors, %.1f fps target, %.1f fps shown\n",
+        player->framesShown, player->framesDropped, player->decodeErrors, player->fps,
+        seconds > 0.0 ? player->framesShown / seconds : 0.0);
+    printf("Stage latency histograms (ms: frames)\n");
+    printHistogram("decode", &player->decodeLatency);
+    printHistogram("upload", &player->uploadLatency);
+    printHistogram("present", &player->presentLatency);
+}
+
+void stopCinePlayer(CinePlayer *player)
+{
+    unsigned int i;
+
+    if (!player->numFiles)
+        return;
+    InterlockedExchange(&player->stop, 1);
+    for (i = 0; i < CINE_QUEUE_FRAMES; i++)
+        SetEvent(player->slotFreed[i]);
+    if (player->numDecoders)
+        WaitForMultipleObjects(player->numDecoders, player->decoders, TRUE, INFINITE);
+    for (i = 0; i < player->numDecoders; i++)
+        CloseHandle(player->decoders[i]);
+    for (i = 0; i < CINE_QUEUE_FRAMES; i++) {
+        freeImagePixels(player->slots[i].pixels);
+        CloseHandle(player->slotFreed[i]);
+    }
+    CloseHandle(player->frameReady);
+    DeleteCriticalSection(&player->lock);
+    deleteTiledImage(&player->textures[0]);
+    deleteTiledImage(&player->textures[1]);
+    free(player->fileNames);
+    memset(player, 0, sizeof(CinePlayer));
+}
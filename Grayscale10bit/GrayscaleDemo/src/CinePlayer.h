@@ -0,0 +1,102 @@
+//
+// CinePlayer.h
+//
+// Plays a sequence of 16-bit tiff or PNG frames at a fixed frame rate. The
+// work is split into three stages that overlap:
+//  - decode: worker threads decode frames ahead into a bounded queue of
+//    CINE_QUEUE_FRAMES slots, a worker waits while its slot is still taken
+//  - upload: the main thread copies the next frame in order through the
+//    pixel buffer ring into the back of two texture sets
+//  - present: when the frame is due by the playback clock the texture sets
+//    are swapped and the frame is drawn through the usual LUT shader
+// Frames which are still queued when their successor is already due are
+// dropped. Each stage keeps a latency histogram.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef CINEPLAYER_H
+#define CINEPLAYER_H
+
+#define CINE_QUEUE_FRAMES       8       // decoded frames ahead of the upload
+#define CINE_MAX_DECODERS       4       // at most CINE_QUEUE_FRAMES
+#define CINE_HISTOGRAM_BINS     12      // <1 ms, 1-2 ms, 2-4 ms, ... >=1024 ms
+#define CINE_WAIT_FOR_FRAME     (-1.0)
+
+enum {
+    CINE_SLOT_FREE = 0,
+    CINE_SLOT_DECODING,
+    CINE_SLOT_READY
+};
+
+typedef struct _LatencyHistogram {
+    unsigned int counts[CINE_HISTOGRAM_BINS];
+    unsigned int samples;
+    double total;                   // seconds
+    double max;
+} LatencyHistogram;
+
+// A queue entry, guarded by CinePlayer::lock
+typedef struct _CineSlot {
+    int state;
+    unsigned int frame;             // position in the playback, counts on when the sequence loops
+    unsigned short *pixels;         // NULL if the frame could not be decoded or has another size
+    double decodeSeconds;
+} CineSlot;
+
+typedef struct _CinePlayer {
+    unsigned int numFiles;          // 0 if no sequence is playing
+    char (*fileNames)[MAX_PATH];
+    GLuint width;                   // size of the first frame, the others must match
+    GLuint height;
+    double fps;
+
+    // Decode stage
+    HANDLE decoders[CINE_MAX_DECODERS];
+    unsigned int numDecoders;
+    CRITICAL_SECTION lock;
+    HANDLE slotFreed[CINE_QUEUE_FRAMES];    // auto reset, wakes the decoder waiting for the slot
+    HANDLE frameReady;              // auto reset, set when a frame is decoded
+    volatile LONG nextDecode;       // next frame a decoder claims
+    volatile LONG stop;
+    CineSlot slots[CINE_QUEUE_FRAMES];
+
+    // Upload stage, textures[front] is drawn while the other one is filled
+    TiledImage textures[2];
+    unsigned int front;
+    unsigned int frontFrame;
+    unsigned int backFrame;
+    bool backValid;
+    unsigned int nextUpload;        // next frame the upload stage takes from the queue
+
+    // Present stage
+    double startTime;               // playback clock, frame n is due at startTime + n/fps
+    bool presentPending;            // front changed, not on screen yet
+    double lastPresent;             // time the last frame was on screen
+
+    // Statistics
+    unsigned int framesShown;
+    unsigned int framesDropped;
+    unsigned int decodeErrors;
+    LatencyHistogram decodeLatency;     // decode of one frame
+    LatencyHistogram uploadLatency;     // copy of one frame into the pixel buffers
+    LatencyHistogram presentLatency;    // SwapBuffers done after the frame was due
+} CinePlayer;
+
+// Plays the files matching pattern (e.g. "shot\*.tif") in name order, looping.
+// The first frame is decoded at once for the image size.
+extern bool startCinePlayer(CinePlayer *player, const char *pattern, double fps);
+// Runs the upload and present stages at time now (seconds, any clock, the
+// first call starts playback). Returns true if a new frame is to be drawn.
+extern bool updateCinePlayer(CinePlayer *player, PboUploader *uploader, double now);
+// Tells the player the frame from updateCinePlayer is on screen.
+extern void cineFramePresented(CinePlayer *player, double now);
+// Seconds until the next frame is due, or CINE_WAIT_FOR_FRAME if it is not
+// decoded yet (wait on player->frameReady).
+extern double cineWaitTime(const CinePlayer *player, double now);
+// The texture set of the current frame.
+extern const TiledImage *cineFrontImage(const CinePlayer *player);
+extern void printCineStats(const CinePlayer *player);
+// Stops the decoders and releases the frames and textures.
+extern void stopCinePlayer(CinePlayer *player);
+
+#endif
@@ -0,0 +1,145 @@
+//
+// DisplayProgram.cpp
+//
+// Cached uniform locations and redundant state filtering for the image shader
+//
+#include <windows.h>
+#include <stddef.h>
+#include <string.h>
+#include <GL\glew.h>
+#include <GL\gl.h>
+#include "ShaderVariants.h"
+#include "DisplayProgram.h"
+
+void initDisplayProgram(DisplayProgram *display)
+{
+    memset(display, 0, sizeof(DisplayProgram));
+    // The program, LUT and dither bindings are not known
+    display->lutTexture = 0xFFFFFFFF;
+    display->ditherTexture = 0xFFFFFFFF;
+
+    glEnable(GL_TEXTURE_2D);
+    glEnable(GL_TEXTURE_1D);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glActiveTexture(GL_TEXTURE0);
+    glClientActiveTexture(GL_TEXTURE0);
+}
+
+void beginDisplayFrame(DisplayProgram *display)
+{
+    display->imageTexture = 0xFFFFFFFF;
+    display->vertexBuffer = 0xFFFFFFFF;
+}
+
+void useShaderVariant(DisplayProgram *display, ShaderVariant *variant)
+{
+    if (variant == display->variant) {
+        display->skippedCalls++;
+        return;
+    }
+    glUseProgramObjectARB(variant->program);
+    display->variant = variant;
+    display->stateCalls++;
+}
+
+void setLutTexture(DisplayProgram *display, GLuint texId)
+{
+    if (texId == display->lutTexture) {
+        display->skippedCalls++;
+        return;
+    }
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_1D, texId);
+    glActiveTexture(GL_TEXTURE0);
+    display->lutTexture = texId;
+    display->stateCalls += 3;
+}
+
+void setLutWindow(DisplayProgram *display, GLfloat offset, GLfloat scale)
+{
+    ShaderVariant *variant = display->variant;
+
+    if (offset != variant->lutOffset) {
+        glUniform1fARB(variant->lutOffsetLocation, offset);
+        variant->lutOffset = offset;
+        display->stateCalls++;
+    } else {
+        display->skippedCalls++;
+    }
+    if (scale != variant->lutScale) {
+        glUniform1fARB(variant->lutScaleLocation, scale);
+        variant->lutScale = scale;
+        display->stateCalls++;
+    } else {
+        display->skippedCalls++;
+    }
+}
+
+void setDitherTexture(DisplayProgram *display, GLuint texId)
+{
+    if (texId == display->ditherTexture) {
+        display->skippedCalls++;
+        return;
+    }
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, texId);
+    glActiveTexture(GL_TEXTURE0);
+    display->ditherTexture = texId;
+    display->stateCalls += 3;
+}
+
+void setDitherOffset(DisplayProgram *display, GLfloat x, GLfloat y)
+{
+    ShaderVariant *variant = display->variant;
+
+    if (x == variant->ditherOffsetX && y == variant->ditherOffsetY) {
+        display->skippedCalls++;
+        return;
+    }
+    glUniform2fARB(variant->ditherOffsetLocation, x, y);
+    variant->ditherOffsetX = x;
+    variant->ditherOffsetY = y;
+    display->stateCalls++;
+}
+
+void setImageTexture(DisplayProgram *display, GLuint texId, GLuint width, GLuint height)
+{
+    ShaderVariant *variant = display->variant;
+
+    if (texId != display->imageTexture) {
+        glBindTexture(GL_TEXTURE_2D, texId);
+        display->imageTexture = texId;
+        display->stateCalls++;
+    } else {
+        display->skippedCalls++;
+    }
+    // Tiles mostly share one size, only the last row and column differ
+    if ((GLfloat)width != variant->textureWidth || (GLfloat)height != variant->textureHeight) {
+        variant->textureWidth = (GLfloat)width;
+        variant->textureHeight = (GLfloat)height;
+        glUniform2fARB(variant->textureSizeLocation, variant->textureWidth, variant->textureHeight);
+        display->stateCalls++;
+    } else {
+        display->skippedCalls++;
+    }
+}
+
+void setVertexBuffer(DisplayProgram *display, GLuint buffer)
+{
+    if (buffer == display->vertexBuffer) {
+        display->skippedCalls++;
+        return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(DisplayVertex), (const GLvoid *)offsetof(DisplayVertex, s));
+    glVertexPointer(2, GL_FLOAT, sizeof(DisplayVertex), (const GLvoid *)offsetof(DisplayVertex, x));
+    display->vertexBuffer = buffer;
+    display->stateCalls += 3;
+}
+
+void drawQuads(DisplayProgram *display, GLint first, GLsizei count)
+{
+    glDrawArrays(GL_QUADS, first, count);
+    display->drawCalls++;
+}
@@ -0,0 +1,49 @@
+//
+// DisplayProgram.h
+//
+// GL state used to draw the image: the shader variant in use and the values
+// last sent to GL, so unchanged programs, uniforms, texture and buffer
+// bindings are not sent again. The program stays bound and texture unit 0
+// stays active between frames.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef DISPLAYPROGRAM_H
+#define DISPLAYPROGRAM_H
+
+typedef struct _DisplayProgram {
+    // Current GL state
+    ShaderVariant *variant;         // bound program, holds its own uniform values
+    GLuint imageTexture;            // bound to texture unit 0
+    GLuint lutTexture;              // bound to texture unit 1
+    GLuint ditherTexture;           // bound to texture unit 3
+    GLuint vertexBuffer;            // bound to the vertex and texture coordinate arrays
+    // Statistics
+    unsigned int stateCalls;        // state changes sent to GL
+    unsigned int skippedCalls;      // redundant state changes not sent
+    unsigned int drawCalls;
+} DisplayProgram;
+
+// Sets the fixed draw state.
+extern void initDisplayProgram(DisplayProgram *display);
+// Forgets the image texture and vertex buffer bindings, which uploads and
+// new images change between frames. Call before drawing a frame.
+extern void beginDisplayFrame(DisplayProgram *display);
+extern void useShaderVariant(DisplayProgram *display, ShaderVariant *variant);
+extern void setLutTexture(DisplayProgram *display, GLuint texId);
+extern void setLutWindow(DisplayProgram *display, GLfloat offset, GLfloat scale);
+// Threshold tile of the dithering variants and its offset in window pixels.
+extern void setDitherTexture(DisplayProgram *display, GLuint texId);
+extern void setDitherOffset(DisplayProgram *display, GLfloat x, GLfloat y);
+extern void setImageTexture(DisplayProgram *display, GLuint texId, GLuint width, GLuint height);
+// Sources positions and texture coordinates from a buffer of DisplayVertex.
+extern void setVertexBuffer(DisplayProgram *display, GLuint buffer);
+// Draws count/4 quads starting at vertex first of the current buffer.
+extern void drawQuads(DisplayProgram *display, GLint first, GLsizei count);
+
+typedef struct _DisplayVertex {
+    GLfloat s, t;
+    GLfloat x, y;
+} DisplayVertex;
+
+#endif
@@ -0,0 +1,281 @@
+//
+// DitherNoise.cpp
+//
+// Bayer and void-and-cluster threshold tiles, SSE2 dithering to 8 bits
+//
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <emmintrin.h>
+#include <GL\glew.h>
+#include <GL\gl.h>
+#include "DitherNoise.h"
+
+#define BLUE_NOISE_SIGMA    1.5f        // Ulichney's filter width
+#define BLUE_NOISE_SEED     12345
+#define CACHE_MAGIC         0x4E425456  // "VTBN"
+
+// Energy of a point at every offset, on a torus so the tile repeats seamlessly
+static void gaussianKernel(float *kernel, GLuint size)
+{
+    GLuint x, y;
+
+    for (y = 0; y < size; y++) {
+        int dy = (y < size / 2) ? (int)y : (int)(size - y);
+        for (x = 0; x < size; x++) {
+            int dx = (x < size / 2) ? (int)x : (int)(size - x);
+            kernel[y * size + x] = expf(-(float)(dx * dx + dy * dy) / (2.0f * BLUE_NOISE_SIGMA * BLUE_NOISE_SIGMA));
+        }
+    }
+}
+
+static void addEnergy(float *energy, const float *kernel, GLuint size, GLuint point, float sign)
+{
+    GLuint px = point % size, py = point / size;
+    GLuint x, y;
+
+    for (y = 0; y < size; y++) {
+        const float *row = kernel + ((y - py) & (size - 1)) * size;
+        float *e = energy + y * size;
+        for (x = 0; x < size; x++)
+            e[x] += sign * row[(x - px) & (size - 1)];
+    }
+}
+
+// The set point with the most energy around it
+static GLuint tightestCluster(const float *energy, const unsigned char *pattern, GLuint n)
+{
+    GLuint i, best = 0;
+    float max = -1.0f;
+
+    for (i = 0; i < n; i++) {
+        if (pattern[i] && energy[i] > max) {
+            max = energy[i];
+            best = i;
+        }
+    }
+    return best;
+}
+
+// The empty point with the least energy around it
+static GLuint largestVoid(const float *energy, const unsigned char *pattern, GLuint n)
+{
+    GLuint i, best = 0;
+    float min = 1e30f;
+
+    for (i = 0; i < n; i++) {
+        if (!pattern[i] && energy[i] < min) {
+            min = energy[i];
+            best = i;
+        }
+    }
+    return best;
+}
+
+//
+// The initial pattern of n/10 random points is relaxed by moving its tightest
+// cluster into its largest void until that moves the point back. Its points
+// are ranked by taking away tightest clusters, the ranks above by filling
+// largest voids. With a Gaussian filter the largest void of the points is also
+// the tightest cluster of the empty points, so filling up past half needs no
+// separate inverted pass.
+//
+void generateBlueNoise(unsigned short *ranks, GLuint size, unsigned int seed)
+{
+    GLuint n = size * size;
+    GLuint ones = n / 10, i, r;
+    float *kernel = (float *)malloc(n * sizeof(float));
+    float *energy = (float *)calloc(n, sizeof(float));
+    float *work = (float *)malloc(n * sizeof(float));
+    unsigned char *pattern = (unsigned char *)calloc(n, 1);
+    unsigned char *workPattern = (unsigned char *)malloc(n);
+
+    gaussianKernel(kernel, size);
+    for (i = 0; i < ones; ) {
+        seed = seed * 1664525 + 1013904223;
+        GLuint p = (seed >> 8) % n;
+        if (!pattern[p]) {
+            pattern[p] = 1;
+            addEnergy(energy, kernel, size, p, 1.0f);
+            i++;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        GLuint cluster = tightestCluster(energy, pattern, n);
+        pattern[cluster] = 0;
+        addEnergy(energy, kernel, size, cluster, -1.0f);
+        GLuint hole = largestVoid(energy, pattern, n);
+        pattern[hole] = 1;
+        addEnergy(energy, kernel, size, hole, 1.0f);
+        if (hole == cluster)
+            break;
+    }
+
+    memcpy(work, energy, n * sizeof(float));
+    memcpy(workPattern, pattern, n);
+    for (r = ones; r-- > 0; ) {
+        GLuint cluster = tightestCluster(work, workPattern, n);
+        workPattern[cluster] = 0;
+        addEnergy(work, kernel, size, cluster, -1.0f);
+        ranks[cluster] = (unsigned short)r;
+    }
+    for (r = ones; r < n; r++) {
+        GLuint hole = largestVoid(energy, pattern, n);
+        pattern[hole] = 1;
+        addEnergy(energy, kernel, size, hole, 1.0f);
+        ranks[hole] = (unsigned short)r;
+    }
+
+    free(kernel);
+    free(energy);
+    free(work);
+    free(pattern);
+    free(workPattern);
+}
+
+// Threshold in the middle of the rank's interval of [0, 65536)
+static unsigned short rankThreshold(GLuint rank, GLuint n)
+{
+    return (unsigned short)(((2 * rank + 1) * 32768) / n);
+}
+
+static bool readNoiseCache(const char *cacheFile, unsigned short *ranks)
+{
+    unsigned int header[2];
+    bool ok;
+    FILE *file = fopen(cacheFile, "rb");
+
+    if (!file)
+        return false;
+    ok = fread(header, sizeof(header), 1, file) == 1 && header[0] == CACHE_MAGIC && header[1] == DITHER_NOISE_SIZE &&
+        fread(ranks, sizeof(unsigned short), DITHER_NOISE_SIZE * DITHER_NOISE_SIZE, file) == DITHER_NOISE_SIZE * DITHER_NOISE_SIZE;
+    fclose(file);
+    return ok;
+}
+
+static void writeNoiseCache(const char *cacheFile, const unsigned short *ranks)
+{
+    unsigned int header[2] = {CACHE_MAGIC, DITHER_NOISE_SIZE};
+    FILE *file = fopen(cacheFile, "wb");
+
+    if (!file) {
+        printf("Unable to write the blue noise cache %s\n", cacheFile);
+        return;
+    }
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(ranks, sizeof(unsigned short), DITHER_NOISE_SIZE * DITHER_NOISE_SIZE, file);
+    fclose(file);
+}
+
+bool initDitherNoise(DitherNoise *noise, const char *cacheFile)
+{
+    unsigned short bayer[DITHER_BAYER_SIZE * DITHER_BAYER_SIZE];
+    unsigned short ranks[DITHER_NOISE_SIZE * DITHER_NOISE_SIZE];
+    GLuint size, x, y;
+
+    memset(noise, 0, sizeof(DitherNoise));
+
+    // Bayer matrix of size 2n from the one of size n: [4M 4M+2; 4M+3 4M+1]
+    bayer[0] = 0;
+    for (size = 1; size < DITHER_BAYER_SIZE; size *= 2) {
+        for (y = size; y-- > 0; ) {
+            for (x = size; x-- > 0; ) {
+                unsigned short m = (unsigned short)(4 * bayer[y * DITHER_BAYER_SIZE + x]);
+                bayer[y * DITHER_BAYER_SIZE + x] = m;
+                bayer[y * DITHER_BAYER_SIZE + x + size] = m + 2;
+                bayer[(y + size) * DITHER_BAYER_SIZE + x] = m + 3;
+                bayer[(y + size) * DITHER_BAYER_SIZE + x + size] = m + 1;
+            }
+        }
+    }
+    for (x = 0; x < DITHER_BAYER_SIZE * DITHER_BAYER_SIZE; x++)
+        noise->bayer[x] = rankThreshold(bayer[x], DITHER_BAYER_SIZE * DITHER_BAYER_SIZE);
+
+    if (!readNoiseCache(cacheFile, ranks)) {
+        LARGE_INTEGER frequency, start, end;
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&start);
+        generateBlueNoise(ranks, DITHER_NOISE_SIZE, BLUE_NOISE_SEED);
+        QueryPerformanceCounter(&end);
+        printf("Blue noise tile built in %.3f s, cached in %s\n",
+            (double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart, cacheFile);
+        writeNoiseCache(cacheFile, ranks);
+    }
+    for (x = 0; x < DITHER_NOISE_SIZE * DITHER_NOISE_SIZE; x++)
+        noise->blueNoise[x] = rankThreshold(ranks[x], DITHER_NOISE_SIZE * DITHER_NOISE_SIZE);
+    return true;
+}
+
+static GLuint createThresholdTexture(const unsigned short *thresholds, GLuint size)
+{
+    GLuint texId;
+
+    glGenTextures(1, &texId);
+    glBindTexture(GL_TEXTURE_2D, texId);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE16, size, size, 0, GL_LUMINANCE, GL_UNSIGNED_SHORT, thresholds);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    return texId;
+}
+
+void createDitherTextures(DitherNoise *noise)
+{
+    glActiveTexture(GL_TEXTURE3);
+    noise->bayerTexture = createThresholdTexture(noise->bayer, DITHER_BAYER_SIZE);
+    noise->blueNoiseTexture = createThresholdTexture(noise->blueNoise, DITHER_NOISE_SIZE);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void deleteDitherTextures(DitherNoise *noise)
+{
+    if (noise->bayerTexture)
+        glDeleteTextures(1, &noise->bayerTexture);
+    if (noise->blueNoiseTexture)
+        glDeleteTextures(1, &noise->blueNoiseTexture);
+    noise->bayerTexture = noise->blueNoiseTexture = 0;
+}
+
+//
+// The exact scale is 255/65535, in * 255 * 65536 / 65535 = in * 255 + in / 257,
+// whose fraction never changes the top byte of the sum with the threshold,
+// so 0 maps to 0 and 65535 to 255 whatever the threshold. The sum fits into
+// 24 bits and is formed in 32-bit lanes as (in << 8) - in + in / 257 +
+// threshold, in / 257 being the high half of in * 0xFF01 shifted down by 8.
+// 8 samples per step; x is a multiple of 8 there, so their thresholds are
+// contiguous.
+//
+void ditherImage8(const unsigned short *src, unsigned char *dst, GLuint width, GLuint height,
+                  const unsigned short *tile, GLuint tileSize)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i div257 = _mm_set1_epi16((short)0xFF01);
+    GLuint x, y;
+
+    for (y = 0; y < height; y++) {
+        const unsigned short *in = src + (size_t)y * width;
+        const unsigned short *thresholds = tile + (y & (tileSize - 1)) * tileSize;
+        unsigned char *out = dst + (size_t)y * width;
+
+        for (x = 0; x + 8 <= width; x += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(in + x));
+            __m128i t = _mm_loadu_si128((const __m128i *)(thresholds + (x & (tileSize - 1))));
+            __m128i q = _mm_srli_epi16(_mm_mulhi_epu16(v, div257), 8);
+            __m128i vlo = _mm_unpacklo_epi16(v, zero);
+            __m128i vhi = _mm_unpackhi_epi16(v, zero);
+            __m128i lo = _mm_add_epi32(_mm_sub_epi32(_mm_slli_epi32(vlo, 8), vlo),
+                                       _mm_add_epi32(_mm_unpacklo_epi16(t, zero), _mm_unpacklo_epi16(q, zero)));
+            __m128i hi = _mm_add_epi32(_mm_sub_epi32(_mm_slli_epi32(vhi, 8), vhi),
+                                       _mm_add_epi32(_mm_unpackhi_epi16(t, zero), _mm_unpackhi_epi16(q, zero)));
+            __m128i w = _mm_packs_epi32(_mm_srli_epi32(lo, 16), _mm_srli_epi32(hi, 16));
+            _mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(w, w));
+        }
+        for (; x < width; x++)
+            out[x] = (unsigned char)((in[x] * 255u + in[x] / 257u + thresholds[x & (tileSize - 1)]) >> 16);
+    }
+}
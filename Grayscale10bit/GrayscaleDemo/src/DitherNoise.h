@@ -0,0 +1,43 @@
+//
+// DitherNoise.h
+//
+// Threshold tiles for dithering the 10/12/16-bit gray levels down to the
+// output bit depth: an 8x8 Bayer matrix for ordered dithering and a 64x64
+// blue noise tile made with Ulichney's void-and-cluster method. Building the
+// blue noise tile takes a moment, so it is cached in a file and only built
+// when the file is missing. The same thresholds drive the shader (texture
+// unit 3) and the SSE2 CPU path.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef DITHERNOISE_H
+#define DITHERNOISE_H
+
+#define DITHER_BAYER_SIZE       8
+#define DITHER_NOISE_SIZE       64                  // power of two, multiple of 8
+#define DITHER_CACHE_FILE       "BlueNoise64.bin"
+
+typedef struct _DitherNoise {
+    // Thresholds (rank + 0.5) / N * 65536 of every tile position
+    unsigned short bayer[DITHER_BAYER_SIZE * DITHER_BAYER_SIZE];
+    unsigned short blueNoise[DITHER_NOISE_SIZE * DITHER_NOISE_SIZE];
+    GLuint bayerTexture;                // 16-bit luminance, repeated over the window
+    GLuint blueNoiseTexture;
+} DitherNoise;
+
+// Ranks 0..size*size-1 of a void-and-cluster blue noise pattern of size x size
+// (power of two), the same for the same seed.
+extern void generateBlueNoise(unsigned short *ranks, GLuint size, unsigned int seed);
+// Fills the threshold tiles, the blue noise one from cacheFile, which is
+// written if it is missing or stale. Returns false if out of memory.
+extern bool initDitherNoise(DitherNoise *noise, const char *cacheFile);
+// Creates the threshold textures, GL_REPEAT and nearest filtering.
+extern void createDitherTextures(DitherNoise *noise);
+extern void deleteDitherTextures(DitherNoise *noise);
+
+// CPU path: out = floor(in * 255 / 65535 + threshold / 65536), the threshold
+// tile (tileSize a power of two, multiple of 8) repeated from the top left.
+extern void ditherImage8(const unsigned short *src, unsigned char *dst, GLuint width, GLuint height,
+                         const unsigned short *tile, GLuint tileSize);
+
+#endif
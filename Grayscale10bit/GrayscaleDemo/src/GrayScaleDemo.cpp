@@ -10,13 +10,28 @@
 #include <windows.h>
 #include <stdio.h>
 #include <assert.h>
+#include <math.h>
 #include <GL\glew.h>	
+#include <GL\wglew.h>
 #include <GL\gl.h>			// Header Files For The OpenGL
 #include <GL\glu.h>	
 #include "GrayScaleTable.h"
+#include "ImageBuffer.h"
+#include "TiffLoader.h"
+#include "ShaderVariants.h"
+#include "DisplayProgram.h"
+#include "PboUploader.h"
+#include "TiledImage.h"
+#include "PngLoader.h"
+#include "ImagePyramid.h"
+#include "AsyncLoader.h"
+#include "RenderScheduler.h"
+#include "VirtualTexture.h"
+#include "CinePlayer.h"
+#include "DitherNoise.h"
 
 // helper variables/constans for the file open dialogue
-static TCHAR szFilter[] = TEXT("Tiff files (*.tif*)\0*.tif*\0");
+static TCHAR szFilter[] = TEXT("Images (*.tif*;*.png)\0*.tif*;*.png\0Tiff files (*.tif*)\0*.tif*\0PNG files (*.png)\0*.png\0");
 OPENFILENAME g_ofn = {sizeof(OPENFILENAME),NULL,NULL,szFilter,NULL,0,0,NULL,MAX_PATH,NULL,MAX_PATH,NULL,NULL,0,0,0,TEXT("tif\tiff"),0L,NULL,NULL};
 
 
@@ -35,20 +50,44 @@ GLsizei gWinHeight = 768;         // Window height
 GLuint gImageWidth = 2048;		// Image width
 GLuint gImageHeight = 2048;		// Image height
 GLuint gLutWidth = 4096;		// Image width
-GLuint gImageTexId, gLut12BitTexId, gLut8BitTexId; //Tex ids for image and 2 lookup tables
+TiledImage gImage;				// Image textures, tiled if larger than the max texture size
+TiledImage gProxy;				// Coarse proxy shown while the image is loading
+AsyncLoad gLoad;				// Background load of the image file
+GLuint gRowsUploaded = 0;		// Image rows uploaded to gImage so far
+GLuint gProxyRowsUploaded = 0;	// Proxy rows uploaded to gProxy so far
+GLuint gProxyFactor = 1;		// Image pixels per proxy pixel
+TiledImage gLevels[PYRAMID_MAX_LEVELS];	// Half size levels of the image for zooming out
+GLuint gNumLevels = 0;			// Levels uploaded to gLevels so far
+float gZoom = 1.0f;				// Window pixels per image pixel
+GLuint gLut12BitTexId, gLut8BitTexId; //Tex ids for the 2 lookup tables
 bool gLut12BitEnabled = true; //by default, enable 12-bit LUT, user can change later at run-time if needed
 float gLutScale = 1.0f;
 float gLutOffset = 0.0f;
-GLhandleARB gShaderProgram = NULL;
+ShaderCache gShaders;			// Compiled variants of the image shader
+unsigned int gShaderKey = SHADER_FILTER_BILINEAR;	// SHADER_* bits of the variant drawn
+PboUploader gUploader;			// Streams the texture uploads through pixel buffer objects
+DisplayProgram gDisplay;		// Uniform locations and GL state of the image shader
+RenderScheduler gScheduler;		// Decides when the window is redrawn
+bool gVsync = false;			// SwapBuffers waits for the vertical retrace
+VirtualTexture gVirtual;		// Page atlas for images too large to keep in textures
+bool gVirtualImage = false;		// The loaded image is drawn from gVirtual instead of gImage
+CinePlayer gCine;				// Frame sequence playback
+const char *gCinePattern = NULL;	// Files of the sequence given by -cine
+double gCineFps = 24.0;			// Playback rate of the sequence
+DitherNoise gDither;			// Threshold tiles of the dithering shader variants
+unsigned int gDitherFrame = 0;	// Frames drawn with temporal dithering
+
+// Full resolution bytes uploaded per frame while loading, keeps the window responsive
+#define UPLOAD_BYTES_PER_FRAME (32*1024*1024)
 
 GLfloat x_start = 0.0;		// X starting location within half width window.
 GLfloat x_end = 0.0;		// X ending location wthin half width window.
 GLfloat y_start = 0.0;		// Y starting location within half width window.
 GLfloat y_end = 0.0;		// Y ending location within half width window.
 
-extern int readTiff(char *imageName, GLuint *pWidth, GLuint *pHeight, GLuint *pBpp, GLuint *pMinValue, GLuint *pMaxValue, GLuint *pNumValues, char** pixels) ;
-
 LRESULT	CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);	// Declaration For WndProc
+GLvoid oglResize(GLsizei width, GLsizei height);
+double timeSeconds();
 #ifdef _DEBUG
 #define CHECK_GL(_x_)  (assert((_x_) != GL_NO_ERROR))
 #else 
@@ -67,54 +106,82 @@ LRESULT	CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);	// Declaration For WndProc
 	}                                                                   \
 }
 
+// The #version line and the FILTER_BILINEAR, INPUT_BITS, LUT_BYPASS,
+// QUANTIZE_BITS, QUANTIZE_LEVELS, VIRTUAL_TEXTURE, PAGE_* and DITHER* defines
+// of the variant are put in front by ShaderVariants
 const GLcharARB fragmentShaderSource[] = 
-"#version 120                                   \n"
-"#extension GL_EXT_gpu_shader4 : enable         \n" // Need gpu_shader 4 for unsigned int support in the shader
 "uniform usampler2D image;                   \n" // Needs to be set by app to textureunit 0, Key here: unsigned sample !
 "uniform sampler1D  lut;                   \n" // Needs to be set by app to textureunit 1, normalized float sampler.
 "uniform vec2  textureSize;					\n" // Needs to be set by app size of texture.
-"uniform bool  doBilinear = true;			\n" //Needs to be set by the app if bilinear filtering is reqd
 "uniform float  lutOffset = 0.0;			\n" //Needs to be set by the app if windowing size needs to scale
 "uniform float  lutScale = 1.0;			\n"  //Needs to be set by the app if offset or bias is needed
-
+"#if INPUT_BITS == 16                           \n"
+"const float normalizer = 1.0/65536.0;          \n" //all 16 bits
+"#else                                          \n"
+"const float normalizer = 1.0/4096.0;           \n" //lo 12 bits taken only
+"#endif                                         \n"
+"#if DITHER                                     \n"
+"uniform sampler2D ditherNoise;                 \n" // textureunit 3, thresholds of the Bayer or blue noise tile
+"uniform vec2 ditherOffset = vec2(0.0);         \n" // moves the tile every frame for temporal dithering
+"#endif                                         \n"
+"#if VIRTUAL_TEXTURE                            \n"
+"uniform usampler2D pageTable;                  \n" // textureunit 2, page table of the level drawn, image is the page atlas
+"                                               \n"
+"ivec2 atlasTexel(ivec2 c)                      \n" // atlas texel of level texel c, from a coarser level while its page is missing
+"{                                              \n"
+"	uvec4 entry = texelFetch2D(pageTable, c >> PAGE_SHIFT, 0);     \n"
+"	ivec2 m = c >> int(entry.z);                \n"
+"	return ivec2(entry.xy) * PAGE_SLOT + (m & (PAGE_SIZE - 1));    \n"
+"}                                              \n"
+"#endif                                         \n"
 "                                               \n"
 "void main(void)                                \n"
 "{                                              \n"
 "	vec2  TexCoord  = vec2(gl_TexCoord[0]);                 \n"
 "   float GrayFloat;                            \n"
-"	float normalizer = 1.0/4096.0;                \n" //lo 12 bits taken only  : adjust here to take highest bits into accout ( e.g. replace '/ 4096.0' with '/ 65536.0');
-"	if (doBilinear) {                           \n"
-"		vec2 f = fract(TexCoord.xy * textureSize );\n"
-"		vec2 texelSize = 1.0/textureSize;	        \n"
-"		float t00 = float(texture2D(image, TexCoord).a)*normalizer;		\n" // 
-"		float t10 = float(texture2D(image, TexCoord + vec2( texelSize.x, 0.0 )).a)*normalizer;		\n"
-"		float tA = mix(t00, t10, f.x );         \n"
-"		float t01 = float(texture2D(image, TexCoord + vec2( 0.0, texelSize.y )).a)*normalizer;		\n"
-"		float t11 = float(texture2D(image, TexCoord + vec2(texelSize.x, texelSize.y)).a)*normalizer ;\n"
-"		float tB = mix( t01, t11, f.x );        \n"
-"		GrayFloat = mix( tA, tB, f.y );			\n"
-"	}											\n"
-"	else	{										\n"
-"		GrayFloat = float(texture2D(image, TexCoord).a)*normalizer;		\n" // 
-"	}											\n"
+"#if VIRTUAL_TEXTURE                            \n"
+"	vec2 pos = TexCoord * textureSize;          \n"
+"	ivec2 a = atlasTexel(ivec2(clamp(pos, vec2(0.0), textureSize - 1.0)));  \n"
+"#if FILTER_BILINEAR                            \n"
+"	vec2 f = fract(pos);                        \n" // the right and bottom neighbours are in the slot border
+"	float tA = mix(float(texelFetch2D(image, a, 0).a), float(texelFetch2D(image, a + ivec2(1, 0), 0).a), f.x);  \n"
+"	float tB = mix(float(texelFetch2D(image, a + ivec2(0, 1), 0).a), float(texelFetch2D(image, a + ivec2(1, 1), 0).a), f.x);  \n"
+"	GrayFloat = mix(tA, tB, f.y) * normalizer;  \n"
+"#else                                          \n"
+"	GrayFloat = float(texelFetch2D(image, a, 0).a) * normalizer;  \n"
+"#endif                                         \n"
+"#elif FILTER_BILINEAR                          \n"
+"	vec2 f = fract(TexCoord.xy * textureSize );  \n"
+"	vec2 texelSize = 1.0/textureSize;	          \n"
+"	float t00 = float(texture2D(image, TexCoord).a)*normalizer;		\n" // 
+"	float t10 = float(texture2D(image, TexCoord + vec2( texelSize.x, 0.0 )).a)*normalizer;		\n"
+"	float tA = mix(t00, t10, f.x );           \n"
+"	float t01 = float(texture2D(image, TexCoord + vec2( 0.0, texelSize.y )).a)*normalizer;		\n"
+"	float t11 = float(texture2D(image, TexCoord + vec2(texelSize.x, texelSize.y)).a)*normalizer ;\n"
+"	float tB = mix( t01, t11, f.x );          \n"
+"	GrayFloat = mix( tA, tB, f.y );			\n"
+"#else                                          \n"
+"	GrayFloat = float(texture2D(image, TexCoord).a)*normalizer;		\n" // 
+"#endif                                         \n"
+"#if LUT_BYPASS                                 \n"
+"	vec4  Gray      = vec4(vec3(clamp((GrayFloat-lutOffset)*lutScale, 0.0, 1.0)), 1.0); \n"  // linear gray ramp
+"#else                                          \n"
 "	vec4  Gray      = vec4(texture1D(lut, (GrayFloat-lutOffset)*lutScale)); \n"  // fetch right grayscale value out of table
+"#endif                                         \n"
+"#if QUANTIZE_BITS                              \n"
+"#if DITHER                                     \n"
+"	float threshold = texture2D(ditherNoise, (gl_FragCoord.xy + ditherOffset) / DITHER_SIZE).r;  \n" // spreads the rounding error as fine noise instead of bands
+"#else                                          \n"
+"	const float threshold = 0.5;                \n"
+"#endif                                         \n"
+"	Gray.rgb = floor(Gray.rgb * QUANTIZE_LEVELS + threshold) / QUANTIZE_LEVELS;  \n"  // show what a lower bit depth display would
+"#endif                                         \n"
 "	gl_FragColor  = Gray.rgba;                               \n"  // write data to the framebuffer
 "}";
 
 
 
 
-void printInfoLog(GLhandleARB object)
-{
-	int maxLength = 0;
-	glGetObjectParameterivARB(object, GL_OBJECT_INFO_LOG_LENGTH_ARB, &maxLength);
-
-	char *infoLog = new char[maxLength];
-	glGetInfoLogARB(object, maxLength, &maxLength, infoLog);
-
-	printf("%s\n", infoLog);
-}
-
 bool generateGradientImage(GLuint width, GLuint height, GLuint *pMinValue, GLuint *pMaxValue, GLuint *pNumValues, unsigned short** pixels) {
 #define MAX_VALUE 65536
 	unsigned short value;
@@ -148,6 +215,180 @@ bool generateGradientImage(GLuint width, GLuint height, GLuint *pMinValue, GLuin
 	return true;
 }
 
+//
+// resetView - Show the whole image unscaled at the bottom left of the window
+//
+void resetView()
+{
+	gZoom = 1.0f;
+	x_start = 0;
+	x_end = (GLfloat)gImageWidth;
+	y_start = 0;
+	y_end = (GLfloat)gImageHeight;
+}
+
+//
+// zoomView - Scale the image by factor around the window point x, y (GL coordinates)
+//
+void zoomView(float factor, GLfloat x, GLfloat y)
+{
+	gZoom *= factor;
+	x_start = x - (x - x_start) * factor;
+	y_start = y - (y - y_start) * factor;
+	x_end = x_start + gImageWidth * gZoom;
+	y_end = y_start + gImageHeight * gZoom;
+	printf("Zoom %.3f, image level %u\n", gZoom, pyramidLevelForZoom(gZoom, gNumLevels));
+}
+
+//
+// uploadPyramidLevel - Create the textures of the given (0 based) pyramid level
+//
+bool uploadPyramidLevel(const ImagePyramid *pyramid, GLuint level)
+{
+	if (!createTiledImage(&gLevels[level], pyramid->width[level], pyramid->height[level]))
+		return false;
+	uploadTiledImage(&gLevels[level], &gUploader, pyramid->pixels[level], 0, pyramid->height[level]);
+	return true;
+}
+
+//
+// loadGradientImage - Generate and upload the default grayscale gradient
+//
+bool loadGradientImage()
+{
+	unsigned short *pImageData = NULL;
+	GLuint minValue, maxValue, numValues;
+
+	gImageWidth = gImageHeight = 2048;
+	pImageData = (unsigned short*)allocImagePixels(gImageWidth*gImageHeight*sizeof(unsigned short) );
+	if (!pImageData)
+		return false;
+	generateGradientImage(gImageWidth, gImageHeight, &minValue, &maxValue, &numValues,  &pImageData);
+	if (!createTiledImage(&gImage, gImageWidth, gImageHeight)) {
+		printf("Unable to create the image textures\n");
+		freeImagePixels(pImageData);
+		return false;
+	}
+	uploadTiledImage(&gImage, &gUploader, pImageData, 0, gImageHeight);
+	gRowsUploaded = gImageHeight;
+
+	ImagePyramid pyramid;
+	if (buildImagePyramid(&pyramid, pImageData, gImageWidth, gImageHeight)) {
+		for (gNumLevels = 0; gNumLevels < pyramid.numLevels; gNumLevels++) {
+			if (!uploadPyramidLevel(&pyramid, gNumLevels))
+				break;
+		}
+		freeImagePyramid(&pyramid);
+	}
+	freeImagePixels(pImageData);
+	resetView();
+	return true;
+}
+
+//
+// updateImageLoad - Move what the loader thread has decoded into the textures.
+// The proxy is uploaded as soon as its rows arrive, the full resolution rows
+// follow under a per frame budget and are drawn over the proxy.
+// Returns true if the image changed and has to be redrawn.
+//
+bool updateImageLoad()
+{
+	AsyncLoadStatus status;
+	bool changed = false;
+
+	if (!gLoad.thread)
+		return false;
+	getAsyncLoadStatus(&gLoad, &status);
+	if (status.state == ASYNCLOAD_FAILED) {
+		finishAsyncLoad(&gLoad);
+		deleteTiledImage(&gProxy);
+		deleteTiledImage(&gImage);
+		gVirtualImage = false;
+		printf("Unable to load the image, showing the default gradient\n");
+		loadGradientImage();
+		return true;
+	}
+	if (status.width == 0)
+		return false;									// size not known yet
+
+	if (!gImage.texIds && !gVirtualImage) {
+		//Download the image to 2D textures in texunit #0 (integer extension used),
+		//split into tiles if it is larger than the maximum texture size.
+		//Very large images are paged in once loaded, until then the proxy is shown
+		gImageWidth = status.width;
+		gImageHeight = status.height;
+		gVirtualImage = needsVirtualTexture(gImageWidth, gImageHeight);
+		if (!gVirtualImage && !createTiledImage(&gImage, gImageWidth, gImageHeight)) {
+			printf("Unable to create the image textures, showing the default gradient\n");
+			finishAsyncLoad(&gLoad);
+			loadGradientImage();
+			return true;
+		}
+		if (status.proxy)
+			createTiledImage(&gProxy, status.proxyWidth, status.proxyHeight);
+		gProxyFactor = status.proxyFactor;
+		resetView();
+	}
+
+	if (gProxy.texIds && status.proxyRowsDone > gProxyRowsUploaded) {
+		// proxy rows are final once reported and live until finishAsyncLoad
+		uploadTiledImage(&gProxy, &gUploader, status.proxy, gProxyRowsUploaded, status.proxyRowsDone - gProxyRowsUploaded);
+		if (gProxyRowsUploaded == 0)
+			printf("First pixels after %.3f s\n", asyncLoadSeconds(&gLoad));
+		gProxyRowsUploaded = status.proxyRowsDone;
+		changed = true;
+	}
+
+	if (!gVirtualImage && status.rowsDone > gRowsUploaded) {
+		GLuint numRows = UPLOAD_BYTES_PER_FRAME / (gImageWidth * sizeof(unsigned short));
+		if (numRows == 0)
+			numRows = 1;
+		if (numRows > status.rowsDone - gRowsUploaded)
+			numRows = status.rowsDone - gRowsUploaded;
+		// The lock keeps a failing load from releasing the pixels during the upload
+		lockAsyncLoad(&gLoad);
+		if (gLoad.status.pixels) {
+			uploadTiledImage(&gImage, &gUploader, gLoad.status.pixels, gRowsUploaded, numRows);
+			if (!gProxy.texIds && gRowsUploaded == 0)
+				printf("First pixels after %.3f s\n", asyncLoadSeconds(&gLoad));
+			gRowsUploaded += numRows;
+			changed = true;
+		}
+		unlockAsyncLoad(&gLoad);
+	}
+
+	if (status.state == ASYNCLOAD_DONE && gVirtualImage) {
+		unsigned short *pixels;
+		ImagePyramid pyramid;
+		detachAsyncLoadImage(&gLoad, &pixels, &pyramid);
+		printf("Full resolution after %.3f s, %u-bit %ux%u, %u values in [%u, %u]\n",
+			asyncLoadSeconds(&gLoad), status.bitDepth, gImageWidth, gImageHeight,
+			status.numValues, status.minValue, status.maxValue);
+		finishAsyncLoad(&gLoad);
+		deleteTiledImage(&gProxy);
+		if (!createVirtualTexture(&gVirtual, &gUploader, pixels, gImageWidth, gImageHeight, &pyramid)) {
+			gVirtualImage = false;
+			printf("Showing the default gradient\n");
+			loadGradientImage();
+		}
+		return true;
+	}
+	if (status.state == ASYNCLOAD_DONE && gRowsUploaded == gImageHeight) {
+		// One pyramid level per frame, the levels are at most a third of the image
+		if (gNumLevels < gLoad.pyramid.numLevels && uploadPyramidLevel(&gLoad.pyramid, gNumLevels)) {
+			gNumLevels++;
+			return true;
+		}
+		printf("Full resolution after %.3f s, %u-bit %ux%u, %u values in [%u, %u]\n",
+			asyncLoadSeconds(&gLoad), status.bitDepth, gImageWidth, gImageHeight,
+			status.numValues, status.minValue, status.maxValue);
+		finishAsyncLoad(&gLoad);
+		deleteTiledImage(&gProxy);
+		changed = true;
+	}
+	return changed;
+}
+
 
 //
 // InitGL - Initialize OpenGL state
@@ -169,40 +410,25 @@ bool oglInit(GLvoid)
 				"  GL_NV_gpu_program4\n Program will not show grayscale image...\n");
 			return false;
 	}
-
-	gShaderProgram = glCreateProgramObjectARB();
-	// Create  fragment shader object
-	GLhandleARB object = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
-	// Add shader source code
-//	GLint length = (GLint)strlen(fpsrc);
-    const GLcharARB *fShade = (char *) &fragmentShaderSource;
-	glShaderSourceARB(object, 1, &fShade, NULL);
-	// Compile fragment shader object
-	glCompileShaderARB(object);
-	// Check if shader compiled
-	GLint compiled = 0;
-	glGetObjectParameterivARB(object, GL_OBJECT_COMPILE_STATUS_ARB, &compiled);
-	if (!compiled) {
-		printInfoLog(object);
-		return false;
+	// Let SwapBuffers wait for the vertical retrace, the render loop is paced by it
+	if (WGLEW_EXT_swap_control) {
+		wglSwapIntervalEXT(1);
+		gVsync = true;
 	}
-	// Attach shader to program object
-	glAttachObjectARB(gShaderProgram, object);
-	// Delete shader object, no longer needed
-	glDeleteObjectARB(object);
-	// Link shader program.
-	glLinkProgramARB(gShaderProgram);
-
-	GLint linked = false;
-	glGetObjectParameterivARB(gShaderProgram, GL_OBJECT_LINK_STATUS_ARB, &linked);
-	if (!linked) {
-		printInfoLog(gShaderProgram);
+
+	// Compile every shader variant now, so switching modes later never waits for the compiler
+	double compileStart = timeSeconds();
+	initShaderCache(&gShaders, fragmentShaderSource);
+	if (!compileShaderVariants(&gShaders) || !getShaderVariant(&gShaders, gShaderKey))
 		return false;
-	}
+	printf("%u shader variants compiled in %.3f s\n", gShaders.numCompiled, timeSeconds() - compileStart);
 
+	// All texture uploads go through the pixel buffer ring
+	initPboUploader(&gUploader);
+	// Dither thresholds, the blue noise tile is built once and cached
+	initDitherNoise(&gDither, DITHER_CACHE_FILE);
+	createDitherTextures(&gDither);
 
-    unsigned short *pImageData = NULL;
-	GLuint bitDepth, minValue, maxValue, numValues;
 	//Prompt user to load a file
 	// Open the standard file load dialog
 	TCHAR szFileName[MAX_PATH], szTitleName[MAX_PATH];
@@ -213,32 +439,22 @@ bool oglInit(GLvoid)
 	g_ofn.nMaxFile = MAX_PATH;
 	g_ofn.nFilterIndex = 1;
 	g_ofn.Flags = OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST;
-	bool fileLoadedOK = false;
-	// If this succeds, try to load the image into the texture
-	if (GetOpenFileName(&g_ofn)) {
-		readTiff(g_ofn.lpstrFile, &gImageWidth, &gImageHeight, &bitDepth, &minValue, &maxValue, &numValues,  (char**)&pImageData);
-		if (bitDepth = 16) //all OK, lets set the flag to trye
-			fileLoadedOK = true;			
+	// A sequence from the command line is played instead
+	if (gCinePattern) {
+		if (startCinePlayer(&gCine, gCinePattern, gCineFps)) {
+			gImageWidth = gCine.width;
+			gImageHeight = gCine.height;
+		}
+		else if (!loadGradientImage())
+			return false;
 	}
-	if (!fileLoadedOK) {//load default grayscale gradient texture
-		pImageData = (unsigned short*)malloc(gImageWidth*gImageHeight*sizeof(unsigned short) );
-	    generateGradientImage(gImageWidth, gImageHeight, &minValue, &maxValue, &numValues,  &pImageData);	
+	// If this succeds, load the image in the background, updateImageLoad
+	// uploads it to the textures as the strips arrive
+	else if (!GetOpenFileName(&g_ofn) || !startAsyncLoad(&gLoad, g_ofn.lpstrFile)) {
+		//load default grayscale gradient texture
+		if (!loadGradientImage())
+			return false;
 	}
-
-	//Download the image to a 2D texture in texunit #0 (integer extension used)
-	glGenTextures(1, &gImageTexId);  
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gImageTexId);
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	float borderColor[4] = {0.0f,0.0f,0.0f,0.0f};
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA16UI_EXT, gImageWidth, gImageHeight, 0, GL_ALPHA_INTEGER_EXT , GL_UNSIGNED_SHORT, pImageData);
-	free(pImageData);
 	GL_GETERROR;
 
 	//generate LUT for 12-bit graydata ie 4096 entries
@@ -273,18 +489,9 @@ bool oglInit(GLvoid)
 	glTexImage1D(GL_TEXTURE_1D, 0, 4, gLutWidth, 0, GL_RGBA, GL_UNSIGNED_BYTE, pLut8BitData);
 	free(pLut8BitData); //this was malloced in the createYasRGBTable function
 
-	//Initialize shader variables
-	GLenum eVal;
-	glUseProgramObjectARB(gShaderProgram);
-	//Attach texunit#0 to Image and texunit#1 to LUT
-	glUniform1iARB(glGetUniformLocationARB(gShaderProgram, "image"), 0);
-	eVal = glGetError();
-	glUniform1iARB(glGetUniformLocationARB(gShaderProgram, "lut"), 1);
-	eVal = glGetError();
-	//set the image dimensions
-	glUniform2fARB(glGetUniformLocationARB(gShaderProgram, "textureSize"), (float) gImageWidth, (float) gImageHeight);
-
-	glUseProgramObjectARB(0);
+	//Initialize the draw state, the program stays bound from now on
+	initDisplayProgram(&gDisplay);
+	GL_GETERROR;
 	//====== END Initialize Shader
 	//Init OpenGl state
 	glShadeModel(GL_SMOOTH);							// Enable Smooth Shading
@@ -294,10 +501,8 @@ bool oglInit(GLvoid)
 	//glDepthFunc(GL_LEQUAL);								// The Type Of Depth Testing To Do
 	//glColor3f(1.0, 1.0, 1.0);							// White for texturing
 
-	x_start = 0;
-	x_end = (GLfloat)gImageWidth;
-	y_start = 0;
-	y_end = (GLfloat)gImageHeight;
+	resetView();
+	oglResize(gWinWidth, gWinHeight);					// WM_SIZE came before the context
 	return TRUE;										// Initialization Went OK
 }
 
@@ -328,62 +533,83 @@ GLvoid oglDraw()
 {
 	GLfloat x0, y0, x1, y1;					// Draw coordinates
 
-	GLenum eval = GL_NO_ERROR;
 	glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT); 
 	x0 = x_start;
 	y0 = y_start;
 	x1 = x_end;
 	y1 = y_end;
 
-	glViewport(0, 0, gWinWidth, gWinHeight);
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluOrtho2D(0, gWinWidth, 0, gWinHeight);
-	glMatrixMode(GL_MODELVIEW);	
-	glLoadIdentity();
-
-	glUseProgramObjectARB(gShaderProgram);
-    glEnable(GL_FRAGMENT_PROGRAM_ARB);
-	glUniform1iARB(glGetUniformLocationARB(gShaderProgram, "image"), 0);
-	glUniform1iARB(glGetUniformLocationARB(gShaderProgram, "lut"), 1);
-	glUniform1fARB(glGetUniformLocationARB(gShaderProgram, "lutOffset"), gLutOffset);
-	glUniform1fARB(glGetUniformLocationARB(gShaderProgram, "lutScale"), gLutScale);
-	GLenum eVal = glGetError();
+	//Zoomed out, draw the pyramid level matching the zoom, this touches about
+	//as many texels as the window has pixels whatever the image size
+	GLuint level = pyramidLevelForZoom(gZoom, gVirtual.numLevels ? gVirtual.numLevels - 1 : gNumLevels);
+	unsigned int shaderKey = gShaderKey;
+	if (gVirtual.numLevels) {
+		//Only the pages of the visible part of the image (window rows run
+		//bottom up, image rows top down) are loaded into the atlas
+		GLfloat c0 = -x0 / gZoom, c1 = (gWinWidth - x0) / gZoom;
+		GLfloat r0 = (y1 - gWinHeight) / gZoom, r1 = y1 / gZoom;
+		if (updateVirtualTexture(&gVirtual, &gUploader, level, c0, r0, c1, r1))
+			invalidateView(&gScheduler, REDRAW_IMAGE);			// more pages next frame
+		shaderKey |= SHADER_VIRTUAL_TEXTURE;
+	}
 
+	// The projection is set by oglResize, the program, texture enables and
+	// arrays by initDisplayProgram. Only what changed is sent.
+	beginDisplayFrame(&gDisplay);
+	useShaderVariant(&gDisplay, getShaderVariant(&gShaders, shaderKey));
+	setLutTexture(&gDisplay, gLut12BitEnabled ? gLut12BitTexId : gLut8BitTexId);
+	setLutWindow(&gDisplay, gLutOffset, gLutScale);
+	if (shaderKey & SHADER_DITHER_MASK) {
+		setDitherTexture(&gDisplay, (shaderKey & SHADER_DITHER_MASK) == SHADER_DITHER_ORDERED ?
+			gDither.bayerTexture : gDither.blueNoiseTexture);
+		if ((shaderKey & SHADER_DITHER_MASK) == SHADER_DITHER_TEMPORAL) {
+			// R2 sequence offsets, consecutive frames get uncorrelated thresholds
+			gDitherFrame++;
+			setDitherOffset(&gDisplay, floorf((float)fmod(0.5 + gDitherFrame * 0.7548776662, 1.0) * DITHER_NOISE_SIZE),
+				floorf((float)fmod(0.5 + gDitherFrame * 0.5698402910, 1.0) * DITHER_NOISE_SIZE));
+			invalidateView(&gScheduler, REDRAW_DITHER);
+		}
+	}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gImageTexId);
-	glActiveTexture(GL_TEXTURE1);
-	if (gLut12BitEnabled)
-		glBindTexture(GL_TEXTURE_1D, gLut12BitTexId);
-	else
-		glBindTexture(GL_TEXTURE_1D, gLut8BitTexId);
-		
-
-	glEnable(GL_TEXTURE_2D);
-	glEnable(GL_TEXTURE_1D);
-	glBegin(GL_QUADS);
-	//We are flipping the y since the tiff image will start from top left
-	//while ogl starts from bottom right
-	glTexCoord2f(0.0, 1.0); glVertex2f(x0, y0);
-	glTexCoord2f(0.0, 0.0); glVertex2f(x0, y1);
-	glTexCoord2f(1.0, 0.0); glVertex2f(x1, y1);
-	glTexCoord2f(1.0, 1.0); glVertex2f(x1, y0);
-	glEnd();
+	if (gCine.numFiles) {
+		drawTiledImage(cineFrontImage(&gCine), &gDisplay, x0, y0, x1, y1);
+	}
+	else if (gVirtual.numLevels) {
+		drawVirtualTexture(&gVirtual, &gDisplay, level, x0, y0, x1, y1);
+	}
+	else if (level > 0) {
+		drawTiledImage(&gLevels[level - 1], &gDisplay, x0, y0, x1, y1);
+	}
+	else {
+		//While loading, the proxy fills in below the full resolution rows uploaded so far
+		if (gProxy.texIds)
+			drawTiledImage(&gProxy, &gDisplay, x0, y0, x1, y1,
+				gRowsUploaded / gProxyFactor, gProxyRowsUploaded);
+		if (gImage.texIds)
+			drawTiledImage(&gImage, &gDisplay, x0, y0, x1, y1,
+				0, gRowsUploaded);
+	}
+#ifdef _DEBUG
 	GL_GETERROR;
-
-    glDisable(GL_FRAGMENT_PROGRAM_ARB);
-	glUseProgramObjectARB(0);
-	eVal = glGetError();
-	glDisable(GL_TEXTURE_2D);
-	glDisable(GL_TEXTURE_1D);
+#endif
 }
 
 void oglCleanup() {
-	glDeleteTextures(1,&gImageTexId);
+	finishAsyncLoad(&gLoad);							// cancels a load still running
+	printCineStats(&gCine);
+	stopCinePlayer(&gCine);
+	deleteTiledImage(&gProxy);
+	deleteTiledImage(&gImage);
+	if (gVirtual.numLevels)
+		printf("Virtual texture: %u pages loaded, %u evicted\n", gVirtual.pagesLoaded, gVirtual.pagesEvicted);
+	deleteVirtualTexture(&gVirtual);
+	for (GLuint i = 0; i < gNumLevels; i++)
+		deleteTiledImage(&gLevels[i]);
 	glDeleteTextures(1,&gLut12BitTexId);
 	glDeleteTextures(1,&gLut8BitTexId);
-    glDeleteProgram(gShaderProgram);
+	deleteShaderCache(&gShaders);
+	deleteDitherTextures(&gDither);
+	deletePboUploader(&gUploader);
 }
 
 GLvoid PanGLScene(int x, int y)							// Pan Image In The GL Window
@@ -397,14 +623,15 @@ GLvoid PanGLScene(int x, int y)							// Pan Image In The GL Window
 
 		x_start -= deltaX;
 		y_start += deltaY;
-		x_end = x_start + (GLfloat)gImageWidth;	
-		y_end = y_start + (GLfloat)gImageHeight;
+		x_end = x_start + gImageWidth * gZoom;	
+		y_end = y_start + gImageHeight * gZoom;
 	}
 
 	prevX = x;
 	prevY = y;
 
 	fprintf(stderr, "x = %d  y = %d\n", x, y);
+	invalidateView(&gScheduler, REDRAW_PAN);
 }
 
 GLvoid KillGLWindow(GLvoid)								
@@ -444,44 +671,104 @@ LRESULT CALLBACK WndProc(	HWND	hWnd,			// Handle For This Window
 				printf("12-bit LUT Enabled\n");
 			else
 				printf("8-bit LUT Enabled\n");
+			invalidateView(&gScheduler, REDRAW_LUT);
+			break;
+		case 70:                                    // F = toggle bilinear and nearest filtering
+			gShaderKey ^= SHADER_FILTER_BILINEAR;
+			printf("%s filtering\n", (gShaderKey & SHADER_FILTER_BILINEAR) ? "Bilinear" : "Nearest");
+			invalidateView(&gScheduler, REDRAW_LUT);
+			break;
+		case 66:                                    // B = toggle 12-bit and 16-bit input
+			gShaderKey ^= SHADER_INPUT_16BIT;
+			printf("%d-bit input\n", (gShaderKey & SHADER_INPUT_16BIT) ? 16 : 12);
+			invalidateView(&gScheduler, REDRAW_LUT);
+			break;
+		case 80:                                    // P = toggle LUT and plain gray ramp
+			gShaderKey ^= SHADER_LUT_BYPASS;
+			printf("%s\n", (gShaderKey & SHADER_LUT_BYPASS) ? "Gray ramp, LUT bypassed" : "LUT enabled");
+			invalidateView(&gScheduler, REDRAW_LUT);
+			break;
+		case 81:                                    // Q = cycle output quantization off, 8-bit, 10-bit
+			if (gShaderKey & SHADER_QUANTIZE_8BIT)
+				gShaderKey ^= SHADER_QUANTIZE_8BIT | SHADER_QUANTIZE_10BIT;
+			else if (gShaderKey & SHADER_QUANTIZE_10BIT)
+				gShaderKey &= ~SHADER_QUANTIZE_10BIT;
+			else
+				gShaderKey |= SHADER_QUANTIZE_8BIT;
+			printf("Output quantization %s\n", (gShaderKey & SHADER_QUANTIZE_8BIT) ? "8-bit" :
+				(gShaderKey & SHADER_QUANTIZE_10BIT) ? "10-bit" : "off");
+			invalidateView(&gScheduler, REDRAW_LUT);
+			break;
+		case 68:                                    // D = cycle dithering off, ordered, blue noise, temporal blue noise
+			gShaderKey = (gShaderKey & ~SHADER_DITHER_MASK) | ((gShaderKey + SHADER_DITHER_ORDERED) & SHADER_DITHER_MASK);
+			switch (gShaderKey & SHADER_DITHER_MASK) {
+			case 0:                       printf("Dithering off\n"); break;
+			case SHADER_DITHER_ORDERED:   printf("Ordered dithering\n"); break;
+			case SHADER_DITHER_BLUE_NOISE: printf("Blue noise dithering\n"); break;
+			default:                      printf("Temporal blue noise dithering\n"); break;
+			}
+			invalidateView(&gScheduler, REDRAW_LUT);
 			break;
 		case 82:                                    // R = Reset everything
 			gLutScale = 1.0f;
 			gLutOffset = 0.0f;
 			gLut12BitEnabled = true;
-			x_start = 0;
-			x_end = (GLfloat)gImageWidth;
-			y_start = 0;
-			y_end = (GLfloat)gImageHeight;
+			gShaderKey = SHADER_FILTER_BILINEAR;
+			resetView();
+			invalidateView(&gScheduler, REDRAW_LUT | REDRAW_PAN);
 			break;
         case VK_RIGHT:
             gLutOffset -= 0.01f;
 			printf("New LUT offset %f\n",gLutOffset);
+			invalidateView(&gScheduler, REDRAW_LUT);
             break;
         case VK_LEFT:
             gLutOffset += 0.01f;
 			printf("New LUT offset %f\n",gLutOffset);
+			invalidateView(&gScheduler, REDRAW_LUT);
             break;
         case VK_UP:
             gLutScale += 0.01f;
 			printf("New LUT scale %f\n",gLutScale);
+			invalidateView(&gScheduler, REDRAW_LUT);
             break;
         case VK_DOWN:
             gLutScale -= 0.01f;
 			printf("New LUT scale %f\n",gLutScale);
+			invalidateView(&gScheduler, REDRAW_LUT);
             break;
+		case VK_PRIOR:								// Page Up = zoom in around the window center
+			zoomView(1.25f, gWinWidth * 0.5f, gWinHeight * 0.5f);
+			invalidateView(&gScheduler, REDRAW_PAN);
+			break;
+		case VK_NEXT:								// Page Down = zoom out around the window center
+			zoomView(0.8f, gWinWidth * 0.5f, gWinHeight * 0.5f);
+			invalidateView(&gScheduler, REDRAW_PAN);
+			break;
 		}
-		oglDraw();
-		return 0;
+		return 0;									// Drawn by the main loop
 	case WM_SIZE:									// Resize The OpenGL Window
 		oglResize(LOWORD(lParam),HIWORD(lParam));  // LoWord=Width, HiWord=Height
+		invalidateView(&gScheduler, REDRAW_RESIZE);
 		return 0;									// Jump Back
+	case WM_PAINT:									// Window uncovered
+		ValidateRect(hWnd, NULL);
+		invalidateView(&gScheduler, REDRAW_EXPOSE);
+		return 0;
 
 	case WM_MOUSEMOVE:								// Mouse moved in window
 		if (mb[0]) {
 			PanGLScene(LOWORD(lParam), HIWORD(lParam));  // LoWord = X, HiWord=Y
 		}
 		return 0;
+	case WM_MOUSEWHEEL:								// Zoom around the mouse position
+		{
+			POINT pt = {(short)LOWORD(lParam), (short)HIWORD(lParam)};  // screen coordinates
+			ScreenToClient(hWnd, &pt);
+			zoomView(GET_WHEEL_DELTA_WPARAM(wParam) > 0 ? 1.25f : 0.8f, (GLfloat)pt.x, (GLfloat)(gWinHeight - pt.y));
+			invalidateView(&gScheduler, REDRAW_PAN);
+		}
+		return 0;
 	case WM_LBUTTONDOWN:							// Left mouse button down
 		mb[0] = TRUE;		
 		return 0;
@@ -570,38 +857,182 @@ bool CreateGLWindow(char* title, int width, int height, HINSTANCE instance)
 
 
 
+//
+// timeSeconds - Performance counter time in seconds
+//
+double timeSeconds()
+{
+	LARGE_INTEGER now, frequency;
+
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&frequency);
+	return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+//
+// benchmarkPng - Decode a PNG file repeatedly and print the throughput.
+// Only the row decode (inflate, unfilter, byte swap) is timed.
+//
+int benchmarkPng(const char *fileName, int runs)
+{
+	LARGE_INTEGER frequency, start, end;
+	double seconds, best = 0.0, total = 0.0;
+	PngFile png;
+	unsigned short *row;
+	int i;
+
+	if (runs < 1)
+		runs = 1;
+	QueryPerformanceFrequency(&frequency);
+	for (i = 0; i < runs; i++) {
+		if (!openPng(&png, fileName))
+			return 1;
+		row = (unsigned short*)malloc(png.width * png.channels * sizeof(unsigned short));
+		QueryPerformanceCounter(&start);
+		while (png.row < png.height) {
+			if (!readPngRow(&png, row))
+				break;
+		}
+		QueryPerformanceCounter(&end);
+		free(row);
+		if (png.row < png.height) {
+			closePng(&png);
+			return 1;
+		}
+		seconds = (double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+		total += seconds;
+		if (i == 0 || seconds < best)
+			best = seconds;
+		if (i == runs - 1) {
+			double megabytes = (double)png.width * png.height * png.channels * sizeof(unsigned short) / (1024.0 * 1024.0);
+			printf("%s: %ux%u, %u channel(s), %u-bit, %.1f MB compressed\n", fileName, png.width, png.height,
+				png.channels, png.bitDepth, png.dataSize / (1024.0 * 1024.0));
+			printf("%d runs, best %.2f ms (%.1f MB/s), average %.2f ms (%.1f MB/s) of 16-bit samples\n",
+				runs, best * 1000.0, megabytes / best, total * 1000.0 / runs, megabytes * runs / total);
+		}
+		closePng(&png);
+	}
+	return 0;
+}
+
+//
+// benchmarkDither - Dither a 16-bit 4K gradient to 8 bits on the CPU repeatedly
+// and print the throughput of the SSE2 path.
+//
+int benchmarkDither(int runs)
+{
+	const GLuint width = 3840, height = 2160;
+	LARGE_INTEGER frequency, start, end;
+	double seconds, best = 0.0;
+	unsigned short *src = (unsigned short*)malloc(width * height * sizeof(unsigned short));
+	unsigned char *dst = (unsigned char*)malloc(width * height);
+	int i;
+
+	if (!src || !dst || !initDitherNoise(&gDither, DITHER_CACHE_FILE)) {
+		free(src);
+		free(dst);
+		return 1;
+	}
+	if (runs < 1)
+		runs = 1;
+	for (GLuint y = 0; y < height; y++)
+		for (GLuint x = 0; x < width; x++)
+			src[y * width + x] = (unsigned short)((x * 65535u) / (width - 1));
+	QueryPerformanceFrequency(&frequency);
+	for (i = 0; i < runs; i++) {
+		QueryPerformanceCounter(&start);
+		ditherImage8(src, dst, width, height, gDither.blueNoise, DITHER_NOISE_SIZE);
+		QueryPerformanceCounter(&end);
+		seconds = (double)(end.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+		if (i == 0 || seconds < best)
+			best = seconds;
+	}
+	printf("%ux%u 16 to 8-bit blue noise dither: best of %d runs %.2f ms (%.0f Mpixel/s)\n",
+		width, height, runs, best * 1000.0, width * height / best / 1e6);
+	free(src);
+	free(dst);
+	return 0;
+}
+
 //TODO make this main so that we get console
 int main(int argc, char** argv)			// Window Show State
 {
 	MSG		msg;									// Windows Message Structure
 	BOOL	done=FALSE;								// Bool Variable To Exit Loop
 	ghInstance = GetModuleHandle(NULL);
+	// GrayscaleDemo -pngbench file.png [runs] measures the PNG decoder only
+	if (argc >= 3 && strcmp(argv[1], "-pngbench") == 0)
+		return benchmarkPng(argv[2], argc >= 4 ? atoi(argv[3]) : 10);
+	// GrayscaleDemo -ditherbench [runs] measures the CPU dither path
+	if (argc >= 2 && strcmp(argv[1], "-ditherbench") == 0)
+		return benchmarkDither(argc >= 3 ? atoi(argv[2]) : 10);
+	// GrayscaleDemo -cine "frames\*.tif" [fps] plays the matching files as a sequence
+	if (argc >= 3 && strcmp(argv[1], "-cine") == 0) {
+		gCinePattern = argv[2];
+		if (argc >= 4 && atof(argv[3]) > 0.0)
+			gCineFps = atof(argv[3]);
+	}
 	// Create Our OpenGL Window
 	if (!CreateGLWindow("GrayScaleDemo", gWinWidth, gWinHeight, ghInstance))
 	{
 		return 0;									// Quit If Window Was Not Created
 	}
 
-	oglDraw();									// Initial Draw Of 3D Scene
+	// With vsync SwapBuffers paces the frames, otherwise draw at most 60 per second
+	initScheduler(&gScheduler, gVsync ? 0.0 : 1.0 / 60.0);	// the first frame is due at once
 
 	while(!done)									// Loop That Runs While done=FALSE
 	{
-		if (PeekMessage(&msg,NULL,0,0,PM_REMOVE))	// Is There A Message Waiting?
+		double now = timeSeconds();
+		double wait = schedulerWaitTime(&gScheduler, now);
+		if (gCine.numFiles) {
+			double cineWait = cineWaitTime(&gCine, now);
+			if (cineWait != CINE_WAIT_FOR_FRAME && (wait == SCHEDULER_WAIT_FOREVER || cineWait < wait))
+				wait = cineWait;
+		}
+		if (wait != 0.0) {
+			// Sleep until there is input, the loader has new rows, a sequence frame
+			// is decoded or the next frame is due
+			HANDLE events[2];
+			DWORD numEvents = 0;
+			if (gLoad.thread)
+				events[numEvents++] = gLoad.progressEvent;
+			if (gCine.numFiles)
+				events[numEvents++] = gCine.frameReady;
+			DWORD timeout = (wait == SCHEDULER_WAIT_FOREVER) ? INFINITE : (DWORD)(wait * 1000.0) + 1;
+			MsgWaitForMultipleObjects(numEvents, events, FALSE, timeout, QS_ALLINPUT);
+		}
+		while (PeekMessage(&msg,NULL,0,0,PM_REMOVE))	// Handle every waiting message before drawing
 		{
 			if (msg.message==WM_QUIT)				// Have We Received A Quit Message?
 			{
 				done=TRUE;							// If So done=TRUE
+				break;
 			}
-			else									// If Not, Deal With Window Messages
-			{
-				TranslateMessage(&msg);				// Translate The Message
-				DispatchMessage(&msg);				// Dispatch The Message
-			}
+			TranslateMessage(&msg);					// Translate The Message
+			DispatchMessage(&msg);					// Dispatch The Message
+		}
+		if (done)
+			break;
+
+		if (updateImageLoad())						// Upload what the loader has decoded
+			invalidateView(&gScheduler, REDRAW_IMAGE);
+		if (updateCinePlayer(&gCine, &gUploader, timeSeconds()))	// Next sequence frame is due
+			invalidateView(&gScheduler, REDRAW_IMAGE);
+		if (beginFrame(&gScheduler, timeSeconds())) {
+			oglDraw();								// Draw The Scene
+			SwapBuffers(ghDC);				        // Swap Buffers (Double Buffering)
+			cineFramePresented(&gCine, timeSeconds());
 		}
-		
-		oglDraw();									// Draw The Scene
-		SwapBuffers(ghDC);				            // Swap Buffers (Double Buffering)
 	} // while (!done)
+	printf("%u redraw requests drawn in %u frames\n", gScheduler.requests, gScheduler.frames);
+	if (gScheduler.frames)
+		printf("Per frame: %.1f GL state changes, %.1f skipped as redundant, %.1f draw calls\n",
+			(double)gDisplay.stateCalls / gScheduler.frames, (double)gDisplay.skippedCalls / gScheduler.frames,
+			(double)gDisplay.drawCalls / gScheduler.frames);
+	printf("Uploaded %.1f MB at %.0f MB/s, %u buffer transfers, %u stalls, %u direct uploads\n",
+		(double)(__int64)gUploader.bytes / (1024.0 * 1024.0), pboUploadRate(&gUploader),
+		gUploader.transfers, gUploader.stalls, gUploader.directUploads);
 
 	// Shutdown
 	KillGLWindow();									// Kill The Window
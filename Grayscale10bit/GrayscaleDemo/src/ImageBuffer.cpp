@@ -0,0 +1,127 @@
+//
+// ImageBuffer.cpp
+//
+// Chunked VirtualAlloc based pixel storage for large images
+//
+#include <windows.h>
+#include <stdio.h>
+#include "ImageBuffer.h"
+
+#ifndef MEM_LARGE_PAGES
+#define MEM_LARGE_PAGES 0x20000000
+#endif
+
+typedef SIZE_T (WINAPI *PFNGETLARGEPAGEMINIMUM)(void);
+
+//
+// getLargePageSize
+//
+// Returns the large page size if the process is allowed to use large pages,
+// 0 otherwise. GetLargePageMinimum is looked up at run time since it does not
+// exist on XP.
+//
+static SIZE_T getLargePageSize()
+{
+    static int checked = 0;
+    static SIZE_T largePageSize = 0;
+
+    if (!checked) {
+        checked = 1;
+        PFNGETLARGEPAGEMINIMUM pGetLargePageMinimum = (PFNGETLARGEPAGEMINIMUM)
+            GetProcAddress(GetModuleHandle("kernel32.dll"), "GetLargePageMinimum");
+        if (pGetLargePageMinimum) {
+            HANDLE token;
+            // Large pages need the "Lock pages in memory" privilege enabled
+            if (OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+                TOKEN_PRIVILEGES tp;
+                tp.PrivilegeCount = 1;
+                tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+                if (LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid) &&
+                    AdjustTokenPrivileges(token, FALSE, &tp, 0, NULL, NULL) &&
+                    GetLastError() == ERROR_SUCCESS) {
+                    largePageSize = pGetLargePageMinimum();
+                }
+                CloseHandle(token);
+            }
+        }
+    }
+    return largePageSize;
+}
+
+static unsigned __int64 roundUp(unsigned __int64 size, unsigned __int64 granularity)
+{
+    return (size + granularity - 1) / granularity * granularity;
+}
+
+bool reserveImageBuffer(ImageBuffer *buffer, unsigned __int64 size)
+{
+    unsigned __int64 reserveSize = roundUp(size, IMAGEBUFFER_CHUNK_SIZE);
+    SIZE_T largePageSize = getLargePageSize();
+
+    buffer->data = NULL;
+    buffer->reserved = 0;
+    buffer->committed = 0;
+    buffer->largePages = false;
+
+    if (size == 0 || reserveSize > (unsigned __int64)(SIZE_T)-1) {
+        fprintf(stderr, "Image buffer of %I64u bytes exceeds the address space of this process\n", size);
+        return false;
+    }
+
+    // Large pages can not be committed piecewise, so take the whole block at once
+    if (largePageSize && (reserveSize % largePageSize) == 0) {
+        buffer->data = (char *)VirtualAlloc(NULL, (SIZE_T)reserveSize,
+            MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (buffer->data) {
+            buffer->largePages = true;
+            buffer->committed = reserveSize;
+        }
+    }
+    if (!buffer->data) {
+        buffer->data = (char *)VirtualAlloc(NULL, (SIZE_T)reserveSize, MEM_RESERVE, PAGE_READWRITE);
+    }
+    if (!buffer->data) {
+        fprintf(stderr, "Could not reserve %I64u bytes for the image\n", size);
+        return false;
+    }
+    buffer->reserved = reserveSize;
+    return true;
+}
+
+bool commitImageBuffer(ImageBuffer *buffer, unsigned __int64 size)
+{
+    if (size <= buffer->committed)
+        return true;
+    if (size > buffer->reserved)
+        return false;
+
+    unsigned __int64 newCommitted = roundUp(size, IMAGEBUFFER_CHUNK_SIZE);
+    if (newCommitted > buffer->reserved)
+        newCommitted = buffer->reserved;
+    if (!VirtualAlloc(buffer->data + buffer->committed, (SIZE_T)(newCommitted - buffer->committed),
+        MEM_COMMIT, PAGE_READWRITE)) {
+        fprintf(stderr, "Could not commit %I64u bytes for the image\n", newCommitted);
+        return false;
+    }
+    buffer->committed = newCommitted;
+    return true;
+}
+
+char *allocImagePixels(unsigned __int64 size)
+{
+    ImageBuffer buffer;
+
+    if (!reserveImageBuffer(&buffer, size))
+        return NULL;
+    if (!commitImageBuffer(&buffer, size)) {
+        freeImagePixels(buffer.data);
+        return NULL;
+    }
+    return buffer.data;
+}
+
+void freeImagePixels(void *pixels)
+{
+    if (pixels)
+        VirtualFree(pixels, 0, MEM_RELEASE);
+}
@@ -0,0 +1,34 @@
+//
+// ImageBuffer.h
+//
+// Pixel storage for large images. The whole image is reserved as one block of
+// address space up front and committed in 2 MB steps while the loader fills
+// it, so a multi gigabyte image is never copied or reallocated. The 2 MB step
+// matches the x86 large page size, large pages are used when the process has
+// the SeLockMemoryPrivilege.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef IMAGEBUFFER_H
+#define IMAGEBUFFER_H
+
+#define IMAGEBUFFER_CHUNK_SIZE (2*1024*1024)
+
+typedef struct _ImageBuffer {
+    char *data;                     // base address of the reserved block
+    unsigned __int64 reserved;      // bytes of address space reserved
+    unsigned __int64 committed;     // bytes committed from the start of data
+    bool largePages;                // block was allocated with MEM_LARGE_PAGES
+} ImageBuffer;
+
+// Reserve address space for size bytes. Fails when size does not fit into the
+// address space of the process (e.g. more than 2 GB in a Win32 build).
+extern bool reserveImageBuffer(ImageBuffer *buffer, unsigned __int64 size);
+// Make sure the first size bytes are backed by memory. Grows in chunk steps.
+extern bool commitImageBuffer(ImageBuffer *buffer, unsigned __int64 size);
+// Reserve and commit size bytes in one go.
+extern char *allocImagePixels(unsigned __int64 size);
+// Release pixel data returned by readTiff() or allocImagePixels().
+extern void freeImagePixels(void *pixels);
+
+#endif
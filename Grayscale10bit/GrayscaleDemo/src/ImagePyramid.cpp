@@ -0,0 +1,162 @@
+//
+// ImagePyramid.cpp
+//
+// Multi-threaded SSE2 2x2 box filter for the image levels
+//
+#include <windows.h>
+#include <process.h>
+#include <string.h>
+#include <emmintrin.h>
+#include <GL/gl.h>
+#include "ImageBuffer.h"
+#include "ImagePyramid.h"
+
+#define DOWNSAMPLE_MAX_THREADS      16
+#define DOWNSAMPLE_ROWS_PER_THREAD  64      // smaller bands are not worth a thread
+
+typedef struct _DownsampleBand {
+    const unsigned short *src;
+    GLuint width;
+    GLuint height;
+    unsigned short *dst;
+    GLuint firstRow;                        // destination rows [firstRow, lastRow)
+    GLuint lastRow;
+} DownsampleBand;
+
+//
+// downsampleBand
+//
+// The samples are biased by 0x8000 so pmaddwd can add the horizontal pairs as
+// signed numbers without overflow; the bias is taken off again when packing.
+//
+static void downsampleBand(const DownsampleBand *band)
+{
+    const GLuint width = band->width;
+    const GLuint dstWidth = (width + 1) / 2;
+    const __m128i bias = _mm_set1_epi16((short)0x8000);
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i round = _mm_set1_epi32(2);
+    GLuint y, x;
+
+    for (y = band->firstRow; y < band->lastRow; y++) {
+        const unsigned short *row0 = band->src + (size_t)(2 * y) * width;
+        const unsigned short *row1 = (2 * y + 1 < band->height) ? row0 + width : row0;
+        unsigned short *dst = band->dst + (size_t)y * dstWidth;
+
+        x = 0;
+        for (; 2 * x + 16 <= width; x += 8) {
+            __m128i a0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(row0 + 2 * x)), bias);
+            __m128i a1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(row1 + 2 * x)), bias);
+            __m128i b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(row0 + 2 * x + 8)), bias);
+            __m128i b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(row1 + 2 * x + 8)), bias);
+            // sum of the 4 samples - 4*0x8000, then (sum + 2) / 4 - 0x8000
+            __m128i a = _mm_add_epi32(_mm_madd_epi16(a0, ones), _mm_madd_epi16(a1, ones));
+            __m128i b = _mm_add_epi32(_mm_madd_epi16(b0, ones), _mm_madd_epi16(b1, ones));
+            a = _mm_srai_epi32(_mm_add_epi32(a, round), 2);
+            b = _mm_srai_epi32(_mm_add_epi32(b, round), 2);
+            _mm_storeu_si128((__m128i *)(dst + x), _mm_xor_si128(_mm_packs_epi32(a, b), bias));
+        }
+        for (; x < dstWidth; x++) {
+            GLuint x0 = 2 * x;
+            GLuint x1 = (x0 + 1 < width) ? x0 + 1 : x0;
+            dst[x] = (unsigned short)((row0[x0] + row0[x1] + row1[x0] + row1[x1] + 2) >> 2);
+        }
+    }
+}
+
+static unsigned __stdcall downsampleThread(void *arg)
+{
+    downsampleBand((const DownsampleBand *)arg);
+    return 0;
+}
+
+static int processorCount()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+
+void downsampleImage(const unsigned short *src, GLuint width, GLuint height, unsigned short *dst)
+{
+    DownsampleBand bands[DOWNSAMPLE_MAX_THREADS];
+    HANDLE threads[DOWNSAMPLE_MAX_THREADS];
+    GLuint dstHeight = (height + 1) / 2;
+    int numBands = processorCount();
+    int i, numThreads = 0;
+
+    if (numBands > DOWNSAMPLE_MAX_THREADS)
+        numBands = DOWNSAMPLE_MAX_THREADS;
+    if (numBands > (int)(dstHeight / DOWNSAMPLE_ROWS_PER_THREAD))
+        numBands = dstHeight / DOWNSAMPLE_ROWS_PER_THREAD;
+    if (numBands < 1)
+        numBands = 1;
+
+    for (i = 0; i < numBands; i++) {
+        bands[i].src = src;
+        bands[i].width = width;
+        bands[i].height = height;
+        bands[i].dst = dst;
+        bands[i].firstRow = (GLuint)((unsigned __int64)dstHeight * i / numBands);
+        bands[i].lastRow = (GLuint)((unsigned __int64)dstHeight * (i + 1) / numBands);
+    }
+    // The calling thread does the first band, the others get a thread each
+    for (i = 1; i < numBands; i++) {
+        threads[numThreads] = (HANDLE)_beginthreadex(NULL, 0, downsampleThread, &bands[i], 0, NULL);
+        if (threads[numThreads])
+            numThreads++;
+        else
+            downsampleBand(&bands[i]);
+    }
+    downsampleBand(&bands[0]);
+    if (numThreads) {
+        WaitForMultipleObjects(numThreads, threads, TRUE, INFINITE);
+        for (i = 0; i < numThreads; i++)
+            CloseHandle(threads[i]);
+    }
+}
+
+bool buildImagePyramid(ImagePyramid *pyramid, const unsigned short *pixels, GLuint width, GLuint height)
+{
+    memset(pyramid, 0, sizeof(ImagePyramid));
+    while ((width > PYRAMID_MIN_SIZE || height > PYRAMID_MIN_SIZE) && pyramid->numLevels < PYRAMID_MAX_LEVELS) {
+        GLuint level = pyramid->numLevels;
+        GLuint levelWidth = (width + 1) / 2;
+        GLuint levelHeight = (height + 1) / 2;
+        unsigned short *levelPixels = (unsigned short *)allocImagePixels(
+            (unsigned __int64)levelWidth * levelHeight * sizeof(unsigned short));
+        if (!levelPixels) {
+            freeImagePyramid(pyramid);
+            return false;
+        }
+        downsampleImage(pixels, width, height, levelPixels);
+        pyramid->width[level] = levelWidth;
+        pyramid->height[level] = levelHeight;
+        pyramid->pixels[level] = levelPixels;
+        pyramid->numLevels++;
+
+        pixels = levelPixels;
+        width = levelWidth;
+        height = levelHeight;
+    }
+    return true;
+}
+
+void freeImagePyramid(ImagePyramid *pyramid)
+{
+    GLuint i;
+
+    for (i = 0; i < pyramid->numLevels; i++)
+        freeImagePixels(pyramid->pixels[i]);
+    memset(pyramid, 0, sizeof(ImagePyramid));
+}
+
+GLuint pyramidLevelForZoom(float zoom, GLuint numLevels)
+{
+    GLuint level = 0;
+
+    // largest level whose texels are still at most one window pixel
+    while (level < numLevels && zoom * (float)(2 << level) <= 1.0f)
+        level++;
+    return level;
+}
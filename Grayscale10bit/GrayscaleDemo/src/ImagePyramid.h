@@ -0,0 +1,34 @@
+//
+// ImagePyramid.h
+//
+// Half resolution levels of a 16-bit single channel image. Integer textures
+// have no mipmaps, so zoomed out views draw a level built here instead, which
+// keeps the texels fetched per frame bounded by the window size.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#define PYRAMID_MAX_LEVELS  16
+#define PYRAMID_MIN_SIZE    256     // no levels below this long side
+
+typedef struct _ImagePyramid {
+    GLuint numLevels;
+    // level i+1 of the image, i.e. 2^(i+1) times smaller
+    GLuint width[PYRAMID_MAX_LEVELS];
+    GLuint height[PYRAMID_MAX_LEVELS];
+    unsigned short *pixels[PYRAMID_MAX_LEVELS];
+} ImagePyramid;
+
+// 2x2 box filter into a (width+1)/2 x (height+1)/2 image, the last row and
+// column are repeated for odd sizes. Large images are split over all cores.
+extern void downsampleImage(const unsigned short *src, GLuint width, GLuint height, unsigned short *dst);
+// Builds the levels down to PYRAMID_MIN_SIZE. Returns false if out of memory.
+extern bool buildImagePyramid(ImagePyramid *pyramid, const unsigned short *pixels, GLuint width, GLuint height);
+extern void freeImagePyramid(ImagePyramid *pyramid);
+// Level to draw at zoom (window pixels per image pixel), 0 is the full image.
+// The level is minified at most 2:1 so the bilinear filter does not alias much.
+extern GLuint pyramidLevelForZoom(float zoom, GLuint numLevels);
+
+#endif
@@ -0,0 +1,22 @@
+//
+// PboEntryPoints.cpp
+//
+// GLEW backed entry point checks for the shared PboUploader
+//
+#include <windows.h>
+#include "PboEntryPoints.h"
+
+bool hasExtension(const char *name)
+{
+    return glewIsSupported(name) != GL_FALSE;
+}
+
+bool loadBufferEntryPoints()
+{
+    return GLEW_ARB_vertex_buffer_object != GL_FALSE;
+}
+
+bool loadFenceEntryPoints()
+{
+    return GLEW_NV_fence != GL_FALSE;
+}
@@ -0,0 +1,23 @@
+//
+// PboEntryPoints.h
+//
+// The OpenGL headers and entry points the shared PboUploader is built
+// against. GLEW loads the ARB and NV named pointers in glewInit, these only
+// tell whether the driver has them.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PBOENTRYPOINTS_H
+#define PBOENTRYPOINTS_H
+
+#include <GL\glew.h>
+#include <GL\gl.h>
+
+// Whether the driver lists the extension.
+extern bool hasExtension(const char *name);
+// ARB_vertex_buffer_object, which the pixel buffer objects are made with.
+extern bool loadBufferEntryPoints();
+// NV_fence.
+extern bool loadFenceEntryPoints();
+
+#endif
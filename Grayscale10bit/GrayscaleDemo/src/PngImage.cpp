@@ -0,0 +1,99 @@
+//
+// PngImage.cpp
+//
+// PNG files as GrayscaleDemo images
+//
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <GL/gl.h>
+#include "ImageBuffer.h"
+#include "TiffLoader.h"
+#include "PngLoader.h"
+#include "PngImage.h"
+
+//
+// readPngImage
+//
+// Reads the rows straight into the image, RGB rows go through a scratch row
+// and are reduced to luminance. The full 16-bit range of the PNG samples is
+// scaled down to the 12 bits the lookup table covers.
+//
+#define PNG_ROWS_PER_PROGRESS   64
+
+int readPngImage(char *imageName, GLuint *pWidth, GLuint *pHeight, GLuint *pBpp, GLuint *pMinValue, GLuint *pMaxValue, GLuint *pNumValues, char** pixels,
+    TiffProgressProc progress, void *userData)
+{
+    int iRet = 0;
+    PngFile png;
+    ImageBuffer buffer;
+    unsigned short *rgbRow = NULL;
+    unsigned __int64 rowBytes;
+    GLuint row, x;
+
+    buffer.data = NULL;
+    if (!openPng(&png, imageName))
+        goto Exit;
+
+    rowBytes = (unsigned __int64)png.width * sizeof(unsigned short);
+    if (!reserveImageBuffer(&buffer, rowBytes * png.height)) {
+        fprintf(stderr, "Could not allocate enough memory\n");
+        goto Exit;
+    }
+    if (png.channels == 3 && (rgbRow = (unsigned short *)malloc(png.width * 3 * sizeof(unsigned short))) == NULL) {
+        fprintf(stderr, "Could not allocate enough memory\n");
+        goto Exit;
+    }
+    if (progress && !progress(userData, (const unsigned short *)buffer.data, png.width, png.height, 0)) {
+        fprintf(stderr, "Image load cancelled\n");
+        goto Exit;
+    }
+
+    for (row = 0; row < png.height; row++) {
+        unsigned short *dst = (unsigned short *)(buffer.data + row * rowBytes);
+        if (row % PNG_ROWS_PER_PROGRESS == 0) {
+            GLuint lastRow = (row + PNG_ROWS_PER_PROGRESS < png.height) ? row + PNG_ROWS_PER_PROGRESS : png.height;
+            if (!commitImageBuffer(&buffer, lastRow * rowBytes)) {
+                fprintf(stderr, "Could not allocate enough memory\n");
+                goto Exit;
+            }
+        }
+        if (png.channels == 1) {
+            if (!readPngRow(&png, dst))
+                goto Exit;
+            for (x = 0; x < png.width; x++)
+                dst[x] >>= 4;
+        } else {
+            if (!readPngRow(&png, rgbRow))
+                goto Exit;
+            // Rec. 709 luminance in 16.16 fixed point, then down to 12 bits
+            for (x = 0; x < png.width; x++) {
+                const unsigned short *rgb = rgbRow + x * 3;
+                dst[x] = (unsigned short)((rgb[0] * 13933u + rgb[1] * 46871u + rgb[2] * 4732u) >> 20);
+            }
+        }
+        if (progress && ((row + 1) % PNG_ROWS_PER_PROGRESS == 0 || row + 1 == png.height) &&
+            !progress(userData, (const unsigned short *)buffer.data, png.width, png.height, row + 1)) {
+            fprintf(stderr, "Image load cancelled\n");
+            goto Exit;
+        }
+    }
+
+    *pWidth = png.width;
+    *pHeight = png.height;
+    *pBpp = png.bitDepth;
+    *pixels = buffer.data;
+    getImageStats((unsigned short *)buffer.data, (unsigned __int64)png.width * png.height,
+        pMinValue, pMaxValue, pNumValues);
+    iRet = 1;
+
+Exit:;
+    closePng(&png);
+    free(rgbRow);
+    if (1 != iRet) {
+        if (progress)
+            progress(userData, NULL, 0, 0, 0);
+        freeImagePixels(buffer.data);
+    }
+    return iRet;
+}
@@ -0,0 +1,16 @@
+//
+// PngImage.h
+//
+// Loads a PNG file through the shared PNG reader into a GrayscaleDemo image
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef PNGIMAGE_H
+#define PNGIMAGE_H
+
+// Loader with the same contract as readTiff: the image is converted to one
+// 12-bit channel (RGB files by their Rec. 709 luminance).
+extern int readPngImage(char *imageName, GLuint *pWidth, GLuint *pHeight, GLuint *pBpp, GLuint *pMinValue, GLuint *pMaxValue, GLuint *pNumValues, char** pixels,
+    TiffProgressProc progress = NULL, void *userData = NULL);
+
+#endif
@@ -0,0 +1,44 @@
+//
+// RenderScheduler.cpp
+//
+// Dirty flag redraw scheduling with frame pacing
+//
+#include "RenderScheduler.h"
+
+void initScheduler(RenderScheduler *scheduler, double frameInterval)
+{
+    scheduler->dirty = REDRAW_EXPOSE;       // the first frame
+    scheduler->frameInterval = frameInterval;
+    scheduler->lastFrame = -frameInterval;
+    scheduler->requests = 0;
+    scheduler->frames = 0;
+}
+
+void invalidateView(RenderScheduler *scheduler, unsigned int reasons)
+{
+    scheduler->dirty |= reasons;
+    scheduler->requests++;
+}
+
+double schedulerWaitTime(const RenderScheduler *scheduler, double now)
+{
+    double next;
+
+    if (!scheduler->dirty)
+        return SCHEDULER_WAIT_FOREVER;
+    // Bursts of input within one frame interval are drawn together
+    next = scheduler->lastFrame + scheduler->frameInterval;
+    return (now >= next) ? 0.0 : next - now;
+}
+
+unsigned int beginFrame(RenderScheduler *scheduler, double now)
+{
+    unsigned int reasons = scheduler->dirty;
+
+    if (!reasons || schedulerWaitTime(scheduler, now) != 0.0)
+        return 0;
+    scheduler->dirty = 0;
+    scheduler->lastFrame = now;
+    scheduler->frames++;
+    return reasons;
+}
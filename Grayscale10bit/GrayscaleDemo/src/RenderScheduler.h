@@ -0,0 +1,43 @@
+//
+// RenderScheduler.h
+//
+// Decides when the window is redrawn. Input only marks the view dirty, the
+// main loop draws at most one frame per frame interval for everything that
+// happened since the last one and sleeps in the message queue while nothing
+// is dirty. Time is passed in by the caller, so the logic has no window or
+// GL dependencies and can be driven with made up clocks.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef RENDERSCHEDULER_H
+#define RENDERSCHEDULER_H
+
+// Reasons for a redraw
+#define REDRAW_EXPOSE   0x01        // window uncovered (WM_PAINT)
+#define REDRAW_RESIZE   0x02
+#define REDRAW_PAN      0x04        // pan or zoom
+#define REDRAW_LUT      0x08        // lookup table, scale or offset changed
+#define REDRAW_IMAGE    0x10        // new image data uploaded
+#define REDRAW_DITHER   0x20        // temporal dithering moves the noise every frame
+
+#define SCHEDULER_WAIT_FOREVER  (-1.0)
+
+typedef struct _RenderScheduler {
+    unsigned int dirty;             // REDRAW_* flags since the last frame
+    double frameInterval;           // minimum seconds between frames, 0 if SwapBuffers waits for vsync
+    double lastFrame;               // time the last frame started
+    unsigned int requests;          // invalidations so far
+    unsigned int frames;            // frames drawn so far
+} RenderScheduler;
+
+extern void initScheduler(RenderScheduler *scheduler, double frameInterval);
+// Marks the view dirty for the given REDRAW_* reasons.
+extern void invalidateView(RenderScheduler *scheduler, unsigned int reasons);
+// Seconds the main loop may sleep waiting for messages at time now: 0 if a
+// frame is due, SCHEDULER_WAIT_FOREVER if nothing is to be drawn.
+extern double schedulerWaitTime(const RenderScheduler *scheduler, double now);
+// If a frame is due at time now, returns its REDRAW_* reasons and clears
+// them, otherwise returns 0.
+extern unsigned int beginFrame(RenderScheduler *scheduler, double now);
+
+#endif
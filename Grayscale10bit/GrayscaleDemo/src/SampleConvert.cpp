@@ -0,0 +1,131 @@
+//
+// SampleConvert.cpp
+//
+// SIMD byte swap and 12-bit unpack for the strip decode
+//
+#include <stddef.h>
+#include <intrin.h>
+#include <emmintrin.h>
+#if _MSC_VER >= 1500
+#include <tmmintrin.h>      // SSSE3, Visual Studio 2008 and newer
+#define SAMPLECONVERT_SSSE3
+#endif
+#if _MSC_VER >= 1700
+#include <immintrin.h>      // AVX2, Visual Studio 2012 and newer
+#define SAMPLECONVERT_AVX2
+#endif
+#include "SampleConvert.h"
+
+enum { CPU_SSE2 = 0, CPU_SSSE3 = 1, CPU_AVX2 = 2 };
+
+//
+// cpuLevel
+//
+// Returns the best instruction set usable for the conversions. SSE2 is always
+// there on the CPUs this demo runs on (Quadro workstations).
+//
+static int cpuLevel()
+{
+    static int level = -1;
+
+    if (level < 0) {
+        int info[4];
+        level = CPU_SSE2;
+        __cpuid(info, 1);
+#ifdef SAMPLECONVERT_SSSE3
+        if (info[2] & (1 << 9))
+            level = CPU_SSSE3;
+#endif
+#ifdef SAMPLECONVERT_AVX2
+        // AVX2 needs OS support for the ymm state (OSXSAVE + XCR0)
+        if ((info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6) {
+            __cpuidex(info, 7, 0);
+            if (info[1] & (1 << 5))
+                level = CPU_AVX2;
+        }
+#endif
+    }
+    return level;
+}
+
+void swapSamples16(unsigned short *samples, size_t count)
+{
+    size_t i = 0;
+
+    // Byte swapping is bound by memory bandwidth, shifts are as fast as pshufb here
+#ifdef SAMPLECONVERT_AVX2
+    if (cpuLevel() >= CPU_AVX2) {
+        for (; i + 16 <= count; i += 16) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(samples + i));
+            v = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+            _mm256_storeu_si256((__m256i *)(samples + i), v);
+        }
+    }
+#endif
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(samples + i));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *)(samples + i), v);
+    }
+    for (; i < count; i++)
+        samples[i] = (unsigned short)((samples[i] << 8) | (samples[i] >> 8));
+}
+
+//
+// Each pair of samples a, b is packed as the bytes aaaaaaaa aaaabbbb bbbbbbbb.
+// The shuffle gathers (b0,b1) big endian into the even word and (b1,b2) into
+// the odd word, the even word is then shifted down by 4 and the odd word masked
+// to 12 bits. 12 input bytes make 8 samples.
+//
+void unpackSamples12(const unsigned char *src, unsigned short *dst, size_t count)
+{
+    size_t i = 0;
+
+#if defined(SAMPLECONVERT_SSSE3) || defined(SAMPLECONVERT_AVX2)
+    const int level = cpuLevel();
+#endif
+#ifdef SAMPLECONVERT_AVX2
+    if (level >= CPU_AVX2) {
+        const __m256i shuffle = _mm256_setr_epi8(
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+        const __m256i evenMask = _mm256_set1_epi32(0x0000FFFF);
+        const __m256i oddMask = _mm256_set1_epi32(0x0FFF0000);
+        // 24 bytes in, 16 samples out; the loads read 4 bytes past the 12
+        // used per lane, so stay 4 bytes away from the end
+        for (; i + 16 + 3 <= count; i += 16) {
+            const unsigned char *p = src + i / 2 * 3;
+            __m256i v = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+                _mm_loadu_si128((const __m128i *)(p + 12)), 1);
+            v = _mm256_shuffle_epi8(v, shuffle);
+            v = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi16(v, 4), evenMask),
+                                _mm256_and_si256(v, oddMask));
+            _mm256_storeu_si256((__m256i *)(dst + i), v);
+        }
+    }
+#endif
+#ifdef SAMPLECONVERT_SSSE3
+    if (level >= CPU_SSSE3) {
+        const __m128i shuffle = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+        const __m128i evenMask = _mm_set1_epi32(0x0000FFFF);
+        const __m128i oddMask = _mm_set1_epi32(0x0FFF0000);
+        for (; i + 8 + 3 <= count; i += 8) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(src + i / 2 * 3));
+            v = _mm_shuffle_epi8(v, shuffle);
+            v = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(v, 4), evenMask),
+                             _mm_and_si128(v, oddMask));
+            _mm_storeu_si128((__m128i *)(dst + i), v);
+        }
+    }
+#endif
+    for (; i + 2 <= count; i += 2) {
+        const unsigned char *p = src + i / 2 * 3;
+        dst[i] = (unsigned short)((p[0] << 4) | (p[1] >> 4));
+        dst[i + 1] = (unsigned short)(((p[1] & 0x0F) << 8) | p[2]);
+    }
+    if (i < count) {
+        const unsigned char *p = src + i / 2 * 3;
+        dst[i] = (unsigned short)((p[0] << 4) | (p[1] >> 4));
+    }
+}
@@ -0,0 +1,23 @@
+//
+// SampleConvert.h
+//
+// Converters from non native TIFF sample layouts into host order 16-bit
+// samples. The best SIMD path (AVX2, SSSE3, SSE2) is picked at run time, the
+// scalar versions handle the tails and CPUs without the extensions.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SAMPLECONVERT_H
+#define SAMPLECONVERT_H
+
+// Swaps the bytes of count 16-bit samples in place (big endian files).
+extern void swapSamples16(unsigned short *samples, size_t count);
+
+// Unpacks count 12-bit samples, stored MSB first with two samples in three
+// bytes as TIFF does with BitsPerSample=12, into 16-bit samples (0..4095).
+extern void unpackSamples12(const unsigned char *src, unsigned short *dst, size_t count);
+
+// Number of bytes a row of count packed 12-bit samples occupies
+#define PACKED12_ROW_BYTES(count) (((count) * 12 + 7) / 8)
+
+#endif
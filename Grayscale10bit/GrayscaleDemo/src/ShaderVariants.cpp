@@ -0,0 +1,155 @@
+//
+// ShaderVariants.cpp
+//
+// Shader permutations built from preprocessor defines, cached by key
+//
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <GL\glew.h>
+#include <GL\gl.h>
+#include "ImagePyramid.h"
+#include "ShaderVariants.h"
+#include "DisplayProgram.h"
+#include "PboUploader.h"
+#include "VirtualTexture.h"
+#include "DitherNoise.h"
+
+static const GLcharARB shaderHeader[] =
+"#version 120                                   \n"
+"#extension GL_EXT_gpu_shader4 : enable         \n"; // Need gpu_shader 4 for unsigned int support in the shader
+
+static void printShaderLog(GLhandleARB object)
+{
+    int maxLength = 0;
+    glGetObjectParameterivARB(object, GL_OBJECT_INFO_LOG_LENGTH_ARB, &maxLength);
+    if (maxLength <= 0)
+        return;
+
+    char *infoLog = new char[maxLength];
+    glGetInfoLogARB(object, maxLength, &maxLength, infoLog);
+    printf("%s\n", infoLog);
+    delete[] infoLog;
+}
+
+static bool validShaderKey(unsigned int key)
+{
+    // one quantization at a time
+    return (key & (SHADER_QUANTIZE_8BIT | SHADER_QUANTIZE_10BIT)) != (SHADER_QUANTIZE_8BIT | SHADER_QUANTIZE_10BIT);
+}
+
+static GLhandleARB compileVariant(const GLcharARB *source, unsigned int key)
+{
+    char defines[512];
+    const GLcharARB *sources[3];
+    GLint compiled = 0, linked = 0;
+    unsigned int dither = (key & SHADER_DITHER_MASK) / SHADER_DITHER_ORDERED;
+    // Dithering without a quantization is for the 8 bits of a normal framebuffer
+    int quantizeBits = (key & SHADER_QUANTIZE_8BIT) ? 8 : (key & SHADER_QUANTIZE_10BIT) ? 10 : dither ? 8 : 0;
+
+    sprintf(defines,
+        "#define FILTER_BILINEAR %d\n"
+        "#define INPUT_BITS %d\n"
+        "#define LUT_BYPASS %d\n"
+        "#define QUANTIZE_BITS %d\n"
+        "#define QUANTIZE_LEVELS %d.0\n"
+        "#define VIRTUAL_TEXTURE %d\n"
+        "#define PAGE_SHIFT %d\n"
+        "#define PAGE_SIZE %d\n"
+        "#define PAGE_SLOT %d\n"
+        "#define DITHER %u\n"
+        "#define DITHER_SIZE %d.0\n",
+        (key & SHADER_FILTER_BILINEAR) ? 1 : 0, (key & SHADER_INPUT_16BIT) ? 16 : 12,
+        (key & SHADER_LUT_BYPASS) ? 1 : 0, quantizeBits, (1 << quantizeBits) - 1,
+        (key & SHADER_VIRTUAL_TEXTURE) ? 1 : 0, VT_PAGE_SHIFT, VT_PAGE_SIZE, VT_SLOT_SIZE,
+        dither, (dither == 1) ? DITHER_BAYER_SIZE : DITHER_NOISE_SIZE);
+    sources[0] = shaderHeader;
+    sources[1] = defines;
+    sources[2] = source;
+
+    GLhandleARB object = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
+    glShaderSourceARB(object, 3, sources, NULL);
+    glCompileShaderARB(object);
+    glGetObjectParameterivARB(object, GL_OBJECT_COMPILE_STATUS_ARB, &compiled);
+    if (!compiled) {
+        printf("Shader variant 0x%02x does not compile:\n", key);
+        printShaderLog(object);
+        glDeleteObjectARB(object);
+        return NULL;
+    }
+    GLhandleARB program = glCreateProgramObjectARB();
+    glAttachObjectARB(program, object);
+    // Flagged for deletion, freed with the program
+    glDeleteObjectARB(object);
+    glLinkProgramARB(program);
+    glGetObjectParameterivARB(program, GL_OBJECT_LINK_STATUS_ARB, &linked);
+    if (!linked) {
+        printf("Shader variant 0x%02x does not link:\n", key);
+        printShaderLog(program);
+        glDeleteObjectARB(program);
+        return NULL;
+    }
+    return program;
+}
+
+void initShaderCache(ShaderCache *cache, const GLcharARB *source)
+{
+    memset(cache, 0, sizeof(ShaderCache));
+    cache->source = source;
+}
+
+ShaderVariant *getShaderVariant(ShaderCache *cache, unsigned int key)
+{
+    ShaderVariant *variant;
+
+    if (key >= SHADER_VARIANT_COUNT || !validShaderKey(key))
+        return NULL;
+    variant = &cache->variants[key];
+    if (variant->program)
+        return variant;
+
+    variant->program = compileVariant(cache->source, key);
+    if (!variant->program)
+        return NULL;
+    cache->numCompiled++;
+    variant->textureSizeLocation = glGetUniformLocationARB(variant->program, "textureSize");
+    variant->lutOffsetLocation = glGetUniformLocationARB(variant->program, "lutOffset");
+    variant->lutScaleLocation = glGetUniformLocationARB(variant->program, "lutScale");
+    variant->ditherOffsetLocation = glGetUniformLocationARB(variant->program, "ditherOffset");
+    // The shader defaults
+    variant->lutOffset = 0.0f;
+    variant->lutScale = 1.0f;
+
+    glUseProgramObjectARB(variant->program);
+    //Attach texunit#0 to Image, texunit#1 to LUT, texunit#2 to the page table and texunit#3 to the dither tile
+    glUniform1iARB(glGetUniformLocationARB(variant->program, "image"), 0);
+    glUniform1iARB(glGetUniformLocationARB(variant->program, "lut"), 1);
+    if (key & SHADER_VIRTUAL_TEXTURE)
+        glUniform1iARB(glGetUniformLocationARB(variant->program, "pageTable"), 2);
+    if (key & SHADER_DITHER_MASK)
+        glUniform1iARB(glGetUniformLocationARB(variant->program, "ditherNoise"), 3);
+    return variant;
+}
+
+bool compileShaderVariants(ShaderCache *cache)
+{
+    unsigned int key;
+    bool ok = true;
+
+    for (key = 0; key < SHADER_VARIANT_COUNT; key++) {
+        if (validShaderKey(key) && !getShaderVariant(cache, key))
+            ok = false;
+    }
+    return ok;
+}
+
+void deleteShaderCache(ShaderCache *cache)
+{
+    unsigned int key;
+
+    for (key = 0; key < SHADER_VARIANT_COUNT; key++) {
+        if (cache->variants[key].program)
+            glDeleteObjectARB(cache->variants[key].program);
+    }
+    memset(cache, 0, sizeof(ShaderCache));
+}
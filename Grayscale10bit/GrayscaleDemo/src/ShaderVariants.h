@@ -0,0 +1,58 @@
+//
+// ShaderVariants.h
+//
+// Specialized builds of the image fragment shader. Every mode (filter, input
+// bit depth, LUT or gray ramp, output quantization) is a preprocessor define
+// instead of a uniform branch, and the compiled programs are kept by key, so
+// switching modes only binds another program.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SHADERVARIANTS_H
+#define SHADERVARIANTS_H
+
+// Variant key bits
+#define SHADER_FILTER_BILINEAR  0x01    // else nearest texel
+#define SHADER_INPUT_16BIT      0x02    // else the low 12 bits are used
+#define SHADER_LUT_BYPASS       0x04    // gray ramp, else the lookup table
+#define SHADER_QUANTIZE_8BIT    0x08    // round the output to 8 bits
+#define SHADER_QUANTIZE_10BIT   0x10    // round the output to 10 bits
+#define SHADER_VIRTUAL_TEXTURE  0x20    // texels through the page table of a VirtualTexture
+#define SHADER_DITHER_ORDERED   0x40    // dither the quantization (8-bit if not set) with a Bayer matrix
+#define SHADER_DITHER_BLUE_NOISE 0x80   // ... with the blue noise tile
+#define SHADER_DITHER_TEMPORAL  0xC0    // ... with the blue noise tile moved every frame
+#define SHADER_DITHER_MASK      0xC0
+#define SHADER_VARIANT_COUNT    0x100
+
+typedef struct _ShaderVariant {
+    GLhandleARB program;            // NULL until compiled
+    GLint textureSizeLocation;
+    GLint lutOffsetLocation;
+    GLint lutScaleLocation;
+    GLint ditherOffsetLocation;
+    // Uniform values last set in the program
+    GLfloat textureWidth;
+    GLfloat textureHeight;
+    GLfloat lutOffset;
+    GLfloat lutScale;
+    GLfloat ditherOffsetX;
+    GLfloat ditherOffsetY;
+} ShaderVariant;
+
+typedef struct _ShaderCache {
+    const GLcharARB *source;        // shader without the #version line
+    ShaderVariant variants[SHADER_VARIANT_COUNT];
+    unsigned int numCompiled;
+} ShaderCache;
+
+extern void initShaderCache(ShaderCache *cache, const GLcharARB *source);
+// Returns the program for key, compiling it the first time. The samplers are
+// set to texture units 0 (image), 1 (lut), 2 (page table) and 3 (dither
+// thresholds); the program is left bound.
+// Returns NULL if it does not compile, the info log is printed.
+extern ShaderVariant *getShaderVariant(ShaderCache *cache, unsigned int key);
+// Compiles all valid variants up front. Returns false if one failed.
+extern bool compileShaderVariants(ShaderCache *cache);
+extern void deleteShaderCache(ShaderCache *cache);
+
+#endif
@@ -4,137 +4,544 @@
 // tiff file read function
 //
 #include <windows.h>
+#include <stdio.h>
 #include "tiffio.h"
 #include <GL/gl.h>
+#include "ImageBuffer.h"
+#include "TiffLoader.h"
+#include "SampleConvert.h"
+
+#define TIFF_VERSION_BIG 43
+
+// BigTIFF field types not known to libtiff 3.8
+#define BIGTIFF_LONG8   16
+#define BIGTIFF_IFD8    18
 
 //
-// readTiff
-// 
-// Wrapper function for the tifflib library to read in data of a tiff image
-// with the given name. The data is transfered to the given pixel container
-// (which is alloced internally and needs to be freed by the user) and all
-// handles to the tiff file are closed.
-// return 0 in error case, 1 in success;
+// unpackStripRows12
 //
-int readTiff(char *imageName, GLuint *pWidth, GLuint *pHeight, GLuint *pBpp, GLuint *pMinValue, GLuint *pMaxValue, GLuint *pNumValues, char** pixels) 
+// Strips of 12-bit images hold rows of packed samples, each row starts on a
+// byte boundary. Unpacks up to numRows rows into the 16-bit image rows
+// starting at firstRow and returns the number of rows unpacked.
+//
+static unsigned __int64 unpackStripRows12(const unsigned char *strip, unsigned __int64 stripBytes,
+    char *image, unsigned __int64 width, unsigned __int64 firstRow, unsigned __int64 numRows)
+{
+    unsigned __int64 rowBytes = PACKED12_ROW_BYTES(width);
+    unsigned __int64 rows = stripBytes / rowBytes;
+    unsigned __int64 row;
+
+    if (rows > numRows)
+        rows = numRows;
+    for (row = 0; row < rows; row++) {
+        unpackSamples12(strip + row * rowBytes,
+            (unsigned short *)image + (firstRow + row) * width, (size_t)width);
+    }
+    return rows;
+}
+
+// Forwards strip progress to the caller, returns false if the load should stop
+static bool reportProgress(TiffProgressProc progress, void *userData, const ImageBuffer *buffer,
+    unsigned __int64 width, unsigned __int64 height, unsigned __int64 rowsDone)
+{
+    if (!progress)
+        return true;
+    if (progress(userData, (const unsigned short *)buffer->data, (GLuint)width, (GLuint)height, (GLuint)rowsDone))
+        return true;
+    fprintf(stderr, "Image load cancelled\n");
+    return false;
+}
+
+//
+// BigTIFF support
+//
+// libtiff 3.8 only knows classic TIFF with 32-bit offsets. BigTIFF files use
+// 64-bit offsets and counts throughout, so their directory is parsed here and
+// the strips are read directly. Only uncompressed strips are supported, which
+// is what detectors and scanners write for the huge images.
+//
+typedef struct _BigTiffFile {
+    HANDLE file;
+    bool swap;                      // file is big endian ("MM")
+} BigTiffFile;
+
+static bool bigTiffRead(BigTiffFile *tif, unsigned __int64 offset, void *dst, unsigned __int64 size)
+{
+    LARGE_INTEGER pos;
+    char *p = (char *)dst;
+
+    pos.QuadPart = (LONGLONG)offset;
+    if (!SetFilePointerEx(tif->file, pos, NULL, FILE_BEGIN))
+        return false;
+    // ReadFile takes 32-bit sizes, read in 1 GB pieces
+    while (size) {
+        DWORD chunk = size > (1 << 30) ? (1 << 30) : (DWORD)size;
+        DWORD got = 0;
+        if (!ReadFile(tif->file, p, chunk, &got, NULL) || got != chunk)
+            return false;
+        p += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+static unsigned __int64 bigTiffValue(const BigTiffFile *tif, const unsigned char *bytes, int size)
+{
+    unsigned __int64 value = 0;
+    int i;
+
+    if (tif->swap) {
+        for (i = 0; i < size; i++)
+            value = (value << 8) | bytes[i];
+    } else {
+        for (i = size - 1; i >= 0; i--)
+            value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+static int bigTiffTypeSize(unsigned int type)
+{
+    switch (type) {
+    case TIFF_BYTE: case TIFF_ASCII: case TIFF_SBYTE: case TIFF_UNDEFINED:
+        return 1;
+    case TIFF_SHORT: case TIFF_SSHORT:
+        return 2;
+    case TIFF_LONG: case TIFF_SLONG: case TIFF_FLOAT: case TIFF_IFD:
+        return 4;
+    case TIFF_RATIONAL: case TIFF_SRATIONAL: case TIFF_DOUBLE: case BIGTIFF_LONG8: case BIGTIFF_IFD8:
+        return 8;
+    }
+    return 0;
+}
+
+//
+// bigTiffReadArray
+//
+// Reads the integer values of a 20 byte BigTIFF directory entry. Values are
+// stored inline if they fit into the 8 byte value field. The returned array
+// is malloced and needs to be freed by the caller.
+//
+static unsigned __int64 *bigTiffReadArray(BigTiffFile *tif, const unsigned char *entry, unsigned __int64 *pCount)
+{
+    unsigned int type = (unsigned int)bigTiffValue(tif, entry + 2, 2);
+    unsigned __int64 count = bigTiffValue(tif, entry + 4, 8);
+    int typeSize = bigTiffTypeSize(type);
+    unsigned char *raw;
+    unsigned __int64 *values;
+    unsigned __int64 i;
+
+    if ((type != TIFF_SHORT && type != TIFF_LONG && type != BIGTIFF_LONG8) || count == 0 ||
+        count * typeSize > (unsigned __int64)((SIZE_T)-1 / 8))
+        return NULL;
+
+    values = (unsigned __int64 *)malloc((size_t)count * sizeof(unsigned __int64));
+    raw = (unsigned char *)malloc((size_t)(count * typeSize));
+    if (!values || !raw) {
+        free(values);
+        free(raw);
+        return NULL;
+    }
+    if (count * typeSize <= 8) {
+        memcpy(raw, entry + 12, (size_t)(count * typeSize));
+    } else if (!bigTiffRead(tif, bigTiffValue(tif, entry + 12, 8), raw, count * typeSize)) {
+        free(values);
+        free(raw);
+        return NULL;
+    }
+    for (i = 0; i < count; i++)
+        values[i] = bigTiffValue(tif, raw + i * typeSize, typeSize);
+    free(raw);
+
+    *pCount = count;
+    return values;
+}
+
+static int readBigTiff(char *imageName, ImageBuffer *buffer, GLuint *pWidth, GLuint *pHeight, GLuint *pBpp,
+    TiffProgressProc progress, void *userData)
 {
     int iRet = 0;
-    TIFF *image;
-    uint16 bps;
-    tsize_t stripSize;
-    unsigned long imageOffset, result;
-    int stripMax, stripCount;
-    char *buffer;
-    unsigned long bufferSize;
+    BigTiffFile tif;
+    unsigned char header[16];
+    unsigned char *entries = NULL;
+    unsigned __int64 *stripOffsets = NULL, *stripByteCounts = NULL;
+    unsigned __int64 numOffsets = 0, numByteCounts = 0;
+    unsigned __int64 numEntries, i, imageSize, imageOffset, dirOffset;
+    unsigned char countBytes[8];
+    unsigned __int64 width = 0, height = 0, bps = 1, spp = 1, compression = COMPRESSION_NONE;
+    unsigned __int64 rowsPerStrip = 0, row;
+    unsigned char *stripBuffer = NULL;
 
-    // Check input variables.
-    if (!imageName || !pHeight || !pHeight || !pBpp || !pixels) {
-        fprintf(stderr, "Imput variable pointers are zero\n");
+    tif.file = CreateFile(imageName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (tif.file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Could not open incoming image\n");
+        return 0;
+    }
+    tif.swap = false;
+    if (!bigTiffRead(&tif, 0, header, sizeof(header))) {
+        fprintf(stderr, "Could not read BigTIFF header\n");
+        goto Exit;
+    }
+    tif.swap = (header[0] == 'M');
+    // Bytesize of offsets must be 8, followed by a zero word
+    if (bigTiffValue(&tif, header + 4, 2) != 8 || bigTiffValue(&tif, header + 6, 2) != 0) {
+        fprintf(stderr, "Unsupported BigTIFF offset size\n");
         goto Exit;
     }
 
-    // Open the TIFF image
-    if((image = TIFFOpen(imageName, "r")) == NULL){
-        fprintf(stderr, "Could not open incoming image\n");
+    // First directory: 8 byte entry count, 20 byte entries
+    dirOffset = bigTiffValue(&tif, header + 8, 8);
+    if (!bigTiffRead(&tif, dirOffset, countBytes, 8)) {
+        fprintf(stderr, "Could not read BigTIFF directory\n");
         goto Exit;
     }
-    // Check that it is of a type that we support
-    if((TIFFGetField(image, TIFFTAG_BITSPERSAMPLE, &bps) == 0) || (bps != 16)){
+    numEntries = bigTiffValue(&tif, countBytes, 8);
+    if (numEntries == 0 || numEntries > 4096 ||
+        (entries = (unsigned char *)malloc((size_t)numEntries * 20)) == NULL ||
+        !bigTiffRead(&tif, dirOffset + 8, entries, numEntries * 20)) {
+        fprintf(stderr, "Could not read BigTIFF directory\n");
+        goto Exit;
+    }
+    for (i = 0; i < numEntries; i++) {
+        const unsigned char *entry = entries + i * 20;
+        unsigned int tag = (unsigned int)bigTiffValue(&tif, entry, 2);
+        unsigned int type = (unsigned int)bigTiffValue(&tif, entry + 2, 2);
+        int typeSize = bigTiffTypeSize(type);
+        // First value of a scalar entry, always stored inline
+        unsigned __int64 value = (typeSize > 0 && typeSize <= 8) ? bigTiffValue(&tif, entry + 12, typeSize) : 0;
+
+        switch (tag) {
+        case TIFFTAG_IMAGEWIDTH:        width = value; break;
+        case TIFFTAG_IMAGELENGTH:       height = value; break;
+        case TIFFTAG_BITSPERSAMPLE:     bps = value; break;
+        case TIFFTAG_SAMPLESPERPIXEL:   spp = value; break;
+        case TIFFTAG_COMPRESSION:       compression = value; break;
+        case TIFFTAG_ROWSPERSTRIP:      rowsPerStrip = value; break;
+        case TIFFTAG_STRIPOFFSETS:
+            stripOffsets = bigTiffReadArray(&tif, entry, &numOffsets);
+            break;
+        case TIFFTAG_STRIPBYTECOUNTS:
+            stripByteCounts = bigTiffReadArray(&tif, entry, &numByteCounts);
+            break;
+        }
+    }
+
+    if ((bps != 16 && bps != 12) || spp != 1) {
         fprintf(stderr, "Either undefined or unsupported number of bits per sample\n");
         goto Exit;
     }
-    // We only support 1 pixelrow per strip
-    stripSize = TIFFStripSize (image);
-    stripMax = TIFFNumberOfStrips (image);
-    imageOffset = 0;
-    bufferSize = TIFFNumberOfStrips (image) * stripSize;
-    if((buffer = (char *) malloc(bufferSize)) == NULL) {
-        fprintf(stderr, "Could not allocate enough memory for the uncompressed image\n");
+    if (compression != COMPRESSION_NONE) {
+        fprintf(stderr, "Only uncompressed BigTIFF images are supported\n");
+        goto Exit;
+    }
+    if (width == 0 || height == 0 || width > 0xFFFFFFFF || height > 0xFFFFFFFF) {
+        fprintf(stderr, "Image does not define a valid size\n");
+        goto Exit;
+    }
+    if (!stripOffsets || !stripByteCounts || numOffsets != numByteCounts) {
+        fprintf(stderr, "Image does not define its strips\n");
+        goto Exit;
+    }
+
+    if (rowsPerStrip == 0 || rowsPerStrip > height)
+        rowsPerStrip = height;
+
+    if (width > (unsigned __int64)-1 / 2 / height) {
+        fprintf(stderr, "Image is too large to load\n");
         goto Exit;
     }
-    for (stripCount = 0; stripCount < stripMax; stripCount++) {
-        if((result = TIFFReadEncodedStrip (image, stripCount,
-            buffer + imageOffset,
-            stripSize)) == -1){
-            fprintf(stderr, "Read error on input strip number %d\n", stripCount);
-            goto Exit;;
+    imageSize = width * height * 2;
+    if (!reserveImageBuffer(buffer, imageSize))
+        goto Exit;
+    if (!reportProgress(progress, userData, buffer, width, height, 0))
+        goto Exit;
+    if (bps == 16) {
+        // Samples are read in place and swapped strip by strip while the
+        // strip is still in the cache
+        imageOffset = 0;
+        for (i = 0; i < numOffsets && imageOffset < imageSize; i++) {
+            unsigned __int64 size = stripByteCounts[i] & ~(unsigned __int64)1;
+            if (size > imageSize - imageOffset)
+                size = imageSize - imageOffset;
+            if (!commitImageBuffer(buffer, imageOffset + size) ||
+                !bigTiffRead(&tif, stripOffsets[i], buffer->data + imageOffset, size)) {
+                fprintf(stderr, "Read error on input strip number %I64u\n", i);
+                goto Exit;
+            }
+            if (tif.swap)
+                swapSamples16((unsigned short *)(buffer->data + imageOffset), (size_t)(size / 2));
+            imageOffset += size;
+            if (!reportProgress(progress, userData, buffer, width, height, imageOffset / (width * 2)))
+                goto Exit;
+        }
+        row = imageOffset / (width * 2);
+    } else {
+        // 12-bit strips are read into a scratch buffer and unpacked row by row
+        unsigned __int64 stripBytes = rowsPerStrip * PACKED12_ROW_BYTES(width);
+        if (stripBytes > (SIZE_T)-1 || (stripBuffer = (unsigned char *)malloc((size_t)stripBytes)) == NULL) {
+            fprintf(stderr, "Could not allocate the strip buffer\n");
+            goto Exit;
+        }
+        row = 0;
+        for (i = 0; i < numOffsets && row < height; i++) {
+            unsigned __int64 size = stripByteCounts[i] < stripBytes ? stripByteCounts[i] : stripBytes;
+            if (!commitImageBuffer(buffer, (row + rowsPerStrip < height ? row + rowsPerStrip : height) * width * 2) ||
+                !bigTiffRead(&tif, stripOffsets[i], stripBuffer, size)) {
+                fprintf(stderr, "Read error on input strip number %I64u\n", i);
+                goto Exit;
+            }
+            row += unpackStripRows12(stripBuffer, size, buffer->data, width, row, height - row);
+            if (!reportProgress(progress, userData, buffer, width, height, row))
+                goto Exit;
         }
-        imageOffset += result;
     }
+    if (row != height) {
+        fprintf(stderr, "Image strips do not cover the image\n");
+        goto Exit;
+    }
+
+    *pWidth = (GLuint)width;
+    *pHeight = (GLuint)height;
+    *pBpp = (GLuint)bps;
+    iRet = 1;
+
+Exit:;
+    free(stripBuffer);
+    free(entries);
+    free(stripOffsets);
+    free(stripByteCounts);
+    CloseHandle(tif.file);
+    return iRet;
+}
 
+static int readClassicTiff(char *imageName, ImageBuffer *buffer, GLuint *pWidth, GLuint *pHeight, GLuint *pBpp,
+    TiffProgressProc progress, void *userData)
+{
+    int iRet = 0;
+    TIFF *image;
+    uint16 bps, compression;
+    uint32 width, height, rowsPerStrip;
+    tsize_t stripSize, result;
+    unsigned __int64 imageSize, imageOffset, row;
+    tstrip_t stripMax, stripCount;
+    unsigned char *stripBuffer = NULL;
+
+    // Open the TIFF image
+    if((image = TIFFOpen(imageName, "r")) == NULL){
+        fprintf(stderr, "Could not open incoming image\n");
+        return 0;
+    }
+    // Check that it is of a type that we support
+    if((TIFFGetField(image, TIFFTAG_BITSPERSAMPLE, &bps) == 0) || (bps != 16 && bps != 12)){
+        fprintf(stderr, "Either undefined or unsupported number of bits per sample\n");
+        goto Exit;
+    }
     // Retrieve needed image parameter
-    if(TIFFGetField(image, TIFFTAG_IMAGEWIDTH, pWidth) == 0) {
+    if(TIFFGetField(image, TIFFTAG_IMAGEWIDTH, &width) == 0) {
         fprintf(stderr, "Image does not define its width\n");
         goto Exit;
     }
     // imageheight
-    if(TIFFGetField(image, TIFFTAG_IMAGELENGTH, pHeight) == 0) {
-        fprintf(stderr, "Image does not define its width\n");
+    if(TIFFGetField(image, TIFFTAG_IMAGELENGTH, &height) == 0) {
+        fprintf(stderr, "Image does not define its height\n");
         goto Exit;
     }
-    if(TIFFGetField(image, TIFFTAG_BITSPERSAMPLE, pBpp) == 0) {
-        fprintf(stderr, "Either undefined or unsupported number of bits per sample\n");
+    TIFFGetFieldDefaulted(image, TIFFTAG_COMPRESSION, &compression);
+    TIFFGetFieldDefaulted(image, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+    if (rowsPerStrip == 0 || rowsPerStrip > height)
+        rowsPerStrip = height;
+
+    // The decoded image can be larger than the file, so all sizes are 64-bit
+    stripSize = TIFFStripSize (image);
+    stripMax = TIFFNumberOfStrips (image);
+    if (width == 0 || height == 0 || width > (unsigned __int64)-1 / 2 / height) {
+        fprintf(stderr, "Image does not define a valid size\n");
+        goto Exit;
+    }
+    imageSize = (unsigned __int64)width * height * 2;
+    if (!reserveImageBuffer(buffer, imageSize)) {
+        fprintf(stderr, "Could not allocate enough memory for the uncompressed image\n");
+        goto Exit;
+    }
+    if (!reportProgress(progress, userData, buffer, width, height, 0))
+        goto Exit;
+    if (bps == 16) {
+        // libtiff swaps big endian samples one at a time after decoding. For
+        // uncompressed strips read the raw data and swap it with SIMD instead.
+        int rawSwap = (compression == COMPRESSION_NONE) && TIFFIsByteSwapped(image);
+        imageOffset = 0;
+        for (stripCount = 0; stripCount < stripMax && imageOffset < imageSize; stripCount++) {
+            tsize_t size = stripSize;
+            if ((unsigned __int64)size > imageSize - imageOffset)
+                size = (tsize_t)(imageSize - imageOffset);
+            if (!commitImageBuffer(buffer, imageOffset + size)) {
+                fprintf(stderr, "Could not allocate enough memory for the uncompressed image\n");
+                goto Exit;
+            }
+            if (rawSwap)
+                result = TIFFReadRawStrip (image, stripCount, buffer->data + imageOffset, size);
+            else
+                result = TIFFReadEncodedStrip (image, stripCount, buffer->data + imageOffset, size);
+            if (result == -1) {
+                fprintf(stderr, "Read error on input strip number %d\n", stripCount);
+                goto Exit;
+            }
+            if (rawSwap)
+                swapSamples16((unsigned short *)(buffer->data + imageOffset), result / 2);
+            imageOffset += result;
+            if (!reportProgress(progress, userData, buffer, width, height, imageOffset / ((unsigned __int64)width * 2)))
+                goto Exit;
+        }
+        row = imageOffset / ((unsigned __int64)width * 2);
+    } else {
+        // 12-bit: decode each strip into a scratch buffer and unpack its rows
+        if ((stripBuffer = (unsigned char *)malloc(stripSize)) == NULL) {
+            fprintf(stderr, "Could not allocate the strip buffer\n");
+            goto Exit;
+        }
+        row = 0;
+        for (stripCount = 0; stripCount < stripMax && row < height; stripCount++) {
+            if (!commitImageBuffer(buffer, (row + rowsPerStrip < height ? row + rowsPerStrip : height) * width * 2)) {
+                fprintf(stderr, "Could not allocate enough memory for the uncompressed image\n");
+                goto Exit;
+            }
+            if ((result = TIFFReadEncodedStrip (image, stripCount, stripBuffer, stripSize)) == -1) {
+                fprintf(stderr, "Read error on input strip number %d\n", stripCount);
+                goto Exit;
+            }
+            row += unpackStripRows12(stripBuffer, result, buffer->data, width, row, height - row);
+            if (!reportProgress(progress, userData, buffer, width, height, row))
+                goto Exit;
+        }
+    }
+    if (row != height) {
+        fprintf(stderr, "Image strips do not cover the image\n");
         goto Exit;
     }
-    *pixels = buffer;
 
+    *pWidth = width;
+    *pHeight = height;
+    *pBpp = bps;
+    iRet = 1;
 
-    // Helper function to find out real image bits range (should be 12 bit 0--4095)
-    if (1)
-    {
-        #define MAX_VALUE 65536
+Exit:;
+    // Close image handle in any case. We've red out all we needed.
+    free(stripBuffer);
+    TIFFClose(image);
+    return iRet;
+}
 
-        unsigned int table[MAX_VALUE];
-        uint16 minv = MAX_VALUE-1;
-        uint16 maxv = 0;
-        unsigned int x,y;
-        uint16 value;
-        int count = 0;
+//
+// getImageStats
+//
+// Helper function to find out real image bits range (should be 12 bit 0--4095)
+//
+void getImageStats(const unsigned short *pixels, unsigned __int64 numPixels, GLuint *pMinValue, GLuint *pMaxValue, GLuint *pNumValues)
+{
+    #define MAX_VALUE 65536
 
-        memset(table, 0, sizeof(table));       // zero out structure
+    // Only whether a value occurs is needed, a flag per value keeps the
+    // table small enough for the stack of each thread calling
+    unsigned char used[MAX_VALUE];
+    unsigned short minv = MAX_VALUE-1;
+    unsigned short maxv = 0;
+    unsigned short value;
+    unsigned __int64 i;
+    int count = 0;
 
-        for (y = 0; y < *pHeight; y++) {
-            for (x = 0; x < *pWidth; x++) {
+    memset(used, 0, sizeof(used));       // zero out structure
 
-                value = ((uint16*)buffer)[y* (*pWidth) +x];
+    for (i = 0; i < numPixels; i++) {
+        value = pixels[i];
 
-                table[value]++;
+        used[value] = 1;
 
-                if (value > maxv) {
-                    maxv = value;
-                }
-                if (value < minv) {
-                    minv = value;
-                }
-            }
+        if (value > maxv) {
+            maxv = value;
         }
-
-        // check for number of values used:
-        for (y = 0; y < MAX_VALUE; y++) {
-            if (table[y]) {
-                count++;
-            }
+        if (value < minv) {
+            minv = value;
         }
+    }
 
-        if (pMinValue)
-            *pMinValue = minv;
-        if (pMaxValue)
-            *pMaxValue = maxv;
-        if (pNumValues)
-            *pNumValues = count;
+    // check for number of values used:
+    for (i = 0; i < MAX_VALUE; i++) {
+        count += used[i];
+    }
+
+    if (pMinValue)
+        *pMinValue = minv;
+    if (pMaxValue)
+        *pMaxValue = maxv;
+    if (pNumValues)
+        *pNumValues = count;
+}
+
+//
+// readTiff
+//
+// Wrapper function for the tifflib library to read in data of a tiff image
+// with the given name. The data is transfered to the given pixel container
+// (which is alloced internally and needs to be freed by the user with
+// freeImagePixels) and all handles to the tiff file are closed.
+// BigTIFF files are detected by their header and read without libtiff.
+// 12-bit packed and big endian 16-bit samples are converted to host order
+// 16-bit samples during the strip decode.
+// If progress is given it is called once the image size is known and after
+// every strip, which lets a caller on another thread display partial images.
+// return 0 in error case, 1 in success;
+//
+int readTiff(char *imageName, GLuint *pWidth, GLuint *pHeight, GLuint *pBpp, GLuint *pMinValue, GLuint *pMaxValue, GLuint *pNumValues, char** pixels,
+    TiffProgressProc progress, void *userData)
+{
+    int iRet = 0;
+    ImageBuffer buffer;
+    unsigned char header[4];
+    FILE *file;
+
+    buffer.data = NULL;
+
+    // Check input variables.
+    if (!imageName || !pWidth || !pHeight || !pBpp || !pixels) {
+        fprintf(stderr, "Imput variable pointers are zero\n");
+        goto Exit;
+    }
+
+    // Peek at the header to tell classic TIFF (42) from BigTIFF (43)
+    if ((file = fopen(imageName, "rb")) == NULL) {
+        fprintf(stderr, "Could not open incoming image\n");
+        goto Exit;
+    }
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)) {
+        fclose(file);
+        fprintf(stderr, "Could not read incoming image\n");
+        goto Exit;
     }
+    fclose(file);
+
+    if ((header[0] == 'I' && header[2] == TIFF_VERSION_BIG && header[3] == 0) ||
+        (header[0] == 'M' && header[2] == 0 && header[3] == TIFF_VERSION_BIG)) {
+        if (!readBigTiff(imageName, &buffer, pWidth, pHeight, pBpp, progress, userData))
+            goto Exit;
+    } else {
+        if (!readClassicTiff(imageName, &buffer, pWidth, pHeight, pBpp, progress, userData))
+            goto Exit;
+    }
+    *pixels = buffer.data;
+
+    getImageStats((unsigned short *)buffer.data, (unsigned __int64)*pWidth * *pHeight,
+        pMinValue, pMaxValue, pNumValues);
 
     iRet = 1;
 
 Exit:;
 
-    // Close image handle in any case. We've red out all we needed.
-    if (image)
-        TIFFClose(image);
-
     if (1 != iRet) {
-        if (buffer)
-            free(buffer);
+        // Tell the caller the partial image is going away
+        if (progress)
+            progress(userData, NULL, 0, 0, 0);
+        freeImagePixels(buffer.data);
         if (pWidth)
             *pWidth = 0;
         if (pHeight)
@@ -0,0 +1,26 @@
+//
+// TiffLoader.h
+//
+// tiff file read functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TIFFLOADER_H
+#define TIFFLOADER_H
+
+// Called by readTiff once the image size is known (rowsDone 0) and after every
+// decoded strip. Rows [0, rowsDone) of pixels are final. Return false to abort.
+// If the load fails it is called with NULL pixels before the buffer is released.
+typedef bool (*TiffProgressProc)(void *userData, const unsigned short *pixels, GLuint width, GLuint height, GLuint rowsDone);
+
+// Reads a 12 or 16-bit single channel tiff (classic or BigTIFF) into 16-bit
+// host order pixels, which must be released with freeImagePixels().
+// pBpp receives the bits per sample of the file.
+// Returns 0 in error case, 1 in success.
+extern int readTiff(char *imageName, GLuint *pWidth, GLuint *pHeight, GLuint *pBpp, GLuint *pMinValue, GLuint *pMaxValue, GLuint *pNumValues, char** pixels,
+    TiffProgressProc progress = NULL, void *userData = NULL);
+
+// Finds the range and the number of distinct values of 16-bit image data.
+extern void getImageStats(const unsigned short *pixels, unsigned __int64 numPixels, GLuint *pMinValue, GLuint *pMaxValue, GLuint *pNumValues);
+
+#endif
@@ -0,0 +1,222 @@
+//
+// TiledImage.cpp
+//
+// Tiled texture storage for images larger than the maximum texture size
+//
+#include <windows.h>
+#include <stdio.h>
+#include <math.h>
+#include <GL\glew.h>
+#include <GL\gl.h>
+#include "ShaderVariants.h"
+#include "PboUploader.h"
+#include "DisplayProgram.h"
+#include "TiledImage.h"
+
+// Tiles overlap by one texel, so tiles advance by tileSize-1 texels
+static GLuint tileCount(GLuint size, GLuint tileSize)
+{
+    if (size <= tileSize)
+        return 1;
+    return 1 + (size - tileSize + tileSize - 2) / (tileSize - 1);
+}
+
+// First texel and texture size of tile i along one axis
+static void tileExtent(GLuint i, GLuint size, GLuint tileSize, GLuint *pStart, GLuint *pSize)
+{
+    GLuint start = i * (tileSize - 1);
+    *pStart = start;
+    *pSize = (size - start < tileSize) ? size - start : tileSize;
+}
+
+// Rows and columns of tile i along one axis without the overlap shared with the next tile
+static GLuint tileCells(GLuint i, GLuint tiles, GLuint size)
+{
+    return (i == tiles - 1) ? size : size - 1;
+}
+
+// Fills the vertex buffer with the quad of every tile. The image is flipped,
+// since the tiff image starts from the top left while GL starts from the
+// bottom left.
+static bool createTileQuads(TiledImage *image)
+{
+    GLuint numTiles = image->tilesX * image->tilesY;
+    DisplayVertex *quads = (DisplayVertex *)malloc(numTiles * 4 * sizeof(DisplayVertex));
+    GLuint tx, ty;
+
+    if (!quads)
+        return false;
+    for (ty = 0; ty < image->tilesY; ty++) {
+        GLuint r0, h, rows;
+        tileExtent(ty, image->height, image->tileSize, &r0, &h);
+        rows = tileCells(ty, image->tilesY, h);
+        for (tx = 0; tx < image->tilesX; tx++) {
+            GLuint c0, w, cols;
+            tileExtent(tx, image->width, image->tileSize, &c0, &w);
+            cols = tileCells(tx, image->tilesX, w);
+
+            DisplayVertex *q = quads + (ty * image->tilesX + tx) * 4;
+            GLfloat xLeft = (GLfloat)c0;
+            GLfloat xRight = (GLfloat)(c0 + cols);
+            GLfloat yTop = (GLfloat)(image->height - r0);
+            GLfloat yBottom = (GLfloat)(image->height - r0 - rows);
+            GLfloat s1 = (GLfloat)cols / w;
+            GLfloat t1 = (GLfloat)rows / h;
+            q[0].s = 0.0f; q[0].t = t1;   q[0].x = xLeft;  q[0].y = yBottom;
+            q[1].s = 0.0f; q[1].t = 0.0f; q[1].x = xLeft;  q[1].y = yTop;
+            q[2].s = s1;   q[2].t = 0.0f; q[2].x = xRight; q[2].y = yTop;
+            q[3].s = s1;   q[3].t = t1;   q[3].x = xRight; q[3].y = yBottom;
+        }
+    }
+    glGenBuffers(1, &image->vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, image->vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, numTiles * 4 * sizeof(DisplayVertex), quads, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    free(quads);
+    return true;
+}
+
+// Window coordinate for the scissor box, clamped far outside the window
+static GLint scissorCoord(GLfloat v)
+{
+    if (v < -16777216.0f)
+        return -16777216;
+    if (v > 16777216.0f)
+        return 16777216;
+    return (GLint)floor(v + 0.5f);
+}
+
+bool createTiledImage(TiledImage *image, GLuint width, GLuint height, GLuint maxTileSize)
+{
+    GLint maxTextureSize = 0;
+    GLuint tx, ty;
+
+    if (maxTileSize == 0) {
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+        maxTileSize = (GLuint)maxTextureSize;
+    }
+    if (maxTileSize < 2 || width == 0 || height == 0)
+        return false;
+
+    image->width = width;
+    image->height = height;
+    image->tileSize = maxTileSize;
+    image->tilesX = tileCount(width, maxTileSize);
+    image->tilesY = tileCount(height, maxTileSize);
+    image->vertexBuffer = 0;
+    image->texIds = (GLuint *)calloc(image->tilesX * image->tilesY, sizeof(GLuint));
+    if (!image->texIds)
+        return false;
+
+    glGenTextures(image->tilesX * image->tilesY, image->texIds);
+    glActiveTexture(GL_TEXTURE0);
+    for (ty = 0; ty < image->tilesY; ty++) {
+        for (tx = 0; tx < image->tilesX; tx++) {
+            GLuint x0, y0, w, h;
+            tileExtent(tx, width, maxTileSize, &x0, &w);
+            tileExtent(ty, height, maxTileSize, &y0, &h);
+
+            glBindTexture(GL_TEXTURE_2D, image->texIds[ty * image->tilesX + tx]);
+            glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            float borderColor[4] = {0.0f,0.0f,0.0f,0.0f};
+            glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA16UI_EXT, w, h, 0, GL_ALPHA_INTEGER_EXT, GL_UNSIGNED_SHORT, NULL);
+        }
+    }
+    if (!createTileQuads(image)) {
+        deleteTiledImage(image);
+        return false;
+    }
+    if (image->tilesX * image->tilesY > 1)
+        printf("Image %ux%u split into %ux%u tiles\n", width, height, image->tilesX, image->tilesY);
+    return true;
+}
+
+void uploadTiledImage(TiledImage *image, PboUploader *uploader, const unsigned short *pixels, GLuint firstRow, GLuint numRows)
+{
+    GLuint tx, ty;
+    GLuint lastRow = firstRow + numRows;
+
+    glActiveTexture(GL_TEXTURE0);
+    for (ty = 0; ty < image->tilesY; ty++) {
+        GLuint y0, h;
+        tileExtent(ty, image->height, image->tileSize, &y0, &h);
+        GLuint r0 = firstRow > y0 ? firstRow : y0;
+        GLuint r1 = lastRow < y0 + h ? lastRow : y0 + h;
+        if (r0 >= r1)
+            continue;
+        for (tx = 0; tx < image->tilesX; tx++) {
+            GLuint x0, w;
+            tileExtent(tx, image->width, image->tileSize, &x0, &w);
+            // 64-bit offset, the image may be larger than 4 GB
+            const unsigned short *src = pixels + (size_t)r0 * image->width + x0;
+            glBindTexture(GL_TEXTURE_2D, image->texIds[ty * image->tilesX + tx]);
+            // Tiles are sub rectangles of the full image rows
+            pboTexSubImage2D(uploader, GL_TEXTURE_2D, 0, r0 - y0, w, r1 - r0, GL_ALPHA_INTEGER_EXT, GL_UNSIGNED_SHORT,
+                sizeof(unsigned short), src, image->width * sizeof(unsigned short));
+        }
+    }
+}
+
+void drawTiledImage(const TiledImage *image, DisplayProgram *display, GLfloat x0, GLfloat y0, GLfloat x1, GLfloat y1,
+                    GLuint firstRow, GLuint lastRow)
+{
+    GLuint tx, ty;
+    GLfloat sx = (x1 - x0) / image->width;
+    GLfloat sy = (y1 - y0) / image->height;
+    // Image texels to window coordinates
+    GLfloat matrix[16] = {
+        sx,   0.0f, 0.0f, 0.0f,
+        0.0f, sy,   0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        x0,   y0,   0.0f, 1.0f
+    };
+    bool clip = firstRow > 0 || lastRow < image->height;
+
+    if (lastRow > image->height)
+        lastRow = image->height;
+    if (firstRow >= lastRow)
+        return;
+    glLoadMatrixf(matrix);
+    if (clip) {
+        // Partly loaded, the quads stay as they are and the scissor cuts off the missing rows
+        GLint left = scissorCoord(x0);
+        GLint bottom = scissorCoord(y1 - lastRow * sy);
+        glScissor(left, bottom, scissorCoord(x1) - left, scissorCoord(y1 - firstRow * sy) - bottom);
+        glEnable(GL_SCISSOR_TEST);
+    }
+    setVertexBuffer(display, image->vertexBuffer);
+    for (ty = 0; ty < image->tilesY; ty++) {
+        GLuint r0, h;
+        tileExtent(ty, image->height, image->tileSize, &r0, &h);
+        if (lastRow <= r0 || firstRow >= r0 + tileCells(ty, image->tilesY, h))
+            continue;
+        for (tx = 0; tx < image->tilesX; tx++) {
+            GLuint c0, w;
+            GLuint tile = ty * image->tilesX + tx;
+            tileExtent(tx, image->width, image->tileSize, &c0, &w);
+            setImageTexture(display, image->texIds[tile], w, h);
+            drawQuads(display, tile * 4, 4);
+        }
+    }
+    if (clip)
+        glDisable(GL_SCISSOR_TEST);
+}
+
+void deleteTiledImage(TiledImage *image)
+{
+    if (image->texIds) {
+        glDeleteTextures(image->tilesX * image->tilesY, image->texIds);
+        free(image->texIds);
+        image->texIds = NULL;
+    }
+    if (image->vertexBuffer) {
+        glDeleteBuffers(1, &image->vertexBuffer);
+        image->vertexBuffer = 0;
+    }
+    image->tilesX = image->tilesY = 0;
+}
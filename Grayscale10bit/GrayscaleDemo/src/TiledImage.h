@@ -0,0 +1,35 @@
+//
+// TiledImage.h
+//
+// Displays 16-bit images which are larger than GL_MAX_TEXTURE_SIZE by
+// splitting them into a grid of integer textures. Neighbouring tiles overlap
+// by one texel so the bilinear filter in the shader has no seams.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TILEDIMAGE_H
+#define TILEDIMAGE_H
+
+typedef struct _TiledImage {
+    GLuint width;           // image width in texels
+    GLuint height;          // image height in texels
+    GLuint tileSize;        // maximum texture size of a tile, including overlap
+    GLuint tilesX;          // number of tiles in x
+    GLuint tilesY;          // number of tiles in y
+    GLuint *texIds;         // tilesX*tilesY textures, row major from the top left
+    GLuint vertexBuffer;    // one quad per tile in image texel coordinates, y up
+} TiledImage;
+
+// Creates the (empty) tile textures. maxTileSize 0 uses GL_MAX_TEXTURE_SIZE.
+extern bool createTiledImage(TiledImage *image, GLuint width, GLuint height, GLuint maxTileSize = 0);
+// Uploads image rows [firstRow, firstRow+numRows) of the full resolution
+// pixels through the pixel buffer ring of uploader.
+extern void uploadTiledImage(TiledImage *image, PboUploader *uploader, const unsigned short *pixels, GLuint firstRow, GLuint numRows);
+// Draws the image into the window rectangle x0,y0 - x1,y1 using texture unit 0.
+// The tile quads come from the vertex buffer, placed by the modelview matrix.
+// Only image rows [firstRow, lastRow) are drawn, e.g. those uploaded so far.
+extern void drawTiledImage(const TiledImage *image, DisplayProgram *display, GLfloat x0, GLfloat y0, GLfloat x1, GLfloat y1,
+                           GLuint firstRow = 0, GLuint lastRow = 0xFFFFFFFF);
+extern void deleteTiledImage(TiledImage *image);
+
+#endif
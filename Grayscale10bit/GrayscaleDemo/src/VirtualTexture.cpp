@@ -0,0 +1,306 @@
+//
+// VirtualTexture.cpp
+//
+// Page atlas, page tables and LRU page residency for very large images
+//
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <GL\glew.h>
+#include <GL\gl.h>
+#include "ImageBuffer.h"
+#include "ImagePyramid.h"
+#include "ShaderVariants.h"
+#include "DisplayProgram.h"
+#include "PboUploader.h"
+#include "VirtualTexture.h"
+
+#define VT_PINNED   0xFFFFFFFF
+
+bool needsVirtualTexture(GLuint width, GLuint height)
+{
+    return (unsigned __int64)width * height * sizeof(unsigned short) > VT_MIN_IMAGE_BYTES;
+}
+
+static GLuint createIntegerTexture(GLenum internalFormat, GLenum format, GLsizei width, GLsizei height, const void *pixels)
+{
+    GLuint texId = 0;
+
+    glGenTextures(1, &texId);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texId);
+    // Integer textures are not filtered, the shader fetches single texels
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_SHORT, pixels);
+    return texId;
+}
+
+//
+// loadPage
+//
+// Copies a page and its border into a free atlas slot, or into the least
+// recently used one not needed for this frame. Returns false if every slot
+// holds a page of this frame.
+//
+static bool loadPage(VirtualTexture *vt, PboUploader *uploader, GLuint level, GLuint page, unsigned int lastUsed)
+{
+    VirtualLevel *l = &vt->levels[level];
+    GLuint numSlots = vt->atlasSlots * vt->atlasSlots;
+    GLuint slot = numSlots;
+    unsigned int oldest = vt->frame;
+    GLuint i, r;
+
+    for (i = 0; i < numSlots; i++) {
+        if (!vt->slots[i].used) {
+            slot = i;
+            break;
+        }
+        if (vt->slots[i].lastUsed < oldest) {
+            oldest = vt->slots[i].lastUsed;
+            slot = i;
+        }
+    }
+    if (slot == numSlots)
+        return false;
+    if (vt->slots[slot].used) {
+        vt->levels[vt->slots[slot].level].slots[vt->slots[slot].page] = VT_NO_SLOT;
+        vt->pagesEvicted++;
+    }
+
+    // The last row and column of the image are repeated into the border
+    GLuint x0 = (page % l->pagesX) * VT_PAGE_SIZE;
+    GLuint y0 = (page / l->pagesX) * VT_PAGE_SIZE;
+    GLuint columns = (l->width - x0 < VT_SLOT_SIZE) ? l->width - x0 : VT_SLOT_SIZE;
+    for (r = 0; r < VT_SLOT_SIZE; r++) {
+        GLuint y = (y0 + r < l->height) ? y0 + r : l->height - 1;
+        const unsigned short *src = l->pixels + (size_t)y * l->width + x0;
+        unsigned short *dst = vt->staging + r * VT_SLOT_SIZE;
+        memcpy(dst, src, columns * sizeof(unsigned short));
+        for (i = columns; i < VT_SLOT_SIZE; i++)
+            dst[i] = src[columns - 1];
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, vt->atlas);
+    pboTexSubImage2D(uploader, GL_TEXTURE_2D, (slot % vt->atlasSlots) * VT_SLOT_SIZE, (slot / vt->atlasSlots) * VT_SLOT_SIZE,
+        VT_SLOT_SIZE, VT_SLOT_SIZE, GL_ALPHA_INTEGER_EXT, GL_UNSIGNED_SHORT, sizeof(unsigned short), vt->staging,
+        VT_SLOT_SIZE * sizeof(unsigned short));
+
+    vt->slots[slot].level = level;
+    vt->slots[slot].page = page;
+    vt->slots[slot].lastUsed = lastUsed;
+    vt->slots[slot].used = true;
+    l->slots[page] = (unsigned short)slot;
+    vt->pagesLoaded++;
+    return true;
+}
+
+bool createVirtualTexture(VirtualTexture *vt, PboUploader *uploader, unsigned short *pixels,
+                          GLuint width, GLuint height, const ImagePyramid *pyramid)
+{
+    GLint maxTextureSize = 0;
+    DisplayVertex quad[4];
+    VirtualLevel *top;
+    GLuint i, page;
+
+    memset(vt, 0, sizeof(VirtualTexture));
+    vt->pixels = pixels;
+    vt->pyramid = *pyramid;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    vt->atlasSlots = (GLuint)maxTextureSize / VT_SLOT_SIZE;
+    if (vt->atlasSlots > VT_ATLAS_SLOTS)
+        vt->atlasSlots = VT_ATLAS_SLOTS;
+    vt->slots = (VirtualSlot *)calloc(vt->atlasSlots * vt->atlasSlots, sizeof(VirtualSlot));
+    vt->staging = (unsigned short *)malloc(VT_SLOT_SIZE * VT_SLOT_SIZE * sizeof(unsigned short));
+    if (!vt->slots || !vt->staging)
+        goto Fail;
+
+    // Level 0 is the image itself, the others come from the pyramid
+    for (i = 0; i <= pyramid->numLevels; i++) {
+        VirtualLevel *l = &vt->levels[i];
+        l->width = i ? pyramid->width[i - 1] : width;
+        l->height = i ? pyramid->height[i - 1] : height;
+        l->pixels = i ? pyramid->pixels[i - 1] : pixels;
+        l->pagesX = (l->width + VT_PAGE_SIZE - 1) >> VT_PAGE_SHIFT;
+        l->pagesY = (l->height + VT_PAGE_SIZE - 1) >> VT_PAGE_SHIFT;
+        if (l->pagesX > (GLuint)maxTextureSize || l->pagesY > (GLuint)maxTextureSize)
+            goto Fail;
+        l->slots = (unsigned short *)malloc(l->pagesX * l->pagesY * sizeof(unsigned short));
+        l->entries = (unsigned short *)calloc(l->pagesX * l->pagesY * 4, sizeof(unsigned short));
+        if (!l->slots || !l->entries)
+            goto Fail;
+        memset(l->slots, 0xFF, l->pagesX * l->pagesY * sizeof(unsigned short));
+        l->pageTable = createIntegerTexture(GL_RGBA16UI_EXT, GL_RGBA_INTEGER_EXT, l->pagesX, l->pagesY, l->entries);
+        vt->numLevels++;
+    }
+    vt->atlas = createIntegerTexture(GL_ALPHA16UI_EXT, GL_ALPHA_INTEGER_EXT,
+        vt->atlasSlots * VT_SLOT_SIZE, vt->atlasSlots * VT_SLOT_SIZE, NULL);
+
+    // The image quad, flipped like the tiles since the image starts at the top
+    quad[0].s = 0.0f; quad[0].t = 1.0f; quad[0].x = 0.0f;           quad[0].y = 0.0f;
+    quad[1].s = 0.0f; quad[1].t = 0.0f; quad[1].x = 0.0f;           quad[1].y = (GLfloat)height;
+    quad[2].s = 1.0f; quad[2].t = 0.0f; quad[2].x = (GLfloat)width; quad[2].y = (GLfloat)height;
+    quad[3].s = 1.0f; quad[3].t = 1.0f; quad[3].x = (GLfloat)width; quad[3].y = 0.0f;
+    glGenBuffers(1, &vt->vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vt->vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // The coarsest level is always resident, every page table entry can fall back to it
+    top = &vt->levels[vt->numLevels - 1];
+    for (page = 0; page < top->pagesX * top->pagesY; page++) {
+        if (!loadPage(vt, uploader, vt->numLevels - 1, page, VT_PINNED))
+            goto Fail;
+    }
+    printf("Virtual texture: %u levels, %ux%u pages of %u texels in a %u MB atlas\n", vt->numLevels,
+        vt->levels[0].pagesX, vt->levels[0].pagesY, VT_PAGE_SIZE,
+        (vt->atlasSlots * VT_SLOT_SIZE) * (vt->atlasSlots * VT_SLOT_SIZE) * 2 / (1024 * 1024));
+    return true;
+
+Fail:
+    printf("Unable to create the virtual texture\n");
+    deleteVirtualTexture(vt);
+    return false;
+}
+
+// Page along one axis containing the full resolution texel, clamped to the level
+static GLuint pageIndex(GLfloat texel, GLuint level, GLuint pages)
+{
+    GLfloat page = texel / (GLfloat)(VT_PAGE_SIZE << level);
+
+    if (page < 0.0f)
+        return 0;
+    if (page >= (GLfloat)pages)
+        return pages - 1;
+    return (GLuint)page;
+}
+
+bool updateVirtualTexture(VirtualTexture *vt, PboUploader *uploader, GLuint level,
+                          GLfloat c0, GLfloat r0, GLfloat c1, GLfloat r1)
+{
+    VirtualLevel *l;
+    GLuint px0, py0, px1, py1, px, py, d;
+    GLuint loads = 0;
+    bool missing = false, changed = false;
+
+    if (!vt->numLevels)
+        return false;
+    if (level >= vt->numLevels)
+        level = vt->numLevels - 1;
+    l = &vt->levels[level];
+    vt->frame++;
+    px0 = pageIndex(c0, level, l->pagesX);
+    px1 = pageIndex(c1, level, l->pagesX);
+    py0 = pageIndex(r0, level, l->pagesY);
+    py1 = pageIndex(r1, level, l->pagesY);
+
+    // Keep the pages in view before any is replaced
+    for (py = py0; py <= py1; py++) {
+        for (px = px0; px <= px1; px++) {
+            unsigned short slot = l->slots[py * l->pagesX + px];
+            if (slot != VT_NO_SLOT && vt->slots[slot].lastUsed != VT_PINNED)
+                vt->slots[slot].lastUsed = vt->frame;
+        }
+    }
+    for (py = py0; py <= py1; py++) {
+        for (px = px0; px <= px1; px++) {
+            if (l->slots[py * l->pagesX + px] != VT_NO_SLOT)
+                continue;
+            if (loads == VT_PAGES_PER_FRAME || !loadPage(vt, uploader, level, py * l->pagesX + px, vt->frame))
+                missing = true;
+            else
+                loads++;
+        }
+    }
+
+    // Page table entries in view and one page around it, missing pages point
+    // at the closest resident coarser page
+    px0 = px0 ? px0 - 1 : 0;
+    py0 = py0 ? py0 - 1 : 0;
+    px1 = (px1 + 1 < l->pagesX) ? px1 + 1 : px1;
+    py1 = (py1 + 1 < l->pagesY) ? py1 + 1 : py1;
+    for (py = py0; py <= py1; py++) {
+        for (px = px0; px <= px1; px++) {
+            unsigned short entry[4] = {0, 0, 0, 0};
+            unsigned short *current = l->entries + (py * l->pagesX + px) * 4;
+            for (d = 0; level + d < vt->numLevels; d++) {
+                VirtualLevel *ancestor = &vt->levels[level + d];
+                unsigned short slot = ancestor->slots[(py >> d) * ancestor->pagesX + (px >> d)];
+                if (slot != VT_NO_SLOT) {
+                    entry[0] = (unsigned short)(slot % vt->atlasSlots);
+                    entry[1] = (unsigned short)(slot / vt->atlasSlots);
+                    entry[2] = (unsigned short)d;
+                    entry[3] = 1;
+                    if (vt->slots[slot].lastUsed != VT_PINNED)
+                        vt->slots[slot].lastUsed = vt->frame;
+                    break;
+                }
+            }
+            if (memcmp(current, entry, sizeof(entry)) != 0) {
+                memcpy(current, entry, sizeof(entry));
+                changed = true;
+            }
+        }
+    }
+    if (changed) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, l->pageTable);
+        pboTexSubImage2D(uploader, GL_TEXTURE_2D, px0, py0, px1 - px0 + 1, py1 - py0 + 1, GL_RGBA_INTEGER_EXT,
+            GL_UNSIGNED_SHORT, 4 * sizeof(unsigned short), l->entries + (py0 * l->pagesX + px0) * 4,
+            l->pagesX * 4 * sizeof(unsigned short));
+    }
+    return missing;
+}
+
+void drawVirtualTexture(VirtualTexture *vt, DisplayProgram *display, GLuint level,
+                        GLfloat x0, GLfloat y0, GLfloat x1, GLfloat y1)
+{
+    VirtualLevel *l;
+    GLfloat sx, sy;
+
+    if (!vt->numLevels)
+        return;
+    if (level >= vt->numLevels)
+        level = vt->numLevels - 1;
+    l = &vt->levels[level];
+    sx = (x1 - x0) / vt->levels[0].width;
+    sy = (y1 - y0) / vt->levels[0].height;
+    // Full resolution texels to window coordinates
+    GLfloat matrix[16] = {
+        sx,   0.0f, 0.0f, 0.0f,
+        0.0f, sy,   0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        x0,   y0,   0.0f, 1.0f
+    };
+    glLoadMatrixf(matrix);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, l->pageTable);
+    glActiveTexture(GL_TEXTURE0);
+    setVertexBuffer(display, vt->vertexBuffer);
+    // textureSize is the size of the level, the shader works in its texels
+    setImageTexture(display, vt->atlas, l->width, l->height);
+    drawQuads(display, 0, 4);
+}
+
+void deleteVirtualTexture(VirtualTexture *vt)
+{
+    GLuint i;
+
+    for (i = 0; i < VT_MAX_LEVELS; i++) {
+        free(vt->levels[i].slots);
+        free(vt->levels[i].entries);
+        if (vt->levels[i].pageTable)
+            glDeleteTextures(1, &vt->levels[i].pageTable);
+    }
+    if (vt->atlas)
+        glDeleteTextures(1, &vt->atlas);
+    if (vt->vertexBuffer)
+        glDeleteBuffers(1, &vt->vertexBuffer);
+    free(vt->slots);
+    free(vt->staging);
+    freeImagePixels(vt->pixels);
+    freeImagePyramid(&vt->pyramid);
+    memset(vt, 0, sizeof(VirtualTexture));
+}
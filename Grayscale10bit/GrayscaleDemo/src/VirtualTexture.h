@@ -0,0 +1,79 @@
+//
+// VirtualTexture.h
+//
+// Draws images too large to keep on the GPU from a fixed size atlas of
+// 128x128 pages. Every level of the image (the full resolution one and the
+// pyramid levels) has a page table texture whose entries point at the atlas
+// slot of the page, or of the closest coarser page that is resident while
+// the page itself is not loaded yet. Each frame the pages the view needs are
+// copied from the CPU images into the atlas, least recently used ones are
+// replaced, so GPU memory stays at the atlas size whatever the image size.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef VIRTUALTEXTURE_H
+#define VIRTUALTEXTURE_H
+
+#define VT_PAGE_SHIFT       7
+#define VT_PAGE_SIZE        (1 << VT_PAGE_SHIFT)
+#define VT_SLOT_SIZE        (VT_PAGE_SIZE + 1)  // the page and the first row and column of its neighbours for the bilinear filter
+#define VT_ATLAS_SLOTS      31                  // slots along each side of the atlas, 3999x3999 texels = 32 MB
+#define VT_MAX_LEVELS       (PYRAMID_MAX_LEVELS + 1)
+#define VT_PAGES_PER_FRAME  32                  // page uploads per frame, keeps panning smooth
+#define VT_NO_SLOT          0xFFFF
+
+// Images over this size are drawn from a virtual texture
+#define VT_MIN_IMAGE_BYTES  (256*1024*1024)
+
+typedef struct _VirtualLevel {
+    GLuint width;
+    GLuint height;
+    GLuint pagesX;
+    GLuint pagesY;
+    const unsigned short *pixels;
+    unsigned short *slots;          // atlas slot of each page, VT_NO_SLOT if not resident
+    unsigned short *entries;        // page table: slot x, slot y, levels up to the resident page, 1
+    GLuint pageTable;               // pagesX x pagesY RGBA16UI texture of the entries
+} VirtualLevel;
+
+typedef struct _VirtualSlot {
+    GLuint level;                   // page held by the slot
+    GLuint page;
+    unsigned int lastUsed;          // frame the page was last drawn or 0xFFFFFFFF if pinned
+    bool used;
+} VirtualSlot;
+
+typedef struct _VirtualTexture {
+    GLuint numLevels;               // 0 if no virtual texture was created
+    VirtualLevel levels[VT_MAX_LEVELS];
+    unsigned short *pixels;         // full resolution image, owned
+    ImagePyramid pyramid;           // owned
+    GLuint atlas;
+    GLuint atlasSlots;              // slots along each side of the atlas
+    VirtualSlot *slots;
+    unsigned short *staging;        // one slot of texels
+    GLuint vertexBuffer;            // the image quad in level 0 texels
+    unsigned int frame;
+    // Statistics
+    unsigned int pagesLoaded;
+    unsigned int pagesEvicted;
+} VirtualTexture;
+
+// Whether an image of this size should be drawn from a virtual texture.
+extern bool needsVirtualTexture(GLuint width, GLuint height);
+// Takes ownership of pixels and the pyramid built from them, also on failure.
+// The pages of the coarsest level are loaded and stay resident.
+extern bool createVirtualTexture(VirtualTexture *vt, PboUploader *uploader, unsigned short *pixels,
+                                 GLuint width, GLuint height, const ImagePyramid *pyramid);
+// Loads the pages of level that cover the image rectangle [c0, c1) x [r0, r1)
+// (full resolution columns and rows) and updates its page table. Returns
+// true if pages are still missing, the next frames will load them.
+extern bool updateVirtualTexture(VirtualTexture *vt, PboUploader *uploader, GLuint level,
+                                 GLfloat c0, GLfloat r0, GLfloat c1, GLfloat r1);
+// Draws level into the window rectangle x0,y0 - x1,y1, the shader variant
+// with SHADER_VIRTUAL_TEXTURE must be in use. The page table goes to texture unit 2.
+extern void drawVirtualTexture(VirtualTexture *vt, DisplayProgram *display, GLuint level,
+                               GLfloat x0, GLfloat y0, GLfloat x1, GLfloat y1);
+extern void deleteVirtualTexture(VirtualTexture *vt);
+
+#endif
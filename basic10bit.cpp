@@ -1,8 +1,12 @@
 ﻿#include "stdafx.h"
 #include <windows.h>
 #include <GL/gl.h>
+#include <stddef.h>
+#include <ctype.h>
 #include <iostream>
 #include <string>
+#include <vector>
+#include "BandingAnalyzer.h"
 
 using namespace std;
 
@@ -16,6 +20,10 @@ using namespace std;
 #define ERRCODE_CANTGETBASICPIXELFORMAT		69
 #define ERRCODE_CANTGETBASICGLCONTEXT		70
 #define ERRCODE_CANTGETOPENGLCONTEXT		71
+#define ERRCODE_BADARGUMENT			72
+#define ERRCODE_CANTCREATEFBO			73
+#define ERRCODE_BANDINGDETECTED			1
+#define ERRCODE_FORMATONLY			2
 
 void ErrorExit(int exitCode, const string &msg)
 {
@@ -29,6 +37,14 @@ void ErrorExit(int exitCode, const string &msg)
 #define GL_STATIC_DRAW						0x88E4
 #define GL_FRAGMENT_SHADER					0x8B30
 #define GL_VERTEX_SHADER					0x8B31
+#define GL_PIXEL_PACK_BUFFER					0x88EB
+#define GL_STREAM_READ						0x88E1
+#define GL_READ_ONLY						0x88B8
+#define GL_FRAMEBUFFER						0x8D40
+#define GL_RENDERBUFFER						0x8D41
+#define GL_COLOR_ATTACHMENT0					0x8CE0
+#define GL_FRAMEBUFFER_COMPLETE					0x8CD5
+#define GL_RGBA16						0x805B
 
 #define WGL_CONTEXT_MAJOR_VERSION_ARB				0x2091
 #define WGL_CONTEXT_MINOR_VERSION_ARB				0x2092
@@ -83,6 +99,9 @@ namespace mygl
 	void (WINAPI *glBindBuffer)(GLenum target, GLuint buffer);
 	void (WINAPI *glBufferData)(GLenum target, GLsizeiptr size, const GLvoid * data, GLenum usage);
 	void (WINAPI *glVertexAttribPointer)(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid * pointer);
+	void (WINAPI *glVertexAttribIPointer)(GLuint index, GLint size, GLenum type, GLsizei stride, const GLvoid * pointer);
+	void (WINAPI *glVertexAttribDivisor)(GLuint index, GLuint divisor);
+	void (WINAPI *glDrawArraysInstanced)(GLenum mode, GLint first, GLsizei count, GLsizei primcount);
 	void (WINAPI *glEnableVertexAttribArray)(GLuint index);
 	GLuint(WINAPI *glCreateShader)(GLenum shaderType);
 	void (WINAPI *glShaderSource)(GLuint shader, GLsizei count, const char **string, const GLint *length);
@@ -91,6 +110,21 @@ namespace mygl
 	void (WINAPI *glAttachShader)(GLuint program, GLuint shader);
 	void (WINAPI *glLinkProgram)(GLuint program);
 	void (WINAPI *glViewport)(GLint x, GLint y, GLsizei width, GLsizei height);
+	void (WINAPI *glDeleteBuffers)(GLsizei n, const GLuint * buffers);
+	void * (WINAPI *glMapBuffer)(GLenum target, GLenum access);
+	GLboolean(WINAPI *glUnmapBuffer)(GLenum target);
+	void (WINAPI *glPixelStorei)(GLenum pname, GLint param);
+	void (WINAPI *glReadPixels)(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid *data);
+	void (WINAPI *glReadBuffer)(GLenum mode);
+	void (WINAPI *glGenFramebuffers)(GLsizei n, GLuint *framebuffers);
+	void (WINAPI *glDeleteFramebuffers)(GLsizei n, const GLuint *framebuffers);
+	void (WINAPI *glBindFramebuffer)(GLenum target, GLuint framebuffer);
+	GLenum(WINAPI *glCheckFramebufferStatus)(GLenum target);
+	void (WINAPI *glGenRenderbuffers)(GLsizei n, GLuint *renderbuffers);
+	void (WINAPI *glDeleteRenderbuffers)(GLsizei n, const GLuint *renderbuffers);
+	void (WINAPI *glBindRenderbuffer)(GLenum target, GLuint renderbuffer);
+	void (WINAPI *glRenderbufferStorage)(GLenum target, GLenum internalformat, GLsizei width, GLsizei height);
+	void (WINAPI *glFramebufferRenderbuffer)(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer);
 
 	// 此定义首先尝试wglGetProcAddress获取函数指针，
 	// 失败则使用GetProcAddress作为备用
@@ -141,6 +175,9 @@ namespace mygl
 		GETPROC(glBindBuffer);
 		GETPROC(glBufferData);
 		GETPROC(glVertexAttribPointer);
+		GETPROC(glVertexAttribIPointer);
+		GETPROC(glVertexAttribDivisor);
+		GETPROC(glDrawArraysInstanced);
 		GETPROC(glEnableVertexAttribArray);
 		GETPROC(glCreateShader);
 		GETPROC(glShaderSource);
@@ -149,6 +186,21 @@ namespace mygl
 		GETPROC(glAttachShader);
 		GETPROC(glLinkProgram);
 		GETPROC(glViewport);
+		GETPROC(glDeleteBuffers);
+		GETPROC(glMapBuffer);
+		GETPROC(glUnmapBuffer);
+		GETPROC(glPixelStorei);
+		GETPROC(glReadPixels);
+		GETPROC(glReadBuffer);
+		GETPROC(glGenFramebuffers);
+		GETPROC(glDeleteFramebuffers);
+		GETPROC(glBindFramebuffer);
+		GETPROC(glCheckFramebufferStatus);
+		GETPROC(glGenRenderbuffers);
+		GETPROC(glDeleteRenderbuffers);
+		GETPROC(glBindRenderbuffer);
+		GETPROC(glRenderbufferStorage);
+		GETPROC(glFramebufferRenderbuffer);
 	}
 
 	// 获取指向OpenGL函数的指针
@@ -220,22 +272,54 @@ namespace mygl
 
 void PaintWindow(HWND hWnd);
 void ResizeWindow(HWND hWnd, int w, int h);
+void initializeGL(HWND hWnd, HDC hDC);
+int AnalyzeBanding(HWND hWnd, const char *jsonFile, int windowBits);
 LRESULT CALLBACK MainWndProc(HWND, UINT, WPARAM, LPARAM);
 INT_PTR CALLBACK AboutDlgProc(HWND, UINT, WPARAM, LPARAM);
 
 // OpenGL一些全局变量的代码
-GLuint VertexShaderId, FragmentShaderId1, FragmentShaderId2, ProgramId1, ProgramId2,
-VaoId0, VaoId1, VboId0, VboId1, TexBufferId0, TexBufferId1, TexId0, TexId1;
+GLuint VertexShaderId, ProgramId,
+VaoId, VboId, StripVboId, TexBufferId0, TexBufferId1, TexId0, TexId1;
 HGLRC globalContext = NULL;
 bool g_init = false;
 
-int main()
+// 从上到下每个条带的量化位数, 0 表示不量化
+#define MAX_STRIPS	16
+vector<GLint> StripBits;
+
+int main(int argc, char* argv[])
 {
+	// -analyze 时在置顶的窗口中绘制并读回, 自动分析色阶并输出 JSON (默认到控制台), 没有色带时返回 0
+	bool analyze = false;
+	const char *jsonFile = NULL;
+
+	// 命令行可以给出条带的位数, 如 basic10bit 0 12 10 8 6
+	for (int i = 1; i < argc && (int)StripBits.size() < MAX_STRIPS; i++)
+	{
+		if (strcmp(argv[i], "-analyze") == 0)
+		{
+			analyze = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-' && !isdigit((unsigned char)argv[i + 1][0]))
+				jsonFile = argv[++i];
+			continue;
+		}
+		int bits = atoi(argv[i]);
+		if (bits < 0 || bits > 16)
+			ErrorExit(ERRCODE_BADARGUMENT, string("无效的条带位数 ") + argv[i]);
+		StripBits.push_back(bits);
+	}
+	if (StripBits.empty())
+	{
+		// 默认第一条不量化, 其余依次为 12, 10, 8, 6 位
+		const GLint defaultBits[] = { 0, 12, 10, 8, 6 };
+		StripBits.assign(defaultBits, defaultBits + sizeof(defaultBits) / sizeof(defaultBits[0]));
+	}
+
 	// 取得 OpenGL 函数
 	mygl::setup();
 
 	// 创建并显示一个窗口,该窗口将显示从黑色到白色的灰阶渐变
-	// 下半窗口强制为8位精度,如果显示器支持,则上半窗口为10位精度
+	// 窗口分为上下排列的条带, 每个条带量化为各自的位数
 	HINSTANCE hInstance = GetModuleHandle(NULL);
 	WNDCLASS wc;
 
@@ -256,7 +340,8 @@ int main()
 		WS_CLIPSIBLINGS | WS_CLIPCHILDREN | WS_OVERLAPPEDWINDOW,
 		100, 100, 640, 480, NULL, NULL, hInstance, NULL);
 	int nCmdShow = SW_SHOW;
-	ShowWindow(hWnd, nCmdShow);
+	if (!analyze)
+		ShowWindow(hWnd, nCmdShow);
 
 	// 让我们检查是否能够获取到一个10位像素格式
 	int attribsDesired[] = {
@@ -279,6 +364,14 @@ int main()
 		ErrorExit(ERRCODE_CANTGET10BITFORMAT, "无法选择 10 位像素格式");
 
 	cout << "日志: 获取到 " << numFormats << " 格式" << endl;
+	if (numFormats < 1 && analyze)
+	{
+		// 软件 GL 等没有 10 位格式时仍然分析, 结果会报告 8 位
+		cout << "警告: 没有 10 位像素格式, 使用 8 位格式进行分析" << endl;
+		attribsDesired[7] = attribsDesired[9] = attribsDesired[11] = 8;
+		if (!mygl::wglChoosePixelFormatARB(hDC, attribsDesired, NULL, 1000, formats, &numFormats))
+			numFormats = 0;
+	}
 	if (numFormats < 1)
 		ErrorExit(ERRCODE_CANTGET10BITFORMAT, "没有检测到可用的 10 位像素格式");
 
@@ -322,6 +415,13 @@ int main()
 
 	cout << "位宽: " << r << ":" << g << ":" << b << ":" << a << endl;
 
+	if (analyze)
+	{
+		initializeGL(hWnd, hDC);
+		g_init = true;
+		return AnalyzeBanding(hWnd, jsonFile, r);
+	}
+
 	// 消息循环
 
 	MSG msg;
@@ -369,79 +469,78 @@ LRESULT CALLBACK MainWndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
 	return 0;
 }
 
+// 所有条带在一次实例化绘制中完成: 每个实例是一个条带,
+// 其量化位数和上下边界来自实例属性 (divisor 1), 增加条带不需要额外的绘制或状态切换
 const char* VertexShader =
 {
 	"#version 400\n"\
 
 	"layout(location=0) in vec4 in_Position;\n"\
 	"layout(location=1) in vec4 in_Color;\n"\
+	"layout(location=2) in int in_Bits;\n"\
+	"layout(location=3) in vec2 in_Strip;\n"\
 	"out vec4 ex_Color;\n"\
 	"out vec4 ex_Pos;\n"\
+	"flat out int ex_Bits;\n"\
 
 	"void main(void)\n"\
 	"{\n"\
-	"   gl_Position = in_Position;\n"\
+	"   // in_Position.y 为 0..1, 映射到条带的下边界 in_Strip.x 和上边界 in_Strip.y\n"\
+	"   gl_Position = vec4(in_Position.x, mix(in_Strip.x, in_Strip.y, in_Position.y), in_Position.zw);\n"\
 	"   ex_Color = in_Color;\n"\
 	"   ex_Pos = in_Position;\n"\
+	"   ex_Bits = in_Bits;\n"\
 	"}\n"
 };
 
-const char* FragmentShaderNormal =
+// 量化位数为 0 时输出不量化, 否则将灰阶量化为该位数
+const char* FragmentShader =
 {
 	"#version 400\n"\
 
 	"in vec4 ex_Color;\n"\
 	"in vec4 ex_Pos;\n"\
+	"flat in int ex_Bits;\n"\
 	"out vec4 out_Color;\n"\
 
 	"void main(void)\n"\
 	"{\n"\
 	"   //out_Color = ex_Color;\n"\
 	"   float x = (ex_Pos.x + 1.0)/2.0;\n"\
+	"   float levels = float((1 << ex_Bits) - 1);\n"\
+	"   x = (ex_Bits > 0) ? floor(x * levels) / levels : x;\n"\
+
 	"   out_Color = vec4(x, x, x, 1.0);\n"\
 	"}\n"
 };
 
-const char* FragmentShader8Bit =
+// 每个条带的实例属性
+struct Strip
 {
-	"#version 400\n"\
-
-	"in vec4 ex_Color;\n"\
-	"in vec4 ex_Pos;\n"\
-	"out vec4 out_Color;\n"\
-
-	"void main(void)\n"\
-	"{\n"\
-	"   //out_Color = ex_Color;\n"\
-	"   float x = (ex_Pos.x + 1.0)/2.0;\n"\
-	"   x *= 255.0;\n"\
-	"   x = floor(x);\n"\
-	"   x /= 255.0;\n"\
-
-	"   out_Color = vec4(x, x, x, 1.0);\n"\
-	"}\n"
+	GLint bits;
+	GLfloat bottom, top;
 };
 
-void CreateVBO(bool upper, GLuint &VaoId, GLuint &VboId)
+void CreateVBO(GLuint &VaoId, GLuint &VboId, GLuint &StripVboId)
 {
+	// 一个横跨窗口的四边形, y 为 0..1, 由顶点着色器放到各条带中
 	GLfloat Vertices[] = {
-		-1.0f, -1.0f, 0.0f, 1.0f,
-		-1.0f,  1.0f, 0.0f, 1.0f,
-		1.0f, -1.0f, 0.0f, 1.0f,
+		-1.0f, 0.0f, 0.0f, 1.0f,
+		-1.0f, 1.0f, 0.0f, 1.0f,
+		1.0f, 0.0f, 0.0f, 1.0f,
 
 		1.0f, 1.0f, 0.0f, 1.0f,
-		-1.0f,  1.0f, 0.0f, 1.0f,
-		1.0f, -1.0f, 0.0f, 1.0f
+		-1.0f, 1.0f, 0.0f, 1.0f,
+		1.0f, 0.0f, 0.0f, 1.0f
 	};
 
-	for (int i = 0; i < 6; i++)
+	// 条带从上到下等高排列
+	vector<Strip> strips(StripBits.size());
+	for (size_t i = 0; i < strips.size(); i++)
 	{
-		int y = i * 4 + 1;
-
-		if (upper)
-			Vertices[y] = Vertices[y] / 2.0f + 0.5f;
-		else
-			Vertices[y] = Vertices[y] / 2.0f - 0.5f;
+		strips[i].bits = StripBits[i];
+		strips[i].top = 1.0f - 2.0f * i / strips.size();
+		strips[i].bottom = 1.0f - 2.0f * (i + 1) / strips.size();
 	}
 
 	int ErrorCheckValue = mygl::glGetError();
@@ -455,6 +554,16 @@ void CreateVBO(bool upper, GLuint &VaoId, GLuint &VboId)
 	mygl::glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
 	mygl::glEnableVertexAttribArray(0);
 
+	mygl::glGenBuffers(1, &StripVboId);
+	mygl::glBindBuffer(GL_ARRAY_BUFFER, StripVboId);
+	mygl::glBufferData(GL_ARRAY_BUFFER, strips.size() * sizeof(Strip), &strips[0], GL_STATIC_DRAW);
+	mygl::glVertexAttribIPointer(2, 1, GL_INT, sizeof(Strip), (const GLvoid *)offsetof(Strip, bits));
+	mygl::glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Strip), (const GLvoid *)offsetof(Strip, bottom));
+	mygl::glVertexAttribDivisor(2, 1);
+	mygl::glVertexAttribDivisor(3, 1);
+	mygl::glEnableVertexAttribArray(2);
+	mygl::glEnableVertexAttribArray(3);
+
 	ErrorCheckValue = mygl::glGetError();
 	if (ErrorCheckValue != GL_NO_ERROR)
 		ErrorExit(ERRCODE_CANTCREATEVBO, "无法创建一个 VBO");
@@ -468,23 +577,14 @@ void CreateShaders(void)
 	mygl::glShaderSource(VertexShaderId, 1, &VertexShader, NULL);
 	mygl::glCompileShader(VertexShaderId);
 
-	FragmentShaderId1 = mygl::glCreateShader(GL_FRAGMENT_SHADER);
-	mygl::glShaderSource(FragmentShaderId1, 1, &FragmentShaderNormal, NULL);
-	mygl::glCompileShader(FragmentShaderId1);
-
-	ProgramId1 = mygl::glCreateProgram();
-	mygl::glAttachShader(ProgramId1, VertexShaderId);
-	mygl::glAttachShader(ProgramId1, FragmentShaderId1);
-	mygl::glLinkProgram(ProgramId1);
+	GLuint fragmentShaderId = mygl::glCreateShader(GL_FRAGMENT_SHADER);
+	mygl::glShaderSource(fragmentShaderId, 1, &FragmentShader, NULL);
+	mygl::glCompileShader(fragmentShaderId);
 
-	FragmentShaderId2 = mygl::glCreateShader(GL_FRAGMENT_SHADER);
-	mygl::glShaderSource(FragmentShaderId2, 1, &FragmentShader8Bit, NULL);
-	mygl::glCompileShader(FragmentShaderId2);
-
-	ProgramId2 = mygl::glCreateProgram();
-	mygl::glAttachShader(ProgramId2, VertexShaderId);
-	mygl::glAttachShader(ProgramId2, FragmentShaderId2);
-	mygl::glLinkProgram(ProgramId2);
+	ProgramId = mygl::glCreateProgram();
+	mygl::glAttachShader(ProgramId, VertexShaderId);
+	mygl::glAttachShader(ProgramId, fragmentShaderId);
+	mygl::glLinkProgram(ProgramId);
 
 	ErrorCheckValue = mygl::glGetError();
 	if (ErrorCheckValue != GL_NO_ERROR)
@@ -496,21 +596,17 @@ void initializeGL(HWND hWnd, HDC hDC)
 	mygl::glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
 	CreateShaders();
-	CreateVBO(true, VaoId0, VboId0);
-	CreateVBO(false, VaoId1, VboId1);
+	CreateVBO(VaoId, VboId, StripVboId);
 }
 
 void paintGL()
 {
 	mygl::glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	mygl::glBindVertexArray(VaoId0);
-	mygl::glUseProgram(ProgramId1);
-	mygl::glDrawArrays(GL_TRIANGLES, 0, 6);
-
-	mygl::glBindVertexArray(VaoId1);
-	mygl::glUseProgram(ProgramId2);
-	mygl::glDrawArrays(GL_TRIANGLES, 0, 6);
+	// 所有条带一次绘制
+	mygl::glBindVertexArray(VaoId);
+	mygl::glUseProgram(ProgramId);
+	mygl::glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei)StripBits.size());
 
 	mygl::glFlush();
 }
@@ -543,3 +639,203 @@ void ResizeWindow(HWND hWnd, int w, int h)
 		mygl::glViewport(0, 0, w, h);
 	}
 }
+
+// 在窗口的后缓冲中绘制条带, 经 PBO 读回后逐行分析, 检查的是实际得到的像素格式.
+// 宽度 4096 使 12 位以内的每个灰阶都至少占一个像素; 窗口没有这么宽时用 x 为负的视口
+// 把条带分段画进窗口, 每段读回到 PBO 中对应的列, 窗口大小不影响结果.
+// 窗口放不下条带或读回出错时才退回到与窗口位宽相同的离屏帧缓冲, 这时只检查了该格式
+#define ANALYZE_WIDTH		4096
+#define ANALYZE_MAX_BITS	12		// log2(ANALYZE_WIDTH), 2^n-1 个灰阶要放进这么多列
+#define ANALYZE_STRIP_ROWS	32
+#define ANALYZE_MIN_TILE	256		// 客户区至少这么宽才从窗口读回
+
+// 把窗口置顶放到工作区左上角, 客户区高度正好放下所有条带, 宽度不超出屏幕,
+// 这样读回的像素都属于这个窗口. 返回每段的宽度, 0 表示窗口放不下条带
+GLsizei PlaceAnalyzeWindow(HWND hWnd, GLsizei width, GLsizei height)
+{
+	RECT work, frame = { 0, 0, 0, 0 }, client;
+
+	SystemParametersInfo(SPI_GETWORKAREA, 0, &work, 0);
+	AdjustWindowRect(&frame, WS_OVERLAPPEDWINDOW, FALSE);
+	LONG frameWidth = frame.right - frame.left, frameHeight = frame.bottom - frame.top;
+	LONG clientWidth = work.right - work.left - frameWidth;
+	if (clientWidth > width)
+		clientWidth = width;
+	if (clientWidth < ANALYZE_MIN_TILE || height + frameHeight > work.bottom - work.top)
+		return 0;
+
+	SetWindowPos(hWnd, HWND_TOPMOST, work.left, work.top, clientWidth + frameWidth, height + frameHeight,
+		SWP_SHOWWINDOW | SWP_NOACTIVATE);
+	GetClientRect(hWnd, &client);
+	if (client.right < ANALYZE_MIN_TILE || client.bottom < height)
+		return 0;
+	return client.right < clientWidth ? client.right : clientWidth;
+}
+
+// 从窗口的后缓冲读回到绑定的 PBO, 每段把视口左移后重画. 出错时返回 false
+bool ReadWindowStrips(GLsizei width, GLsizei height, GLsizei tileWidth)
+{
+	mygl::glGetError();
+	mygl::glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	mygl::glReadBuffer(GL_BACK);
+	mygl::glPixelStorei(GL_PACK_ROW_LENGTH, width);
+	for (GLsizei x = 0; x < width; x += tileWidth)
+	{
+		GLsizei w = (width - x < tileWidth) ? width - x : tileWidth;
+		mygl::glViewport(-x, 0, width, height);
+		paintGL();
+		mygl::glReadPixels(0, 0, w, height, GL_RED, GL_UNSIGNED_SHORT, (GLvoid *)(x * sizeof(unsigned short)));
+	}
+	mygl::glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+	return mygl::glGetError() == GL_NO_ERROR;
+}
+
+// 退路: 在与窗口位宽相同的离屏帧缓冲中一次画完并读回到绑定的 PBO.
+// 读回的是该格式而不是窗口的像素, 返回格式的名字
+const char *ReadOffscreenStrips(GLsizei width, GLsizei height, int windowBits, int *framebufferBits)
+{
+	GLenum format = GL_RGBA8;
+	const char *formatName = "RGBA8";
+
+	*framebufferBits = 8;
+	if (windowBits >= 16)
+	{
+		format = GL_RGBA16;
+		formatName = "RGBA16";
+		*framebufferBits = 16;
+	}
+	else if (windowBits >= 10)
+	{
+		format = GL_RGB10_A2;
+		formatName = "RGB10_A2";
+		*framebufferBits = 10;
+	}
+
+	GLuint fboId, rboId;
+	mygl::glGenRenderbuffers(1, &rboId);
+	mygl::glBindRenderbuffer(GL_RENDERBUFFER, rboId);
+	mygl::glRenderbufferStorage(GL_RENDERBUFFER, format, width, height);
+	mygl::glGenFramebuffers(1, &fboId);
+	mygl::glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+	mygl::glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rboId);
+	if (mygl::glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		ErrorExit(ERRCODE_CANTCREATEFBO, string("无法创建 ") + formatName + " 离屏帧缓冲");
+
+	mygl::glViewport(0, 0, width, height);
+	paintGL();
+	mygl::glReadPixels(0, 0, width, height, GL_RED, GL_UNSIGNED_SHORT, 0);
+
+	// 像素已经在 PBO 中
+	mygl::glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	mygl::glDeleteFramebuffers(1, &fboId);
+	mygl::glDeleteRenderbuffers(1, &rboId);
+	return formatName;
+}
+
+// 驱动字符串中可能有引号、反斜杠或控制字符, 按 JSON 转义后写出
+void WriteJsonString(FILE *out, const char *s)
+{
+	fputc('"', out);
+	for (; s && *s; s++)
+	{
+		if (*s == '"' || *s == '\\')
+			fprintf(out, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(out, "\\u%04x", *s);
+		else
+			fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+int AnalyzeBanding(HWND hWnd, const char *jsonFile, int windowBits)
+{
+	const GLsizei width = ANALYZE_WIDTH;
+	const GLsizei height = ANALYZE_STRIP_ROWS * (GLsizei)StripBits.size();
+	const char *formatName = NULL;		// 退回离屏帧缓冲时的格式, NULL 表示从窗口读回
+	int framebufferBits = windowBits > 16 ? 16 : windowBits;
+
+	// 读到 PBO 中, 映射后直接分析, 不再复制一份
+	GLuint pboId;
+	mygl::glGenBuffers(1, &pboId);
+	mygl::glBindBuffer(GL_PIXEL_PACK_BUFFER, pboId);
+	mygl::glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * sizeof(unsigned short), NULL, GL_STREAM_READ);
+	mygl::glPixelStorei(GL_PACK_ALIGNMENT, 2);
+
+	GLsizei tileWidth = PlaceAnalyzeWindow(hWnd, width, height);
+	if (!tileWidth || !ReadWindowStrips(width, height, tileWidth))
+	{
+		cout << "警告: 无法从窗口读回条带, 改用离屏帧缓冲, 只能检查其格式" << endl;
+		formatName = ReadOffscreenStrips(width, height, windowBits, &framebufferBits);
+	}
+	const unsigned short *pixels = (const unsigned short *)mygl::glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+	if (!pixels)
+		ErrorExit(ERRCODE_CANTCREATEFBO, "无法映射读回的像素");
+
+	// 读回的第 0 行在底部, 条带从上到下排列; 每个条带去掉上下边缘各一行
+	vector<RegionBanding> regions(StripBits.size());
+	bool banding = windowBits < 10;
+	for (size_t i = 0; i < regions.size(); i++)
+	{
+		size_t firstRow = (regions.size() - 1 - i) * ANALYZE_STRIP_ROWS + 1;
+		AnalyzeRegion(pixels + firstRow * width, width, ANALYZE_STRIP_ROWS - 2, width, &regions[i]);
+		int expected = (StripBits[i] == 0 || StripBits[i] > framebufferBits) ? framebufferBits : StripBits[i];
+		if (expected > ANALYZE_MAX_BITS)
+			expected = ANALYZE_MAX_BITS;
+		// n 位的渐变至少有 2^n-1 个灰阶 (量化时最后一个灰阶只占右边缘)
+		if (regions[i].levels < (1u << expected) - 1 || regions[i].nonMonotonicRows)
+			banding = true;
+	}
+	// 只检查了离屏格式时不能说明窗口没有色带, 不算通过
+	bool pass = !banding && !formatName;
+
+	mygl::glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	mygl::glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	mygl::glDeleteBuffers(1, &pboId);
+
+	FILE *out = stdout;
+	if (jsonFile && fopen_s(&out, jsonFile, "w") != 0)
+		ErrorExit(ERRCODE_BADARGUMENT, string("无法写入 ") + jsonFile);
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"renderer\": ");
+	WriteJsonString(out, (const char *)mygl::glGetString(GL_RENDERER));
+	fprintf(out, ",\n  \"vendor\": ");
+	WriteJsonString(out, (const char *)mygl::glGetString(GL_VENDOR));
+	fprintf(out, ",\n  \"version\": ");
+	WriteJsonString(out, (const char *)mygl::glGetString(GL_VERSION));
+	fprintf(out, ",\n");
+	fprintf(out, "  \"window_bits\": %d,\n", windowBits);
+	if (formatName)
+	{
+		// 没有读到窗口的像素: 结果只说明离屏格式的精度, 不说明窗口的像素格式
+		fprintf(out, "  \"readback\": \"offscreen\",\n");
+		fprintf(out, "  \"readback_format\": \"%s\",\n", formatName);
+		fprintf(out, "  \"format_only\": true,\n");
+	}
+	else
+	{
+		fprintf(out, "  \"readback\": \"window\",\n");
+		fprintf(out, "  \"format_only\": false,\n");
+	}
+	fprintf(out, "  \"width\": %d,\n", width);
+	fprintf(out, "  \"strips\": [\n");
+	for (size_t i = 0; i < regions.size(); i++)
+	{
+		const RegionBanding &region = regions[i];
+		fprintf(out, "    {\"strip\": %u, \"quantize_bits\": %d, \"rows\": %u, \"levels\": %u, "
+			"\"effective_bits\": %.2f, \"bits\": %u, \"min_step\": %u, \"max_step\": %u, \"mean_step\": %.2f, "
+			"\"non_monotonic_rows\": %u}%s\n",
+			(unsigned int)i, StripBits[i], region.rows, region.levels, region.effectiveBits, region.bits,
+			region.minStep, region.maxStep, region.meanStep, region.nonMonotonicRows, i + 1 < regions.size() ? "," : "");
+	}
+	fprintf(out, "  ],\n");
+	fprintf(out, "  \"pass\": %s\n", pass ? "true" : "false");
+	fprintf(out, "}\n");
+	if (out != stdout)
+		fclose(out);
+
+	if (banding)
+		return ERRCODE_BANDINGDETECTED;
+	return formatName ? ERRCODE_FORMATONLY : 0;
+}